@@ -9,9 +9,15 @@
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
 
 #include "fs_util_format.h"
 #include "fs_util_volume.h"
+#include "fs_util_bmap.h"
+#include "fs_util_bitmap.h"
+#include "fs_util_freetree.h"
+#include "fs_util_alloc.h"
+#include "fs_util_journal.h"
 #include "fs_util_verify.h"
 #include "fs_op_mkfile.h"
 #include "fs_op_unlinkfile.h"
@@ -21,7 +27,14 @@
 #include "fs_op_truncfile.h"
 #include "fs_op_statfile.h"
 #include "fs_op_statfs.h"
+#include "fs_op_lookup.h"
+#include "fs_op_syncfile.h"
+#include "fs_op_txn.h"
 #include "fs_dev_memorydev.h"
+#include "fs_dev_cachedev.h"
+#include "fs_dev_imagedev.h"
+#include "fs_dev_mmapdev.h"
+#include "fs_dev_uringdev.h"
 
 /** Optional functions **/
 #include "fs_op_chmodfile.h"
@@ -31,6 +44,86 @@
 #include "CUnit/CUnit.h"
 #include "CUnit/Basic.h"
 
+/**
+ * Count completed asynchronous requests.
+ *
+ * @param req the completed request
+ */
+static void count_callback(struct blkdev_req *req) {
+    (*(int*)req->data)++;
+}
+
+/** 1 to make writes to a faulty device fail */
+static int faulty_fail_writes;
+
+/** 1 to make reads from a faulty device fail */
+static int faulty_fail_reads;
+
+/** number of write calls to a faulty device */
+static int faulty_n_writes;
+
+/** number of flush calls to part of a faulty device */
+static int faulty_n_partial_flushes;
+
+/** number of blocks in a faulty device */
+static int faulty_num_blocks(struct fs_dev_blkdev *dev) {
+    struct fs_dev_blkdev *under = dev->private;
+    return under->ops->num_blocks(under);
+}
+
+/** read blocks of a faulty device, failing if faulty_fail_reads */
+static int faulty_read(struct fs_dev_blkdev *dev, int first, int n, void *buf) {
+    struct fs_dev_blkdev *under = dev->private;
+    return faulty_fail_reads ? E_UNAVAIL : under->ops->read(under, first, n, buf);
+}
+
+/** write blocks of a faulty device, failing if faulty_fail_writes */
+static int faulty_write(struct fs_dev_blkdev *dev, int first, int n, void *buf) {
+    struct fs_dev_blkdev *under = dev->private;
+    faulty_n_writes++;
+    return faulty_fail_writes ? E_UNAVAIL : under->ops->write(under, first, n, buf);
+}
+
+/** flush blocks of a faulty device */
+static int faulty_flush(struct fs_dev_blkdev *dev, int first, int n) {
+    struct fs_dev_blkdev *under = dev->private;
+    if ((first > 0) || (first + n < under->ops->num_blocks(under))) {
+        faulty_n_partial_flushes++;
+    }
+    return under->ops->flush(under, first, n);
+}
+
+/** close a faulty device and its underlying device */
+static void faulty_close(struct fs_dev_blkdev *dev) {
+    struct fs_dev_blkdev *under = dev->private;
+    under->ops->close(under);
+    free(dev);
+}
+
+/** operations of a faulty device */
+static struct blkdev_ops faulty_ops = {
+    .num_blocks = faulty_num_blocks, .read = faulty_read, .write = faulty_write,
+    .flush = faulty_flush, .close = faulty_close
+};
+
+/**
+ * Create a device whose reads or writes can be made
+ * to fail, layered over another device.
+ *
+ * @param under the underlying device
+ * @return the faulty device
+ */
+static struct fs_dev_blkdev *faulty_blkdev_create(struct fs_dev_blkdev *under) {
+    struct fs_dev_blkdev *dev = malloc(sizeof(struct fs_dev_blkdev));
+    dev->ops = &faulty_ops;
+    dev->private = under;
+    faulty_fail_writes = 0;
+    faulty_fail_reads = 0;
+    faulty_n_writes = 0;
+    faulty_n_partial_flushes = 0;
+    return dev;
+}
+
 /**
  * Test memory device operations
  */
@@ -87,10 +180,406 @@ void test_mem_device(void) {
     status = dev->ops->read(dev, 3, 2, &readblk[0]);
     CU_ASSERT_NOT_EQUAL(status, SUCCESS);
 
+    // scatter-gather write and read of discontiguous blocks
+    struct blkdev_iovec iov[2] = {{.blkno = 3, .buf = writeblk[0]}, {.blkno = 0, .buf = writeblk[1]}};
+    CU_ASSERT_EQUAL(blkdev_writev(dev, iov, 2), SUCCESS);
+    iov[0].buf = readblk[1];
+    iov[1].buf = readblk[0];
+    CU_ASSERT_EQUAL(blkdev_readv(dev, iov, 2), SUCCESS);
+    CU_ASSERT_STRING_EQUAL((char*)readblk[1], "block 0");
+    CU_ASSERT_STRING_EQUAL((char*)readblk[0], "block 1");
+    iov[0].blkno = n_blks;
+    CU_ASSERT_NOT_EQUAL(blkdev_readv(dev, iov, 2), SUCCESS);
+    CU_ASSERT_EQUAL(dev->ops->write(dev, 2, 2, &writeblk[0]), SUCCESS);
+
+    // asynchronous read completes through synchronous fallback
+    int n_callbacks = 0;
+    memset(readblk, 0, sizeof(readblk));
+    struct blkdev_req req = {
+        .op = BLKDEV_READ, .first_blk = 2, .num_blks = 2, .buf = readblk,
+        .callback = count_callback, .data = &n_callbacks
+    };
+    CU_ASSERT_EQUAL(blkdev_submit(dev, &req), SUCCESS);
+    CU_ASSERT_EQUAL(blkdev_wait(dev, &req), SUCCESS);
+    CU_ASSERT_EQUAL(n_callbacks, 1);
+    CU_ASSERT_EQUAL(memcmp(&writeblk[0], &readblk[0], 2*FS_BLOCK_SIZE), 0);
+
     // close device
     dev->ops->close(dev);
 }
 
+/**
+ * Test buffer cache device operations
+ */
+void test_cache_device(void) {
+    const int n_blks = 100;
+    const int n_bufs = 8;
+
+    // create write-back cache over memory block device
+    struct fs_dev_blkdev *mdev = memory_blkdev_create(n_blks);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(mdev);
+    struct fs_dev_blkdev *dev =
+        cache_blkdev_create(mdev, n_bufs*FS_BLOCK_SIZE, CACHE_WRITE_BACK);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+    CU_ASSERT_EQUAL(dev->ops->num_blocks(dev), n_blks);
+
+    int status;
+    block writeblk[2];
+    block readblk[2];
+    strcpy((void*)&writeblk[0], "block 0");
+    strcpy((void*)&writeblk[1], "block 1");
+
+    // write 2 blocks, which are not written to memory device until flushed
+    memset(readblk, 0, sizeof(readblk));
+    mdev->ops->write(mdev, 2, 2, &readblk[0]);
+    status = dev->ops->write(dev, 2, 2, &writeblk[0]);
+    CU_ASSERT_EQUAL(status, SUCCESS);
+    mdev->ops->read(mdev, 2, 2, &readblk[0]);
+    CU_ASSERT_NOT_EQUAL(memcmp(&writeblk[0], &readblk[0], 2*FS_BLOCK_SIZE), 0);
+
+    // read back cached blocks
+    struct cache_blkdev_stats stats;
+    status = dev->ops->read(dev, 2, 2, &readblk[0]);
+    CU_ASSERT_EQUAL(status, SUCCESS);
+    CU_ASSERT_EQUAL(memcmp(&writeblk[0], &readblk[0], 2*FS_BLOCK_SIZE), 0);
+    cache_blkdev_stats(dev, &stats);
+    CU_ASSERT_EQUAL(stats.hits, 2);
+    CU_ASSERT_EQUAL(stats.misses, 0);
+    CU_ASSERT_EQUAL(stats.n_bufs, n_bufs);
+
+    // flush writes dirty blocks to memory device
+    status = dev->ops->flush(dev, 0, n_blks);
+    CU_ASSERT_EQUAL(status, SUCCESS);
+    mdev->ops->read(mdev, 2, 2, &readblk[0]);
+    CU_ASSERT_EQUAL(memcmp(&writeblk[0], &readblk[0], 2*FS_BLOCK_SIZE), 0);
+    cache_blkdev_stats(dev, &stats);
+    CU_ASSERT_EQUAL(stats.writebacks, 2);
+
+    // out of range access fails
+    status = dev->ops->write(dev, n_blks-1, 2, &writeblk[0]);
+    CU_ASSERT_NOT_EQUAL(status, SUCCESS);
+    status = dev->ops->read(dev, n_blks-1, 2, &readblk[0]);
+    CU_ASSERT_NOT_EQUAL(status, SUCCESS);
+
+    // format and mount volume through cache
+    int fmtstatus = fs_format_volume(dev, 0, 0);
+    CU_ASSERT_EQUAL_FATAL(fmtstatus, 0);
+    struct fs_ext2 *fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+
+    // write a file larger than the cache and read it back
+    char msg[4*n_bufs*FS_BLOCK_SIZE];
+    char readbuf[sizeof(msg)];
+    for (int i = 0; i < (int)sizeof(msg); i++) {
+        msg[i] = 'a' + i % 26;
+    }
+    int file_ino = fs_mkfile(fs, fs->root_inode, "file", 0644);
+    CU_ASSERT_TRUE_FATAL(file_ino > 0);
+    CU_ASSERT_EQUAL(fs_writefile(fs, file_ino, msg, sizeof(msg)), 0);
+    CU_ASSERT_EQUAL(fs_readfile(fs, file_ino, readbuf, sizeof(readbuf)), sizeof(readbuf));
+    CU_ASSERT_EQUAL(memcmp(msg, readbuf, sizeof(msg)), 0);
+
+    // dirty blocks were written when evicted
+    cache_blkdev_stats(dev, &stats);
+    CU_ASSERT_TRUE(stats.writebacks > 2);
+
+    // remount through cache and verify contents
+    fs_unmount_volume(fs);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    file_ino = fs_lookup(fs, fs->root_inode, "file");
+    CU_ASSERT_TRUE_FATAL(file_ino > 0);
+    memset(readbuf, 0, sizeof(readbuf));
+    CU_ASSERT_EQUAL(fs_readfile(fs, file_ino, readbuf, sizeof(readbuf)), sizeof(readbuf));
+    CU_ASSERT_EQUAL(memcmp(msg, readbuf, sizeof(msg)), 0);
+    fs_unmount_volume(fs);
+
+    // close cache device, which writes dirty blocks and closes memory device
+    dev->ops->close(dev);
+
+    // blocks stay dirty if their writeback fails
+    struct fs_dev_blkdev *fdev = faulty_blkdev_create(memory_blkdev_create(n_blks));
+    dev = cache_blkdev_create(fdev, n_bufs*FS_BLOCK_SIZE, CACHE_WRITE_BACK);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+    CU_ASSERT_EQUAL(dev->ops->write(dev, 40, 2, &writeblk[0]), SUCCESS);
+    CU_ASSERT_EQUAL(dev->ops->write(dev, 7, 1, &writeblk[0]), SUCCESS);
+    faulty_fail_writes = 1;
+    CU_ASSERT_NOT_EQUAL(dev->ops->flush(dev, 0, n_blks), SUCCESS);
+    faulty_fail_writes = 0;
+    CU_ASSERT_EQUAL(dev->ops->flush(dev, 0, n_blks), SUCCESS);
+    cache_blkdev_stats(dev, &stats);
+    CU_ASSERT_EQUAL(stats.writebacks, 3);
+    fdev->ops->read(fdev, 40, 2, &readblk[0]);
+    CU_ASSERT_EQUAL(memcmp(&writeblk[0], &readblk[0], 2*FS_BLOCK_SIZE), 0);
+    fdev->ops->read(fdev, 7, 1, &readblk[0]);
+    CU_ASSERT_EQUAL(memcmp(&writeblk[0], &readblk[0], FS_BLOCK_SIZE), 0);
+    dev->ops->close(dev);
+}
+
+/**
+ * Test image device operations
+ */
+void test_image_device(void) {
+    const int n_blks = 100;
+
+    // create image block device over temporary file
+    char path[] = "/tmp/fs_imageXXXXXX";
+    int fd = mkstemp(path);
+    CU_ASSERT_TRUE_FATAL(fd >= 0);
+    close(fd);
+    struct fs_dev_blkdev *dev = image_blkdev_create(path, n_blks);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+    CU_ASSERT_EQUAL(dev->ops->num_blocks(dev), n_blks);
+
+    int status;
+    block writeblk[2];
+    block readblk[2];
+    strcpy((void*)&writeblk[0], "block 0");
+    strcpy((void*)&writeblk[1], "block 1");
+
+    // unwritten blocks read as zeros
+    memset(readblk, 'x', sizeof(readblk));
+    status = dev->ops->read(dev, n_blks-2, 2, &readblk[0]);
+    CU_ASSERT_EQUAL(status, SUCCESS);
+    CU_ASSERT_EQUAL(readblk[1][FS_BLOCK_SIZE-1], 0);
+
+    // write and read 2 blocks
+    status = dev->ops->write(dev, 2, 2, &writeblk[0]);
+    CU_ASSERT_EQUAL(status, SUCCESS);
+    status = dev->ops->read(dev, 2, 2, &readblk[0]);
+    CU_ASSERT_EQUAL(status, SUCCESS);
+    CU_ASSERT_EQUAL(memcmp(&writeblk[0], &readblk[0], 2*FS_BLOCK_SIZE), 0);
+    CU_ASSERT_EQUAL(dev->ops->flush(dev, 2, 2), SUCCESS);
+
+    // scatter-gather read of adjacent blocks into discontiguous buffers
+    struct blkdev_iovec iov[3] = {
+        {.blkno = 3, .buf = readblk[0]}, {.blkno = 4, .buf = writeblk[0]}, {.blkno = 2, .buf = readblk[1]}
+    };
+    CU_ASSERT_EQUAL(blkdev_writev(dev, iov+1, 1), SUCCESS);
+    CU_ASSERT_EQUAL(blkdev_readv(dev, iov, 3), SUCCESS);
+    CU_ASSERT_STRING_EQUAL((char*)readblk[0], "block 1");
+    CU_ASSERT_STRING_EQUAL((char*)writeblk[0], "block 0");
+    CU_ASSERT_STRING_EQUAL((char*)readblk[1], "block 0");
+
+    // out of range access fails
+    status = dev->ops->write(dev, n_blks-1, 2, &writeblk[0]);
+    CU_ASSERT_NOT_EQUAL(status, SUCCESS);
+    status = dev->ops->read(dev, n_blks-1, 2, &readblk[0]);
+    CU_ASSERT_NOT_EQUAL(status, SUCCESS);
+
+    // format volume and write a file
+    int fmtstatus = fs_format_volume(dev, 0, 0);
+    CU_ASSERT_EQUAL_FATAL(fmtstatus, 0);
+    struct fs_ext2 *fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    char msg[3*FS_BLOCK_SIZE];
+    for (int i = 0; i < (int)sizeof(msg); i++) {
+        msg[i] = 'a' + i % 26;
+    }
+    int file_ino = fs_mkfile(fs, fs->root_inode, "file", 0644);
+    CU_ASSERT_TRUE_FATAL(file_ino > 0);
+    CU_ASSERT_EQUAL(fs_writefile(fs, file_ino, msg, sizeof(msg)), 0);
+    fs_unmount_volume(fs);
+    dev->ops->close(dev);
+
+    // reopen image sized from file and verify file persisted
+    dev = image_blkdev_create(path, 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+    CU_ASSERT_EQUAL(dev->ops->num_blocks(dev), n_blks);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    file_ino = fs_lookup(fs, fs->root_inode, "file");
+    CU_ASSERT_TRUE_FATAL(file_ino > 0);
+    char readbuf[sizeof(msg)];
+    CU_ASSERT_EQUAL(fs_readfile(fs, file_ino, readbuf, sizeof(readbuf)), sizeof(readbuf));
+    CU_ASSERT_EQUAL(memcmp(msg, readbuf, sizeof(msg)), 0);
+    fs_unmount_volume(fs);
+    dev->ops->close(dev);
+
+    unlink(path);
+}
+
+/**
+ * Test memory-mapped image device operations
+ */
+void test_mmap_device(void) {
+    const int n_blks = 100;
+
+    // create memory-mapped block device over temporary file
+    char path[] = "/tmp/fs_mmapXXXXXX";
+    int fd = mkstemp(path);
+    CU_ASSERT_TRUE_FATAL(fd >= 0);
+    close(fd);
+    struct fs_dev_blkdev *dev = mmap_blkdev_create(path, n_blks);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+    CU_ASSERT_EQUAL(dev->ops->num_blocks(dev), n_blks);
+
+    int status;
+    block writeblk[2];
+    block readblk[2];
+    strcpy((void*)&writeblk[0], "block 0");
+    strcpy((void*)&writeblk[1], "block 1");
+
+    // write and read 2 blocks
+    status = dev->ops->write(dev, 2, 2, &writeblk[0]);
+    CU_ASSERT_EQUAL(status, SUCCESS);
+    status = dev->ops->read(dev, 2, 2, &readblk[0]);
+    CU_ASSERT_EQUAL(status, SUCCESS);
+    CU_ASSERT_EQUAL(memcmp(&writeblk[0], &readblk[0], 2*FS_BLOCK_SIZE), 0);
+
+    // borrowed block is the written block
+    void *blk = mmap_blkdev_borrow(dev, 3, 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(blk);
+    CU_ASSERT_EQUAL(memcmp(blk, &writeblk[1], FS_BLOCK_SIZE), 0);
+    CU_ASSERT_PTR_NULL(mmap_blkdev_borrow(dev, n_blks, 0));
+
+    // other devices cannot lend blocks
+    struct fs_dev_blkdev *mem_dev = memory_blkdev_create(n_blks);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(mem_dev);
+    CU_ASSERT_PTR_NULL(mmap_blkdev_borrow(mem_dev, 3, 0));
+    mem_dev->ops->close(mem_dev);
+
+    // write through borrowed block and read it back
+    blk = mmap_blkdev_borrow(dev, 5, 1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(blk);
+    strcpy(blk, "block 5");
+    status = dev->ops->read(dev, 5, 1, &readblk[0]);
+    CU_ASSERT_EQUAL(status, SUCCESS);
+    CU_ASSERT_STRING_EQUAL((char*)readblk[0], "block 5");
+    CU_ASSERT_EQUAL(dev->ops->flush(dev, 0, n_blks), SUCCESS);
+
+    // out of range access fails
+    status = dev->ops->write(dev, n_blks-1, 2, &writeblk[0]);
+    CU_ASSERT_NOT_EQUAL(status, SUCCESS);
+    status = dev->ops->read(dev, n_blks-1, 2, &readblk[0]);
+    CU_ASSERT_NOT_EQUAL(status, SUCCESS);
+    dev->ops->close(dev);
+
+    // reopen image sized from file and verify blocks persisted
+    dev = mmap_blkdev_create(path, 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+    CU_ASSERT_EQUAL(dev->ops->num_blocks(dev), n_blks);
+    status = dev->ops->read(dev, 2, 2, &readblk[0]);
+    CU_ASSERT_EQUAL(status, SUCCESS);
+    CU_ASSERT_EQUAL(memcmp(&writeblk[0], &readblk[0], 2*FS_BLOCK_SIZE), 0);
+    CU_ASSERT_STRING_EQUAL((char*)mmap_blkdev_borrow(dev, 5, 0), "block 5");
+
+    // format and mount volume
+    int fmtstatus = fs_format_volume(dev, 0, 0);
+    CU_ASSERT_EQUAL_FATAL(fmtstatus, 0);
+    struct fs_ext2 *fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    int file_ino = fs_mkfile(fs, fs->root_inode, "file", 0644);
+    CU_ASSERT_TRUE(file_ino > 0);
+    fs_unmount_volume(fs);
+    dev->ops->close(dev);
+
+    unlink(path);
+}
+
+/**
+ * Test asynchronous io_uring device operations
+ */
+void test_uring_device(void) {
+    const int n_blks = 100;
+    const int n_reqs = 12;
+
+    // create asynchronous block device over temporary file
+    char path[] = "/tmp/fs_uringXXXXXX";
+    int fd = mkstemp(path);
+    CU_ASSERT_TRUE_FATAL(fd >= 0);
+    close(fd);
+    struct fs_dev_blkdev *dev = uring_blkdev_create(path, n_blks, 4);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+    CU_ASSERT_EQUAL(dev->ops->num_blocks(dev), n_blks);
+
+    // submit more writes than the queue depth, reaping to make room
+    block writeblk[n_reqs];
+    block readblk[n_reqs];
+    struct blkdev_req reqs[n_reqs];
+    struct blkdev_req *submit[n_reqs];
+    struct blkdev_req *done[n_reqs];
+    for (int i = 0; i < n_reqs; i++) {
+        sprintf((char*)writeblk[i], "block %d", 2*i);
+        reqs[i] = (struct blkdev_req) {
+            .op = BLKDEV_WRITE, .first_blk = 2*i, .num_blks = 1, .buf = writeblk[i]
+        };
+        submit[i] = &reqs[i];
+    }
+    int n_submitted = 0, n_done = 0;
+    while (n_done < n_reqs) {
+        int n = uring_blkdev_submit(dev, submit+n_submitted, n_reqs-n_submitted);
+        CU_ASSERT_TRUE_FATAL(n >= 0);
+        n_submitted += n;
+        n = uring_blkdev_reap(dev, done, n_reqs, 1);
+        for (int i = 0; i < n; i++) {
+            CU_ASSERT_EQUAL(done[i]->status, SUCCESS);
+        }
+        n_done += n;
+    }
+    CU_ASSERT_EQUAL(n_submitted, n_reqs);
+    CU_ASSERT_EQUAL(uring_blkdev_reap(dev, done, n_reqs, 1), 0);
+
+    // read blocks back asynchronously
+    for (int i = 0; i < n_reqs; i++) {
+        reqs[i].op = BLKDEV_READ;
+        reqs[i].buf = readblk[i];
+    }
+    for (n_submitted = n_done = 0; n_done < n_reqs; ) {
+        n_submitted += uring_blkdev_submit(dev, submit+n_submitted, n_reqs-n_submitted);
+        n_done += uring_blkdev_reap(dev, done, n_reqs, 1);
+    }
+    CU_ASSERT_EQUAL(memcmp(writeblk, readblk, sizeof(writeblk)), 0);
+
+    // read blocks back synchronously
+    CU_ASSERT_EQUAL(dev->ops->read(dev, 2, 1, readblk[0]), SUCCESS);
+    CU_ASSERT_STRING_EQUAL((char*)readblk[0], "block 2");
+    CU_ASSERT_EQUAL(dev->ops->flush(dev, 0, n_blks), SUCCESS);
+
+    // out of range requests fail
+    reqs[0] = (struct blkdev_req) {
+        .op = BLKDEV_READ, .first_blk = n_blks-1, .num_blks = 2, .buf = readblk
+    };
+    CU_ASSERT_EQUAL(uring_blkdev_submit(dev, submit, 1), 1);
+    CU_ASSERT_EQUAL(uring_blkdev_reap(dev, done, 1, 1), 1);
+    CU_ASSERT_EQUAL(done[0]->status, E_SIZE);
+    CU_ASSERT_NOT_EQUAL(dev->ops->write(dev, n_blks-1, 2, writeblk), SUCCESS);
+
+    // callback requests complete by waiting
+    int n_callbacks = 0;
+    for (int i = 0; i < n_reqs; i++) {
+        reqs[i] = (struct blkdev_req) {
+            .op = BLKDEV_READ, .first_blk = 2*i, .num_blks = 1, .buf = readblk[i],
+            .callback = count_callback, .data = &n_callbacks
+        };
+        CU_ASSERT_EQUAL(blkdev_submit(dev, &reqs[i]), SUCCESS);
+    }
+    CU_ASSERT_EQUAL(blkdev_wait(dev, &reqs[n_reqs-1]), SUCCESS);
+    CU_ASSERT_EQUAL(blkdev_wait(dev, NULL), SUCCESS);
+    CU_ASSERT_EQUAL(n_callbacks, n_reqs);
+    CU_ASSERT_EQUAL(memcmp(writeblk, readblk, sizeof(writeblk)), 0);
+
+    // format and mount volume
+    int fmtstatus = fs_format_volume(dev, 0, 0);
+    CU_ASSERT_EQUAL_FATAL(fmtstatus, 0);
+    struct fs_ext2 *fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_TRUE(fs_mkdir(fs, fs->root_inode, "dir", 0755) > 0);
+    CU_ASSERT_TRUE(fs_lookup(fs, fs_lookup(fs, fs->root_inode, "dir"), "..") == fs->root_inode);
+    char msg[3*FS_BLOCK_SIZE];
+    memset(msg, 'a', sizeof(msg));
+    int file_ino = fs_mkfile(fs, fs->root_inode, "file", 0644);
+    CU_ASSERT_TRUE_FATAL(file_ino > 0);
+    CU_ASSERT_EQUAL(fs_writefile(fs, file_ino, msg, sizeof(msg)), 0);
+    char readbuf[sizeof(msg)];
+    CU_ASSERT_EQUAL(fs_readfile(fs, file_ino, readbuf, sizeof(readbuf)), sizeof(readbuf));
+    CU_ASSERT_EQUAL(memcmp(msg, readbuf, sizeof(msg)), 0);
+    fs_unmount_volume(fs);
+    dev->ops->close(dev);
+
+    unlink(path);
+}
+
 /**
  * Test file system volume operations.
  */
@@ -121,9 +610,25 @@ void test_volume(void) {
     CU_ASSERT_PTR_NOT_NULL(fs->block_map);
     CU_ASSERT_PTR_NOT_NULL(fs->inodes);
 
+    // ensure block size recorded in superblock
+    CU_ASSERT_EQUAL(fs->super->blk_size, FS_BLOCK_SIZE);
+
     // unmount file system volume
     fs_unmount_volume(fs);
 
+    // ensure unsupported block sizes are rejected
+    struct fs_format_opts opts = {.blk_size = 512};
+    CU_ASSERT_EQUAL(fs_format_volume_opts(dev, &opts), -EINVAL);
+    opts.blk_size = 3000;
+    CU_ASSERT_EQUAL(fs_format_volume_opts(dev, &opts), -EINVAL);
+    opts.blk_size = 2*FS_MAX_BLOCK_SIZE;
+    CU_ASSERT_EQUAL(fs_format_volume_opts(dev, &opts), -EINVAL);
+    struct fs_super sb;
+    CU_ASSERT_EQUAL_FATAL(dev->ops->read(dev, 0, 1, &sb), SUCCESS);
+    sb.blk_size = 3000;
+    CU_ASSERT_EQUAL_FATAL(dev->ops->write(dev, 0, 1, &sb), SUCCESS);
+    CU_ASSERT_PTR_NULL(fs_mount_volume(dev));
+
     // close device
     dev->ops->close(dev);
 }
@@ -153,20 +658,20 @@ void test_file_cpcd(void) {
     CU_ASSERT_TRUE(file1_ino > 0);
 
     // verify "file1" is empty
-    CU_ASSERT_EQUAL(fs->inodes[file1_ino].size, 0);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->size, 0);
 
     // verify "file1" has link count 1
-    CU_ASSERT_EQUAL(fs->inodes[file1_ino].nlink, 1);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->nlink, 1);
 
     // create "File1"
     int File1_ino = fs_mkfile(fs, fs->root_inode, "File1", file_mode);
     CU_ASSERT_TRUE(File1_ino > 0);
 
     // verify "File1" is empty
-    CU_ASSERT_EQUAL(fs->inodes[File1_ino].size, 0);
+    CU_ASSERT_EQUAL(fs_inode(fs, File1_ino)->size, 0);
 
     // verify "File1" has link count 1
-    CU_ASSERT_EQUAL(fs->inodes[File1_ino].nlink, 1);
+    CU_ASSERT_EQUAL(fs_inode(fs, File1_ino)->nlink, 1);
 
     // verify cannot create duplicate "File1"
     int File1_dup_ino = fs_mkfile(fs, fs->root_inode, "File1", file_mode);
@@ -177,7 +682,7 @@ void test_file_cpcd(void) {
     CU_ASSERT_EQUAL(file1_status, 0);
 
     // ensure file1_ino not allocated
-    int file1_ino_set = FD_ISSET(file1_ino, fs->inode_map);
+    int file1_ino_set = fs_bitmap_test(fs->inode_map, file1_ino);
     CU_ASSERT_EQUAL(file1_ino_set, 0);
 
     // verify cannot remove "file1" again
@@ -189,7 +694,7 @@ void test_file_cpcd(void) {
     CU_ASSERT_EQUAL(File1_status, 0);
 
     // ensure File1_ino not allocated
-    int File1_ino_set = FD_ISSET(File1_ino, fs->inode_map);
+    int File1_ino_set = fs_bitmap_test(fs->inode_map, File1_ino);
     CU_ASSERT_EQUAL(File1_ino_set, 0);
 
     // unmount file system volume and close device
@@ -272,11 +777,11 @@ void test_dir(void) {
 
     // expect 2 entries for "." and ".."
     // (size of directory is size of used fs_dirents)
-    int root_size = fs->inodes[fs->root_inode].size;
+    int root_size = fs_inode(fs, fs->root_inode)->size;
     CU_ASSERT_EQUAL(root_size, 2*sizeof(struct fs_dirent));
 
     // verify root inode has link count 2 for "." and ".."
-    int root_nlink = fs->inodes[fs->root_inode].nlink;
+    int root_nlink = fs_inode(fs, fs->root_inode)->nlink;
     CU_ASSERT_EQUAL(root_nlink, 2);
 
     // ensure cannot remove "." from root dir
@@ -288,7 +793,7 @@ void test_dir(void) {
     /// and deleting a regular file
 
     // get root dir mod time for comparison
-    int root_time = fs->inodes[fs->root_inode].mtime;
+    int root_time = fs_inode(fs, fs->root_inode)->mtime;
     sleep(1); // time passes
 
     // create "file1"
@@ -296,19 +801,19 @@ void test_dir(void) {
     CU_ASSERT_TRUE(file1_ino > 0);
 
     // verify root dir mode time changed
-    CU_ASSERT_NOT_EQUAL(fs->inodes[fs->root_inode].mtime, root_time);
+    CU_ASSERT_NOT_EQUAL(fs_inode(fs, fs->root_inode)->mtime, root_time);
 
     // expect 3 entries for ".", "..", and "file1"
     // (size of directory is size of used fs_dirents)
-    root_size = fs->inodes[fs->root_inode].size;
+    root_size = fs_inode(fs, fs->root_inode)->size;
     CU_ASSERT_EQUAL(root_size, 3*sizeof(struct fs_dirent));
 
     // verify root inode still has link count 2 for "." and ".."
-    root_nlink = fs->inodes[fs->root_inode].nlink;
+    root_nlink = fs_inode(fs, fs->root_inode)->nlink;
     CU_ASSERT_EQUAL(root_nlink, 2);
 
     // get root dir mod time for comparison
-    root_time = fs->inodes[fs->root_inode].mtime;
+    root_time = fs_inode(fs, fs->root_inode)->mtime;
     sleep(1); // time passes
 
     // remove "file1"
@@ -316,18 +821,18 @@ void test_dir(void) {
     CU_ASSERT_EQUAL(file1_status, 0);
 
     // verify root dir mode time changed
-    CU_ASSERT_NOT_EQUAL(fs->inodes[fs->root_inode].mtime, root_time);
+    CU_ASSERT_NOT_EQUAL(fs_inode(fs, fs->root_inode)->mtime, root_time);
 
     // ensure file1_ino not allocated
-    int file1_ino_set = FD_ISSET(file1_ino, fs->inode_map);
+    int file1_ino_set = fs_bitmap_test(fs->inode_map, file1_ino);
     CU_ASSERT_EQUAL(file1_ino_set, 0);
 
     // expect 2 entries for "." and ".."
-    root_size = fs->inodes[fs->root_inode].size;
+    root_size = fs_inode(fs, fs->root_inode)->size;
     CU_ASSERT_EQUAL(root_size, 2*sizeof(struct fs_dirent));
 
     // verify root inode still has link count 2 for "." and ".."
-    root_nlink = fs->inodes[fs->root_inode].nlink;
+    root_nlink = fs_inode(fs, fs->root_inode)->nlink;
     CU_ASSERT_EQUAL(root_nlink, 2);
 
     /// Verify state of root directory and new
@@ -338,19 +843,19 @@ void test_dir(void) {
     CU_ASSERT_TRUE(dir1_ino > 0);
 
     // expect 2 entries for "." and ".."
-    int dir1_size = fs->inodes[dir1_ino].size;
+    int dir1_size = fs_inode(fs, dir1_ino)->size;
     CU_ASSERT_EQUAL(dir1_size, 2*sizeof(struct fs_dirent));
 
     // verify dir1_ino has link count 2
-    int dir1_nlink = fs->inodes[dir1_ino].nlink;
+    int dir1_nlink = fs_inode(fs, dir1_ino)->nlink;
     CU_ASSERT_EQUAL(dir1_nlink, 2);
 
     // expect 3 root entries for ".", "..", and "dir1"
-    root_size = fs->inodes[fs->root_inode].size;
+    root_size = fs_inode(fs, fs->root_inode)->size;
     CU_ASSERT_EQUAL(root_size, 3*sizeof(struct fs_dirent));
 
     // verify root_ino has link count 3 (".", "..", and "dir1/.."
-    CU_ASSERT_EQUAL(fs->inodes[fs->root_inode].nlink, 3);
+    CU_ASSERT_EQUAL(fs_inode(fs, fs->root_inode)->nlink, 3);
 
     // ensure cannot create duplicate "dir1"
     int dir1_dup_ino = fs_mkdir(fs, fs->root_inode, "dir1", dir_mode);
@@ -365,11 +870,11 @@ void test_dir(void) {
     CU_ASSERT_TRUE(dir2_ino > 0);
 
     // expect 4 root entries for ".","..", "dir1", and "dir2"
-    root_size = fs->inodes[fs->root_inode].size;
+    root_size = fs_inode(fs, fs->root_inode)->size;
     CU_ASSERT_EQUAL(root_size, 4*sizeof(struct fs_dirent));
 
     // verify root_ino has link count 4 (".", "..", "dir1/..", and "dir2/.."
-    CU_ASSERT_EQUAL(fs->inodes[fs->root_inode].nlink, 4);
+    CU_ASSERT_EQUAL(fs_inode(fs, fs->root_inode)->nlink, 4);
 
 
     /// Verify state of subdirectory "dir2" when creating
@@ -384,7 +889,7 @@ void test_dir(void) {
     CU_ASSERT_NOT_EQUAL(dir2_status, 0);
 
     // ensure dir2_ino still allocated
-    int dir2_ino_set = FD_ISSET(dir2_ino, fs->inode_map);
+    int dir2_ino_set = fs_bitmap_test(fs->inode_map, dir2_ino);
     CU_ASSERT_NOT_EQUAL(dir2_ino_set, 0);
 
     // remove "file1" from dir2
@@ -392,7 +897,7 @@ void test_dir(void) {
     CU_ASSERT_EQUAL(file1_status, 0);
 
     // ensure dir2_file1_ino not allocated
-    int dir2_file1_ino_set = FD_ISSET(dir2_file1_ino, fs->inode_map);
+    int dir2_file1_ino_set = fs_bitmap_test(fs->inode_map, dir2_file1_ino);
     CU_ASSERT_EQUAL(dir2_file1_ino_set, 0);
 
     // ensure can remove empty dir2
@@ -400,7 +905,7 @@ void test_dir(void) {
     CU_ASSERT_EQUAL(dir2_status, 0);
 
     // ensure dir2_file1_ino not allocated
-    dir2_ino_set = FD_ISSET(dir2_ino, fs->inode_map);
+    dir2_ino_set = fs_bitmap_test(fs->inode_map, dir2_ino);
     CU_ASSERT_EQUAL(dir2_ino_set, 0);
 
     /// Verify state of root directory when removing
@@ -411,15 +916,15 @@ void test_dir(void) {
     CU_ASSERT_EQUAL(dir1_status, 0);
 
     // ensure dir1_ino not allocated
-    int dir1_ino_set = FD_ISSET(dir1_ino, fs->inode_map);
+    int dir1_ino_set = fs_bitmap_test(fs->inode_map, dir1_ino);
     CU_ASSERT_EQUAL(dir1_ino_set, 0);
 
     // expect 2 entries for "." and ".."
-    root_size = fs->inodes[fs->root_inode].size;
+    root_size = fs_inode(fs, fs->root_inode)->size;
     CU_ASSERT_EQUAL(root_size, 2*sizeof(struct fs_dirent));
 
     // verify root inode has link count 2 for "." and ".."
-    root_nlink = fs->inodes[fs->root_inode].nlink;
+    root_nlink = fs_inode(fs, fs->root_inode)->nlink;
     CU_ASSERT_EQUAL(root_nlink, 2);
 
 
@@ -466,7 +971,7 @@ void test_link(void) {
     CU_ASSERT_EQUAL(file2_ino, file1_ino);
 
     // verify file1_ino link count 2
-    int file1_nlink = fs->inodes[file1_ino].nlink;
+    int file1_nlink = fs_inode(fs, file1_ino)->nlink;
     CU_ASSERT_EQUAL(file1_nlink, 2);
 
 
@@ -491,7 +996,7 @@ void test_link(void) {
     CU_ASSERT_EQUAL(file1_ino, dir1_file1_ino);
 
     // verify dir1_file1_ino link count 3
-    int dir1_file1_nlink = fs->inodes[dir1_file1_ino].nlink;
+    int dir1_file1_nlink = fs_inode(fs, dir1_file1_ino)->nlink;
     CU_ASSERT_EQUAL(dir1_file1_nlink, 3);
 
     // unlink "file1" from dir1_ino
@@ -499,11 +1004,11 @@ void test_link(void) {
     CU_ASSERT_EQUAL(dir1_file1_status, 0);
 
     // ensure file1_ino is still allocated
-    int file1_ino_set = FD_ISSET(file1_ino, fs->inode_map);
+    int file1_ino_set = fs_bitmap_test(fs->inode_map, file1_ino);
     CU_ASSERT_NOT_EQUAL(file1_ino_set, 0);
 
     // verify dir1_file1_ino link count 2
-    file1_nlink = fs->inodes[file1_ino].nlink;
+    file1_nlink = fs_inode(fs, file1_ino)->nlink;
     CU_ASSERT_EQUAL(file1_nlink, 2);
 
     // ensure cannot unlink file1_ino from dir1_ino
@@ -511,11 +1016,11 @@ void test_link(void) {
     CU_ASSERT_NOT_EQUAL(dir1_file1_status, 0);
 
     // ensure file1_ino is still allocated
-    file1_ino_set = FD_ISSET(file1_ino, fs->inode_map);
+    file1_ino_set = fs_bitmap_test(fs->inode_map, file1_ino);
     CU_ASSERT_NOT_EQUAL(file1_ino_set, 0);
 
     // ensure file2_ino link count 2
-    int file2_nlink = fs->inodes[file2_ino].nlink;
+    int file2_nlink = fs_inode(fs, file2_ino)->nlink;
     CU_ASSERT_EQUAL(file2_nlink, 2);
 
     // unlink file2_ino from root directory
@@ -527,7 +1032,7 @@ void test_link(void) {
     CU_ASSERT_EQUAL(file1_status, 0);
 
     // ensure file1_ino not allocated
-    file1_ino_set = FD_ISSET(file1_ino, fs->inode_map);
+    file1_ino_set = fs_bitmap_test(fs->inode_map, file1_ino);
     CU_ASSERT_EQUAL(file1_ino_set, 0);
 
     // unmount file system volume and close device
@@ -611,6 +1116,135 @@ void test_readdir(void) {
 
     // close directory stream
     fs_closedir(dirp);
+
+    // unmount file system volume and close device
+    fs_unmount_volume(fs);
+    dev->ops->close(dev);
+}
+
+/**
+ * Test directory operations on a directory that
+ * spans multiple directory blocks.
+ */
+void test_bigdir(void) {
+    const int n_files = 3*DIRENTS_PER_BLK(FS_BLOCK_SIZE);
+    const int n_blks = 1000 + 4*n_files;  // 1 inode per 4 blocks
+    const mode_t file_mode = 0644;  // rw-r--r--
+    char name[FS_FILENAME_SIZE];
+
+    // create memory block device
+    struct fs_dev_blkdev *dev = memory_blkdev_create(n_blks);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+
+    // format volume
+    int fmtstatus = fs_format_volume(dev, 0, 0);
+    CU_ASSERT_EQUAL_FATAL(fmtstatus, 0);
+
+    // mount formatted volume
+    struct fs_ext2 *fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+
+    // create more files than fit in one directory block
+    for (int i = 0; i < n_files; i++) {
+        sprintf(name, "file%d", i);
+        int ino = fs_mkfile(fs, fs->root_inode, name, file_mode);
+        CU_ASSERT_TRUE_FATAL(ino > 0);
+    }
+    CU_ASSERT_EQUAL(fs_inode(fs, fs->root_inode)->size, (n_files+2)*sizeof(struct fs_dirent));
+
+    // ensure full directory block was converted to hashed index
+    CU_ASSERT_NOT_EQUAL(fs_inode(fs, fs->root_inode)->flags & FS_INODE_INDEX, 0);
+
+    // ensure cannot create duplicate in a later block
+    sprintf(name, "file%d", n_files-1);
+    int status = fs_mkfile(fs, fs->root_inode, name, file_mode);
+    CU_ASSERT_EQUAL(status, -EEXIST);
+
+    // remove a file from the first and last blocks
+    status = fs_unlinkfile(fs, fs->root_inode, "file0");
+    CU_ASSERT_EQUAL(status, 0);
+    sprintf(name, "file%d", n_files-1);
+    status = fs_unlinkfile(fs, fs->root_inode, name);
+    CU_ASSERT_EQUAL(status, 0);
+    status = fs_unlinkfile(fs, fs->root_inode, name);
+    CU_ASSERT_EQUAL(status, -ENOENT);
+
+    // read directory stream across all blocks
+    FS_DIR *dirp = fs_opendir(fs, fs->root_inode);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dirp);
+    struct fs_dirent *de = fs_readdir(dirp);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(de);
+    CU_ASSERT_STRING_EQUAL(de->name, ".");
+    de = fs_readdir(dirp);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(de);
+    CU_ASSERT_STRING_EQUAL(de->name, "..");
+    int n_entries = 2;
+    while (fs_readdir(dirp) != NULL) {
+        n_entries++;
+    }
+    fs_closedir(dirp);
+    CU_ASSERT_EQUAL(n_entries, n_files);  // ".", ".." and n_files-2 files
+
+    // unmount file system volume and close device
+    fs_unmount_volume(fs);
+    dev->ops->close(dev);
+}
+
+/**
+ * Test file system lookup and path resolution operations.
+ */
+void test_lookup(void) {
+    const int n_blks = 100;
+    const mode_t file_mode = 0644;  // rw-r--r--
+    const mode_t dir_mode = 0755;   // rwxr-xr-xx
+
+    // create memory block device
+    struct fs_dev_blkdev *dev = memory_blkdev_create(n_blks);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+
+    // format volume
+    int fmtstatus = fs_format_volume(dev, 0, 0);
+    CU_ASSERT_EQUAL_FATAL(fmtstatus, 0);
+
+    // mount formatted volume
+    struct fs_ext2 *fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+
+    // create "/dir1/dir2/file1"
+    int dir1_ino = fs_mkdir(fs, fs->root_inode, "dir1", dir_mode);
+    CU_ASSERT_TRUE_FATAL(dir1_ino > 0);
+    int dir2_ino = fs_mkdir(fs, dir1_ino, "dir2", dir_mode);
+    CU_ASSERT_TRUE_FATAL(dir2_ino > 0);
+
+    // ensure missing file not found, twice to use cached miss
+    CU_ASSERT_EQUAL(fs_namei(fs, "/dir1/dir2/file1"), -ENOENT);
+    CU_ASSERT_EQUAL(fs_lookup(fs, dir2_ino, "file1"), -ENOENT);
+
+    // ensure created file replaces cached miss
+    int file1_ino = fs_mkfile(fs, dir2_ino, "file1", file_mode);
+    CU_ASSERT_TRUE_FATAL(file1_ino > 0);
+    CU_ASSERT_EQUAL(fs_lookup(fs, dir2_ino, "file1"), file1_ino);
+    CU_ASSERT_EQUAL(fs_namei(fs, "/dir1/dir2/file1"), file1_ino);
+    CU_ASSERT_EQUAL(fs_namei(fs, "dir1//dir2/./file1"), file1_ino);
+    CU_ASSERT_EQUAL(fs_namei(fs, "/dir1/dir2/.."), dir1_ino);
+    CU_ASSERT_EQUAL(fs_namei(fs, "/"), fs->root_inode);
+
+    // ensure path through a file is not a directory
+    CU_ASSERT_EQUAL(fs_namei(fs, "/dir1/dir2/file1/x"), -ENOTDIR);
+
+    // ensure removed file no longer found
+    int status = fs_unlinkfile(fs, dir2_ino, "file1");
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_EQUAL(fs_namei(fs, "/dir1/dir2/file1"), -ENOENT);
+
+    // ensure removed directory no longer found
+    status = fs_rmdir(fs, dir1_ino, "dir2");
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_EQUAL(fs_namei(fs, "/dir1/dir2"), -ENOENT);
+
+    // unmount file system volume and close device
+    fs_unmount_volume(fs);
+    dev->ops->close(dev);
 }
 
 /**
@@ -637,10 +1271,10 @@ void test_io(void) {
     CU_ASSERT_TRUE(file1_ino > 0);
 
     // verify file1 is empty
-    CU_ASSERT_EQUAL(fs->inodes[file1_ino].size, 0);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->size, 0);
 
     // get file1 mod time for comparison
-    int file1_time = fs->inodes[file1_ino].mtime;
+    int file1_time = fs_inode(fs, file1_ino)->mtime;
     sleep(1); // time passes
 
     char msg[2*FS_BLOCK_SIZE];
@@ -652,9 +1286,9 @@ void test_io(void) {
     // ensure successful write
     CU_ASSERT_EQUAL(status, 0);
     // ensure inode size matches
-    CU_ASSERT_EQUAL(fs->inodes[file1_ino].size, msglen);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->size, msglen);
     // ensure mode time has changed
-    CU_ASSERT_NOT_EQUAL(fs->inodes[file1_ino].mtime, file1_time);
+    CU_ASSERT_NOT_EQUAL(fs_inode(fs, file1_ino)->mtime, file1_time);
 
     // short read from file1
     char readbuf[FS_BLOCK_SIZE] = "bbbbbbbbbb";
@@ -665,15 +1299,20 @@ void test_io(void) {
     // ensure read back original message
     CU_ASSERT_STRING_EQUAL(readbuf, "aaaaabbbbb");
 
-    // write content too large
-    // NOTE: current implementation supports
-    // only 1 block of storage.
+    // write content spanning 2 blocks
     int bigmsglen = 2*FS_BLOCK_SIZE;
     status = fs_writefile(fs, file1_ino, msg, bigmsglen);
+    // ensure successful write
+    CU_ASSERT_EQUAL(status, 0);
+    // ensure inode size matches
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->size, bigmsglen);
+
+    // write content too large
+    status = fs_pwritefile(fs, file1_ino, msg, 1, FS_MAX_FILE_SIZE(FS_BLOCK_SIZE));
     // ensure write failed -- too large
-    CU_ASSERT_NOT_EQUAL(status, 0);
+    CU_ASSERT_EQUAL(status, -EFBIG);
     // ensure inode size has not changed
-    CU_ASSERT_EQUAL(fs->inodes[file1_ino].size, msglen);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->size, bigmsglen);
 
     // unmount file system volume and close device
     fs_unmount_volume(fs);
@@ -710,10 +1349,10 @@ void test_trunc(void) {
     int status = fs_writefile(fs, file1_ino, msg, FS_BLOCK_SIZE);
     // ensure successful write
     CU_ASSERT_EQUAL(status, 0);
-    CU_ASSERT_EQUAL(fs->inodes[file1_ino].size, FS_BLOCK_SIZE);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->size, FS_BLOCK_SIZE);
 
     // get file1 mod time for comparison
-    int file1_time = fs->inodes[file1_ino].mtime;
+    int file1_time = fs_inode(fs, file1_ino)->mtime;
     sleep(1); // time passes
 
     // truncate to same length
@@ -721,12 +1360,12 @@ void test_trunc(void) {
     CU_ASSERT_EQUAL(trunc_status, 0);
 
     // ensure inode size matches
-    CU_ASSERT_EQUAL(fs->inodes[file1_ino].size, FS_BLOCK_SIZE);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->size, FS_BLOCK_SIZE);
     // ensure mode time has not changed
-    CU_ASSERT_EQUAL(fs->inodes[file1_ino].mtime, file1_time);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->mtime, file1_time);
 
     // get file1 mod time for comparison
-    file1_time = fs->inodes[file1_ino].mtime;
+    file1_time = fs_inode(fs, file1_ino)->mtime;
     sleep(1); // time passes
 
     // truncate to 1 byte
@@ -734,18 +1373,18 @@ void test_trunc(void) {
     CU_ASSERT_EQUAL(trunc_status, 0);
 
     // ensure inode size matches
-    CU_ASSERT_EQUAL(fs->inodes[file1_ino].size, 1);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->size, 1);
     // ensure mode time has changed
-    CU_ASSERT_NOT_EQUAL(fs->inodes[file1_ino].mtime, file1_time);
+    CU_ASSERT_NOT_EQUAL(fs_inode(fs, file1_ino)->mtime, file1_time);
 
     // truncate to 3 bytes
     trunc_status = fs_truncfile(fs, file1_ino, 3);
     CU_ASSERT_EQUAL(trunc_status, 0);
 
     // ensure inode size matches
-    CU_ASSERT_EQUAL(fs->inodes[file1_ino].size, 3);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->size, 3);
     // ensure mode time has changed
-    CU_ASSERT_NOT_EQUAL(fs->inodes[file1_ino].mtime, file1_time);
+    CU_ASSERT_NOT_EQUAL(fs_inode(fs, file1_ino)->mtime, file1_time);
 
     // read block
     int read_size = fs_readfile(fs, file1_ino, msg, FS_BLOCK_SIZE);
@@ -759,11 +1398,13 @@ void test_trunc(void) {
 }
 
 /**
- * Test file system stat operations.
+ * Test file system i/o operations on files that span
+ * direct, single-indirect, and double-indirect blocks.
  */
-void test_stat(void) {
-    const int n_blks = 100;
+void test_bigfile(void) {
     const mode_t file_mode = 0644;  // rw-r--r--
+    const int n_file_blks = N_DIRECT + PTRS_PER_BLK(FS_BLOCK_SIZE) + 10;  // into double-indirect
+    const int n_blks = 1000 + n_file_blks;
 
     // create memory block device
     struct fs_dev_blkdev *dev = memory_blkdev_create(n_blks);
@@ -777,26 +1418,120 @@ void test_stat(void) {
     struct fs_ext2 *fs = fs_mount_volume(dev);
     CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
 
+    struct statvfs sb;
+    fs_statfs(fs, &sb);
+    int free_blks = sb.f_bfree;
+
     // create "file1"
     int file1_ino = fs_mkfile(fs, fs->root_inode, "file1", file_mode);
-    CU_ASSERT_TRUE(file1_ino > 0);
+    CU_ASSERT_TRUE_FATAL(file1_ino > 0);
 
-    char msg[FS_BLOCK_SIZE];
-    memset(msg, 'a', FS_BLOCK_SIZE);
+    // fill each block with a distinct byte
+    static char msg[(N_DIRECT + PTRS_PER_BLK(FS_BLOCK_SIZE) + 10)*FS_BLOCK_SIZE];
+    for (int i = 0; i < n_file_blks; i++) {
+        memset(msg + i*FS_BLOCK_SIZE, 'a' + i%26, FS_BLOCK_SIZE);
+    }
 
-    // write message to file1
-    int status = fs_writefile(fs, file1_ino, msg, FS_BLOCK_SIZE-1);
-    // ensure successful write
+    // write content spanning all block pointer levels
+    int msglen = n_file_blks*FS_BLOCK_SIZE;
+    int status = fs_writefile(fs, file1_ino, msg, msglen);
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->size, msglen);
+    CU_ASSERT_NOT_EQUAL(fs_inode(fs, file1_ino)->indir_1, 0);
+    CU_ASSERT_NOT_EQUAL(fs_inode(fs, file1_ino)->indir_2, 0);
+
+    // read back across block boundaries
+    static char readbuf[(N_DIRECT + PTRS_PER_BLK(FS_BLOCK_SIZE) + 10)*FS_BLOCK_SIZE];
+    int nread = fs_preadfile(fs, file1_ino, readbuf, msglen - 100, 50);
+    CU_ASSERT_EQUAL(nread, msglen - 100);
+    CU_ASSERT_EQUAL(memcmp(readbuf, msg + 50, nread), 0);
+
+    // write past end of file leaves a zero-filled hole
+    char c = 'z';
+    status = fs_pwritefile(fs, file1_ino, &c, 1, msglen + 3*FS_BLOCK_SIZE);
     CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->size, msglen + 3*FS_BLOCK_SIZE + 1);
+    nread = fs_preadfile(fs, file1_ino, readbuf, 2*FS_BLOCK_SIZE, msglen);
+    CU_ASSERT_EQUAL(nread, 2*FS_BLOCK_SIZE);
+    CU_ASSERT_TRUE(readbuf[0] == 0 && memcmp(readbuf, readbuf+1, nread-1) == 0);
 
-    struct stat sb;
-    fs_stat(fs, file1_ino, &sb);
+    // truncate to 1 block frees the other data and indirect blocks
+    status = fs_truncfile(fs, file1_ino, FS_BLOCK_SIZE);
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->indir_1, 0);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->indir_2, 0);
+    fs_statfs(fs, &sb);
+    CU_ASSERT_EQUAL(sb.f_bfree, free_blks - 1);
+
+    // unlink frees the remaining block
+    status = fs_unlinkfile(fs, fs->root_inode, "file1");
+    CU_ASSERT_EQUAL(status, 0);
+    fs_statfs(fs, &sb);
+    CU_ASSERT_EQUAL(sb.f_bfree, free_blks);
+
+    // a sparse file maps one block through its indirect block
+    int file2_ino = fs_mkfile(fs, fs->root_inode, "file2", file_mode);
+    CU_ASSERT_TRUE_FATAL(file2_ino > 0);
+    status = fs_pwritefile(fs, file2_ino, &c, 1, (N_DIRECT + 5)*FS_BLOCK_SIZE);
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_NOT_EQUAL(fs_inode(fs, file2_ino)->indir_1, 0);
+
+    // mapping a block that is already mapped leaves the inode unchanged
+    CU_ASSERT_EQUAL(fs->n_dirty, 0);
+    CU_ASSERT_TRUE(fs_bmap(fs, file2_ino, N_DIRECT + 5, 1, NULL) > 0);
+    CU_ASSERT_EQUAL(fs->n_dirty, 0);
+
+    // truncate frees an indirect block that no longer maps blocks
+    status = fs_truncfile(fs, file2_ino, (N_DIRECT + 1)*FS_BLOCK_SIZE);
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_EQUAL(fs_inode(fs, file2_ino)->indir_1, 0);
+    fs_statfs(fs, &sb);
+    CU_ASSERT_EQUAL(sb.f_bfree, free_blks - 1);  // first block of new file
+
+    // unmount file system volume and close device
+    fs_unmount_volume(fs);
+    dev->ops->close(dev);
+}
+
+/**
+ * Test file system stat operations.
+ */
+void test_stat(void) {
+    const int n_blks = 100;
+    const mode_t file_mode = 0644;  // rw-r--r--
+
+    // create memory block device
+    struct fs_dev_blkdev *dev = memory_blkdev_create(n_blks);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+
+    // format volume
+    int fmtstatus = fs_format_volume(dev, 0, 0);
+    CU_ASSERT_EQUAL_FATAL(fmtstatus, 0);
+
+    // mount formatted volume
+    struct fs_ext2 *fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+
+    // create "file1"
+    int file1_ino = fs_mkfile(fs, fs->root_inode, "file1", file_mode);
+    CU_ASSERT_TRUE(file1_ino > 0);
+
+    char msg[FS_BLOCK_SIZE];
+    memset(msg, 'a', FS_BLOCK_SIZE);
+
+    // write message to file1
+    int status = fs_writefile(fs, file1_ino, msg, FS_BLOCK_SIZE-1);
+    // ensure successful write
+    CU_ASSERT_EQUAL(status, 0);
+
+    struct stat sb;
+    fs_stat(fs, file1_ino, &sb);
 
     // test selection of struct stat fields
     CU_ASSERT_EQUAL(sb.st_ino, file1_ino);
     CU_ASSERT_EQUAL(sb.st_blksize, FS_BLOCK_SIZE);
     CU_ASSERT_EQUAL(sb.st_size, FS_BLOCK_SIZE-1);
-    CU_ASSERT_EQUAL(sb.st_blocks, 2);  // 2 512 byte blocks
+    CU_ASSERT_EQUAL(sb.st_blocks, FS_BLOCK_SIZE / 512);  // 512 byte blocks
     CU_ASSERT_EQUAL(sb.st_nlink, 1);
     CU_ASSERT_EQUAL(sb.st_atime, sb.st_mtime);
 
@@ -833,11 +1568,808 @@ void test_statfs(void) {
     CU_ASSERT_EQUAL(sb.f_files, fs->n_inodes);
     CU_ASSERT_EQUAL(sb.f_namemax, FS_FILENAME_SIZE-1);
 
+    // new volume has free counts that need no repair
+    CU_ASSERT_EQUAL(fs->n_dirty, 0);
+    int free_blks = sb.f_bfree;
+    int free_inodes = sb.f_ffree;
+    CU_ASSERT_EQUAL(free_blks, fs->block_map->n_free);
+    CU_ASSERT_EQUAL(free_inodes, fs->inode_map->n_free);
+
+    // free counts follow allocation and persist
+    int file1_ino = fs_mkfile(fs, fs->root_inode, "file1", file_mode);
+    CU_ASSERT_TRUE_FATAL(file1_ino > 0);
+    fs_unmount_volume(fs);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_EQUAL(fs->n_dirty, 0);
+    fs_statfs(fs, &sb);
+    CU_ASSERT_EQUAL(sb.f_bfree, free_blks - 1);
+    CU_ASSERT_EQUAL(sb.f_ffree, free_inodes - 1);
+
+    CU_ASSERT_EQUAL(fs_unlinkfile(fs, fs->root_inode, "file1"), 0);
+    fs_statfs(fs, &sb);
+    CU_ASSERT_EQUAL(sb.f_bfree, free_blks);
+    CU_ASSERT_EQUAL(sb.f_ffree, free_inodes);
+    fs_unmount_volume(fs);
+
+    // wrong free counts are repaired at mount
+    struct fs_super super;
+    dev->ops->read(dev, 0, 1, &super);
+    super.free_blocks = 0;
+    super.free_inodes = 12345;
+    dev->ops->write(dev, 0, 1, &super);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    fs_statfs(fs, &sb);
+    CU_ASSERT_EQUAL(sb.f_bfree, free_blks);
+    CU_ASSERT_EQUAL(sb.f_ffree, free_inodes);
+    CU_ASSERT_TRUE(fs->n_dirty > 0);
+
+    // unmount file system volume and close device
+    fs_unmount_volume(fs);
+    dev->ops->read(dev, 0, 1, &super);
+    CU_ASSERT_EQUAL(super.free_blocks, free_blks);
+    dev->ops->close(dev);
+}
+
+/**
+ * Test bitmap search and allocation.
+ */
+static void test_bitmap(void) {
+    const int n_bits = 3*FS_BITMAP_CHUNK_BITS + 100;
+    struct fs_bitmap *bm = fs_bitmap_create(NULL, n_bits);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(bm);
+    CU_ASSERT_EQUAL(bm->n_free, n_bits);
+    CU_ASSERT_EQUAL(fs_bitmap_find_set(bm, 0), -1);
+
+    // fill first two chunks except one bit
+    for (int i = 0; i < 2*FS_BITMAP_CHUNK_BITS; i++) {
+        fs_bitmap_set(bm, i);
+    }
+    CU_ASSERT_EQUAL(fs_bitmap_set(bm, 5), 0);
+    CU_ASSERT_EQUAL(fs_bitmap_clear(bm, FS_BITMAP_CHUNK_BITS + 77), 1);
+    CU_ASSERT_EQUAL(bm->n_free, n_bits - 2*FS_BITMAP_CHUNK_BITS + 1);
+    CU_ASSERT_EQUAL(fs_bitmap_find_zero(bm, 0), FS_BITMAP_CHUNK_BITS + 77);
+    CU_ASSERT_EQUAL(fs_bitmap_find_zero(bm, FS_BITMAP_CHUNK_BITS + 78), 2*FS_BITMAP_CHUNK_BITS);
+    CU_ASSERT_EQUAL(fs_bitmap_find_set(bm, FS_BITMAP_CHUNK_BITS + 77), FS_BITMAP_CHUNK_BITS + 78);
+    CU_ASSERT_EQUAL(fs_bitmap_find_set(bm, 2*FS_BITMAP_CHUNK_BITS), -1);
+
+    // next-fit allocation continues after last bit and wraps around
+    CU_ASSERT_EQUAL(fs_bitmap_alloc(bm), FS_BITMAP_CHUNK_BITS + 77);
+    CU_ASSERT_EQUAL(fs_bitmap_alloc(bm), 2*FS_BITMAP_CHUNK_BITS);
+    fs_bitmap_clear(bm, 10);
+    int wrapped = 0;
+    while (bm->n_free > 1) {
+        wrapped |= (fs_bitmap_alloc(bm) <= 2*FS_BITMAP_CHUNK_BITS);
+    }
+    CU_ASSERT_FALSE(wrapped);
+    CU_ASSERT_EQUAL(fs_bitmap_alloc(bm), 10);
+    CU_ASSERT_EQUAL(fs_bitmap_alloc(bm), -1);
+    CU_ASSERT_EQUAL(fs_bitmap_find_zero(bm, 0), -1);
+
+    // bits past the end are never found
+    fs_bitmap_clear(bm, n_bits - 1);
+    fs_bitmap_recount(bm);
+    CU_ASSERT_EQUAL(bm->n_free, 1);
+    CU_ASSERT_EQUAL(fs_bitmap_find_zero(bm, n_bits - 64), n_bits - 1);
+    CU_ASSERT_EQUAL(fs_bitmap_find_zero(bm, n_bits), -1);
+
+    fs_bitmap_destroy(bm);
+}
+
+/**
+ * Test free extent tree and contiguous block allocation.
+ */
+static void test_freetree(void) {
+    const int n_bits = 1000;
+    struct fs_bitmap *bm = fs_bitmap_create(NULL, n_bits);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(bm);
+    for (int i = 0; i < 10; i++) {
+        fs_bitmap_set(bm, i);
+    }
+    for (int i = 100; i < 200; i++) {
+        fs_bitmap_set(bm, i);
+    }
+    fs_bitmap_set(bm, 500);
+
+    // free runs 10-99, 200-499, 501-999
+    struct fs_freetree *ft = fs_freetree_create(bm);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ft);
+    CU_ASSERT_EQUAL(ft->n_extents, 3);
+    int len = 0;
+    CU_ASSERT_EQUAL(fs_freetree_find(ft, 0, n_bits, 1, &len), 10);
+    CU_ASSERT_EQUAL(len, 90);
+    CU_ASSERT_EQUAL(fs_freetree_find(ft, 0, n_bits, 100, &len), 200);
+    CU_ASSERT_EQUAL(len, 300);
+    CU_ASSERT_EQUAL(fs_freetree_find(ft, 0, n_bits, 400, &len), 501);
+    CU_ASSERT_EQUAL(fs_freetree_find(ft, 0, n_bits, 500, &len), -1);
+    CU_ASSERT_EQUAL(fs_freetree_find(ft, 250, 300, 10, &len), 250);
+    CU_ASSERT_EQUAL(len, 50);
+
+    // allocating inside a run splits it; freeing joins it again
+    CU_ASSERT_EQUAL(fs_freetree_remove(ft, 300, 10), 0);
+    CU_ASSERT_EQUAL(ft->n_extents, 4);
+    CU_ASSERT_EQUAL(fs_freetree_find(ft, 295, n_bits, 10, &len), 310);
+    CU_ASSERT_EQUAL(fs_freetree_add(ft, 300, 10), 0);
+    CU_ASSERT_EQUAL(ft->n_extents, 3);
+    CU_ASSERT_EQUAL(fs_freetree_add(ft, 500, 1), 0);
+    CU_ASSERT_EQUAL(ft->n_extents, 2);
+    CU_ASSERT_EQUAL(fs_freetree_find(ft, 0, n_bits, 700, &len), 200);
+    CU_ASSERT_EQUAL(len, 800);
+    CU_ASSERT_EQUAL(fs_freetree_add(ft, 50, 1), -EINVAL);
+    CU_ASSERT_EQUAL(fs_freetree_remove(ft, 5, 1), -EINVAL);
+    fs_bitmap_clear(bm, 500);
+
+    // tree follows random allocation and freeing
+    srand(7600);
+    int updated = 1;
+    for (int k = 0; k < 5000; k++) {
+        int i = rand() % n_bits;
+        if (fs_bitmap_set(bm, i)) {
+            updated &= (fs_freetree_remove(ft, i, 1) == 0);
+        } else {
+            fs_bitmap_clear(bm, i);
+            updated &= (fs_freetree_add(ft, i, 1) == 0);
+        }
+    }
+    CU_ASSERT_TRUE(updated);
+    struct fs_freetree *ft2 = fs_freetree_create(bm);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ft2);
+    CU_ASSERT_EQUAL(ft->n_extents, ft2->n_extents);
+    int same = 1;
+    for (int i = 0; i < n_bits; i++) {
+        same &= (fs_freetree_find(ft, i, n_bits, 1, &len) == fs_bitmap_find_zero(bm, i));
+    }
+    CU_ASSERT_TRUE(same);
+    fs_freetree_destroy(ft2);
+    fs_freetree_destroy(ft);
+    fs_bitmap_destroy(bm);
+
+    // create memory block device
+    struct fs_dev_blkdev *dev = memory_blkdev_create(1024);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+
+    // format and mount volume
+    int fmtstatus = fs_format_volume(dev, 0, 0);
+    CU_ASSERT_EQUAL_FATAL(fmtstatus, 0);
+    struct fs_ext2 *fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    int free_blks = fs->super->free_blocks;
+
+    // run of blocks is allocated in one call
+    int n_alloc = 0;
+    int start = fs_alloc_blks(fs, fs->root_inode, 0, 50, &n_alloc);
+    CU_ASSERT_TRUE_FATAL(start > 0);
+    CU_ASSERT_EQUAL(n_alloc, 50);
+    CU_ASSERT_EQUAL(fs->super->free_blocks, free_blks - 50);
+    int all_set = 1;
+    for (int i = 0; i < 50; i++) {
+        all_set &= fs_bitmap_test(fs->block_map, start + i);
+    }
+    CU_ASSERT_TRUE(all_set);
+
+    // free goal block continues a file even if its run is short
+    for (int i = 0; i < 50; i += 2) {
+        fs_free_blk(fs, start + i);
+    }
+    CU_ASSERT_EQUAL(fs_alloc_blks(fs, fs->root_inode, start, 10, &n_alloc), start);
+    CU_ASSERT_EQUAL(n_alloc, 1);
+
+    // otherwise a whole run is preferred over nearer short runs
+    int blkno = fs_alloc_blks(fs, fs->root_inode, start + 1, 10, &n_alloc);
+    CU_ASSERT_TRUE(blkno >= start + 50);
+    CU_ASSERT_EQUAL(n_alloc, 10);
+    CU_ASSERT_EQUAL(fs->super->free_blocks, free_blks - 50 + 25 - 1 - 10);
+
     // unmount file system volume and close device
     fs_unmount_volume(fs);
     dev->ops->close(dev);
 }
 
+/**
+ * Test block group allocation.
+ */
+static void test_groups(void) {
+    const int n_blks = 1024;
+    const mode_t file_mode = 0644;  // rw-r--r--
+
+    // create memory block device
+    struct fs_dev_blkdev *dev = memory_blkdev_create(n_blks);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+
+    // format volume with four groups and mount it
+    CU_ASSERT_EQUAL(fs_format_volume_opts(dev, &(struct fs_format_opts){.group_blks = 10}), -EINVAL);
+    struct fs_format_opts opts = {.journal_blks = FS_JOURNAL_DEFAULT, .group_blks = 256};
+    int fmtstatus = fs_format_volume_opts(dev, &opts);
+    CU_ASSERT_EQUAL_FATAL(fmtstatus, 0);
+    struct fs_ext2 *fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_EQUAL_FATAL(fs->n_groups, 4);
+    CU_ASSERT_EQUAL(fs->group_blks, 256);
+    CU_ASSERT_EQUAL(fs->group_inodes * fs->n_groups, fs->n_inodes);
+    CU_ASSERT_EQUAL(fs->groups[1].free_blocks, 256);
+    CU_ASSERT_EQUAL(fs->groups[1].free_inodes, fs->group_inodes);
+
+    // files in root directory use group of root directory
+    int file1_ino = fs_mkfile(fs, fs->root_inode, "file1", file_mode);
+    CU_ASSERT_TRUE_FATAL(file1_ino > 0);
+    CU_ASSERT_EQUAL(file1_ino / fs->group_inodes, 0);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->direct[0] / fs->group_blks, 0);
+
+    // once group is out of inodes, the next group is used,
+    // and a file's blocks are allocated in the group of its inode
+    char name[FS_FILENAME_SIZE];
+    int ino = 0;
+    for (int i = 0; (ino >= 0) && (ino / fs->group_inodes == 0); i++) {
+        sprintf(name, "f%d", i);
+        ino = fs_mkfile(fs, fs->root_inode, name, file_mode);
+    }
+    CU_ASSERT_EQUAL_FATAL(ino / fs->group_inodes, 1);
+    CU_ASSERT_EQUAL(fs->groups[0].free_inodes, 0);
+    char buf[10*FS_BLOCK_SIZE];
+    memset(buf, 'x', sizeof(buf));
+    CU_ASSERT_EQUAL(fs_pwritefile(fs, ino, buf, sizeof(buf), 0), 0);
+    int in_group = 1;
+    for (int lblk = 0; lblk < 10; lblk++) {
+        in_group &= (fs_bmap(fs, ino, lblk, 0, NULL) / fs->group_blks == 1);
+    }
+    in_group &= (fs_inode(fs, ino)->indir_1 / fs->group_blks == 1);
+    CU_ASSERT_TRUE(in_group);
+
+    // group counts add up to volume counts and survive remount
+    int free_blks = 0;
+    for (int g = 0; g < fs->n_groups; g++) {
+        free_blks += fs->groups[g].free_blocks;
+    }
+    struct statvfs sb;
+    fs_statfs(fs, &sb);
+    CU_ASSERT_EQUAL(sb.f_bfree, free_blks);
+    int group1_free = fs->groups[1].free_blocks;
+    CU_ASSERT_EQUAL(group1_free, 256 - 11);  // 10 data blocks, 1 indirect
+    fs_unmount_volume(fs);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_EQUAL(fs->groups[1].free_blocks, group1_free);
+    CU_ASSERT_EQUAL(fs->groups[0].free_inodes, 0);
+    fs_unmount_volume(fs);
+
+    // wrong group counts are repaired on first use of the group
+    block desc;
+    CU_ASSERT_EQUAL(dev->ops->read(dev, 1, 1, desc), SUCCESS);
+    ((struct fs_group_desc*)desc)[1].free_blocks = 7;
+    ((struct fs_group_desc*)desc)[1].n_dirs = 1000;
+    CU_ASSERT_EQUAL(dev->ops->write(dev, 1, 1, desc), SUCCESS);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_EQUAL(fs->groups[1].free_blocks, 7);
+    CU_ASSERT_EQUAL(fs->super->free_blocks, free_blks - group1_free + 7);
+    CU_ASSERT_EQUAL(fs_check_group(fs, 1), 0);
+    CU_ASSERT_EQUAL(fs->groups[1].free_blocks, group1_free);
+    CU_ASSERT_EQUAL(fs->groups[1].n_dirs, fs->group_inodes - fs->groups[1].free_inodes);
+    CU_ASSERT_EQUAL(fs->super->free_blocks, free_blks);
+    CU_ASSERT_EQUAL(fs->super->free_blocks, fs->block_map->n_free);
+
+    // unmount file system volume and close device
+    fs_unmount_volume(fs);
+    dev->ops->close(dev);
+}
+
+/**
+ * Test directory spreading and file clustering of inodes.
+ */
+static void test_alloc_orlov(void) {
+    const int n_blks = 1024;
+    const mode_t file_mode = 0644;  // rw-r--r--
+
+    // create memory block device
+    struct fs_dev_blkdev *dev = memory_blkdev_create(n_blks);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+
+    // format volume with four groups and mount it
+    struct fs_format_opts opts = {.journal_blks = 0, .group_blks = 256};
+    int fmtstatus = fs_format_volume_opts(dev, &opts);
+    CU_ASSERT_EQUAL_FATAL(fmtstatus, 0);
+    struct fs_ext2 *fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_EQUAL_FATAL(fs->n_groups, 4);
+    CU_ASSERT_EQUAL(fs->groups[0].n_dirs, 1);  // root directory
+
+    // top-level directories are spread across groups
+    int used = 0;
+    int dir_inos[3];
+    char name[FS_FILENAME_SIZE];
+    for (int i = 0; i < 3; i++) {
+        sprintf(name, "dir%d", i);
+        dir_inos[i] = fs_mkdir(fs, fs->root_inode, name, 0755);
+        CU_ASSERT_TRUE_FATAL(dir_inos[i] > 0);
+        used |= 1 << (dir_inos[i] / fs->group_inodes);
+    }
+    CU_ASSERT_EQUAL(__builtin_popcount(used), 3);
+
+    // files are clustered after their directory inode
+    int dir_ino = dir_inos[0];
+    int contiguous = 1;
+    for (int i = 0; i < 5; i++) {
+        sprintf(name, "file%d", i);
+        contiguous &= (fs_mkfile(fs, dir_ino, name, file_mode) == dir_ino + 1 + i);
+    }
+    CU_ASSERT_TRUE(contiguous);
+
+    // subdirectory stays in the group of its parent
+    int subdir_ino = fs_mkdir(fs, dir_ino, "subdir", 0755);
+    CU_ASSERT_TRUE_FATAL(subdir_ino > 0);
+    CU_ASSERT_EQUAL(subdir_ino / fs->group_inodes, dir_ino / fs->group_inodes);
+    int group = dir_ino / fs->group_inodes;
+    CU_ASSERT_EQUAL(fs->groups[group].n_dirs, 2);
+
+    // directory counts follow removal and survive remount
+    CU_ASSERT_EQUAL(fs_rmdir(fs, dir_ino, "subdir"), 0);
+    CU_ASSERT_EQUAL(fs->groups[group].n_dirs, 1);
+    fs_unmount_volume(fs);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_EQUAL(fs->groups[group].n_dirs, 1);
+
+    // unmount file system volume and close device
+    fs_unmount_volume(fs);
+    dev->ops->close(dev);
+}
+
+/**
+ * Test goal-directed block allocation.
+ */
+static void test_alloc_goal(void) {
+    const int n_blks = 1000;
+    const mode_t file_mode = 0644;  // rw-r--r--
+
+    // create memory block device
+    struct fs_dev_blkdev *dev = memory_blkdev_create(n_blks);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+
+    // format and mount volume
+    int fmtstatus = fs_format_volume(dev, 0, 0);
+    CU_ASSERT_EQUAL_FATAL(fmtstatus, 0);
+    struct fs_ext2 *fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+
+    // new file block follows its directory block
+    int dir1_ino = fs_mkdir(fs, fs->root_inode, "dir1", 0755);
+    CU_ASSERT_TRUE_FATAL(dir1_ino > 0);
+    int file1_ino = fs_mkfile(fs, dir1_ino, "file1", file_mode);
+    int file2_ino = fs_mkfile(fs, dir1_ino, "file2", file_mode);
+    CU_ASSERT_TRUE_FATAL((file1_ino > 0) && (file2_ino > 0));
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->direct[0], fs_inode(fs, dir1_ino)->direct[0] + 1);
+
+    // appended block follows previous block of file
+    CU_ASSERT_EQUAL(fs_unlinkfile(fs, dir1_ino, "file2"), 0);
+    char buf[20*FS_BLOCK_SIZE];
+    memset(buf, 'x', sizeof(buf));
+    CU_ASSERT_EQUAL(fs_pwritefile(fs, file1_ino, buf, 2*FS_BLOCK_SIZE, 0), 0);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->direct[1], fs_inode(fs, file1_ino)->direct[0] + 1);
+
+    // blocks of a sequentially written file are contiguous,
+    // with the indirect block before the blocks it maps
+    int file4_ino = fs_mkfile(fs, fs->root_inode, "file4", file_mode);
+    CU_ASSERT_TRUE_FATAL(file4_ino > 0);
+    CU_ASSERT_EQUAL(fs_pwritefile(fs, file4_ino, buf, sizeof(buf), 0), 0);
+    int n_runs = 1;
+    for (int lblk = 1; lblk < 20; lblk++) {
+        int prev = fs_bmap(fs, file4_ino, lblk-1, 0, NULL);
+        int blkno = fs_bmap(fs, file4_ino, lblk, 0, NULL);
+        n_runs += (blkno != prev + 1);
+    }
+    CU_ASSERT_EQUAL(n_runs, 2);
+    CU_ASSERT_EQUAL(fs_inode(fs, file4_ino)->indir_1, fs_inode(fs, file4_ino)->direct[N_DIRECT-1] + 1);
+
+    // unmount file system volume and close device
+    fs_unmount_volume(fs);
+    dev->ops->close(dev);
+}
+
+/**
+ * Test extent-mapped files.
+ */
+static void test_extents(void) {
+    enum { n_file_blks = 300, n_frag_blks = 2*(N_INODE_EXTENTS + EXTENTS_PER_BLK(FS_BLOCK_SIZE)) + 30 };
+    const int n_blks = 1000 + 3*n_frag_blks;
+    const mode_t file_mode = 0644;  // rw-r--r--
+
+    // create memory block device that counts writes
+    struct fs_dev_blkdev *dev = faulty_blkdev_create(memory_blkdev_create(n_blks));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+
+    // format volume with extents and mount it
+    struct fs_format_opts opts = {.journal_blks = 0, .extents = 1};
+    int fmtstatus = fs_format_volume_opts(dev, &opts);
+    CU_ASSERT_EQUAL_FATAL(fmtstatus, 0);
+    struct fs_ext2 *fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+
+    struct statvfs sb;
+    fs_statfs(fs, &sb);
+    int free_blks = sb.f_bfree;
+
+    // directories keep block pointers
+    int dir_ino = fs_mkdir(fs, fs->root_inode, "dir1", 0755);
+    CU_ASSERT_TRUE_FATAL(dir_ino > 0);
+    CU_ASSERT_FALSE(fs_inode(fs, dir_ino)->flags & FS_INODE_EXTENTS);
+
+    // fill each block with a distinct byte
+    static char msg[(n_file_blks + n_frag_blks)*FS_BLOCK_SIZE];
+    for (int i = 0; i < n_file_blks + n_frag_blks; i++) {
+        memset(msg + i*FS_BLOCK_SIZE, 'a' + i%26, FS_BLOCK_SIZE);
+    }
+
+    // sequential file is mapped by few extents
+    int file1_ino = fs_mkfile(fs, dir_ino, "file1", file_mode);
+    CU_ASSERT_TRUE_FATAL(file1_ino > 0);
+    CU_ASSERT_TRUE(fs_inode(fs, file1_ino)->flags & FS_INODE_EXTENTS);
+    int n_writes = faulty_n_writes;
+    int status = fs_pwritefile(fs, file1_ino, msg, n_file_blks*FS_BLOCK_SIZE, 0);
+    CU_ASSERT_EQUAL(status, 0);
+
+    // adjacent blocks are written together
+    CU_ASSERT_TRUE(faulty_n_writes - n_writes < n_file_blks / 4);
+    CU_ASSERT_TRUE(fs_inode(fs, file1_ino)->ext.n_extents <= N_INODE_EXTENTS);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->ext.overflow, 0);
+
+    // files written alternately are fragmented into
+    // more extents than fit in the inode
+    int file2_ino = fs_mkfile(fs, dir_ino, "file2", file_mode);
+    int file3_ino = fs_mkfile(fs, dir_ino, "file3", file_mode);
+    CU_ASSERT_TRUE_FATAL((file2_ino > 0) && (file3_ino > 0));
+    for (int i = 0; i < n_frag_blks; i++) {
+        int offset = i*FS_BLOCK_SIZE;
+        status = fs_pwritefile(fs, file2_ino, msg + offset, FS_BLOCK_SIZE, offset);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+        status = fs_pwritefile(fs, file3_ino, msg + offset, FS_BLOCK_SIZE, offset);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+    CU_ASSERT_TRUE(fs_inode(fs, file2_ino)->ext.n_extents > N_INODE_EXTENTS + EXTENTS_PER_BLK(FS_BLOCK_SIZE));
+    CU_ASSERT_NOT_EQUAL(fs_inode(fs, file2_ino)->ext.overflow, 0);
+
+    // contents read back after remount
+    fs_unmount_volume(fs);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    static char readbuf[(n_file_blks + n_frag_blks)*FS_BLOCK_SIZE];
+    int nread = fs_preadfile(fs, file1_ino, readbuf, n_file_blks*FS_BLOCK_SIZE, 0);
+    CU_ASSERT_EQUAL(nread, n_file_blks*FS_BLOCK_SIZE);
+    CU_ASSERT_EQUAL(memcmp(readbuf, msg, nread), 0);
+    nread = fs_preadfile(fs, file3_ino, readbuf, n_frag_blks*FS_BLOCK_SIZE, 0);
+    CU_ASSERT_EQUAL(nread, n_frag_blks*FS_BLOCK_SIZE);
+    CU_ASSERT_EQUAL(memcmp(readbuf, msg, nread), 0);
+    for (int i = n_frag_blks; i > 0; i--) {  // backward bypasses hint
+        int blkno = fs_bmap(fs, file2_ino, i-1, 0, NULL);
+        CU_ASSERT_TRUE(blkno > 0);
+    }
+
+    // truncate frees the overflow blocks no longer needed
+    status = fs_truncfile(fs, file2_ino, FS_BLOCK_SIZE + 10);
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_TRUE(fs_inode(fs, file2_ino)->ext.n_extents <= N_INODE_EXTENTS);
+    CU_ASSERT_EQUAL(fs_inode(fs, file2_ino)->ext.overflow, 0);
+    CU_ASSERT_EQUAL(fs_bmap(fs, file2_ino, 2, 0, NULL), 0);
+    nread = fs_preadfile(fs, file2_ino, readbuf, 3*FS_BLOCK_SIZE, 0);
+    CU_ASSERT_EQUAL(nread, FS_BLOCK_SIZE + 10);
+    CU_ASSERT_EQUAL(memcmp(readbuf, msg, nread), 0);
+
+    // unlink frees all data and overflow blocks
+    CU_ASSERT_EQUAL(fs_unlinkfile(fs, dir_ino, "file1"), 0);
+    CU_ASSERT_EQUAL(fs_unlinkfile(fs, dir_ino, "file2"), 0);
+    CU_ASSERT_EQUAL(fs_unlinkfile(fs, dir_ino, "file3"), 0);
+    CU_ASSERT_EQUAL(fs_rmdir(fs, fs->root_inode, "dir1"), 0);
+    fs_statfs(fs, &sb);
+    CU_ASSERT_EQUAL(sb.f_bfree, free_blks);
+
+    // unmount file system volume and close device
+    fs_unmount_volume(fs);
+    dev->ops->close(dev);
+}
+
+/**
+ * Test lazy initialization of inode blocks.
+ */
+static void test_lazy_itable(void) {
+    const int n_blks = 2048;
+    char name[FS_FILENAME_SIZE];
+
+    // create memory block device filled with stale data
+    struct fs_dev_blkdev *dev = memory_blkdev_create(n_blks);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+    block stale;
+    memset(stale, 0xa5, FS_BLOCK_SIZE);
+    for (int i = 0; i < n_blks; i++) {
+        dev->ops->write(dev, i, 1, stale);
+    }
+
+    // format volume with eight groups; only the inode
+    // blocks of the group of the root inode are written
+    struct fs_format_opts opts = {.journal_blks = FS_JOURNAL_DEFAULT, .group_blks = 256};
+    int fmtstatus = fs_format_volume_opts(dev, &opts);
+    CU_ASSERT_EQUAL_FATAL(fmtstatus, 0);
+    struct fs_ext2 *fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_EQUAL_FATAL(fs->n_groups, 8);
+    CU_ASSERT_FALSE(fs_itable_uninit(fs->super, 0));
+    int n_uninit = 0;
+    for (int g = 1; g < fs->n_groups; g++) {
+        n_uninit += fs_itable_uninit(fs->super, g);
+    }
+    CU_ASSERT_EQUAL(n_uninit, fs->n_groups - 1);
+
+    // unwritten inode blocks are zero in memory, stale on disk
+    int group_iblks = fs->group_inodes / INODES_PER_BLK(FS_BLOCK_SIZE);
+    int blkno = fs->inode_base + 3*group_iblks;
+    CU_ASSERT_EQUAL(fs_inode(fs, 3*fs->group_inodes)->mode, 0);
+    block buf;
+    dev->ops->read(dev, blkno, 1, buf);
+    CU_ASSERT_EQUAL(memcmp(buf, stale, FS_BLOCK_SIZE), 0);
+
+    // top-level directories spread to other groups,
+    // whose inode blocks are written on first use
+    int dir_inos[4];
+    for (int i = 0; i < 4; i++) {
+        sprintf(name, "dir%d", i);
+        dir_inos[i] = fs_mkdir(fs, fs->root_inode, name, 0755);
+        CU_ASSERT_TRUE_FATAL(dir_inos[i] > 0);
+        CU_ASSERT_FALSE(fs_itable_uninit(fs->super, dir_inos[i] / fs->group_inodes));
+    }
+    n_uninit = 0;
+    for (int g = 1; g < fs->n_groups; g++) {
+        n_uninit += fs_itable_uninit(fs->super, g);
+    }
+    CU_ASSERT_TRUE(n_uninit > 0);
+    CU_ASSERT_TRUE(n_uninit < fs->n_groups - 1);
+
+    // directories survive remount; unwritten inode blocks
+    // are still not read
+    fs_unmount_volume(fs);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    for (int i = 0; i < 4; i++) {
+        sprintf(name, "dir%d", i);
+        CU_ASSERT_EQUAL(fs_lookup(fs, fs->root_inode, name), dir_inos[i]);
+        CU_ASSERT_TRUE(S_ISDIR(fs_inode(fs, dir_inos[i])->mode));
+    }
+    int clean = 1;
+    for (int ino = 0; ino < fs->n_inodes; ino++) {
+        if (fs_itable_uninit(fs->super, ino / fs->group_inodes)) {
+            clean &= (fs_inode(fs, ino)->mode == 0) && (fs_inode(fs, ino)->nlink == 0);
+        }
+    }
+    CU_ASSERT_TRUE(clean);
+
+    // unmount file system volume and close device
+    fs_unmount_volume(fs);
+    dev->ops->close(dev);
+}
+
+/**
+ * Test inode density options.
+ */
+static void test_inode_ratio(void) {
+    const int n_blks = 2048;
+
+    // create memory block device
+    struct fs_dev_blkdev *dev = memory_blkdev_create(n_blks);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+
+    // default is one inode for every 4 blocks
+    struct fs_format_opts opts = {.journal_blks = 0};
+    CU_ASSERT_EQUAL_FATAL(fs_format_volume_opts(dev, &opts), 0);
+    struct fs_ext2 *fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_EQUAL(fs->n_inodes, n_blks / 4);
+    CU_ASSERT_EQUAL(fs->super->num_inodes, fs->n_inodes);
+    struct statvfs sb;
+    fs_statfs(fs, &sb);
+    int default_free = sb.f_bfree;
+    fs_unmount_volume(fs);
+
+    // fewer inodes leave more blocks free
+    opts.inode_ratio = 32 * FS_BLOCK_SIZE;
+    CU_ASSERT_EQUAL_FATAL(fs_format_volume_opts(dev, &opts), 0);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_EQUAL(fs->n_inodes, n_blks / 32);
+    fs_statfs(fs, &sb);
+    CU_ASSERT_EQUAL(sb.f_files, n_blks / 32);
+    CU_ASSERT_EQUAL(sb.f_bfree, default_free + (n_blks/4 - n_blks/32) / INODES_PER_BLK(FS_BLOCK_SIZE));
+    fs_unmount_volume(fs);
+
+    // explicit count is rounded up to whole inode blocks per group
+    opts = (struct fs_format_opts) {.journal_blks = 0, .group_blks = 256, .n_inodes = 100};
+    CU_ASSERT_EQUAL_FATAL(fs_format_volume_opts(dev, &opts), 0);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_TRUE(fs->n_inodes >= 100);
+    CU_ASSERT_TRUE(fs->n_inodes < 100 + fs->n_groups * INODES_PER_BLK(FS_BLOCK_SIZE));
+    CU_ASSERT_EQUAL(fs->group_inodes * fs->n_groups, fs->n_inodes);
+    int file_ino = fs_mkfile(fs, fs->root_inode, "file1", 0644);
+    CU_ASSERT_TRUE(file_ino > 0);
+    fs_unmount_volume(fs);
+
+    // invalid densities
+    opts = (struct fs_format_opts) {.inode_ratio = FS_BLOCK_SIZE / 2};
+    CU_ASSERT_EQUAL(fs_format_volume_opts(dev, &opts), -EINVAL);
+    opts = (struct fs_format_opts) {.n_inodes = 1};
+    CU_ASSERT_EQUAL(fs_format_volume_opts(dev, &opts), -EINVAL);
+
+    // close device
+    dev->ops->close(dev);
+}
+
+/**
+ * Test mounting with inode blocks paged in on demand.
+ */
+static void test_paged_mount(void) {
+    const int n_blks = 2048;
+    const int n_dirs = 2*FS_MCACHE_MIN_BLKS;
+    char name[FS_FILENAME_SIZE];
+    char buf[100];
+
+    // create memory block device
+    struct fs_dev_blkdev *dev = memory_blkdev_create(n_blks);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+
+    // format volume with more groups than cached blocks, and
+    // spread a directory with a file over the groups
+    struct fs_format_opts opts = {.journal_blks = FS_JOURNAL_DEFAULT, .group_blks = FS_GROUP_MIN};
+    CU_ASSERT_EQUAL_FATAL(fs_format_volume_opts(dev, &opts), 0);
+    struct fs_ext2 *fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_PTR_NOT_NULL(fs->inodes);
+    int dir_inos[n_dirs], file_inos[n_dirs];
+    for (int i = 0; i < n_dirs; i++) {
+        sprintf(name, "dir%d", i);
+        dir_inos[i] = fs_mkdir(fs, fs->root_inode, name, 0755);
+        CU_ASSERT_TRUE_FATAL(dir_inos[i] > 0);
+        file_inos[i] = fs_mkfile(fs, dir_inos[i], "file", 0644);
+        CU_ASSERT_TRUE_FATAL(file_inos[i] > 0);
+        sprintf(buf, "contents of file %d", i);
+        CU_ASSERT_EQUAL(fs_pwritefile(fs, file_inos[i], buf, strlen(buf), 0), 0);
+    }
+    int n_inode_blks = 0;
+    for (int b = 0; b < fs->n_inodes / INODES_PER_BLK(FS_BLOCK_SIZE); b++) {
+        int used = 0;
+        for (int ino = b*INODES_PER_BLK(FS_BLOCK_SIZE); ino < (b+1)*INODES_PER_BLK(FS_BLOCK_SIZE); ino++) {
+            used |= (fs_inode(fs, ino)->nlink != 0);
+        }
+        n_inode_blks += used;
+    }
+    CU_ASSERT_TRUE_FATAL(n_inode_blks > FS_MCACHE_MIN_BLKS);
+    int n_inodes = fs->n_inodes;
+    struct fs_inode *inodes = malloc(n_inodes * sizeof(struct fs_inode));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(inodes);
+    for (int ino = 0; ino < n_inodes; ino++) {
+        inodes[ino] = *fs_inode(fs, ino);
+    }
+    fs_unmount_volume(fs);
+
+    // paged mount reads map and inode blocks on demand within the limit
+    struct fs_mount_opts mopts = {.mcache_blks = FS_MCACHE_MIN_BLKS};
+    fs = fs_mount_volume_opts(dev, &mopts);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_PTR_NULL(fs->inodes);
+    CU_ASSERT_PTR_NULL(fs->inode_map);
+    CU_ASSERT_PTR_NULL(fs->block_map);
+    CU_ASSERT_EQUAL(fs->n_inodes, n_inodes);
+    CU_ASSERT_EQUAL(fs_mcache_size(fs->mcache), 0);
+    int ok = 1;
+    for (int ino = 0; ino < n_inodes; ino++) {
+        ok &= (memcmp(fs_inode(fs, ino), &inodes[ino], sizeof(struct fs_inode)) == 0);
+        ok &= (fs_mcache_size(fs->mcache) <= FS_MCACHE_MIN_BLKS);
+    }
+    CU_ASSERT_TRUE(ok);
+    for (int i = 0; i < n_dirs; i++) {
+        sprintf(name, "dir%d", i);
+        CU_ASSERT_EQUAL(fs_lookup(fs, fs->root_inode, name), dir_inos[i]);
+        CU_ASSERT_EQUAL(fs_lookup(fs, dir_inos[i], "file"), file_inos[i]);
+        char expect[100];
+        sprintf(expect, "contents of file %d", i);
+        memset(buf, 0, sizeof(buf));
+        CU_ASSERT_EQUAL(fs_preadfile(fs, file_inos[i], buf, sizeof(buf), 0), strlen(expect));
+        CU_ASSERT_STRING_EQUAL(buf, expect);
+    }
+
+    // changed blocks stay cached past the limit until synced
+    fs_set_sync_policy(fs, FS_SYNC_WRITEBACK, 1000, 1000);
+    for (int i = 0; i < n_dirs; i++) {
+        CU_ASSERT_EQUAL(fs_chmod(fs, file_inos[i], 0600), 0);
+    }
+    CU_ASSERT_TRUE(fs_mcache_size(fs->mcache) > FS_MCACHE_MIN_BLKS);
+    CU_ASSERT_EQUAL(fs_sync_metadata(fs), 0);
+    CU_ASSERT_TRUE(fs_mcache_size(fs->mcache) <= FS_MCACHE_MIN_BLKS);
+
+    // aborted transaction restores paged inodes
+    CU_ASSERT_EQUAL(fs_txn_begin(fs), 0);
+    for (int i = 0; i < n_dirs; i++) {
+        CU_ASSERT_EQUAL(fs_chmod(fs, file_inos[i], 0644), 0);
+    }
+    int new_ino = fs_mkfile(fs, dir_inos[0], "new", 0644);
+    CU_ASSERT_TRUE(new_ino > 0);
+    CU_ASSERT_EQUAL(fs_txn_abort(fs), 0);
+    CU_ASSERT_EQUAL(fs_lookup(fs, dir_inos[0], "new"), -ENOENT);
+    ok = 1;
+    for (int i = 0; i < n_dirs; i++) {
+        ok &= ((fs_inode(fs, file_inos[i])->mode & 0777) == 0600);
+    }
+    CU_ASSERT_TRUE(ok);
+    CU_ASSERT_EQUAL(fs_inode(fs, new_ino)->nlink, 0);
+
+    // changed inode stays cached while other inode blocks are used
+    struct fs_inode *in = fs_inode_mut(fs, file_inos[0]);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(in);
+    for (int ino = 0; ino < n_inodes; ino++) {
+        fs_inode(fs, ino);
+    }
+    in->mtime = 12345;
+    CU_ASSERT_EQUAL(fs_sync_metadata(fs), 0);
+    for (int ino = 0; ino < n_inodes; ino++) {
+        fs_inode(fs, ino);
+    }
+    CU_ASSERT_EQUAL(fs_inode(fs, file_inos[0])->mtime, 12345);
+
+    // new files and blocks in paged groups survive remount
+    char data[4*FS_BLOCK_SIZE];
+    memset(data, 'x', sizeof(data));
+    CU_ASSERT_EQUAL(fs_set_sync_policy(fs, FS_SYNC_ALWAYS, FS_SYNC_MAX_DIRTY, FS_SYNC_INTERVAL), 0);
+    ok = 1;
+    for (int i = 0; i < n_dirs; i++) {
+        int ino = fs_mkfile(fs, dir_inos[i], "new", 0644);
+        ok &= (ino > 0) && (fs_pwritefile(fs, ino, data, sizeof(data), 0) == 0);
+        ok &= (fs_mcache_size(fs->mcache) <= FS_MCACHE_MIN_BLKS);
+    }
+    CU_ASSERT_TRUE(ok);
+    CU_ASSERT_EQUAL(fs_unlinkfile(fs, dir_inos[0], "new"), 0);
+    fs_unmount_volume(fs);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    ok = 1;
+    for (int i = 0; i < n_dirs; i++) {
+        ok &= ((fs_inode(fs, file_inos[i])->mode & 0777) == 0600);
+        ok &= (fs_lookup(fs, dir_inos[i], "new") > 0) == (i > 0);
+    }
+    CU_ASSERT_TRUE(ok);
+    ok = 1;
+    for (int g = 0; g < fs->n_groups; g++) {
+        ok &= (fs->groups[g].free_blocks ==
+               fs_bitmap_count_zero(fs->block_map, g*fs->group_blks, (g+1)*fs->group_blks));
+        ok &= (fs->groups[g].free_inodes ==
+               fs_bitmap_count_zero(fs->inode_map, g*fs->group_inodes, (g+1)*fs->group_inodes));
+    }
+    CU_ASSERT_TRUE(ok);
+    CU_ASSERT_EQUAL(fs->super->free_blocks, fs->block_map->n_free);
+    CU_ASSERT_EQUAL(fs->super->free_inodes, fs->inode_map->n_free);
+    fs_unmount_volume(fs);
+
+    // inode whose block cannot be read reports an i/o error
+    struct fs_dev_blkdev *fdev = faulty_blkdev_create(dev);
+    fs = fs_mount_volume_opts(fdev, &mopts);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    int file_blk = file_inos[0] / INODES_PER_BLK(FS_BLOCK_SIZE);
+    for (int ino = 0; ino < n_inodes; ino++) {
+        if (ino / INODES_PER_BLK(FS_BLOCK_SIZE) != file_blk) {
+            fs_inode(fs, ino);  // evict block of file inode
+        }
+    }
+    faulty_fail_reads = 1;
+    struct stat sb;
+    CU_ASSERT_PTR_NULL(fs_inode(fs, file_inos[0]));
+    CU_ASSERT_EQUAL(fs_stat(fs, file_inos[0], &sb), -EIO);
+    CU_ASSERT_EQUAL(fs_chmod(fs, file_inos[0], 0644), -EIO);
+    CU_ASSERT_EQUAL(fs_preadfile(fs, file_inos[0], buf, sizeof(buf), 0), -EIO);
+    faulty_fail_reads = 0;
+    CU_ASSERT_EQUAL(fs_stat(fs, file_inos[0], &sb), 0);
+    CU_ASSERT_EQUAL(sb.st_mode & 0777, 0600);
+
+    // unmount file system volume and close device
+    free(inodes);
+    fs_unmount_volume(fs);
+    fdev->ops->close(fdev);
+}
+
 /**
  * Test file system sync meta operations.
  */
@@ -850,8 +2382,9 @@ static void test_sync_meta(void) {
     struct fs_dev_blkdev *dev = memory_blkdev_create(n_blks);
     CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
 
-    // format volume
-    int fmtstatus = fs_format_volume(dev, 0, 0);
+    // format volume without journal to write metadata in place
+    struct fs_format_opts opts = {.journal_blks = 0};
+    int fmtstatus = fs_format_volume_opts(dev, &opts);
     CU_ASSERT_EQUAL_FATAL(fmtstatus, 0);
 
     // mount formatted volume
@@ -871,9 +2404,9 @@ static void test_sync_meta(void) {
     CU_ASSERT_TRUE(dir1_ino > 0);
 
     // verify inodes are allocated
-    CU_ASSERT_NOT_EQUAL(FD_ISSET(file1_ino, fs->inode_map), 0);
-    CU_ASSERT_NOT_EQUAL(FD_ISSET(file2_ino, fs->inode_map), 0);
-    CU_ASSERT_NOT_EQUAL(FD_ISSET(dir1_ino, fs->inode_map), 0);
+    CU_ASSERT_NOT_EQUAL(fs_bitmap_test(fs->inode_map, file1_ino), 0);
+    CU_ASSERT_NOT_EQUAL(fs_bitmap_test(fs->inode_map, file2_ino), 0);
+    CU_ASSERT_NOT_EQUAL(fs_bitmap_test(fs->inode_map, dir1_ino), 0);
 
     // unmount and re-mount volume to rebuild fs
     fs_unmount_volume(fs);
@@ -881,15 +2414,716 @@ static void test_sync_meta(void) {
     CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
 
     // ensure inodes are still allocated
-    CU_ASSERT_NOT_EQUAL(FD_ISSET(file1_ino, fs->inode_map), 0);
-    CU_ASSERT_NOT_EQUAL(FD_ISSET(file2_ino, fs->inode_map), 0);
-    CU_ASSERT_NOT_EQUAL(FD_ISSET(dir1_ino, fs->inode_map), 0);
+    CU_ASSERT_NOT_EQUAL(fs_bitmap_test(fs->inode_map, file1_ino), 0);
+    CU_ASSERT_NOT_EQUAL(fs_bitmap_test(fs->inode_map, file2_ino), 0);
+    CU_ASSERT_NOT_EQUAL(fs_bitmap_test(fs->inode_map, dir1_ino), 0);
+
+    // changing every inode writes the inode map and inode blocks in two runs
+    for (int ino = 1; ino < fs->n_inodes; ino++) {
+        fs_mark_inode(fs, ino);
+    }
+    CU_ASSERT_EQUAL(fs_sync_metadata(fs), 0);
+    int n_ino_blks = (fs->n_inodes + INODES_PER_BLK(FS_BLOCK_SIZE) - 1) / INODES_PER_BLK(FS_BLOCK_SIZE);
+    CU_ASSERT_EQUAL(fs->sync_stats.last_blocks, 1 + n_ino_blks);
+    CU_ASSERT_EQUAL(fs->sync_stats.last_calls, 2);
+
+    // nothing left to write
+    CU_ASSERT_EQUAL(fs_sync_metadata(fs), 0);
+    CU_ASSERT_EQUAL(fs->sync_stats.last_blocks, 0);
+    CU_ASSERT_EQUAL(fs->sync_stats.last_calls, 0);
+    CU_ASSERT_EQUAL(fs->sync_stats.calls, 2);
 
     // unmount file system volume and close device
     fs_unmount_volume(fs);
     dev->ops->close(dev);
 }
 
+/**
+ * Test write-back metadata sync policy.
+ */
+static void test_sync_policy(void) {
+    const int n_blks = 100;
+    const mode_t file_mode = 0644;  // rw-r--r--
+
+    // create memory block device
+    struct fs_dev_blkdev *dev = memory_blkdev_create(n_blks);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+
+    // format and mount volume without journal to write metadata in place
+    struct fs_format_opts opts = {.journal_blks = 0};
+    int fmtstatus = fs_format_volume_opts(dev, &opts);
+    CU_ASSERT_EQUAL_FATAL(fmtstatus, 0);
+    struct fs_ext2 *fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_EQUAL(fs->sync_mode, FS_SYNC_ALWAYS);
+
+    // defer metadata writes until many blocks change
+    fs_set_sync_policy(fs, FS_SYNC_WRITEBACK, 1000, 3600);
+    int file1_ino = fs_mkfile(fs, fs->root_inode, "file1", file_mode);
+    CU_ASSERT_TRUE_FATAL(file1_ino > 0);
+    CU_ASSERT_EQUAL(fs_chmod(fs, file1_ino, 0600), 0);
+    CU_ASSERT_TRUE(fs->n_dirty > 0);
+
+    // device inode block does not have the change
+    int inode_blkno = fs->inode_base + file1_ino/INODES_PER_BLK(FS_BLOCK_SIZE);
+    struct fs_inode dev_inodes[INODES_PER_BLK(FS_BLOCK_SIZE)];
+    dev->ops->read(dev, inode_blkno, 1, dev_inodes);
+    CU_ASSERT_EQUAL(dev_inodes[file1_ino % INODES_PER_BLK(FS_BLOCK_SIZE)].mode, 0);
+
+    // fsync writes the change
+    CU_ASSERT_EQUAL(fs_fsync(fs, file1_ino), 0);
+    CU_ASSERT_EQUAL(fs->n_dirty, 0);
+    dev->ops->read(dev, inode_blkno, 1, dev_inodes);
+    CU_ASSERT_EQUAL(dev_inodes[file1_ino % INODES_PER_BLK(FS_BLOCK_SIZE)].mode, S_IFREG | 0600);
+    CU_ASSERT_EQUAL(fs_fsync(fs, 0), -EINVAL);
+
+    // reaching the dirty threshold writes the change
+    fs_set_sync_policy(fs, FS_SYNC_WRITEBACK, 2, 3600);
+    CU_ASSERT_EQUAL(fs_chmod(fs, file1_ino, 0640), 0);
+    CU_ASSERT_EQUAL(fs->n_dirty, 0);
+    dev->ops->read(dev, inode_blkno, 1, dev_inodes);
+    CU_ASSERT_EQUAL(dev_inodes[file1_ino % INODES_PER_BLK(FS_BLOCK_SIZE)].mode, S_IFREG | 0640);
+
+    // deferred changes are written when unmounted
+    fs_set_sync_policy(fs, FS_SYNC_WRITEBACK, 1000, 3600);
+    int file2_ino = fs_mkfile(fs, fs->root_inode, "file2", file_mode);
+    CU_ASSERT_TRUE_FATAL(file2_ino > 0);
+    CU_ASSERT_TRUE(fs->n_dirty > 0);
+    fs_unmount_volume(fs);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_EQUAL(fs_lookup(fs, fs->root_inode, "file2"), file2_ino);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->mode, S_IFREG | 0640);
+
+    CU_ASSERT_EQUAL(fs_syncfs(fs), 0);
+
+    // unmount file system volume and close device
+    fs_unmount_volume(fs);
+    dev->ops->close(dev);
+
+    // policy is unchanged if changed metadata cannot be written
+    dev = faulty_blkdev_create(memory_blkdev_create(n_blks));
+    CU_ASSERT_EQUAL_FATAL(fs_format_volume_opts(dev, &opts), 0);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_EQUAL(fs_set_sync_policy(fs, FS_SYNC_WRITEBACK, 1000, 3600), 0);
+    CU_ASSERT_EQUAL(fs_chmod(fs, fs->root_inode, 0700), 0);
+    faulty_fail_writes = 1;
+    CU_ASSERT_EQUAL(fs_set_sync_policy(fs, FS_SYNC_ALWAYS, 0, 0), -EIO);
+    CU_ASSERT_EQUAL(fs->sync_mode, FS_SYNC_WRITEBACK);
+    faulty_fail_writes = 0;
+    CU_ASSERT_EQUAL(fs_set_sync_policy(fs, FS_SYNC_ALWAYS, 0, 0), 0);
+    CU_ASSERT_EQUAL(fs->sync_mode, FS_SYNC_ALWAYS);
+
+    // failed mkdir releases its inode and block
+    struct statvfs st;
+    fs_statfs(fs, &st);
+    int free_blks = st.f_bfree;
+    int free_inodes = st.f_ffree;
+    faulty_fail_writes = 1;
+    CU_ASSERT_EQUAL(fs_mkdir(fs, fs->root_inode, "dir1", 0755), -EIO);
+    faulty_fail_writes = 0;
+    fs_statfs(fs, &st);
+    CU_ASSERT_EQUAL(st.f_bfree, free_blks);
+    CU_ASSERT_EQUAL(st.f_ffree, free_inodes);
+    CU_ASSERT_EQUAL(fs_lookup(fs, fs->root_inode, "dir1"), -ENOENT);
+
+    // operation fails if its metadata cannot be written,
+    // and so do syncfs and unmount
+    faulty_fail_writes = 1;
+    CU_ASSERT_EQUAL(fs_chmod(fs, fs->root_inode, 0750), -EIO);
+    CU_ASSERT_EQUAL(fs_syncfs(fs), -EIO);
+    CU_ASSERT_PTR_NULL(fs_unmount_volume(fs));
+    faulty_fail_writes = 0;
+    dev->ops->close(dev);
+}
+
+/**
+ * Copy the blocks of a device to a new memory device,
+ * as they would be found after a crash.
+ *
+ * @param dev the block device
+ * @return the copy
+ */
+static struct fs_dev_blkdev *crash_copy(struct fs_dev_blkdev *dev) {
+    int n_blks = dev->ops->num_blocks(dev);
+    struct fs_dev_blkdev *copy = memory_blkdev_create(n_blks);
+    block blk;
+    for (int i = 0; i < n_blks; i++) {
+        dev->ops->read(dev, i, 1, blk);
+        copy->ops->write(copy, i, 1, blk);
+    }
+    return copy;
+}
+
+/**
+ * Test metadata journal commit and replay.
+ */
+static void test_journal(void) {
+    const int n_blks = 1000;
+    const mode_t file_mode = 0644;  // rw-r--r--
+
+    // create memory block device
+    struct fs_dev_blkdev *dev = memory_blkdev_create(n_blks);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+
+    // format volume with journal and mount it
+    struct fs_format_opts opts = {.journal_blks = 64};
+    CU_ASSERT_EQUAL(fs_format_volume_opts(dev, &(struct fs_format_opts){.journal_blks = 2}), -EINVAL);
+    int fmtstatus = fs_format_volume_opts(dev, &opts);
+    CU_ASSERT_EQUAL_FATAL(fmtstatus, 0);
+    struct fs_ext2 *fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_EQUAL(fs->journal_base, fs->n_meta);
+    CU_ASSERT_EQUAL(fs->journal_n_log, opts.journal_blks - 1);
+
+    // each operation commits one transaction to the journal
+    int file_ino = fs_mkfile(fs, fs->root_inode, "file", file_mode);
+    CU_ASSERT_TRUE_FATAL(file_ino > 0);
+    CU_ASSERT_EQUAL(fs->sync_stats.last_calls, 1);
+    CU_ASSERT_EQUAL(fs_chmod(fs, file_ino, 0600), 0);
+    CU_ASSERT_EQUAL(fs->sync_stats.last_calls, 1);
+    CU_ASSERT_EQUAL(fs->sync_stats.last_blocks, 2 + 2);  // inode map and inode
+    CU_ASSERT_TRUE(fs->journal_head > fs->journal_tail);
+
+    // home inode block is not yet written
+    int inode_blkno = fs->inode_base + file_ino/INODES_PER_BLK(FS_BLOCK_SIZE);
+    struct fs_inode dev_inodes[INODES_PER_BLK(FS_BLOCK_SIZE)];
+    dev->ops->read(dev, inode_blkno, 1, dev_inodes);
+    CU_ASSERT_EQUAL(dev_inodes[file_ino % INODES_PER_BLK(FS_BLOCK_SIZE)].mode, 0);
+
+    // crash, then replay both transactions on mount
+    struct fs_dev_blkdev *dev2 = crash_copy(dev);
+    struct fs_ext2 *fs2 = fs_mount_volume(dev2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs2);
+    CU_ASSERT_EQUAL(fs_lookup(fs2, fs2->root_inode, "file"), file_ino);
+    CU_ASSERT_EQUAL(fs_inode(fs2, file_ino)->mode, S_IFREG | 0600);
+    CU_ASSERT_EQUAL(fs2->journal_head, fs->journal_head);
+    CU_ASSERT_EQUAL(fs2->journal_tail, fs2->journal_head);
+    dev2->ops->read(dev2, inode_blkno, 1, dev_inodes);
+    CU_ASSERT_EQUAL(dev_inodes[file_ino % INODES_PER_BLK(FS_BLOCK_SIZE)].mode, S_IFREG | 0600);
+    fs_unmount_volume(fs2);
+    dev2->ops->close(dev2);
+
+    // crash with torn commit block; last transaction is not replayed
+    dev2 = crash_copy(dev);
+    block zeros;
+    memset(zeros, 0, sizeof(zeros));
+    int commit_blkno = fs->journal_base + 1 + (fs->journal_head - 1) % fs->journal_n_log;
+    dev2->ops->write(dev2, commit_blkno, 1, zeros);
+    fs2 = fs_mount_volume(dev2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs2);
+    CU_ASSERT_EQUAL(fs_lookup(fs2, fs2->root_inode, "file"), file_ino);
+    CU_ASSERT_EQUAL(fs_inode(fs2, file_ino)->mode, S_IFREG | file_mode);
+    fs_unmount_volume(fs2);
+    dev2->ops->close(dev2);
+
+    // many commits wrap around the log, checkpointing as it fills
+    for (int i = 0; i < 100; i++) {
+        CU_ASSERT_EQUAL(fs_chmod(fs, file_ino, (i % 2) ? 0600 : 0644), 0);
+    }
+    CU_ASSERT_TRUE(fs->journal_head > (uint32_t)fs->journal_n_log);
+    CU_ASSERT_TRUE(fs->journal_head - fs->journal_tail <= (uint32_t)fs->journal_n_log);
+    dev2 = crash_copy(dev);
+    fs2 = fs_mount_volume(dev2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs2);
+    CU_ASSERT_EQUAL(fs_inode(fs2, file_ino)->mode, S_IFREG | 0600);
+    fs_unmount_volume(fs2);
+    dev2->ops->close(dev2);
+
+    // unmount checkpoints the journal
+    fs_unmount_volume(fs);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_EQUAL(fs_inode(fs, file_ino)->mode, S_IFREG | 0600);
+    fs_unmount_volume(fs);
+    dev->ops->close(dev);
+
+    // commits and checkpoints flush the whole device as a barrier
+    dev = faulty_blkdev_create(memory_blkdev_create(n_blks));
+    CU_ASSERT_EQUAL_FATAL(fs_format_volume_opts(dev, &opts), 0);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    for (int i = 0; i < 100; i++) {
+        CU_ASSERT_EQUAL(fs_chmod(fs, fs->root_inode, (i % 2) ? 0700 : 0755), 0);
+    }
+    CU_ASSERT_TRUE(fs->journal_head > (uint32_t)fs->journal_n_log);
+    CU_ASSERT_PTR_NOT_NULL(fs_unmount_volume(fs));
+    CU_ASSERT_EQUAL(faulty_n_partial_flushes, 0);
+    dev->ops->close(dev);
+}
+
+/**
+ * Test journaling of directory and indirect blocks.
+ */
+static void test_journal_blocks(void) {
+    const int n_blks = 1000;
+    const mode_t file_mode = 0644;  // rw-r--r--
+
+    // create memory block device
+    struct fs_dev_blkdev *dev = memory_blkdev_create(n_blks);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+
+    // format volume with journal and mount it
+    struct fs_format_opts opts = {.journal_blks = 64};
+    CU_ASSERT_EQUAL_FATAL(fs_format_volume_opts(dev, &opts), 0);
+    struct fs_ext2 *fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+
+    // directory block is held until checkpointed
+    int dir_ino = fs_mkdir(fs, fs->root_inode, "dir", 0755);
+    CU_ASSERT_TRUE_FATAL(dir_ino > 0);
+    int file_ino = fs_mkfile(fs, dir_ino, "file", file_mode);
+    CU_ASSERT_TRUE_FATAL(file_ino > 0);
+    CU_ASSERT_EQUAL(fs->n_dirty, 0);
+    int dir_blkno = fs_bmap(fs, dir_ino, 0, 0, NULL);
+    CU_ASSERT_TRUE_FATAL(dir_blkno > 0);
+    CU_ASSERT_TRUE(fs_journal_logged(fs, dir_blkno));
+    struct fs_dirent dev_de[DIRENTS_PER_BLK(FS_BLOCK_SIZE)];
+    dev->ops->read(dev, dir_blkno, 1, dev_de);
+    for (int i = 0; i < DIRENTS_PER_BLK(FS_BLOCK_SIZE); i++) {
+        CU_ASSERT_FALSE(dev_de[i].valid && (strcmp(dev_de[i].name, "file") == 0));
+    }
+
+    // indirect block of a file is committed with its inode
+    char buf[(N_DIRECT+2) * FS_BLOCK_SIZE];
+    for (int i = 0; i < (int)sizeof(buf); i++) {
+        buf[i] = 'a' + i % 26;
+    }
+    CU_ASSERT_EQUAL(fs_pwritefile(fs, file_ino, buf, sizeof(buf), 0), 0);
+    int indir_blkno = fs_inode(fs, file_ino)->indir_1;
+    CU_ASSERT_TRUE_FATAL(indir_blkno > 0);
+    CU_ASSERT_TRUE(fs_journal_logged(fs, indir_blkno));
+
+    // crash, then replay directory and indirect blocks on mount
+    struct fs_dev_blkdev *dev2 = crash_copy(dev);
+    struct fs_ext2 *fs2 = fs_mount_volume(dev2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs2);
+    CU_ASSERT_EQUAL(fs_lookup(fs2, dir_ino, "file"), file_ino);
+    char buf2[sizeof(buf)];
+    CU_ASSERT_EQUAL(fs_preadfile(fs2, file_ino, buf2, sizeof(buf2), 0), sizeof(buf2));
+    CU_ASSERT_EQUAL(memcmp(buf, buf2, sizeof(buf)), 0);
+    CU_ASSERT_EQUAL(fs_journal_logged(fs2, dir_blkno), 0);
+    dev2->ops->read(dev2, dir_blkno, 1, dev_de);
+    int found = 0;
+    for (int i = 0; i < DIRENTS_PER_BLK(FS_BLOCK_SIZE); i++) {
+        found |= dev_de[i].valid && (strcmp(dev_de[i].name, "file") == 0);
+    }
+    CU_ASSERT_TRUE(found);  // written home by replay
+    fs_unmount_volume(fs2);
+    dev2->ops->close(dev2);
+
+    // freeing a logged block checkpoints it so replay
+    // cannot overwrite the block once it is reused
+    CU_ASSERT_EQUAL(fs_truncfile(fs, file_ino, FS_BLOCK_SIZE), 0);
+    CU_ASSERT_EQUAL(fs_inode(fs, file_ino)->indir_1, 0);
+    CU_ASSERT_EQUAL(fs_journal_logged(fs, indir_blkno), 0);
+    CU_ASSERT_EQUAL(fs_journal_logged(fs, dir_blkno), 0);
+    block zeros;
+    memset(zeros, 0, sizeof(zeros));
+    dev->ops->write(dev, indir_blkno, 1, zeros);  // reused for file data
+    dev2 = crash_copy(dev);
+    fs2 = fs_mount_volume(dev2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs2);
+    dev2->ops->read(dev2, indir_blkno, 1, buf2);
+    CU_ASSERT_EQUAL(memcmp(buf2, zeros, FS_BLOCK_SIZE), 0);
+    CU_ASSERT_EQUAL(fs_inode(fs2, file_ino)->size, FS_BLOCK_SIZE);
+    fs_unmount_volume(fs2);
+    dev2->ops->close(dev2);
+
+    fs_unmount_volume(fs);
+    dev->ops->close(dev);
+}
+
+/**
+ * Test journal transactions larger than one descriptor
+ * block, and changes larger than the log.
+ */
+static void test_journal_large(void) {
+    const int n_blks = 8000;
+    const int per_blk = INODES_PER_BLK(FS_BLOCK_SIZE);
+
+    // create memory block device
+    struct fs_dev_blkdev *dev = memory_blkdev_create(n_blks);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+
+    // format volume with large journal and mount it
+    struct fs_format_opts opts = {.journal_blks = 1000, .n_inodes = 8000};
+    CU_ASSERT_EQUAL_FATAL(fs_format_volume_opts(dev, &opts), 0);
+    struct fs_ext2 *fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    int n_changed = JOURNAL_DESC_LIMIT(FS_BLOCK_SIZE) + 50;
+    CU_ASSERT_TRUE_FATAL(fs_journal_capacity(fs) > n_changed);
+    CU_ASSERT_TRUE_FATAL(n_changed * per_blk < fs->n_inodes);
+
+    // change one inode in each of many inode blocks
+    for (int i = 1; i <= n_changed; i++) {
+        fs_inode_mut(fs, i * per_blk)->mtime = i;
+    }
+    int n_dirty = fs->n_dirty;
+    uint32_t seq = fs->journal_seq;
+    CU_ASSERT_EQUAL(fs_sync_metadata(fs), 0);
+
+    // one transaction with two descriptors and a commit block
+    CU_ASSERT_EQUAL(fs->journal_seq, seq + 1);
+    CU_ASSERT_EQUAL(fs->sync_stats.last_calls, 1);
+    CU_ASSERT_EQUAL(fs->sync_stats.last_blocks, n_dirty + 2 + 1);
+    CU_ASSERT_TRUE(fs->journal_head > fs->journal_tail);
+
+    // crash, then replay the whole transaction on mount
+    struct fs_dev_blkdev *dev2 = crash_copy(dev);
+    struct fs_ext2 *fs2 = fs_mount_volume(dev2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs2);
+    for (int i = 1; i <= n_changed; i++) {
+        CU_ASSERT_EQUAL(fs_inode(fs2, i * per_blk)->mtime, i);
+    }
+    fs_unmount_volume(fs2);
+    dev2->ops->close(dev2);
+
+    // crash with torn commit block; no block is replayed
+    dev2 = crash_copy(dev);
+    block zeros;
+    memset(zeros, 0, sizeof(zeros));
+    int commit_blkno = fs->journal_base + 1 + (fs->journal_head - 1) % fs->journal_n_log;
+    dev2->ops->write(dev2, commit_blkno, 1, zeros);
+    fs2 = fs_mount_volume(dev2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs2);
+    for (int i = 1; i <= n_changed; i++) {
+        CU_ASSERT_EQUAL(fs_inode(fs2, i * per_blk)->mtime, 0);
+    }
+    fs_unmount_volume(fs2);
+    dev2->ops->close(dev2);
+    fs_unmount_volume(fs);
+
+    // changes larger than the log are split into transactions
+    opts.journal_blks = 64;
+    CU_ASSERT_EQUAL_FATAL(fs_format_volume_opts(dev, &opts), 0);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    n_changed = 100;
+    CU_ASSERT_TRUE_FATAL(fs_journal_capacity(fs) < n_changed);
+    for (int i = 1; i <= n_changed; i++) {
+        fs_inode_mut(fs, i * per_blk)->mtime = i;
+    }
+    seq = fs->journal_seq;
+    CU_ASSERT_EQUAL(fs_sync_metadata(fs), 0);
+    CU_ASSERT_EQUAL(fs->journal_seq, seq + 2);
+    CU_ASSERT_EQUAL(fs->n_dirty, 0);
+    dev2 = crash_copy(dev);
+    fs2 = fs_mount_volume(dev2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs2);
+    for (int i = 1; i <= n_changed; i++) {
+        CU_ASSERT_EQUAL(fs_inode(fs2, i * per_blk)->mtime, i);
+    }
+    fs_unmount_volume(fs2);
+    dev2->ops->close(dev2);
+
+    fs_unmount_volume(fs);
+    dev->ops->close(dev);
+}
+
+/**
+ * Test multi-operation transactions.
+ */
+static void test_txn(void) {
+    const int n_blks = 1000;
+    const mode_t file_mode = 0644;  // rw-r--r--
+
+    // create memory block device
+    struct fs_dev_blkdev *dev = memory_blkdev_create(n_blks);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+
+    // format volume with journal and mount it
+    int fmtstatus = fs_format_volume(dev, 0, 0);
+    CU_ASSERT_EQUAL_FATAL(fmtstatus, 0);
+    struct fs_ext2 *fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_EQUAL(fs_txn_commit(fs), -EINVAL);
+    CU_ASSERT_EQUAL(fs_txn_abort(fs), -EINVAL);
+
+    // publish a file with one metadata commit
+    char buf[8000];
+    for (int i = 0; i < (int)sizeof(buf); i++) {
+        buf[i] = 'a' + i % 26;
+    }
+    CU_ASSERT_EQUAL_FATAL(fs_txn_begin(fs), 0);
+    CU_ASSERT_EQUAL(fs_txn_begin(fs), -EBUSY);
+    long calls = fs->sync_stats.calls;
+    int file1_ino = fs_mkfile(fs, fs->root_inode, "file1", file_mode);
+    CU_ASSERT_TRUE_FATAL(file1_ino > 0);
+    CU_ASSERT_EQUAL(fs_pwritefile(fs, file1_ino, buf, sizeof(buf), 0), 0);
+    CU_ASSERT_EQUAL(fs_chmod(fs, file1_ino, 0600), 0);
+    CU_ASSERT_EQUAL(fs_chown(fs, file1_ino, 1002, 1003), 0);
+    CU_ASSERT_EQUAL(fs_utime(fs, file1_ino, 1000), 0);
+    CU_ASSERT_EQUAL(fs->sync_stats.calls, calls);
+    CU_ASSERT_TRUE(fs->n_dirty > 0);
+    CU_ASSERT_EQUAL(fs_txn_commit(fs), 0);
+    CU_ASSERT_EQUAL(fs->sync_stats.calls, calls + 1);
+    CU_ASSERT_EQUAL(fs->n_dirty, 0);
+
+    struct statvfs sb;
+    fs_statfs(fs, &sb);
+    int free_blks = sb.f_bfree;
+    int free_inodes = sb.f_ffree;
+
+    // abort rolls back new entries, allocations, and an indirect block
+    CU_ASSERT_EQUAL_FATAL(fs_txn_begin(fs), 0);
+    CU_ASSERT_TRUE(fs_mkfile(fs, fs->root_inode, "file2", file_mode) > 0);
+    CU_ASSERT_TRUE(fs_mkdir(fs, fs->root_inode, "dir1", file_mode) > 0);
+    CU_ASSERT_EQUAL(fs_lookup(fs, fs->root_inode, "file2") > 0, 1);
+    CU_ASSERT_EQUAL(fs_pwritefile(fs, file1_ino, buf, 100, 20000), 0);
+    CU_ASSERT_EQUAL(fs_chmod(fs, file1_ino, 0644), 0);
+    CU_ASSERT_EQUAL(fs_txn_abort(fs), 0);
+    CU_ASSERT_EQUAL(fs->n_dirty, 0);
+
+    CU_ASSERT_EQUAL(fs_lookup(fs, fs->root_inode, "file2"), -ENOENT);
+    CU_ASSERT_EQUAL(fs_lookup(fs, fs->root_inode, "dir1"), -ENOENT);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->size, sizeof(buf));
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->mode, S_IFREG | 0600);
+    CU_ASSERT_EQUAL(fs_bmap(fs, file1_ino, 20000 / FS_BLOCK_SIZE, 0, NULL), 0);
+    fs_statfs(fs, &sb);
+    CU_ASSERT_EQUAL(sb.f_bfree, free_blks);
+    CU_ASSERT_EQUAL(sb.f_ffree, free_inodes);
+
+    // committed file survives remount unchanged
+    fs_unmount_volume(fs);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_EQUAL(fs_lookup(fs, fs->root_inode, "file1"), file1_ino);
+    CU_ASSERT_EQUAL(fs_lookup(fs, fs->root_inode, "file2"), -ENOENT);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->uid, 1002);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->mtime, 1000);
+    char rbuf[sizeof(buf)];
+    CU_ASSERT_EQUAL(fs_readfile(fs, file1_ino, rbuf, sizeof(rbuf)), sizeof(rbuf));
+    CU_ASSERT_EQUAL(memcmp(buf, rbuf, sizeof(buf)), 0);
+
+    // explicit syncs cannot write part of a transaction
+    CU_ASSERT_EQUAL_FATAL(fs_txn_begin(fs), 0);
+    CU_ASSERT_EQUAL(fs_chmod(fs, file1_ino, 0644), 0);
+    CU_ASSERT_EQUAL(fs_fsync(fs, file1_ino), -EBUSY);
+    CU_ASSERT_EQUAL(fs_syncfs(fs), -EBUSY);
+    CU_ASSERT_EQUAL(fs_set_sync_policy(fs, FS_SYNC_WRITEBACK, 1000, 3600), -EBUSY);
+    CU_ASSERT_EQUAL(fs->sync_mode, FS_SYNC_ALWAYS);
+    CU_ASSERT_EQUAL(fs_txn_abort(fs), 0);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->mode, S_IFREG | 0600);
+
+    // unmount discards an active transaction
+    CU_ASSERT_EQUAL_FATAL(fs_txn_begin(fs), 0);
+    CU_ASSERT_EQUAL(fs_chmod(fs, file1_ino, 0644), 0);
+    CU_ASSERT_TRUE(fs_mkfile(fs, fs->root_inode, "file3", file_mode) > 0);
+    fs_unmount_volume(fs);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->mode, S_IFREG | 0600);
+    CU_ASSERT_EQUAL(fs_lookup(fs, fs->root_inode, "file3"), -ENOENT);
+
+    // crash before commit leaves no part of the transaction
+    CU_ASSERT_EQUAL_FATAL(fs_txn_begin(fs), 0);
+    CU_ASSERT_TRUE(fs_mkfile(fs, fs->root_inode, "file4", file_mode) > 0);
+    CU_ASSERT_EQUAL(fs_chmod(fs, file1_ino, 0644), 0);
+    struct fs_dev_blkdev *dev2 = crash_copy(dev);
+    struct fs_ext2 *fs2 = fs_mount_volume(dev2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs2);
+    CU_ASSERT_EQUAL(fs_lookup(fs2, fs2->root_inode, "file4"), -ENOENT);
+    CU_ASSERT_EQUAL(fs_inode(fs2, file1_ino)->mode, S_IFREG | 0600);
+    fs_unmount_volume(fs2);
+    dev2->ops->close(dev2);
+    CU_ASSERT_EQUAL(fs_txn_commit(fs), 0);
+    dev2 = crash_copy(dev);
+    fs2 = fs_mount_volume(dev2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs2);
+    CU_ASSERT_EQUAL(fs_lookup(fs2, fs2->root_inode, "file4") > 0, 1);
+    CU_ASSERT_EQUAL(fs_inode(fs2, file1_ino)->mode, S_IFREG | 0644);
+    fs_unmount_volume(fs2);
+    dev2->ops->close(dev2);
+    fs_unmount_volume(fs);
+
+    // transaction larger than the journal cannot commit
+    struct fs_format_opts opts = {.journal_blks = FS_JOURNAL_MIN};
+    CU_ASSERT_EQUAL_FATAL(fs_format_volume_opts(dev, &opts), 0);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    fs_statfs(fs, &sb);
+    free_blks = sb.f_bfree;
+    CU_ASSERT_EQUAL_FATAL(fs_txn_begin(fs), 0);
+    int dir_ino = fs->root_inode;
+    for (int i = 0; (i < FS_JOURNAL_MIN) && (dir_ino > 0); i++) {
+        dir_ino = fs_mkdir(fs, dir_ino, "dir0", file_mode);  // changes parent block
+    }
+    CU_ASSERT_TRUE(dir_ino > 0);
+    CU_ASSERT_TRUE(fs->n_dirty > fs_journal_capacity(fs));
+    CU_ASSERT_EQUAL(fs_txn_commit(fs), -EFBIG);
+    CU_ASSERT_EQUAL(fs_txn_abort(fs), 0);
+    CU_ASSERT_EQUAL(fs_lookup(fs, fs->root_inode, "dir0"), -ENOENT);
+    fs_statfs(fs, &sb);
+    CU_ASSERT_EQUAL(sb.f_bfree, free_blks);
+    fs_unmount_volume(fs);
+
+    // without a journal, blocks are not written until commit
+    opts.journal_blks = 0;
+    CU_ASSERT_EQUAL_FATAL(fs_format_volume_opts(dev, &opts), 0);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    int root_blk = fs_bmap(fs, fs->root_inode, 0, 0, NULL);
+    CU_ASSERT_TRUE_FATAL(root_blk > 0);
+    block before, after;
+    dev->ops->read(dev, root_blk, 1, before);
+    CU_ASSERT_EQUAL_FATAL(fs_txn_begin(fs), 0);
+    CU_ASSERT_TRUE(fs_mkfile(fs, fs->root_inode, "file5", file_mode) > 0);
+    dev->ops->read(dev, root_blk, 1, after);
+    CU_ASSERT_EQUAL(memcmp(before, after, FS_BLOCK_SIZE), 0);
+    CU_ASSERT_EQUAL(fs_txn_abort(fs), 0);
+    CU_ASSERT_EQUAL(fs_lookup(fs, fs->root_inode, "file5"), -ENOENT);
+    dev->ops->read(dev, root_blk, 1, after);
+    CU_ASSERT_EQUAL(memcmp(before, after, FS_BLOCK_SIZE), 0);
+    CU_ASSERT_EQUAL_FATAL(fs_txn_begin(fs), 0);
+    CU_ASSERT_TRUE(fs_mkfile(fs, fs->root_inode, "file5", file_mode) > 0);
+    CU_ASSERT_EQUAL(fs_txn_commit(fs), 0);
+    dev->ops->read(dev, root_blk, 1, after);
+    CU_ASSERT_NOT_EQUAL(memcmp(before, after, FS_BLOCK_SIZE), 0);
+    fs_unmount_volume(fs);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_EQUAL(fs_lookup(fs, fs->root_inode, "file5") > 0, 1);
+
+    // unmount file system volume and close device
+    fs_unmount_volume(fs);
+    dev->ops->close(dev);
+}
+
+/**
+ * Exercise a volume formatted with a block size.
+ *
+ * @param blk_size the block size in bytes
+ */
+static void check_block_size(int blk_size) {
+    const int n_dev_blks = 16000;
+    const int ratio = blk_size / BLOCK_SIZE;
+    const int n_files = 2*DIRENTS_PER_BLK(blk_size) + 10;
+    const int n_file_blks = N_DIRECT + 2;  // into single-indirect
+    const int n_frag_blks = 2*N_INODE_EXTENTS + 2;
+    const mode_t file_mode = 0644;  // rw-r--r--
+    char name[FS_FILENAME_SIZE];
+
+    // create memory block device
+    struct fs_dev_blkdev *dev = memory_blkdev_create(n_dev_blks);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+
+    // format volume with block size and a journal, then mount it
+    struct fs_format_opts opts = {.journal_blks = 64, .blk_size = blk_size, .n_inodes = 2*n_files};
+    CU_ASSERT_EQUAL_FATAL(fs_format_volume_opts(dev, &opts), 0);
+    struct fs_ext2 *fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_EQUAL(fs->blk_size, blk_size);
+    CU_ASSERT_EQUAL(fs->super->blk_size, blk_size);
+    CU_ASSERT_EQUAL(fs->n_blocks, n_dev_blks / ratio);
+    struct statvfs sb;
+    fs_statfs(fs, &sb);
+    CU_ASSERT_EQUAL(sb.f_bsize, blk_size);
+    CU_ASSERT_EQUAL(sb.f_blocks, n_dev_blks / ratio);
+    int free_blks = sb.f_bfree;
+
+    // fill each block with a distinct byte
+    static char msg[(N_DIRECT + 2*N_INODE_EXTENTS + 4)*FS_MAX_BLOCK_SIZE];
+    static char readbuf[sizeof(msg)];
+    for (int i = 0; i < n_file_blks + n_frag_blks; i++) {
+        memset(msg + i*blk_size, 'a' + i%26, blk_size);
+    }
+
+    // directory with more entries than fit in a block is indexed
+    int dir_ino = fs_mkdir(fs, fs->root_inode, "dir1", 0755);
+    CU_ASSERT_TRUE_FATAL(dir_ino > 0);
+    for (int i = 0; i < n_files; i++) {
+        sprintf(name, "file%d", i);
+        CU_ASSERT_TRUE_FATAL(fs_mkfile(fs, dir_ino, name, file_mode) > 0);
+    }
+    CU_ASSERT_NOT_EQUAL(fs_inode(fs, dir_ino)->flags & FS_INODE_INDEX, 0);
+    sprintf(name, "file%d", n_files-1);
+    CU_ASSERT_TRUE(fs_lookup(fs, dir_ino, name) > 0);
+    CU_ASSERT_EQUAL(fs_mkfile(fs, dir_ino, name, file_mode), -EEXIST);
+
+    // file spans direct and single-indirect blocks
+    int file1_ino = fs_mkfile(fs, fs->root_inode, "file1", file_mode);
+    CU_ASSERT_TRUE_FATAL(file1_ino > 0);
+    int msglen = n_file_blks*blk_size;
+    CU_ASSERT_EQUAL(fs_writefile(fs, file1_ino, msg, msglen), 0);
+    CU_ASSERT_NOT_EQUAL(fs_inode(fs, file1_ino)->indir_1, 0);
+    CU_ASSERT_EQUAL(fs_preadfile(fs, file1_ino, readbuf, msglen - 100, 50), msglen - 100);
+    CU_ASSERT_EQUAL(memcmp(readbuf, msg + 50, msglen - 100), 0);
+    struct stat st;
+    CU_ASSERT_EQUAL(fs_stat(fs, file1_ino, &st), 0);
+    CU_ASSERT_EQUAL(st.st_blksize, blk_size);
+    CU_ASSERT_EQUAL(st.st_blocks, n_file_blks * (blk_size / 512));
+
+    // committed transaction replays after a crash
+    CU_ASSERT_EQUAL_FATAL(fs_txn_begin(fs), 0);
+    CU_ASSERT_EQUAL(fs_chmod(fs, file1_ino, 0600), 0);
+    CU_ASSERT_TRUE(fs_mkfile(fs, fs->root_inode, "file2", file_mode) > 0);
+    CU_ASSERT_EQUAL(fs_txn_commit(fs), 0);
+    struct fs_dev_blkdev *dev2 = crash_copy(dev);
+    struct fs_ext2 *fs2 = fs_mount_volume(dev2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs2);
+    CU_ASSERT_EQUAL(fs_inode(fs2, file1_ino)->mode, S_IFREG | 0600);
+    CU_ASSERT_TRUE(fs_lookup(fs2, fs2->root_inode, "file2") > 0);
+    CU_ASSERT_EQUAL(fs_unmount_volume(fs2), dev2);
+    dev2->ops->close(dev2);
+
+    // paged mount reads the same volume
+    CU_ASSERT_EQUAL(fs_unmount_volume(fs), dev);
+    struct fs_mount_opts mopts = {.mcache_blks = FS_MCACHE_MIN_BLKS};
+    fs = fs_mount_volume_opts(dev, &mopts);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_EQUAL(fs_lookup(fs, dir_ino, name) > 0, 1);
+    CU_ASSERT_EQUAL(fs_readfile(fs, file1_ino, readbuf, msglen), msglen);
+    CU_ASSERT_EQUAL(memcmp(readbuf, msg, msglen), 0);
+
+    // truncate and unlink free the file blocks
+    CU_ASSERT_EQUAL(fs_truncfile(fs, file1_ino, blk_size), 0);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->indir_1, 0);
+    CU_ASSERT_EQUAL(fs_unlinkfile(fs, fs->root_inode, "file1"), 0);
+    CU_ASSERT_EQUAL(fs_unlinkfile(fs, fs->root_inode, "file2"), 0);
+    for (int i = 0; i < n_files; i++) {
+        sprintf(name, "file%d", i);
+        CU_ASSERT_EQUAL(fs_unlinkfile(fs, dir_ino, name), 0);
+    }
+    CU_ASSERT_EQUAL(fs_rmdir(fs, fs->root_inode, "dir1"), 0);
+    fs_statfs(fs, &sb);
+    CU_ASSERT_EQUAL(sb.f_bfree, free_blks);
+    CU_ASSERT_EQUAL(fs_unmount_volume(fs), dev);
+
+    // fragmented extents file overflows into an extent block
+    opts = (struct fs_format_opts){.journal_blks = 0, .extents = 1, .blk_size = blk_size};
+    CU_ASSERT_EQUAL_FATAL(fs_format_volume_opts(dev, &opts), 0);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    int file3_ino = fs_mkfile(fs, fs->root_inode, "file3", file_mode);
+    int file4_ino = fs_mkfile(fs, fs->root_inode, "file4", file_mode);
+    CU_ASSERT_TRUE_FATAL((file3_ino > 0) && (file4_ino > 0));
+    for (int i = 0; i < n_frag_blks; i++) {
+        CU_ASSERT_EQUAL_FATAL(fs_pwritefile(fs, file3_ino, msg + i*blk_size, blk_size, i*blk_size), 0);
+        CU_ASSERT_EQUAL_FATAL(fs_pwritefile(fs, file4_ino, msg + i*blk_size, blk_size, i*blk_size), 0);
+    }
+    CU_ASSERT_NOT_EQUAL(fs_inode(fs, file3_ino)->ext.overflow, 0);
+    CU_ASSERT_EQUAL(fs_unmount_volume(fs), dev);
+    fs = fs_mount_volume(dev);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fs);
+    CU_ASSERT_EQUAL(fs_readfile(fs, file3_ino, readbuf, n_frag_blks*blk_size), n_frag_blks*blk_size);
+    CU_ASSERT_EQUAL(memcmp(readbuf, msg, n_frag_blks*blk_size), 0);
+
+    // unmount returns the device formatted
+    CU_ASSERT_EQUAL(fs_unmount_volume(fs), dev);
+    dev->ops->close(dev);
+}
+
+/**
+ * Test volumes formatted with each supported block size.
+ */
+static void test_block_sizes(void) {
+    for (int blk_size = FS_MIN_BLOCK_SIZE; blk_size <= FS_MAX_BLOCK_SIZE; blk_size *= 2) {
+        check_block_size(blk_size);
+    }
+}
+
 /*++ Optional function tests ++*/
 
 /**
@@ -916,10 +3150,10 @@ void test_pio(void) {
     CU_ASSERT_TRUE(file1_ino > 0);
 
     // verify file1 is empty
-    CU_ASSERT_EQUAL(fs->inodes[file1_ino].size, 0);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->size, 0);
 
     // get file1 mod time for comparison
-    int file1_time = fs->inodes[file1_ino].mtime;
+    int file1_time = fs_inode(fs, file1_ino)->mtime;
     sleep(1); // time passes
 
     // initialize block with half 'a's and half 'b's
@@ -935,9 +3169,9 @@ void test_pio(void) {
     // ensure successful write
     CU_ASSERT_EQUAL(status, 0);
     // ensure inode size matches
-    CU_ASSERT_EQUAL(fs->inodes[file1_ino].size, FS_BLOCK_SIZE);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->size, FS_BLOCK_SIZE);
     // ensure mode time has changed
-    CU_ASSERT_NOT_EQUAL(fs->inodes[file1_ino].mtime, file1_time);
+    CU_ASSERT_NOT_EQUAL(fs_inode(fs, file1_ino)->mtime, file1_time);
 
     // read upper-half block written to file1
     char readbuf[FS_BLOCK_SIZE];
@@ -961,7 +3195,7 @@ void test_pio(void) {
     // ensure successful write
     CU_ASSERT_EQUAL(status, 0);
     // ensure inode size matches
-    CU_ASSERT_EQUAL(fs->inodes[file1_ino].size, FS_BLOCK_SIZE);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->size, FS_BLOCK_SIZE);
 
     // read entire block
     nread = fs_preadfile(fs, file1_ino, readbuf, FS_BLOCK_SIZE, 0);
@@ -1000,23 +3234,23 @@ void test_chown_chmod_utime(void) {
     CU_ASSERT_TRUE(file1_ino > 0);
 
     // verify file1 is empty
-    CU_ASSERT_EQUAL(fs->inodes[file1_ino].size, 0);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->size, 0);
 
     // set file1 user to 1 and group to 2
     int status = fs_chown(fs, file1_ino, 1, 2);
     CU_ASSERT_EQUAL(status, 0);
-    CU_ASSERT_EQUAL(fs->inodes[file1_ino].uid, 1);
-    CU_ASSERT_EQUAL(fs->inodes[file1_ino].gid, 2);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->uid, 1);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->gid, 2);
 
     // set file1 access mode to 0111
     status = fs_chmod(fs, file1_ino, 0111);
     CU_ASSERT_EQUAL(status, 0);
-    CU_ASSERT_EQUAL(fs->inodes[file1_ino].mode & 0777, 0111);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->mode & 0777, 0111);
 
     // set file1 mod time to 1
     status = fs_utime(fs, file1_ino, 1);
     CU_ASSERT_EQUAL(status, 0);
-    CU_ASSERT_EQUAL(fs->inodes[file1_ino].mtime, 1);
+    CU_ASSERT_EQUAL(fs_inode(fs, file1_ino)->mtime, 1);
 
     // unmount file system volume and close device
     fs_unmount_volume(fs);
@@ -1037,17 +3271,39 @@ static CU_ErrorCode test_all() {
 
     // add the tests to the suite
     CU_add_test(pSuite, "test_mem_device", test_mem_device);
+    CU_add_test(pSuite, "test_cache_device", test_cache_device);
+    CU_add_test(pSuite, "test_image_device", test_image_device);
+    CU_add_test(pSuite, "test_mmap_device", test_mmap_device);
+    CU_add_test(pSuite, "test_uring_device", test_uring_device);
     CU_add_test(pSuite, "test_volume", test_volume);
     CU_add_test(pSuite, "test_file_cpcd", test_file_cpcd);
     CU_add_test(pSuite, "test_file_cpci", test_file_cpci);
     CU_add_test(pSuite, "test_dir", test_dir);
     CU_add_test(pSuite, "test_link", test_link);
     CU_add_test(pSuite, "test_readdir", test_readdir);
+    CU_add_test(pSuite, "test_bigdir", test_bigdir);
+    CU_add_test(pSuite, "test_lookup", test_lookup);
     CU_add_test(pSuite, "test_io", test_io);
     CU_add_test(pSuite, "test_trunc", test_trunc);
+    CU_add_test(pSuite, "test_bigfile", test_bigfile);
     CU_add_test(pSuite, "test_stat", test_stat);
     CU_add_test(pSuite, "test_statfs", test_statfs);
+    CU_add_test(pSuite, "test_bitmap", test_bitmap);
+    CU_add_test(pSuite, "test_freetree", test_freetree);
+    CU_add_test(pSuite, "test_groups", test_groups);
+    CU_add_test(pSuite, "test_alloc_goal", test_alloc_goal);
+    CU_add_test(pSuite, "test_extents", test_extents);
+    CU_add_test(pSuite, "test_lazy_itable", test_lazy_itable);
+    CU_add_test(pSuite, "test_inode_ratio", test_inode_ratio);
+    CU_add_test(pSuite, "test_paged_mount", test_paged_mount);
+    CU_add_test(pSuite, "test_alloc_orlov", test_alloc_orlov);
     CU_add_test(pSuite, "test_sync_meta", test_sync_meta);
+    CU_add_test(pSuite, "test_sync_policy", test_sync_policy);
+    CU_add_test(pSuite, "test_journal", test_journal);
+    CU_add_test(pSuite, "test_journal_blocks", test_journal_blocks);
+    CU_add_test(pSuite, "test_journal_large", test_journal_large);
+    CU_add_test(pSuite, "test_txn", test_txn);
+    CU_add_test(pSuite, "test_block_sizes", test_block_sizes);
 
     // add thee optional function tests to the suite
     CU_add_test(pSuite, "test_pio", test_pio);
@@ -0,0 +1,132 @@
+/*
+ * fs_dev_blkdev.c
+ *
+ * description: asynchronous and scatter-gather request
+ * functions for block devices for CS 7600 / CS 5600
+ * file system
+ *
+ * Peter Desnoyers, Northeastern Computer Science, 2011
+ * Philip Gust, Northeastern Computer Science, 2019
+ */
+
+#include <stdlib.h>
+
+#include "fs_dev_blkdev.h"
+
+/**
+ * Submit an asynchronous request to a block device. The
+ * request and its buffer must remain valid until it
+ * completes. A device without asynchronous operations
+ * performs the request before returning.
+ *
+ * @param dev the block device
+ * @param req the request
+ * @return SUCCESS if submitted, E_UNAVAIL if device unavailable
+ */
+int blkdev_submit(struct fs_dev_blkdev *dev, struct blkdev_req *req)
+{
+    if (dev->ops->submit != NULL) {
+        req->status = BLKDEV_PENDING;
+        return dev->ops->submit(dev, req);
+    }
+
+    // perform request synchronously
+    if (req->op == BLKDEV_READ) {
+        req->status = dev->ops->read(dev, req->first_blk, req->num_blks, req->buf);
+    } else {
+        req->status = dev->ops->write(dev, req->first_blk, req->num_blks, req->buf);
+    }
+    if (req->callback != NULL) {
+        req->callback(req);
+    }
+    return SUCCESS;
+}
+
+/**
+ * Wait for an asynchronous request to complete.
+ *
+ * @param dev the block device
+ * @param req the request, or NULL to wait for all requests
+ * @return the request status, or SUCCESS if req is NULL
+ */
+int blkdev_wait(struct fs_dev_blkdev *dev, struct blkdev_req *req)
+{
+    if (dev->ops->wait != NULL) {
+        return dev->ops->wait(dev, req);
+    }
+    return (req != NULL) ? req->status : SUCCESS;  // already complete
+}
+
+/**
+ * Find the length of a run of adjacent blocks in
+ * adjacent buffers.
+ *
+ * @param iov the blocks and their buffers
+ * @param n the number of blocks
+ * @return the number of blocks in the run
+ */
+static int iov_run(struct blkdev_iovec *iov, int n)
+{
+    int len = 1;
+    while (   (len < n) && (iov[len].blkno == iov[0].blkno + len)
+           && ((char*)iov[len].buf == (char*)iov[0].buf + len*BLOCK_SIZE)) {
+        len++;
+    }
+    return len;
+}
+
+/**
+ * Read a list of possibly discontiguous blocks from a block
+ * device. A device without scatter-gather operations reads
+ * each run of adjacent blocks into adjacent buffers with
+ * one call.
+ *
+ * @param dev the block device
+ * @param iov the blocks and their buffers
+ * @param n the number of blocks
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+int blkdev_readv(struct fs_dev_blkdev *dev, struct blkdev_iovec *iov, int n)
+{
+    if (dev->ops->readv != NULL) {
+        return dev->ops->readv(dev, iov, n);
+    }
+    for (int i = 0; i < n; ) {
+        int len = iov_run(iov+i, n-i);
+        int status = dev->ops->read(dev, iov[i].blkno, len, iov[i].buf);
+        if (status != SUCCESS) {
+            return status;
+        }
+        i += len;
+    }
+    return SUCCESS;
+}
+
+/**
+ * Write a list of possibly discontiguous blocks to a block
+ * device. A device without scatter-gather operations writes
+ * each run of adjacent blocks from adjacent buffers with
+ * one call.
+ *
+ * @param dev the block device
+ * @param iov the blocks and their buffers
+ * @param n the number of blocks
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+int blkdev_writev(struct fs_dev_blkdev *dev, struct blkdev_iovec *iov, int n)
+{
+    if (dev->ops->writev != NULL) {
+        return dev->ops->writev(dev, iov, n);
+    }
+    for (int i = 0; i < n; ) {
+        int len = iov_run(iov+i, n-i);
+        int status = dev->ops->write(dev, iov[i].blkno, len, iov[i].buf);
+        if (status != SUCCESS) {
+            return status;
+        }
+        i += len;
+    }
+    return SUCCESS;
+}
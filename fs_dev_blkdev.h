@@ -8,6 +8,7 @@
  */
 #ifndef __BLKDEV_H__
 #define __BLKDEV_H__
+#include <stddef.h>
 #include <stdint.h>
 
 /**  block device block size */
@@ -19,6 +20,34 @@ typedef uint8_t block[BLOCK_SIZE];
 /** block device operation status */
 enum {SUCCESS = 0, E_BADADDR = -1, E_UNAVAIL = -2, E_SIZE = -3};
 
+/** asynchronous request operation */
+enum {BLKDEV_READ = 0, BLKDEV_WRITE = 1};
+
+/** asynchronous request status while in progress */
+enum {BLKDEV_PENDING = 1};
+
+/** Definition of an asynchronous block request */
+struct blkdev_req {
+    int op;						/* BLKDEV_READ or BLKDEV_WRITE */
+    int first_blk;				/* first block */
+    int num_blks;				/* number of blocks */
+    void *buf;					/* buffer for blocks */
+    int status;					/* BLKDEV_PENDING, then completion status */
+    void (*callback)(struct blkdev_req *req);	/* called on completion, or NULL */
+    void *data;					/* caller data, not used by device */
+
+    /* private to device */
+    size_t done;				/* bytes transferred */
+    int reap;					/* 1 if queued for device-specific reaping */
+    struct blkdev_req *next;	/* next completed request */
+};
+
+/** Definition of a scatter-gather element for one block */
+struct blkdev_iovec {
+    int blkno;					/* block number */
+    void *buf;					/* buffer for block */
+};
+
 /** Definition of a block device */
 struct fs_dev_blkdev {
     struct blkdev_ops *ops;		/* operations on block device */
@@ -32,6 +61,61 @@ struct blkdev_ops {
     int  (*write)(struct fs_dev_blkdev *dev, int first_blk, int num_blks, void *buf);
     int  (*flush)(struct fs_dev_blkdev *dev, int first_blk, int num_blks);
     void (*close)(struct fs_dev_blkdev *dev);
+
+    /* optional asynchronous operations, NULL if not supported */
+    int  (*submit)(struct fs_dev_blkdev *dev, struct blkdev_req *req);
+    int  (*wait)(struct fs_dev_blkdev *dev, struct blkdev_req *req);
+    int  (*readv)(struct fs_dev_blkdev *dev, struct blkdev_iovec *iov, int n);
+    int  (*writev)(struct fs_dev_blkdev *dev, struct blkdev_iovec *iov, int n);
 };
 
+/**
+ * Submit an asynchronous request to a block device. The
+ * request and its buffer must remain valid until it
+ * completes. A device without asynchronous operations
+ * performs the request before returning.
+ *
+ * @param dev the block device
+ * @param req the request
+ * @return SUCCESS if submitted, E_UNAVAIL if device unavailable
+ */
+extern int blkdev_submit(struct fs_dev_blkdev *dev, struct blkdev_req *req);
+
+/**
+ * Wait for an asynchronous request to complete.
+ *
+ * @param dev the block device
+ * @param req the request, or NULL to wait for all requests
+ * @return the request status, or SUCCESS if req is NULL
+ */
+extern int blkdev_wait(struct fs_dev_blkdev *dev, struct blkdev_req *req);
+
+/**
+ * Read a list of possibly discontiguous blocks from a block
+ * device. A device without scatter-gather operations reads
+ * each run of adjacent blocks into adjacent buffers with
+ * one call.
+ *
+ * @param dev the block device
+ * @param iov the blocks and their buffers
+ * @param n the number of blocks
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+extern int blkdev_readv(struct fs_dev_blkdev *dev, struct blkdev_iovec *iov, int n);
+
+/**
+ * Write a list of possibly discontiguous blocks to a block
+ * device. A device without scatter-gather operations writes
+ * each run of adjacent blocks from adjacent buffers with
+ * one call.
+ *
+ * @param dev the block device
+ * @param iov the blocks and their buffers
+ * @param n the number of blocks
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+extern int blkdev_writev(struct fs_dev_blkdev *dev, struct blkdev_iovec *iov, int n);
+
 #endif
@@ -0,0 +1,438 @@
+/*
+ * fs_dev_cachedev.c
+ *
+ * description: block buffer cache device layered over
+ * another block device for CS 7600 / CS 5600 file system
+ *
+ * Peter Desnoyers, Northeastern Computer Science, 2011
+ * Philip Gust, Northeastern Computer Science, 2019
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fs_dev_cachedev.h"
+
+/** Definition of a cache buffer */
+struct cache_buf {
+    int blkno;				// cached block number, -1 if free
+    int dirty;				// 1 if not yet written to device
+    int next;				// next buffer in hash bucket or free list
+    int lru_prev, lru_next;	// least recently used list
+};
+
+/** Definition of cache block device */
+struct cache_dev {
+    struct fs_dev_blkdev *dev;	// underlying device
+    int nblks;					// number of blocks in device
+    int policy;					// write policy
+    int n_bufs;					// number of buffers
+    block *data;				// buffer contents
+    struct cache_buf *bufs;		// buffer headers
+    int n_buckets;				// number of hash buckets (power of 2)
+    int *buckets;				// first buffer in each bucket
+    int free;					// first free buffer
+    int lru_head, lru_tail;		// most and least recently used buffers
+    struct cache_buf **order;	// dirty buffers sorted for writeback
+    struct cache_blkdev_stats stats;	// cache statistics
+};
+
+/**
+ * Find the link to a cached block in its hash bucket.
+ *
+ * @param pvt the cache device
+ * @param blkno the block number
+ * @return pointer to link to buffer, or to -1 if not cached
+ */
+static int *cache_find(struct cache_dev *pvt, int blkno)
+{
+    int *link = &pvt->buckets[blkno & (pvt->n_buckets-1)];
+    while ((*link >= 0) && (pvt->bufs[*link].blkno != blkno)) {
+        link = &pvt->bufs[*link].next;
+    }
+    return link;
+}
+
+/**
+ * Remove a buffer from the least recently used list.
+ *
+ * @param pvt the cache device
+ * @param i the buffer
+ */
+static void lru_unlink(struct cache_dev *pvt, int i)
+{
+    struct cache_buf *b = &pvt->bufs[i];
+    if (b->lru_prev >= 0) {
+        pvt->bufs[b->lru_prev].lru_next = b->lru_next;
+    } else {
+        pvt->lru_head = b->lru_next;
+    }
+    if (b->lru_next >= 0) {
+        pvt->bufs[b->lru_next].lru_prev = b->lru_prev;
+    } else {
+        pvt->lru_tail = b->lru_prev;
+    }
+}
+
+/**
+ * Add a buffer at the head of the least recently used list.
+ *
+ * @param pvt the cache device
+ * @param i the buffer
+ */
+static void lru_push(struct cache_dev *pvt, int i)
+{
+    struct cache_buf *b = &pvt->bufs[i];
+    b->lru_prev = -1;
+    b->lru_next = pvt->lru_head;
+    if (pvt->lru_head >= 0) {
+        pvt->bufs[pvt->lru_head].lru_prev = i;
+    } else {
+        pvt->lru_tail = i;
+    }
+    pvt->lru_head = i;
+}
+
+/**
+ * Get a buffer for a block that is not cached, evicting
+ * the least recently used buffer if none are free. A
+ * dirty evicted buffer is written to the device first.
+ *
+ * @param pvt the cache device
+ * @param blkno the block number
+ * @return the buffer, or -1 if a dirty buffer cannot be written
+ */
+static int cache_alloc(struct cache_dev *pvt, int blkno)
+{
+    if (pvt->free < 0) {
+        // evict least recently used buffer
+        int i = pvt->lru_tail;
+        struct cache_buf *b = &pvt->bufs[i];
+        if (b->dirty) {
+            if (pvt->dev->ops->write(pvt->dev, b->blkno, 1, pvt->data[i]) != SUCCESS) {
+                return -1;
+            }
+            pvt->stats.writebacks++;
+        }
+        int *link = cache_find(pvt, b->blkno);
+        *link = b->next;
+        lru_unlink(pvt, i);
+        b->next = pvt->free;
+        pvt->free = i;
+    }
+
+    // add free buffer to hash bucket for block
+    int i = pvt->free;
+    struct cache_buf *b = &pvt->bufs[i];
+    pvt->free = b->next;
+    b->blkno = blkno;
+    b->dirty = 0;
+    int *bucket = &pvt->buckets[blkno & (pvt->n_buckets-1)];
+    b->next = *bucket;
+    *bucket = i;
+    lru_push(pvt, i);
+    return i;
+}
+
+/**
+ * Compare buffers by block number.
+ *
+ * @param a pointer to first buffer
+ * @param b pointer to second buffer
+ * @return <0, 0, or >0 as first block is before, same, or after
+ */
+static int buf_compare(const void *a, const void *b)
+{
+    int blk_a = (*(struct cache_buf *const *)a)->blkno;
+    int blk_b = (*(struct cache_buf *const *)b)->blkno;
+    return (blk_a > blk_b) - (blk_a < blk_b);
+}
+
+/**
+ * Write dirty buffers in a block range to the device,
+ * combining adjacent dirty blocks into one write. Only
+ * the buffers are scanned, so the cost does not depend
+ * on the size of the range. Blocks remain dirty if their
+ * write fails.
+ *
+ * @param pvt the cache device
+ * @param offset starting block offset
+ * @param len number of blocks
+ * @return SUCCESS if successful, or device error
+ */
+static int cache_writeback(struct cache_dev *pvt, int offset, int len)
+{
+    // collect dirty buffers in range in block order
+    int n = 0;
+    for (int i = 0; i < pvt->n_bufs; i++) {
+        struct cache_buf *b = &pvt->bufs[i];
+        if (b->dirty && (b->blkno >= offset) && (b->blkno < offset + len)) {
+            pvt->order[n++] = b;
+        }
+    }
+    qsort(pvt->order, n, sizeof(struct cache_buf *), buf_compare);
+
+    block run[16];  // bounded staging buffer for adjacent blocks
+    for (int k = 0; k < n; ) {
+        int run_first = pvt->order[k]->blkno;
+        int run_len = 0;
+        do {
+            memcpy(run[run_len], pvt->data[pvt->order[k+run_len] - pvt->bufs], BLOCK_SIZE);
+            run_len++;
+        } while (   (k+run_len < n) && (run_len < 16)
+                 && (pvt->order[k+run_len]->blkno == run_first + run_len));
+
+        int status = pvt->dev->ops->write(pvt->dev, run_first, run_len, run);
+        if (status != SUCCESS) {
+            return status;  // blocks of run remain dirty
+        }
+        for (int j = k; j < k + run_len; j++) {
+            pvt->order[j]->dirty = 0;
+        }
+        pvt->stats.writebacks += run_len;
+        k += run_len;
+    }
+    return SUCCESS;
+}
+
+/**
+ * The number of blocks in the block device.
+ *
+ * @param the block device
+ */
+static int cachedev_num_blocks(struct fs_dev_blkdev *dev)
+{
+    struct cache_dev *pvt = dev->private;
+    return pvt->nblks;
+}
+
+/**
+ * Read blocks from block device starting at give block offset.
+ * Cached blocks are copied from the cache; adjacent uncached
+ * blocks are read from the device in one call and cached.
+ *
+ * @param dev the block device
+ * @param offset starting block offset
+ * @param len number of blocks to read
+ * @param buf the input buffer
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+static int cachedev_read(struct fs_dev_blkdev *dev, int offset, int len, void *buf)
+{
+    struct cache_dev *pvt = dev->private;
+    if (offset < 0 || offset+len > pvt->nblks) {
+        return E_SIZE;
+    }
+
+    block *out = buf;
+    for (int n = 0; n < len; ) {
+        int i = *cache_find(pvt, offset+n);
+        if (i >= 0) {
+            // copy cached block
+            memcpy(out[n], pvt->data[i], BLOCK_SIZE);
+            lru_unlink(pvt, i);
+            lru_push(pvt, i);
+            pvt->stats.hits++;
+            n++;
+            continue;
+        }
+
+        // read run of uncached blocks from device
+        int run = 1;
+        while ((n+run < len) && (*cache_find(pvt, offset+n+run) < 0)) {
+            run++;
+        }
+        int status = pvt->dev->ops->read(pvt->dev, offset+n, run, out[n]);
+        if (status != SUCCESS) {
+            return status;
+        }
+        pvt->stats.misses += run;
+
+        // cache blocks read from device
+        for (int k = 0; k < run; k++) {
+            if ((i = cache_alloc(pvt, offset+n+k)) >= 0) {
+                memcpy(pvt->data[i], out[n+k], BLOCK_SIZE);
+            }
+        }
+        n += run;
+    }
+    return SUCCESS;
+}
+
+/**
+ * Write blocks to block device starting at give block offset.
+ * With write-through policy blocks are also written to the
+ * device; with write-back policy they are written on flush
+ * or eviction.
+ *
+ * @param dev the block device
+ * @param offset starting block offset
+ * @param len number of blocks to write
+ * @param buf the output buffer
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+static int cachedev_write(struct fs_dev_blkdev *dev, int offset, int len, void *buf)
+{
+    struct cache_dev *pvt = dev->private;
+    if (offset < 0 || offset+len > pvt->nblks) {
+        return E_SIZE;
+    }
+
+    if (pvt->policy == CACHE_WRITE_THROUGH) {
+        int status = pvt->dev->ops->write(pvt->dev, offset, len, buf);
+        if (status != SUCCESS) {
+            return status;
+        }
+    }
+
+    // update cached copies of blocks
+    block *in = buf;
+    for (int n = 0; n < len; n++) {
+        int i = *cache_find(pvt, offset+n);
+        if (i >= 0) {
+            lru_unlink(pvt, i);
+            lru_push(pvt, i);
+        } else if ((i = cache_alloc(pvt, offset+n)) < 0) {
+            return E_UNAVAIL;  // cannot write evicted block
+        }
+        memcpy(pvt->data[i], in[n], BLOCK_SIZE);
+        pvt->bufs[i].dirty = (pvt->policy == CACHE_WRITE_BACK);
+    }
+    return SUCCESS;
+}
+
+/**
+ * Flush the block device. Dirty cached blocks in the
+ * range are written before flushing the device.
+ *
+ * @param dev the block device
+ * @param offset starting block offset
+ * @param len number of blocks to flush
+ * @return SUCCESS if successful, E_UNAVAIL if device unavailable
+ */
+static int cachedev_flush(struct fs_dev_blkdev *dev, int offset, int len)
+{
+    struct cache_dev *pvt = dev->private;
+    if (offset < 0) {
+        len += offset;
+        offset = 0;
+    }
+    if (offset + len > pvt->nblks) {
+        len = pvt->nblks - offset;
+    }
+    int status = cache_writeback(pvt, offset, len);
+    if (status != SUCCESS) {
+        return status;
+    }
+    return pvt->dev->ops->flush(pvt->dev, offset, len);
+}
+
+/**
+ * Close the block device. Dirty blocks are written
+ * and the underlying device is closed. After this any
+ * further access to that device will fail.
+ *
+ * @param dev the block device
+ */
+static void cachedev_close(struct fs_dev_blkdev *dev)
+{
+    struct cache_dev *pvt = dev->private;
+
+    cachedev_flush(dev, 0, pvt->nblks);  // write dirty blocks
+    pvt->dev->ops->close(pvt->dev);
+
+    free(pvt->data);
+    free(pvt->bufs);
+    free(pvt->buckets);
+    free(pvt->order);
+    free(dev->private);  // free private storage
+    dev->private = NULL; // crash any attempts to access
+    free(dev);
+}
+
+/** Operations on this block device */
+static struct blkdev_ops cachedev_ops = {
+    .num_blocks = cachedev_num_blocks,
+    .read = cachedev_read,
+    .write = cachedev_write,
+    .flush = cachedev_flush,
+    .close = cachedev_close
+};
+
+/**
+ * Create a buffer cache device over a block device.
+ * The cache device takes ownership of the underlying
+ * device and closes it when the cache device is closed.
+ *
+ * @param dev the underlying block device
+ * @param budget the cache memory budget in bytes
+ * @param policy CACHE_WRITE_THROUGH or CACHE_WRITE_BACK
+ * @return the block device or NULL if cannot create the block device
+ */
+struct fs_dev_blkdev *cache_blkdev_create(struct fs_dev_blkdev *dev, size_t budget, int policy)
+{
+    int n_bufs = budget / BLOCK_SIZE;
+    if (n_bufs < 1) {
+        n_bufs = 1;
+    }
+
+    struct fs_dev_blkdev *cdev = malloc(sizeof(struct fs_dev_blkdev));
+    struct cache_dev *pvt = calloc(1, sizeof(struct cache_dev));
+    if (cdev == NULL || pvt == NULL) {
+        free(cdev);
+        free(pvt);
+        return NULL;
+    }
+    for (pvt->n_buckets = 1; pvt->n_buckets < n_bufs; pvt->n_buckets *= 2) {
+    }
+    pvt->data = malloc(n_bufs * sizeof(block));
+    pvt->bufs = malloc(n_bufs * sizeof(struct cache_buf));
+    pvt->buckets = malloc(pvt->n_buckets * sizeof(int));
+    pvt->order = malloc(n_bufs * sizeof(struct cache_buf *));
+
+    // fail if cannot allocate buffers
+    if (pvt->data == NULL || pvt->bufs == NULL || pvt->buckets == NULL || pvt->order == NULL) {
+        free(pvt->data);
+        free(pvt->bufs);
+        free(pvt->buckets);
+        free(pvt->order);
+        free(pvt);
+        free(cdev);
+        return NULL;
+    }
+
+    // all buckets empty and all buffers free
+    memset(pvt->buckets, -1, pvt->n_buckets * sizeof(int));
+    for (int i = 0; i < n_bufs; i++) {
+        pvt->bufs[i] = (struct cache_buf) {
+            .blkno = -1, .dirty = 0,
+            .next = (i+1 < n_bufs) ? i+1 : -1,
+            .lru_prev = -1, .lru_next = -1
+        };
+    }
+    pvt->free = 0;
+    pvt->lru_head = pvt->lru_tail = -1;
+    pvt->dev = dev;
+    pvt->nblks = dev->ops->num_blocks(dev);
+    pvt->policy = policy;
+    pvt->n_bufs = n_bufs;
+    pvt->stats.n_bufs = n_bufs;
+
+    cdev->private = pvt;
+    cdev->ops = &cachedev_ops;
+    return cdev;
+}
+
+/**
+ * Get the statistics of a buffer cache device.
+ *
+ * @param dev the cache block device
+ * @param stats returns the statistics
+ */
+void cache_blkdev_stats(struct fs_dev_blkdev *dev, struct cache_blkdev_stats *stats)
+{
+    struct cache_dev *pvt = dev->private;
+    *stats = pvt->stats;
+}
@@ -0,0 +1,51 @@
+/*
+ * fs_dev_cachedev.h
+ *
+ * description: block buffer cache device layered over
+ * another block device for CS 7600 / CS 5600 file system
+ *
+ * Peter Desnoyers, Northeastern Computer Science, 2015
+ * Philip Gust, Northeastern Computer Science, 2019
+ */
+
+#ifndef FS_DEV_CACHEDEV_H_
+#define FS_DEV_CACHEDEV_H_
+
+#include <stddef.h>
+#include "fs_dev_blkdev.h"
+
+/** buffer cache write policy */
+enum {
+    CACHE_WRITE_THROUGH = 0,	/** write to device on every write */
+    CACHE_WRITE_BACK = 1		/** write dirty blocks on flush or eviction */
+};
+
+/** buffer cache statistics */
+struct cache_blkdev_stats {
+    long hits;			/** blocks read from cache */
+    long misses;		/** blocks read from device */
+    long writebacks;	/** dirty blocks written to device */
+    int n_bufs;			/** number of cache buffers */
+};
+
+/**
+ * Create a buffer cache device over a block device.
+ * The cache device takes ownership of the underlying
+ * device and closes it when the cache device is closed.
+ *
+ * @param dev the underlying block device
+ * @param budget the cache memory budget in bytes
+ * @param policy CACHE_WRITE_THROUGH or CACHE_WRITE_BACK
+ * @return the block device or NULL if cannot create the block device
+ */
+extern struct fs_dev_blkdev *cache_blkdev_create(struct fs_dev_blkdev *dev, size_t budget, int policy);
+
+/**
+ * Get the statistics of a buffer cache device.
+ *
+ * @param dev the cache block device
+ * @param stats returns the statistics
+ */
+extern void cache_blkdev_stats(struct fs_dev_blkdev *dev, struct cache_blkdev_stats *stats);
+
+#endif /* FS_DEV_CACHEDEV_H_ */
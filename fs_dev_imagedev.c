@@ -0,0 +1,334 @@
+/*
+ * fs_dev_imagedev.c
+ *
+ * description: image file block device functions
+ * for CS 7600 / CS 5600 file system
+ *
+ * Peter Desnoyers, Northeastern Computer Science, 2011
+ * Philip Gust, Northeastern Computer Science, 2019
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "fs_dev_imagedev.h"
+
+/** Definition of image block device */
+struct image_dev {
+    int fd;			// image file descriptor, -1 if closed
+    int nblks;		// number of blocks in device
+};
+
+/**
+ * The number of blocks in the block device.
+ *
+ * @param the block device
+ */
+static int imagedev_num_blocks(struct fs_dev_blkdev *dev)
+{
+    struct image_dev *pvt = dev->private;
+    return pvt->nblks;
+}
+
+/**
+ * Read blocks from block device starting at give block offset.
+ * Short reads are retried; reads past the end of the image
+ * file return zeros.
+ *
+ * @param dev the block device
+ * @param offset starting block offset
+ * @param len number of blocks to read
+ * @param buf the input buffer
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+static int imagedev_read(struct fs_dev_blkdev *dev, int offset, int len, void *buf)
+{
+    struct image_dev *pvt = dev->private;
+    if (pvt->fd < 0) {
+        return E_UNAVAIL;
+    }
+    if (offset < 0 || offset+len > pvt->nblks) {
+        return E_SIZE;
+    }
+
+    char *p = buf;
+    size_t n = (size_t)len * BLOCK_SIZE;
+    off_t pos = (off_t)offset * BLOCK_SIZE;
+    while (n > 0) {
+        ssize_t nread = pread(pvt->fd, p, n, pos);
+        if (nread < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return E_UNAVAIL;
+        }
+        if (nread == 0) {
+            memset(p, 0, n);  // past end of file
+            break;
+        }
+        p += nread;
+        n -= nread;
+        pos += nread;
+    }
+    return SUCCESS;
+}
+
+/**
+ * Write blocks to block device starting at give block offset.
+ * Short writes are retried.
+ *
+ * @param dev the block device
+ * @param offset starting block offset
+ * @param len number of blocks to write
+ * @param buf the output buffer
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+static int imagedev_write(struct fs_dev_blkdev *dev, int offset, int len, void *buf)
+{
+    struct image_dev *pvt = dev->private;
+    if (pvt->fd < 0) {
+        return E_UNAVAIL;
+    }
+    if (offset < 0 || offset+len > pvt->nblks) {
+        return E_SIZE;
+    }
+
+    const char *p = buf;
+    size_t n = (size_t)len * BLOCK_SIZE;
+    off_t pos = (off_t)offset * BLOCK_SIZE;
+    while (n > 0) {
+        ssize_t nwritten = pwrite(pvt->fd, p, n, pos);
+        if (nwritten < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return E_UNAVAIL;
+        }
+        p += nwritten;
+        n -= nwritten;
+        pos += nwritten;
+    }
+    return SUCCESS;
+}
+
+/** maximum blocks in one vectored transfer */
+enum {IMAGE_MAX_IOV = 64};
+
+/**
+ * Transfer a list of blocks with one vectored call per run
+ * of adjacent blocks. Blocks of a run that are not fully
+ * transferred are retried one at a time.
+ *
+ * @param dev the block device
+ * @param iov the blocks and their buffers
+ * @param n the number of blocks
+ * @param write 1 to write blocks, 0 to read blocks
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+static int imagedev_xferv(struct fs_dev_blkdev *dev, struct blkdev_iovec *iov, int n, int write)
+{
+    struct image_dev *pvt = dev->private;
+    if (pvt->fd < 0) {
+        return E_UNAVAIL;
+    }
+    for (int i = 0; i < n; i++) {
+        if (iov[i].blkno < 0 || iov[i].blkno >= pvt->nblks) {
+            return E_SIZE;
+        }
+    }
+
+    struct iovec vec[IMAGE_MAX_IOV];
+    for (int i = 0; i < n; ) {
+        // gather run of adjacent blocks
+        int len = 0;
+        do {
+            vec[len] = (struct iovec) {.iov_base = iov[i+len].buf, .iov_len = BLOCK_SIZE};
+            len++;
+        } while (   (i+len < n) && (len < IMAGE_MAX_IOV)
+                 && (iov[i+len].blkno == iov[i].blkno + len));
+
+        off_t pos = (off_t)iov[i].blkno * BLOCK_SIZE;
+        ssize_t nxfer;
+        do {
+            nxfer = write ? pwritev(pvt->fd, vec, len, pos) : preadv(pvt->fd, vec, len, pos);
+        } while (nxfer < 0 && errno == EINTR);
+        if (nxfer < 0) {
+            return E_UNAVAIL;
+        }
+
+        // retry blocks not fully transferred
+        for (int k = nxfer / BLOCK_SIZE; k < len; k++) {
+            int status = write
+                ? imagedev_write(dev, iov[i+k].blkno, 1, iov[i+k].buf)
+                : imagedev_read(dev, iov[i+k].blkno, 1, iov[i+k].buf);
+            if (status != SUCCESS) {
+                return status;
+            }
+        }
+        i += len;
+    }
+    return SUCCESS;
+}
+
+/**
+ * Read a list of blocks from block device.
+ *
+ * @param dev the block device
+ * @param iov the blocks and their buffers
+ * @param n the number of blocks
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+static int imagedev_readv(struct fs_dev_blkdev *dev, struct blkdev_iovec *iov, int n)
+{
+    return imagedev_xferv(dev, iov, n, 0);
+}
+
+/**
+ * Write a list of blocks to block device.
+ *
+ * @param dev the block device
+ * @param iov the blocks and their buffers
+ * @param n the number of blocks
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+static int imagedev_writev(struct fs_dev_blkdev *dev, struct blkdev_iovec *iov, int n)
+{
+    return imagedev_xferv(dev, iov, n, 1);
+}
+
+/**
+ * Flush the block device. Flushing the whole device
+ * makes written data durable with fdatasync. On Linux,
+ * flushing part of the device only writes back that
+ * range with sync_file_range, a hint that does not make
+ * the data durable; use a whole-device flush as a
+ * write barrier.
+ *
+ * @param dev the block device
+ * @param offset starting block offset
+ * @param len number of blocks to flush
+ * @return SUCCESS if successful, E_UNAVAIL if device unavailable
+ */
+static int imagedev_flush(struct fs_dev_blkdev *dev, int offset, int len)
+{
+    struct image_dev *pvt = dev->private;
+    if (pvt->fd < 0) {
+        return E_UNAVAIL;
+    }
+
+#ifdef __linux__
+    if (offset > 0 || offset+len < pvt->nblks) {
+        if (len <= 0) {
+            return SUCCESS;
+        }
+        int status = sync_file_range(pvt->fd,
+            (off_t)offset * BLOCK_SIZE, (off_t)len * BLOCK_SIZE,
+            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        return (status == 0) ? SUCCESS : E_UNAVAIL;
+    }
+#endif
+#if defined(__APPLE__)
+    return (fsync(pvt->fd) == 0) ? SUCCESS : E_UNAVAIL;  // no fdatasync
+#else
+    return (fdatasync(pvt->fd) == 0) ? SUCCESS : E_UNAVAIL;
+#endif
+}
+
+/**
+ * Close the block device. After this any further
+ * access to that device will fail.
+ *
+ * @param dev the block device
+ */
+static void imagedev_close(struct fs_dev_blkdev *dev)
+{
+    struct image_dev *pvt = dev->private;
+
+    if (pvt->fd >= 0) {
+        close(pvt->fd);
+        pvt->fd = -1;
+    }
+    pvt->nblks = 0;
+
+    free(dev->private);  // free private storage
+    dev->private = NULL; // crash any attempts to access
+    free(dev);
+}
+
+/** Operations on this block device */
+static struct blkdev_ops imagedev_ops = {
+    .num_blocks = imagedev_num_blocks,
+    .read = imagedev_read,
+    .write = imagedev_write,
+    .flush = imagedev_flush,
+    .close = imagedev_close,
+    .readv = imagedev_readv,
+    .writev = imagedev_writev
+};
+
+/**
+ * Create an image block device reading from a specified image file.
+ * The file is created if it does not exist. If nblks is positive,
+ * a shorter file is extended to nblks blocks without allocating
+ * storage; if nblks is 0, the device size is the file size.
+ *
+ * @param path the path of the image file
+ * @param nblks the number of blocks for the device, or 0 for file size
+ * @return the block device or NULL if cannot create the block device
+ */
+struct fs_dev_blkdev *image_blkdev_create(const char *path, int nblks)
+{
+    if (nblks < 0) {
+        return NULL;
+    }
+    int fd = open(path, O_RDWR | O_CREAT, 0666);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    // size device from file or extend file to device size
+    struct stat sb;
+    if (fstat(fd, &sb) < 0) {
+        close(fd);
+        return NULL;
+    }
+    if (nblks == 0) {
+        nblks = sb.st_size / BLOCK_SIZE;
+    } else if (sb.st_size < (off_t)nblks * BLOCK_SIZE) {
+        if (ftruncate(fd, (off_t)nblks * BLOCK_SIZE) < 0) {
+            close(fd);
+            return NULL;
+        }
+    }
+    if (nblks == 0) {
+        close(fd);  // empty device
+        return NULL;
+    }
+
+    struct fs_dev_blkdev *dev = malloc(sizeof(struct fs_dev_blkdev));
+    struct image_dev *pvt = malloc(sizeof(struct image_dev));
+    if (dev == NULL || pvt == NULL) {
+        free(dev);
+        free(pvt);
+        close(fd);
+        return NULL;
+    }
+    pvt->fd = fd;
+    pvt->nblks = nblks;
+
+    dev->private = pvt;
+    dev->ops = &imagedev_ops;
+    return dev;
+}
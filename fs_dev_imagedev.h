@@ -0,0 +1,28 @@
+/*
+ * fs_dev_imagedev.h
+ *
+ * description: image file block device creation function
+ * for CS 7600 / CS 5600 file system
+ *
+ * Peter Desnoyers, Northeastern Computer Science, 2015
+ * Philip Gust, Northeastern Computer Science, 2019
+ */
+
+#ifndef FS_DEV_IMAGEDEV_H_
+#define FS_DEV_IMAGEDEV_H_
+
+#include "fs_dev_blkdev.h"
+
+/**
+ * Create an image block device reading from a specified image file.
+ * The file is created if it does not exist. If nblks is positive,
+ * a shorter file is extended to nblks blocks without allocating
+ * storage; if nblks is 0, the device size is the file size.
+ *
+ * @param path the path of the image file
+ * @param nblks the number of blocks for the device, or 0 for file size
+ * @return the block device or NULL if cannot create the block device
+ */
+extern struct fs_dev_blkdev *image_blkdev_create(const char *path, int nblks);
+
+#endif /* FS_DEV_IMAGEDEV_H_ */
@@ -88,6 +88,60 @@ static int memdev_write(struct fs_dev_blkdev * dev, int offset, int len, void *b
     return E_SIZE;
 }
 
+/**
+ * Read a list of blocks from block device.
+ *
+ * @param dev the block device
+ * @param iov the blocks and their buffers
+ * @param n the number of blocks
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+static int memdev_readv(struct fs_dev_blkdev *dev, struct blkdev_iovec *iov, int n)
+{
+    struct memory_dev *pvt = dev->private;
+
+    /* to fail we free its memory and set it to NULL */
+    if (pvt->blocks == NULL) {
+        return E_UNAVAIL;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (iov[i].blkno < 0 || iov[i].blkno >= pvt->nblks) {
+            return E_SIZE;
+        }
+        memcpy(iov[i].buf, pvt->blocks + iov[i].blkno, BLOCK_SIZE);
+    }
+    return SUCCESS;
+}
+
+/**
+ * Write a list of blocks to block device.
+ *
+ * @param dev the block device
+ * @param iov the blocks and their buffers
+ * @param n the number of blocks
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+static int memdev_writev(struct fs_dev_blkdev *dev, struct blkdev_iovec *iov, int n)
+{
+    struct memory_dev *pvt = dev->private;
+
+    /* to fail we free its memory and set it to NULL */
+    if (pvt->blocks == NULL) {
+        return E_UNAVAIL;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (iov[i].blkno < 0 || iov[i].blkno >= pvt->nblks) {
+            return E_SIZE;
+        }
+        memcpy(pvt->blocks + iov[i].blkno, iov[i].buf, BLOCK_SIZE);
+    }
+    return SUCCESS;
+}
+
 /**
  * Flush the block device.
  *
@@ -126,7 +180,9 @@ static struct blkdev_ops memdev_ops = {
     .read = memdev_read,
     .write = memdev_write,
     .flush = memdev_flush,
-    .close = memdev_close
+    .close = memdev_close,
+    .readv = memdev_readv,
+    .writev = memdev_writev
 };
 
 /**
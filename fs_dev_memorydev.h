@@ -14,12 +14,12 @@
 #include "fs_dev_blkdev.h"
 
 /**
- * Create an image block device reading from a specified image file.
+ * Create an in-memory block device.
  *
  * @param nblks the number of blocks for the device
  * @return the block device or NULL if cannot create the block device
  */
-extern struct fs_dev_blkdev *memory_blkdev_create(size_t nblks);
+extern struct fs_dev_blkdev *memory_blkdev_create(int nblks);
 
 
 #endif /* FS_DEV_MEMORYDEV_H_ */
@@ -0,0 +1,325 @@
+/*
+ * fs_dev_mmapdev.c
+ *
+ * description: memory-mapped image file block device
+ * functions for CS 7600 / CS 5600 file system
+ *
+ * Peter Desnoyers, Northeastern Computer Science, 2011
+ * Philip Gust, Northeastern Computer Science, 2019
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fs_dev_mmapdev.h"
+
+/** Definition of memory-mapped block device */
+struct mmap_dev {
+    block *blocks;		// mapped blocks, NULL if closed
+    int nblks;			// number of blocks in device
+    int dirty_lo;		// first dirty block
+    int dirty_hi;		// one past last dirty block, dirty_lo if clean
+};
+
+/**
+ * Extend the dirty range to include blocks.
+ *
+ * @param pvt the device
+ * @param offset starting block offset
+ * @param len number of blocks
+ */
+static void mark_dirty(struct mmap_dev *pvt, int offset, int len)
+{
+    if (pvt->dirty_lo == pvt->dirty_hi) {
+        pvt->dirty_lo = offset;
+        pvt->dirty_hi = offset + len;
+    } else {
+        if (offset < pvt->dirty_lo) {
+            pvt->dirty_lo = offset;
+        }
+        if (offset + len > pvt->dirty_hi) {
+            pvt->dirty_hi = offset + len;
+        }
+    }
+}
+
+/**
+ * The number of blocks in the block device.
+ *
+ * @param the block device
+ */
+static int mmapdev_num_blocks(struct fs_dev_blkdev *dev)
+{
+    struct mmap_dev *pvt = dev->private;
+    return pvt->nblks;
+}
+
+/**
+ * Read blocks from block device starting at give block offset.
+ *
+ * @param dev the block device
+ * @param offset starting block offset
+ * @param len number of blocks to read
+ * @param buf the input buffer
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+static int mmapdev_read(struct fs_dev_blkdev *dev, int offset, int len, void *buf)
+{
+    struct mmap_dev *pvt = dev->private;
+    if (pvt->blocks == NULL) {
+        return E_UNAVAIL;
+    }
+
+    if (offset >= 0 && offset+len <= pvt->nblks) {
+        // copy blocks to buf
+        memcpy(buf, pvt->blocks + offset, len * BLOCK_SIZE);
+        return SUCCESS;
+    }
+    return E_SIZE;
+}
+
+/**
+ * Write blocks to block device starting at give block offset.
+ *
+ * @param dev the block device
+ * @param offset starting block offset
+ * @param len number of blocks to write
+ * @param buf the output buffer
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+static int mmapdev_write(struct fs_dev_blkdev *dev, int offset, int len, void *buf)
+{
+    struct mmap_dev *pvt = dev->private;
+    if (pvt->blocks == NULL) {
+        return E_UNAVAIL;
+    }
+
+    if (offset >= 0 && offset+len <= pvt->nblks) {
+        // copy buf to blocks
+        memcpy(pvt->blocks + offset, buf, len * BLOCK_SIZE);
+        mark_dirty(pvt, offset, len);
+        return SUCCESS;
+    }
+    return E_SIZE;
+}
+
+/**
+ * Read a list of blocks from block device.
+ *
+ * @param dev the block device
+ * @param iov the blocks and their buffers
+ * @param n the number of blocks
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+static int mmapdev_readv(struct fs_dev_blkdev *dev, struct blkdev_iovec *iov, int n)
+{
+    struct mmap_dev *pvt = dev->private;
+    if (pvt->blocks == NULL) {
+        return E_UNAVAIL;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (iov[i].blkno < 0 || iov[i].blkno >= pvt->nblks) {
+            return E_SIZE;
+        }
+        memcpy(iov[i].buf, pvt->blocks + iov[i].blkno, BLOCK_SIZE);
+    }
+    return SUCCESS;
+}
+
+/**
+ * Write a list of blocks to block device.
+ *
+ * @param dev the block device
+ * @param iov the blocks and their buffers
+ * @param n the number of blocks
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+static int mmapdev_writev(struct fs_dev_blkdev *dev, struct blkdev_iovec *iov, int n)
+{
+    struct mmap_dev *pvt = dev->private;
+    if (pvt->blocks == NULL) {
+        return E_UNAVAIL;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (iov[i].blkno < 0 || iov[i].blkno >= pvt->nblks) {
+            return E_SIZE;
+        }
+        memcpy(pvt->blocks + iov[i].blkno, iov[i].buf, BLOCK_SIZE);
+        mark_dirty(pvt, iov[i].blkno, 1);
+    }
+    return SUCCESS;
+}
+
+/**
+ * Flush the block device. Only the part of the range that
+ * was written since the last flush is synchronized.
+ *
+ * @param dev the block device
+ * @param offset starting block offset
+ * @param len number of blocks to flush
+ * @return SUCCESS if successful, E_UNAVAIL if device unavailable
+ */
+static int mmapdev_flush(struct fs_dev_blkdev *dev, int offset, int len)
+{
+    struct mmap_dev *pvt = dev->private;
+    if (pvt->blocks == NULL) {
+        return E_UNAVAIL;
+    }
+
+    // intersect range with dirty range
+    int lo = (offset > pvt->dirty_lo) ? offset : pvt->dirty_lo;
+    int hi = (offset+len < pvt->dirty_hi) ? offset+len : pvt->dirty_hi;
+    if (lo >= hi) {
+        return SUCCESS;
+    }
+
+    // msync requires a page-aligned address
+    long pagesize = sysconf(_SC_PAGESIZE);
+    size_t start = ((size_t)lo * BLOCK_SIZE) & ~(size_t)(pagesize-1);
+    size_t end = (size_t)hi * BLOCK_SIZE;
+    if (msync((char*)pvt->blocks + start, end - start, MS_SYNC) < 0) {
+        return E_UNAVAIL;
+    }
+
+    // shrink dirty range if flushed at either end
+    if (lo == pvt->dirty_lo) {
+        pvt->dirty_lo = (hi < pvt->dirty_hi) ? hi : pvt->dirty_hi;
+    } else if (hi == pvt->dirty_hi) {
+        pvt->dirty_hi = lo;
+    }
+    return SUCCESS;
+}
+
+/**
+ * Close the block device. After this any further
+ * access to that device will fail.
+ *
+ * @param dev the block device
+ */
+static void mmapdev_close(struct fs_dev_blkdev *dev)
+{
+    struct mmap_dev *pvt = dev->private;
+
+    if (pvt->blocks != NULL) {
+        munmap(pvt->blocks, (size_t)pvt->nblks * BLOCK_SIZE);
+        pvt->blocks = NULL;
+    }
+    pvt->nblks = 0;
+
+    free(dev->private);  // free private storage
+    dev->private = NULL; // crash any attempts to access
+    free(dev);
+}
+
+/** Operations on this block device */
+static struct blkdev_ops mmapdev_ops = {
+    .num_blocks = mmapdev_num_blocks,
+    .read = mmapdev_read,
+    .write = mmapdev_write,
+    .flush = mmapdev_flush,
+    .close = mmapdev_close,
+    .readv = mmapdev_readv,
+    .writev = mmapdev_writev
+};
+
+/**
+ * Create a block device that maps a specified image file into
+ * memory. The file is created if it does not exist. If nblks
+ * is positive, a shorter file is extended to nblks blocks; if
+ * nblks is 0, the device size is the file size.
+ *
+ * @param path the path of the image file
+ * @param nblks the number of blocks for the device, or 0 for file size
+ * @return the block device or NULL if cannot create the block device
+ */
+struct fs_dev_blkdev *mmap_blkdev_create(const char *path, int nblks)
+{
+    if (nblks < 0) {
+        return NULL;
+    }
+    int fd = open(path, O_RDWR | O_CREAT, 0666);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    // size device from file or extend file to device size
+    struct stat sb;
+    if (fstat(fd, &sb) < 0) {
+        close(fd);
+        return NULL;
+    }
+    if (nblks == 0) {
+        nblks = sb.st_size / BLOCK_SIZE;
+    } else if (sb.st_size < (off_t)nblks * BLOCK_SIZE) {
+        if (ftruncate(fd, (off_t)nblks * BLOCK_SIZE) < 0) {
+            close(fd);
+            return NULL;
+        }
+    }
+    if (nblks == 0) {
+        close(fd);  // empty device
+        return NULL;
+    }
+
+    // mapping remains valid after file is closed
+    void *blocks = mmap(NULL, (size_t)nblks * BLOCK_SIZE,
+                        PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (blocks == MAP_FAILED) {
+        return NULL;
+    }
+
+    struct fs_dev_blkdev *dev = malloc(sizeof(struct fs_dev_blkdev));
+    struct mmap_dev *pvt = malloc(sizeof(struct mmap_dev));
+    if (dev == NULL || pvt == NULL) {
+        free(dev);
+        free(pvt);
+        munmap(blocks, (size_t)nblks * BLOCK_SIZE);
+        return NULL;
+    }
+    pvt->blocks = blocks;
+    pvt->nblks = nblks;
+    pvt->dirty_lo = pvt->dirty_hi = 0;
+
+    dev->private = pvt;
+    dev->ops = &mmapdev_ops;
+    return dev;
+}
+
+/**
+ * Borrow a pointer to a block in the mapping instead of copying
+ * it. The pointer remains valid until the device is closed. If
+ * writable, the block is included in the next flush.
+ *
+ * @param dev the memory-mapped block device
+ * @param blkno the block number
+ * @param writable 1 if the caller will modify the block, 0 if not
+ * @return pointer to the block, or NULL if not a memory-mapped
+ *  device, out of range, or unavailable
+ */
+void *mmap_blkdev_borrow(struct fs_dev_blkdev *dev, int blkno, int writable)
+{
+    if (dev->ops != &mmapdev_ops) {
+        return NULL;  // private data is not a mmap_dev
+    }
+    struct mmap_dev *pvt = dev->private;
+    if (pvt->blocks == NULL || blkno < 0 || blkno >= pvt->nblks) {
+        return NULL;
+    }
+    if (writable) {
+        mark_dirty(pvt, blkno, 1);
+    }
+    return pvt->blocks + blkno;
+}
@@ -0,0 +1,41 @@
+/*
+ * fs_dev_mmapdev.h
+ *
+ * description: memory-mapped image file block device
+ * functions for CS 7600 / CS 5600 file system
+ *
+ * Peter Desnoyers, Northeastern Computer Science, 2015
+ * Philip Gust, Northeastern Computer Science, 2019
+ */
+
+#ifndef FS_DEV_MMAPDEV_H_
+#define FS_DEV_MMAPDEV_H_
+
+#include "fs_dev_blkdev.h"
+
+/**
+ * Create a block device that maps a specified image file into
+ * memory. The file is created if it does not exist. If nblks
+ * is positive, a shorter file is extended to nblks blocks; if
+ * nblks is 0, the device size is the file size.
+ *
+ * @param path the path of the image file
+ * @param nblks the number of blocks for the device, or 0 for file size
+ * @return the block device or NULL if cannot create the block device
+ */
+extern struct fs_dev_blkdev *mmap_blkdev_create(const char *path, int nblks);
+
+/**
+ * Borrow a pointer to a block in the mapping instead of copying
+ * it. The pointer remains valid until the device is closed. If
+ * writable, the block is included in the next flush.
+ *
+ * @param dev the memory-mapped block device
+ * @param blkno the block number
+ * @param writable 1 if the caller will modify the block, 0 if not
+ * @return pointer to the block, or NULL if not a memory-mapped
+ *  device, out of range, or unavailable
+ */
+extern void *mmap_blkdev_borrow(struct fs_dev_blkdev *dev, int blkno, int writable);
+
+#endif /* FS_DEV_MMAPDEV_H_ */
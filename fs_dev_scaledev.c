@@ -0,0 +1,209 @@
+/*
+ * fs_dev_scaledev.c
+ *
+ * description: block device with larger blocks layered
+ * over another block device for CS 7600 / CS 5600 file system
+ *
+ * Peter Desnoyers, Northeastern Computer Science, 2011
+ * Philip Gust, Northeastern Computer Science, 2019
+ */
+
+#include <stdlib.h>
+
+#include "fs_dev_scaledev.h"
+
+/** underlying blocks passed in one scatter-gather call */
+enum {SCALE_IOV_BATCH = 64};
+
+/** Definition of scaled block device */
+struct scale_dev {
+    struct fs_dev_blkdev *dev;	// underlying device
+    int ratio;					// underlying blocks per block
+    int nblks;					// number of blocks in device
+};
+
+/**
+ * The number of blocks in the block device.
+ *
+ * @param the block device
+ */
+static int scaledev_num_blocks(struct fs_dev_blkdev *dev)
+{
+    struct scale_dev *pvt = dev->private;
+    return pvt->nblks;
+}
+
+/**
+ * Read blocks from block device starting at give block offset.
+ *
+ * @param dev the block device
+ * @param offset starting block offset
+ * @param len number of blocks to read
+ * @param buf the input buffer
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+static int scaledev_read(struct fs_dev_blkdev *dev, int offset, int len, void *buf)
+{
+    struct scale_dev *pvt = dev->private;
+    if ((offset < 0) || (len < 0) || (offset > pvt->nblks - len)) {
+        return E_SIZE;
+    }
+    return pvt->dev->ops->read(pvt->dev, offset * pvt->ratio, len * pvt->ratio, buf);
+}
+
+/**
+ * Write blocks to block device starting at give block offset.
+ *
+ * @param dev the block device
+ * @param offset starting block offset
+ * @param len number of blocks to write
+ * @param buf the output buffer
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+static int scaledev_write(struct fs_dev_blkdev *dev, int offset, int len, void *buf)
+{
+    struct scale_dev *pvt = dev->private;
+    if ((offset < 0) || (len < 0) || (offset > pvt->nblks - len)) {
+        return E_SIZE;
+    }
+    return pvt->dev->ops->write(pvt->dev, offset * pvt->ratio, len * pvt->ratio, buf);
+}
+
+/**
+ * Transfer a list of blocks as the lists of their
+ * underlying blocks, a batch at a time.
+ *
+ * @param dev the block device
+ * @param iov the blocks and their buffers
+ * @param n the number of blocks
+ * @param op BLKDEV_READ or BLKDEV_WRITE
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+static int scaledev_xferv(struct fs_dev_blkdev *dev, struct blkdev_iovec *iov, int n, int op)
+{
+    struct scale_dev *pvt = dev->private;
+    struct blkdev_iovec dev_iov[SCALE_IOV_BATCH];
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        if ((iov[i].blkno < 0) || (iov[i].blkno >= pvt->nblks)) {
+            return E_SIZE;
+        }
+        for (int k = 0; k < pvt->ratio; k++) {
+            dev_iov[m++] = (struct blkdev_iovec) {
+                .blkno = iov[i].blkno * pvt->ratio + k,
+                .buf = (char*)iov[i].buf + k*BLOCK_SIZE
+            };
+            if ((m == SCALE_IOV_BATCH) || ((i == n-1) && (k == pvt->ratio-1))) {
+                int status = (op == BLKDEV_READ) ? blkdev_readv(pvt->dev, dev_iov, m)
+                                                 : blkdev_writev(pvt->dev, dev_iov, m);
+                if (status != SUCCESS) {
+                    return status;
+                }
+                m = 0;
+            }
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * Read a list of blocks from block device.
+ *
+ * @param dev the block device
+ * @param iov the blocks and their buffers
+ * @param n the number of blocks
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+static int scaledev_readv(struct fs_dev_blkdev *dev, struct blkdev_iovec *iov, int n)
+{
+    return scaledev_xferv(dev, iov, n, BLKDEV_READ);
+}
+
+/**
+ * Write a list of blocks to block device.
+ *
+ * @param dev the block device
+ * @param iov the blocks and their buffers
+ * @param n the number of blocks
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+static int scaledev_writev(struct fs_dev_blkdev *dev, struct blkdev_iovec *iov, int n)
+{
+    return scaledev_xferv(dev, iov, n, BLKDEV_WRITE);
+}
+
+/**
+ * Flush the block device.
+ *
+ * @param dev the block device
+ * @param offset starting block offset
+ * @param len number of blocks to flush
+ * @return SUCCESS if successful, E_UNAVAIL if device unavailable
+ */
+static int scaledev_flush(struct fs_dev_blkdev *dev, int offset, int len)
+{
+    struct scale_dev *pvt = dev->private;
+    return pvt->dev->ops->flush(pvt->dev, offset * pvt->ratio, len * pvt->ratio);
+}
+
+/**
+ * Close the block device. The underlying device
+ * is not closed.
+ *
+ * @param dev the block device
+ */
+static void scaledev_close(struct fs_dev_blkdev *dev)
+{
+    free(dev->private);  // free private storage
+    dev->private = NULL; // crash any attempts to access
+    free(dev);
+}
+
+/** Operations on this block device */
+static struct blkdev_ops scaledev_ops = {
+    .num_blocks = scaledev_num_blocks,
+    .read = scaledev_read,
+    .write = scaledev_write,
+    .flush = scaledev_flush,
+    .close = scaledev_close,
+    .readv = scaledev_readv,
+    .writev = scaledev_writev
+};
+
+/**
+ * Create a block device whose blocks are a number of
+ * adjacent blocks of an underlying block device. Block
+ * b of the new device is blocks b*ratio through
+ * b*ratio + ratio-1 of the underlying device, so its
+ * buffers are ratio*BLOCK_SIZE bytes. Closing the new
+ * device does not close the underlying device.
+ *
+ * @param dev the underlying block device
+ * @param ratio underlying blocks per block, at least 1
+ * @return the block device or NULL if cannot create the block device
+ */
+struct fs_dev_blkdev *scale_blkdev_create(struct fs_dev_blkdev *dev, int ratio)
+{
+    if (ratio < 1) {
+        return NULL;
+    }
+    struct fs_dev_blkdev *sdev = malloc(sizeof(struct fs_dev_blkdev));
+    struct scale_dev *pvt = malloc(sizeof(struct scale_dev));
+    if (sdev == NULL || pvt == NULL) {
+        free(sdev);
+        free(pvt);
+        return NULL;
+    }
+    pvt->dev = dev;
+    pvt->ratio = ratio;
+    pvt->nblks = dev->ops->num_blocks(dev) / ratio;
+
+    sdev->private = pvt;
+    sdev->ops = &scaledev_ops;
+    return sdev;
+}
@@ -0,0 +1,30 @@
+/*
+ * fs_dev_scaledev.h
+ *
+ * description: block device with larger blocks layered
+ * over another block device for CS 7600 / CS 5600 file system
+ *
+ * Peter Desnoyers, Northeastern Computer Science, 2015
+ * Philip Gust, Northeastern Computer Science, 2019
+ */
+
+#ifndef FS_DEV_SCALEDEV_H_
+#define FS_DEV_SCALEDEV_H_
+
+#include "fs_dev_blkdev.h"
+
+/**
+ * Create a block device whose blocks are a number of
+ * adjacent blocks of an underlying block device. Block
+ * b of the new device is blocks b*ratio through
+ * b*ratio + ratio-1 of the underlying device, so its
+ * buffers are ratio*BLOCK_SIZE bytes. Closing the new
+ * device does not close the underlying device.
+ *
+ * @param dev the underlying block device
+ * @param ratio underlying blocks per block, at least 1
+ * @return the block device or NULL if cannot create the block device
+ */
+extern struct fs_dev_blkdev *scale_blkdev_create(struct fs_dev_blkdev *dev, int ratio);
+
+#endif /* FS_DEV_SCALEDEV_H_ */
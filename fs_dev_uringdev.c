@@ -0,0 +1,652 @@
+/*
+ * fs_dev_uringdev.c
+ *
+ * description: asynchronous image file block device
+ * using io_uring for CS 7600 / CS 5600 file system
+ *
+ * Peter Desnoyers, Northeastern Computer Science, 2011
+ * Philip Gust, Northeastern Computer Science, 2019
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "fs_dev_uringdev.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#undef BLOCK_SIZE  // defined by <linux/fs.h>
+#endif
+
+/** Definition of io_uring block device */
+struct uring_dev {
+    int fd;				// image file descriptor, -1 if closed
+    int nblks;			// number of blocks in device
+    int ring_fd;		// io_uring descriptor, -1 if not available
+    unsigned depth;		// maximum requests in progress
+    unsigned inflight;	// requests in progress
+    unsigned to_submit;	// queued entries not yet passed to kernel
+
+#ifdef __linux__
+    // submission queue ring
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+
+    // completion queue ring
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    // ring mappings
+    void *sq_ptr, *cq_ptr;
+    size_t sq_size, cq_size, sqes_size;
+#endif
+
+    // completed requests not yet reaped
+    struct blkdev_req *ready_head, *ready_tail;
+};
+
+/**
+ * Complete a request. A request submitted by uring_blkdev_submit()
+ * is added to the list of requests to be reaped; otherwise its
+ * callback is called.
+ *
+ * @param pvt the device
+ * @param req the request
+ * @param status the completion status
+ */
+static void req_complete(struct uring_dev *pvt, struct blkdev_req *req, int status)
+{
+    req->status = status;
+    if (req->reap) {
+        req->next = NULL;
+        if (pvt->ready_tail == NULL) {
+            pvt->ready_head = req;
+        } else {
+            pvt->ready_tail->next = req;
+        }
+        pvt->ready_tail = req;
+    } else if (req->callback != NULL) {
+        req->callback(req);
+    }
+}
+
+/**
+ * Perform the remainder of a request with positional I/O.
+ * Used when io_uring is not available.
+ *
+ * @param pvt the device
+ * @param req the request
+ */
+static void req_perform(struct uring_dev *pvt, struct blkdev_req *req)
+{
+    size_t total = (size_t)req->num_blks * BLOCK_SIZE;
+    while (req->done < total) {
+        char *p = (char*)req->buf + req->done;
+        off_t pos = (off_t)req->first_blk * BLOCK_SIZE + req->done;
+        ssize_t n = (req->op == BLKDEV_READ)
+                  ? pread(pvt->fd, p, total - req->done, pos)
+                  : pwrite(pvt->fd, p, total - req->done, pos);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            req_complete(pvt, req, E_UNAVAIL);
+            return;
+        }
+        if (n == 0 && req->op == BLKDEV_READ) {
+            memset(p, 0, total - req->done);  // past end of file
+            break;
+        }
+        req->done += n;
+    }
+    req_complete(pvt, req, SUCCESS);
+}
+
+#ifdef __linux__
+/**
+ * Queue the remainder of a request in the submission ring.
+ * The caller ensures that fewer than depth requests are
+ * in progress.
+ *
+ * @param pvt the device
+ * @param req the request
+ */
+static void ring_queue(struct uring_dev *pvt, struct blkdev_req *req)
+{
+    unsigned tail = *pvt->sq_tail;
+    unsigned idx = tail & *pvt->sq_mask;
+    struct io_uring_sqe *sqe = &pvt->sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (req->op == BLKDEV_READ) ? IORING_OP_READ : IORING_OP_WRITE;
+    sqe->fd = pvt->fd;
+    sqe->addr = (uintptr_t)((char*)req->buf + req->done);
+    sqe->len = (size_t)req->num_blks * BLOCK_SIZE - req->done;
+    sqe->off = (uint64_t)req->first_blk * BLOCK_SIZE + req->done;
+    sqe->user_data = (uintptr_t)req;
+
+    pvt->sq_array[idx] = idx;
+    __atomic_store_n(pvt->sq_tail, tail+1, __ATOMIC_RELEASE);
+    pvt->to_submit++;
+    pvt->inflight++;
+}
+
+/**
+ * Withdraw the entry of a request from the submission ring
+ * if it is the most recently queued entry and has not been
+ * passed to the kernel.
+ *
+ * @param pvt the device
+ * @param req the request
+ * @return 0 if withdrawn, -1 if not
+ */
+static int ring_unqueue(struct uring_dev *pvt, struct blkdev_req *req)
+{
+    if (pvt->to_submit == 0) {
+        return -1;
+    }
+    unsigned tail = *pvt->sq_tail - 1;
+    struct io_uring_sqe *sqe = &pvt->sqes[pvt->sq_array[tail & *pvt->sq_mask]];
+    if (sqe->user_data != (uintptr_t)req) {
+        return -1;
+    }
+    __atomic_store_n(pvt->sq_tail, tail, __ATOMIC_RELEASE);
+    pvt->to_submit--;
+    pvt->inflight--;
+    return 0;
+}
+
+/**
+ * Pass queued entries to the kernel and optionally
+ * wait for completions.
+ *
+ * @param pvt the device
+ * @param min_complete number of completions to wait for
+ * @return 0 if successful, -1 if failed
+ */
+static int ring_enter(struct uring_dev *pvt, unsigned min_complete)
+{
+    while (pvt->to_submit > 0 || min_complete > 0) {
+        int n = syscall(__NR_io_uring_enter, pvt->ring_fd, pvt->to_submit, min_complete,
+                        (min_complete > 0) ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        pvt->to_submit -= n;
+        min_complete = 0;
+    }
+    return 0;
+}
+
+/**
+ * Process entries in the completion ring. A short transfer
+ * or interrupted request is queued again for the remainder.
+ *
+ * @param pvt the device
+ */
+static void ring_process(struct uring_dev *pvt)
+{
+    unsigned head = *pvt->cq_head;
+    unsigned tail = __atomic_load_n(pvt->cq_tail, __ATOMIC_ACQUIRE);
+    for ( ; head != tail; head++) {
+        struct io_uring_cqe *cqe = &pvt->cqes[head & *pvt->cq_mask];
+        struct blkdev_req *req = (void*)(uintptr_t)cqe->user_data;
+        int res = cqe->res;
+        size_t total = (size_t)req->num_blks * BLOCK_SIZE;
+        pvt->inflight--;
+
+        if (res == -EINTR || res == -EAGAIN) {
+            ring_queue(pvt, req);
+        } else if (res < 0) {
+            req_complete(pvt, req, E_UNAVAIL);
+        } else if (res == 0 && req->op == BLKDEV_READ) {
+            memset((char*)req->buf + req->done, 0, total - req->done);  // past end of file
+            req_complete(pvt, req, SUCCESS);
+        } else if (res == 0) {
+            req_complete(pvt, req, E_UNAVAIL);
+        } else if ((req->done += res) < total) {
+            ring_queue(pvt, req);
+        } else {
+            req_complete(pvt, req, SUCCESS);
+        }
+    }
+    __atomic_store_n(pvt->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/**
+ * Set up the io_uring rings for a device.
+ *
+ * @param pvt the device
+ * @return 0 if successful, -1 if io_uring not available
+ */
+static int ring_setup(struct uring_dev *pvt)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int ring_fd = syscall(__NR_io_uring_setup, pvt->depth, &p);
+    if (ring_fd < 0) {
+        return -1;
+    }
+
+    // map submission and completion rings, which may share a mapping
+    pvt->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    pvt->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (pvt->cq_size > pvt->sq_size) {
+            pvt->sq_size = pvt->cq_size;
+        }
+        pvt->cq_size = 0;
+    }
+    pvt->sq_ptr = mmap(NULL, pvt->sq_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (pvt->sq_ptr == MAP_FAILED) {
+        close(ring_fd);
+        return -1;
+    }
+    pvt->cq_ptr = pvt->sq_ptr;
+    if (pvt->cq_size > 0) {
+        pvt->cq_ptr = mmap(NULL, pvt->cq_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (pvt->cq_ptr == MAP_FAILED) {
+            munmap(pvt->sq_ptr, pvt->sq_size);
+            close(ring_fd);
+            return -1;
+        }
+    }
+    pvt->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    pvt->sqes = mmap(NULL, pvt->sqes_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (pvt->sqes == MAP_FAILED) {
+        if (pvt->cq_size > 0) {
+            munmap(pvt->cq_ptr, pvt->cq_size);
+        }
+        munmap(pvt->sq_ptr, pvt->sq_size);
+        close(ring_fd);
+        return -1;
+    }
+
+    char *sq = pvt->sq_ptr, *cq = pvt->cq_ptr;
+    pvt->sq_head = (unsigned*)(sq + p.sq_off.head);
+    pvt->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    pvt->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    pvt->sq_array = (unsigned*)(sq + p.sq_off.array);
+    pvt->cq_head = (unsigned*)(cq + p.cq_off.head);
+    pvt->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    pvt->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    pvt->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+    // kernel may round up ring size
+    if (p.sq_entries < pvt->depth) {
+        pvt->depth = p.sq_entries;
+    }
+    pvt->ring_fd = ring_fd;
+    return 0;
+}
+
+/**
+ * Tear down the io_uring rings for a device.
+ *
+ * @param pvt the device
+ */
+static void ring_close(struct uring_dev *pvt)
+{
+    munmap(pvt->sqes, pvt->sqes_size);
+    if (pvt->cq_size > 0) {
+        munmap(pvt->cq_ptr, pvt->cq_size);
+    }
+    munmap(pvt->sq_ptr, pvt->sq_size);
+    close(pvt->ring_fd);
+    pvt->ring_fd = -1;
+}
+#else
+static void ring_queue(struct uring_dev *pvt, struct blkdev_req *req) {}
+static int ring_unqueue(struct uring_dev *pvt, struct blkdev_req *req) { return -1; }
+static int ring_enter(struct uring_dev *pvt, unsigned min_complete) { return -1; }
+static void ring_process(struct uring_dev *pvt) {}
+static int ring_setup(struct uring_dev *pvt) { return -1; }
+static void ring_close(struct uring_dev *pvt) {}
+#endif
+
+/**
+ * Start a request, completing it immediately if out of
+ * range or if io_uring is not available.
+ *
+ * @param pvt the device
+ * @param req the request
+ */
+static void req_start(struct uring_dev *pvt, struct blkdev_req *req)
+{
+    req->done = 0;
+    if (req->first_blk < 0 || req->first_blk + req->num_blks > pvt->nblks) {
+        req_complete(pvt, req, E_SIZE);
+    } else if (pvt->ring_fd < 0) {
+        req_perform(pvt, req);
+    } else {
+        ring_queue(pvt, req);
+    }
+}
+
+/**
+ * Submit a request whose completion is signaled by its callback.
+ *
+ * @param dev the block device
+ * @param req the request
+ * @return SUCCESS if submitted, E_UNAVAIL if device unavailable
+ */
+static int uringdev_submit(struct fs_dev_blkdev *dev, struct blkdev_req *req)
+{
+    struct uring_dev *pvt = dev->private;
+    if (pvt->fd < 0) {
+        return E_UNAVAIL;
+    }
+
+    // make room for request
+    while (pvt->ring_fd >= 0 && pvt->inflight >= pvt->depth) {
+        if (ring_enter(pvt, 1) < 0) {
+            return E_UNAVAIL;
+        }
+        ring_process(pvt);
+    }
+
+    req->reap = 0;
+    req->status = BLKDEV_PENDING;
+    req_start(pvt, req);
+    if (pvt->ring_fd >= 0 && ring_enter(pvt, 0) < 0) {
+        // entries are passed in order, so the request is still
+        // queued; withdraw it so the kernel never completes it
+        ring_unqueue(pvt, req);
+        req->status = E_UNAVAIL;
+        return E_UNAVAIL;
+    }
+    return SUCCESS;
+}
+
+/**
+ * Wait for a request to complete. Other requests that
+ * complete meanwhile are completed or remain to be reaped.
+ *
+ * @param dev the block device
+ * @param req the request, or NULL to wait for all requests
+ * @return the request status, or SUCCESS if req is NULL
+ */
+static int uringdev_wait(struct fs_dev_blkdev *dev, struct blkdev_req *req)
+{
+    struct uring_dev *pvt = dev->private;
+    while ((req != NULL) ? (req->status == BLKDEV_PENDING) : (pvt->inflight > 0)) {
+        if (ring_enter(pvt, 1) < 0) {
+            if (req != NULL) {
+                req->status = E_UNAVAIL;
+            }
+            return E_UNAVAIL;
+        }
+        ring_process(pvt);
+    }
+    return (req != NULL) ? req->status : SUCCESS;
+}
+
+/**
+ * The number of blocks in the block device.
+ *
+ * @param the block device
+ */
+static int uringdev_num_blocks(struct fs_dev_blkdev *dev)
+{
+    struct uring_dev *pvt = dev->private;
+    return pvt->nblks;
+}
+
+/**
+ * Read blocks from block device starting at give block offset.
+ *
+ * @param dev the block device
+ * @param offset starting block offset
+ * @param len number of blocks to read
+ * @param buf the input buffer
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+static int uringdev_read(struct fs_dev_blkdev *dev, int offset, int len, void *buf)
+{
+    struct blkdev_req req = {
+        .op = BLKDEV_READ, .first_blk = offset, .num_blks = len, .buf = buf
+    };
+    int status = uringdev_submit(dev, &req);
+    return (status == SUCCESS) ? uringdev_wait(dev, &req) : status;
+}
+
+/**
+ * Write blocks to block device starting at give block offset.
+ *
+ * @param dev the block device
+ * @param offset starting block offset
+ * @param len number of blocks to write
+ * @param buf the output buffer
+ * @return SUCCESS if successful,
+ *  E_UNAVAIL if device unavailable, E_SIZE if out of range
+ */
+static int uringdev_write(struct fs_dev_blkdev *dev, int offset, int len, void *buf)
+{
+    struct blkdev_req req = {
+        .op = BLKDEV_WRITE, .first_blk = offset, .num_blks = len, .buf = buf
+    };
+    int status = uringdev_submit(dev, &req);
+    return (status == SUCCESS) ? uringdev_wait(dev, &req) : status;
+}
+
+/**
+ * Flush the block device. Waits for requests in progress,
+ * then makes written data durable with fdatasync.
+ *
+ * @param dev the block device
+ * @param offset starting block offset
+ * @param len number of blocks to flush
+ * @return SUCCESS if successful, E_UNAVAIL if device unavailable
+ */
+static int uringdev_flush(struct fs_dev_blkdev *dev, int offset, int len)
+{
+    struct uring_dev *pvt = dev->private;
+    if (pvt->fd < 0 || uringdev_wait(dev, NULL) != SUCCESS) {
+        return E_UNAVAIL;
+    }
+#if defined(__APPLE__)
+    return (fsync(pvt->fd) == 0) ? SUCCESS : E_UNAVAIL;  // no fdatasync
+#else
+    return (fdatasync(pvt->fd) == 0) ? SUCCESS : E_UNAVAIL;
+#endif
+}
+
+/**
+ * Close the block device. Waits for requests in progress.
+ * After this any further access to that device will fail.
+ *
+ * @param dev the block device
+ */
+static void uringdev_close(struct fs_dev_blkdev *dev)
+{
+    struct uring_dev *pvt = dev->private;
+
+    if (pvt->ring_fd >= 0) {
+        while (pvt->inflight > 0 && ring_enter(pvt, 1) == 0) {
+            ring_process(pvt);
+        }
+        ring_close(pvt);
+    }
+    if (pvt->fd >= 0) {
+        close(pvt->fd);
+        pvt->fd = -1;
+    }
+    pvt->nblks = 0;
+
+    free(dev->private);  // free private storage
+    dev->private = NULL; // crash any attempts to access
+    free(dev);
+}
+
+/** Operations on this block device */
+static struct blkdev_ops uringdev_ops = {
+    .num_blocks = uringdev_num_blocks,
+    .read = uringdev_read,
+    .write = uringdev_write,
+    .flush = uringdev_flush,
+    .close = uringdev_close,
+    .submit = uringdev_submit,
+    .wait = uringdev_wait
+};
+
+/**
+ * Create an asynchronous block device over a specified image file.
+ * The file is created if it does not exist. If nblks is positive,
+ * a shorter file is extended to nblks blocks; if nblks is 0, the
+ * device size is the file size. If io_uring is not available, the
+ * requests are performed when submitted. The device supports the
+ * asynchronous blkdev_ops, which complete requests by callback;
+ * uring_blkdev_submit() requests are instead returned by
+ * uring_blkdev_reap().
+ *
+ * @param path the path of the image file
+ * @param nblks the number of blocks for the device, or 0 for file size
+ * @param depth maximum number of requests in progress
+ * @return the block device or NULL if cannot create the block device
+ */
+struct fs_dev_blkdev *uring_blkdev_create(const char *path, int nblks, int depth)
+{
+    if (nblks < 0 || depth < 1) {
+        return NULL;
+    }
+    int fd = open(path, O_RDWR | O_CREAT, 0666);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    // size device from file or extend file to device size
+    struct stat sb;
+    if (fstat(fd, &sb) < 0) {
+        close(fd);
+        return NULL;
+    }
+    if (nblks == 0) {
+        nblks = sb.st_size / BLOCK_SIZE;
+    } else if (sb.st_size < (off_t)nblks * BLOCK_SIZE) {
+        if (ftruncate(fd, (off_t)nblks * BLOCK_SIZE) < 0) {
+            close(fd);
+            return NULL;
+        }
+    }
+    if (nblks == 0) {
+        close(fd);  // empty device
+        return NULL;
+    }
+
+    struct fs_dev_blkdev *dev = malloc(sizeof(struct fs_dev_blkdev));
+    struct uring_dev *pvt = calloc(1, sizeof(struct uring_dev));
+    if (dev == NULL || pvt == NULL) {
+        free(dev);
+        free(pvt);
+        close(fd);
+        return NULL;
+    }
+    pvt->fd = fd;
+    pvt->nblks = nblks;
+    pvt->depth = depth;
+    pvt->ring_fd = -1;
+    ring_setup(pvt);  // requests performed on submit if not available
+
+    dev->private = pvt;
+    dev->ops = &uringdev_ops;
+    return dev;
+}
+
+/**
+ * Submit requests to an asynchronous block device. Fewer requests
+ * than requested are submitted if the device queue is full; reap
+ * completed requests to make room. The requests and their buffers
+ * must remain valid until reaped. Requests that cannot be passed
+ * to the kernel are completed with E_UNAVAIL.
+ *
+ * Errors
+ *   E_UNAVAIL if the device is unavailable
+ *
+ * @param dev the asynchronous block device
+ * @param reqs the requests
+ * @param n the number of requests
+ * @return number of requests submitted, or error
+ */
+int uring_blkdev_submit(struct fs_dev_blkdev *dev, struct blkdev_req *reqs[], int n)
+{
+    struct uring_dev *pvt = dev->private;
+    if (pvt->fd < 0) {
+        return E_UNAVAIL;
+    }
+
+    int i;
+    for (i = 0; i < n; i++) {
+        if (pvt->ring_fd >= 0 && pvt->inflight >= pvt->depth) {
+            break;  // queue full
+        }
+        reqs[i]->reap = 1;
+        reqs[i]->status = BLKDEV_PENDING;
+        req_start(pvt, reqs[i]);
+    }
+    if (pvt->ring_fd >= 0 && ring_enter(pvt, 0) < 0) {
+        // withdraw the requests not passed to the kernel and
+        // complete them as failed, to be reaped with the others
+        for (int k = i-1; k >= 0; k--) {
+            if (reqs[k]->status != BLKDEV_PENDING) {
+                continue;  // completed without queuing
+            }
+            if (ring_unqueue(pvt, reqs[k]) != 0) {
+                break;  // passed to the kernel
+            }
+            req_complete(pvt, reqs[k], E_UNAVAIL);
+        }
+    }
+    return i;
+}
+
+/**
+ * Reap completed requests from an asynchronous block device.
+ * The status of each completed request is SUCCESS, E_SIZE if
+ * out of range, or E_UNAVAIL if the transfer failed.
+ *
+ * @param dev the asynchronous block device
+ * @param reqs returns the completed requests
+ * @param max the maximum number of requests to return
+ * @param wait 1 to wait for a completion if requests are in progress
+ * @return number of completed requests returned
+ */
+int uring_blkdev_reap(struct fs_dev_blkdev *dev, struct blkdev_req *reqs[], int max, int wait)
+{
+    struct uring_dev *pvt = dev->private;
+    if (pvt->ring_fd >= 0) {
+        ring_process(pvt);
+        ring_enter(pvt, 0);  // resubmit short transfers
+        while (wait && pvt->ready_head == NULL && pvt->inflight > 0) {
+            if (ring_enter(pvt, 1) < 0) {
+                break;
+            }
+            ring_process(pvt);
+        }
+    }
+
+    int n;
+    for (n = 0; n < max && pvt->ready_head != NULL; n++) {
+        reqs[n] = pvt->ready_head;
+        pvt->ready_head = reqs[n]->next;
+    }
+    if (pvt->ready_head == NULL) {
+        pvt->ready_tail = NULL;
+    }
+    return n;
+}
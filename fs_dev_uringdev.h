@@ -0,0 +1,63 @@
+/*
+ * fs_dev_uringdev.h
+ *
+ * description: asynchronous image file block device
+ * using io_uring for CS 7600 / CS 5600 file system
+ *
+ * Peter Desnoyers, Northeastern Computer Science, 2015
+ * Philip Gust, Northeastern Computer Science, 2019
+ */
+
+#ifndef FS_DEV_URINGDEV_H_
+#define FS_DEV_URINGDEV_H_
+
+#include "fs_dev_blkdev.h"
+
+/**
+ * Create an asynchronous block device over a specified image file.
+ * The file is created if it does not exist. If nblks is positive,
+ * a shorter file is extended to nblks blocks; if nblks is 0, the
+ * device size is the file size. If io_uring is not available, the
+ * requests are performed when submitted. The device supports the
+ * asynchronous blkdev_ops, which complete requests by callback;
+ * uring_blkdev_submit() requests are instead returned by
+ * uring_blkdev_reap().
+ *
+ * @param path the path of the image file
+ * @param nblks the number of blocks for the device, or 0 for file size
+ * @param depth maximum number of requests in progress
+ * @return the block device or NULL if cannot create the block device
+ */
+extern struct fs_dev_blkdev *uring_blkdev_create(const char *path, int nblks, int depth);
+
+/**
+ * Submit requests to an asynchronous block device. Fewer requests
+ * than requested are submitted if the device queue is full; reap
+ * completed requests to make room. The requests and their buffers
+ * must remain valid until reaped. Requests that cannot be passed
+ * to the kernel are completed with E_UNAVAIL.
+ *
+ * Errors
+ *   E_UNAVAIL if the device is unavailable
+ *
+ * @param dev the asynchronous block device
+ * @param reqs the requests
+ * @param n the number of requests
+ * @return number of requests submitted, or error
+ */
+extern int uring_blkdev_submit(struct fs_dev_blkdev *dev, struct blkdev_req *reqs[], int n);
+
+/**
+ * Reap completed requests from an asynchronous block device.
+ * The status of each completed request is SUCCESS, E_SIZE if
+ * out of range, or E_UNAVAIL if the transfer failed.
+ *
+ * @param dev the asynchronous block device
+ * @param reqs returns the completed requests
+ * @param max the maximum number of requests to return
+ * @param wait 1 to wait for a completion if requests are in progress
+ * @return number of completed requests returned
+ */
+extern int uring_blkdev_reap(struct fs_dev_blkdev *dev, struct blkdev_req *reqs[], int max, int wait);
+
+#endif /* FS_DEV_URINGDEV_H_ */
@@ -9,28 +9,38 @@
 
 #include <stdlib.h>
 #include <time.h>
+#include <errno.h>
 
 #include "fs_op_chmodfile.h"
 
 /**
  * Change the permissions.
  *
+ * Errors
+ *   -EIO      - i/o error
+ *
  * @param fs the file system
  * @param file_ino the inode number
  * @param perms the permissions
- * @param 0 if successful
+ * @return 0 if successful, -error if error occurred
  */
 int fs_chmod(struct fs_ext2 *fs, int file_ino, int perms)
 {
     // permissions mask
     static const int perm_msk = S_IRWXU | S_IRWXG | S_IRWXO;
 
-    fs->inodes[file_ino].mode =
-          (fs->inodes[file_ino].mode & ~perm_msk)  // clear permissions
+    struct fs_inode *in = fs_inode_mut(fs, file_ino);  // mark inode changed
+    if (in == NULL) {
+        return -EIO;
+    }
+    in->mode =
+          (in->mode & ~perm_msk)  // clear permissions
         | (perms & perm_msk); // set new permissions
 
-    fs_mark_inode(fs, file_ino);  // mark inode changed
-    fs_sync_metadata(fs); // sync changed inode
+    // commit changed inode
+    if (fs_commit_metadata(fs) != 0) {
+        return -EIO;
+    }
 
     return 0;
 }
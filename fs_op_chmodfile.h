@@ -16,10 +16,13 @@
 /**
  * Change the permissions.
  *
+ * Errors
+ *   -EIO      - i/o error
+ *
  * @param fs the file system
  * @param file_ino the inode number
  * @param perms the permissions
- * @param 0 if successful
+ * @return 0 if successful, -error if error occurred
  */
 int fs_chmod(struct fs_ext2 *fs, int file_ino, int perms);
 
@@ -16,20 +16,30 @@
 /**
  * Change the owner and group.
  *
+ * Errors
+ *   -EIO      - i/o error
+ *
  * @param fs the file system
  * @param file_ino the inode number
  * @param owner the owner id
  * @param group the group id
- * @return 0 if successful
+ * @return 0 if successful, -error if error occurred
  */
 int fs_chown(struct fs_ext2 *fs, int file_ino, int owner, int group)
 {
+    struct fs_inode *in = fs_inode_mut(fs, file_ino);  // mark inode changed
+    if (in == NULL) {
+        return -EIO;
+    }
+
     // set owner and group mask
-    fs->inodes[file_ino].uid = owner;
-    fs->inodes[file_ino].gid = group;
+    in->uid = owner;
+    in->gid = group;
 
-    fs_mark_inode(fs, file_ino);  // mark inode changed
-    fs_sync_metadata(fs); // sync changed inode
+    // commit changed inode
+    if (fs_commit_metadata(fs) != 0) {
+        return -EIO;
+    }
 
     return 0;
 }
@@ -16,11 +16,14 @@
 /**
  * Change the owner and group.
  *
+ * Errors
+ *   -EIO      - i/o error
+ *
  * @param fs the file system
  * @param file_ino the inode number
  * @param owner the owner id
  * @param group the group id
- * @return 0 if successful
+ * @return 0 if successful, -error if error occurred
  */
 int fs_chown(struct fs_ext2 *fs, int file_ino, int owner, int group);
 
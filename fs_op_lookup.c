@@ -0,0 +1,111 @@
+/*
+ * fs_op_lookup.c
+ *
+ * description: look up names and resolve paths
+ * for CS 5600 / 7600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Philip Gust, March 2021
+ */
+
+#include <string.h>
+#include <sys/stat.h>
+#include <errno.h>
+
+#include "fs_op_lookup.h"
+#include "fs_util_dir.h"
+
+/**
+ * Look up the inode of a name in a directory.
+ * Results, including missing names, are cached.
+ *
+ * Errors
+ *   -ENAMETOOLONG  - name too long
+ *   -ENOTDIR  - dir_ino not a directory
+ *   -ENOENT   - name not found
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param dir_ino inode of directory
+ * @param name the entry name
+ * @return inode of entry if successful, -error if not found
+ */
+int fs_lookup(struct fs_ext2 *fs, int dir_ino, const char *name)
+{
+    // ensure the file name is not too long
+    if (strlen(name) >= FS_FILENAME_SIZE) {
+        return -ENAMETOOLONG; // name too long
+    }
+
+    // ensure dir_ino is a directory
+    const struct fs_inode *in = fs_inode(fs, dir_ino);
+    if (in == NULL) {
+        return -EIO;
+    }
+    if (!S_ISDIR(in->mode)) {
+        return -ENOTDIR;
+    }
+
+    // return cached entry or cached miss
+    int ino;
+    if (fs_dcache_lookup(fs->dcache, dir_ino, name, &ino)) {
+        return (ino > 0) ? ino : -ENOENT;
+    }
+
+    // look up entry in directory blocks and cache result
+    struct fs_dirblk dir_blk;
+    int status = fs_dir_lookup(fs, dir_ino, name, &dir_blk);
+    if (status == 0) {
+        ino = dir_blk.de[dir_blk.entry].inode;
+        fs_dcache_insert(fs->dcache, dir_ino, name, ino);
+        return ino;
+    } else if (status == -ENOENT) {
+        fs_dcache_insert(fs->dcache, dir_ino, name, 0);
+    }
+    return status;
+}
+
+/**
+ * Resolve a path to an inode. The path is relative
+ * to the root directory; a leading '/' is optional
+ * and repeated '/' separators are ignored.
+ *
+ * Errors
+ *   -ENAMETOOLONG  - path component too long
+ *   -ENOTDIR  - path prefix component not a directory
+ *   -ENOENT   - path component not found
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param path the path
+ * @return inode of path if successful, -error if not found
+ */
+int fs_namei(struct fs_ext2 *fs, const char *path)
+{
+    int ino = fs->root_inode;
+    char name[FS_FILENAME_SIZE];
+
+    for (const char *p = path; *p != '\0'; ) {
+        // skip separators
+        if (*p == '/') {
+            p++;
+            continue;
+        }
+
+        // copy next path component
+        size_t len = strcspn(p, "/");
+        if (len >= FS_FILENAME_SIZE) {
+            return -ENAMETOOLONG;
+        }
+        memcpy(name, p, len);
+        name[len] = '\0';
+        p += len;
+
+        // look up component in current directory
+        ino = fs_lookup(fs, ino, name);
+        if (ino < 0) {
+            return ino;
+        }
+    }
+    return ino;
+}
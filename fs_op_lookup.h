@@ -0,0 +1,50 @@
+/*
+ * fs_op_lookup.h
+ *
+ * description: look up names and resolve paths
+ * for CS 5600 / 7600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Philip Gust, March 2021
+ */
+
+#ifndef FS_OP_LOOKUP_H_
+#define FS_OP_LOOKUP_H_
+
+#include "fs_util_volume.h"
+
+/**
+ * Look up the inode of a name in a directory.
+ * Results, including missing names, are cached.
+ *
+ * Errors
+ *   -ENAMETOOLONG  - name too long
+ *   -ENOTDIR  - dir_ino not a directory
+ *   -ENOENT   - name not found
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param dir_ino inode of directory
+ * @param name the entry name
+ * @return inode of entry if successful, -error if not found
+ */
+int fs_lookup(struct fs_ext2 *fs, int dir_ino, const char *name);
+
+/**
+ * Resolve a path to an inode. The path is relative
+ * to the root directory; a leading '/' is optional
+ * and repeated '/' separators are ignored.
+ *
+ * Errors
+ *   -ENAMETOOLONG  - path component too long
+ *   -ENOTDIR  - path prefix component not a directory
+ *   -ENOENT   - path component not found
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param path the path
+ * @return inode of path if successful, -error if not found
+ */
+int fs_namei(struct fs_ext2 *fs, const char *path);
+
+#endif /* FS_OP_LOOKUP_H_ */
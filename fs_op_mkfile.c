@@ -15,51 +15,10 @@
 #include <ctype.h>
 
 #include "fs_op_mkfile.h"
+#include "fs_util_alloc.h"
+#include "fs_util_dir.h"
 #include "fs_dev_blkdev.h"
 
-/**
- * Gets a free inode number from the free list.
- *
- * Errors
- *   -ENOSPC   - free entry not found
- *
- * @param fs the file system
- * @return a free inode number or -error if none available
- */
-static int get_free_inode(struct fs_ext2 *fs)
-{
-    // allocate inode for file
-    for (int i = 1; i < fs->n_inodes; i++) {
-        if (FD_ISSET(i, fs->inode_map) == 0) {
-            FD_SET(i, fs->inode_map);  // mark allocated
-            fs_mark_inode(fs, i);  // mark inode metadata changed
-            return i;
-        }
-    }
-    return -ENOSPC;
-}
-
-/**
- * Gets a free block number from the free list.
- *
- * Errors
- *   -ENOSPC   - free entry not found
- *
- * @param fs the file system
- * @return free block number or -error if none available
- */
-static int get_free_blk(struct fs_ext2 *fs)
-{
-    for (int i = fs->n_meta; i < fs->n_blocks; i++) {
-        if (FD_ISSET(i, fs->block_map) == 0) {
-            FD_SET(i, fs->block_map);  // mark allocated
-            fs_mark_blk(fs, i);  // mark blk metadata changed
-            return i;
-        }
-    }
-    return -ENOSPC;
-}
-
 /**
  * Fold case of a character string in place.
  *
@@ -73,38 +32,17 @@ static void fold_case(char *str)
 }
 
 /**
- * Find free entry in a directory block for
- * named file.
+ * Free the inode and first block allocated for a new
+ * file or directory that could not be made.
  *
- * Errors
- *   -EEXIST   - entry already exists
- *   -ENOSPC   - free entry not found
- *
- * @param de storage for a directory block
- * @param name the name of the entry
- * @param ignore_case 1 for case-independent, 0 for case-dependent
- * @return entry in directory block or -error if
- *  dup or not available
+ * @param fs the file system
+ * @param file_ino the inode of the new file
+ * @param file_blkno the first block of the new file
  */
-static int get_free_entry_in_block(struct fs_dirent* de, const char *name, int ignore_case)
+static void free_new_file(struct fs_ext2 *fs, int file_ino, int file_blkno)
 {
-    // case-dependent or case-dependent comparison
-    static int (*compare[2])(const char*, const char*) = {strcmp, strcasecmp};
-
-    // find free directory entry;
-    // scan entire directory to check for dups
-    int entry = -ENOSPC;
-    for (int i = 0; i < DIRENTS_PER_BLK; i++) {
-        if (de[i].valid == 1) {
-            // check for duplicate existing entry
-            if (compare[ignore_case==1](de[i].name, name) == 0) {
-                return -EEXIST;
-            }
-        } else if (entry == -ENOSPC) { // first found
-            entry = i;
-        }
-    }
-    return entry;
+    fs_free_blk(fs, file_blkno);
+    fs_free_inode(fs, file_ino);
 }
 
 /**
@@ -135,63 +73,82 @@ static int mkentry(struct fs_ext2 *fs, int dir_ino, const char* name, mode_t mod
     }
 
     // ensure dir_ino is a directory
-    if (!S_ISDIR(fs->inodes[dir_ino].mode)) {
-        return -ENOTDIR;
-    }
-
-    // get block number of first directory block
-    int dir_blkno = fs->inodes[dir_ino].direct[0];
-    if (dir_blkno == 0) {
-        return -ENOSPC;  // no directory block
+    const struct fs_inode *in = fs_inode(fs, dir_ino);
+    if (in == NULL) {
+        return -EIO;
     }
-
-    // read the directory block
-    struct fs_dirent dir_de[DIRENTS_PER_BLK];
-    if (fs->dev->ops->read(fs->dev, dir_blkno, 1, dir_de) != SUCCESS) {
-        return -EIO;  // cannot read block
+    if (!S_ISDIR(in->mode)) {
+        return -ENOTDIR;
     }
+    int dir_gid = in->gid;
 
     // find free directory entry for name
-    int entry = get_free_entry_in_block(dir_de, name, fs->ignore_case);
-    if (entry < 0) {
-        return entry;
+    struct fs_dirblk dir_blk;
+    int status = fs_dir_alloc_entry(fs, dir_ino, name, &dir_blk);
+    if (status < 0) {
+        return status;
     }
+    struct fs_dirent *dir_de = dir_blk.de;
+    int entry = dir_blk.entry;
 
-    int file_ino, file_blkno;
+    int file_ino, file_blkno = 0;
     time_t t = time(NULL);
 
     if (flag > 0) {  // link to existing inode
         file_ino = flag;
 
         // cannot link a directory
-        if (S_ISDIR(fs->inodes[file_ino].mode)) {
+        if ((in = fs_inode(fs, file_ino)) == NULL) {
+            return -EIO;
+        }
+        if (S_ISDIR(in->mode)) {
             return -EISDIR;
         }
     } else {  // create a new file or subdir
-        // allocate block for new file
-        file_blkno = get_free_blk(fs);
+        // get free inode for new file or subdir
+        int type = (-flag) & S_IFMT;  // isolate file type
+        file_ino = fs_alloc_inode(fs, dir_ino, type);
+        if (file_ino < 0) {
+            return file_ino;  // no inode available
+        }
+
+        // allocate block for new file near the directory
+        // block, if that is in the group of its inode
+        int goal = dir_blk.blkno + 1;
+        if (goal / fs->group_blks != file_ino / fs->group_inodes) {
+            goal = 0;
+        }
+        file_blkno = fs_alloc_blk(fs, file_ino, goal);
         if (file_blkno < 0) {
+            fs_free_inode(fs, file_ino);
             return file_blkno;
         }
-
-        // get free inode for new file
-        file_ino = get_free_inode(fs);
-        if (file_ino < 0) {
-            return file_ino;  // no inode available
+        struct fs_inode *file_in = fs_inode_mut(fs, file_ino);
+        if (file_in == NULL) {
+            free_new_file(fs, file_ino, file_blkno);
+            return -EIO;
         }
 
         // initialize file inode for new file
-        int type = (-flag) & S_IFMT;  // isolate file type
         int perm = mode & 0777;  // isolate file permissions
-        fs->inodes[file_ino] = (struct fs_inode) {
+        *file_in = (struct fs_inode) {
                 .uid = 1001, // inode owner
-                .gid = fs->inodes[dir_ino].gid, // inode group matches directory
+                .gid = dir_gid, // inode group matches directory
                 .mode = (type | perm), // combine type and permissions
                 .ctime = t, .mtime = t,
                 .size = 0, .nlink = 0,
                 .direct = {file_blkno, 0, 0, 0, 0, 0},
                 .indir_1 = 0, .indir_2 = 0
         };
+
+        // map new regular files by extents if enabled
+        if ((fs->features & FS_FEATURE_EXTENTS) && (type == S_IFREG)) {
+            file_in->flags = FS_INODE_EXTENTS;
+            file_in->ext = (struct fs_extent_root) {
+                    .n_extents = 1, .overflow = 0,
+                    .extents = {{.lblk = 0, .pblk = file_blkno, .len = 1}}
+            };
+        }
     }
 
     // add file inode for new file to directory
@@ -205,25 +162,14 @@ static int mkentry(struct fs_ext2 *fs, int dir_ino, const char* name, mode_t mod
         fold_case(dir_de[entry].name);
     }
 
-    // write directory block with new file entry back to disk
-    if (fs->dev->ops->write(fs->dev, dir_blkno, 1, dir_de) != SUCCESS) {
-        return -EIO;
-    }
-
-    // increase size of dir_inode by size of new directory entry
-    fs->inodes[dir_ino].size += sizeof(struct fs_dirent);
-    fs->inodes[dir_ino].mtime = t;
-    fs_mark_inode(fs, dir_ino);  // mark dir inode changed
-
-    // increment link count of file for new directory entry
-    fs->inodes[file_ino].nlink++;
-    fs_mark_inode(fs, file_ino);
-
-    // make "." and ".." entries in new subdirectory block
+    // start writing "." and ".." entries to new subdirectory block
+    struct fs_dirent subdir_de[DIRENTS_PER_BLK(FS_MAX_BLOCK_SIZE)];
+    struct blkdev_req subdir_req = {
+            .op = BLKDEV_WRITE, .first_blk = file_blkno, .num_blks = 1, .buf = subdir_de
+    };
     if (flag == -S_IFDIR) {
         // init directory block for "." and ".." entries
-        struct fs_dirent subdir_de[DIRENTS_PER_BLK];
-        memset(subdir_de, 0, FS_BLOCK_SIZE);
+        memset(subdir_de, 0, fs->blk_size);
 
         // entry ".", links to new subdirectory
         subdir_de[0] = (struct fs_dirent) {
@@ -239,22 +185,60 @@ static int mkentry(struct fs_ext2 *fs, int dir_ino, const char* name, mode_t mod
                 .name = ".."
         };
 
-        // write subdirectory block to disk
-        if (fs->dev->ops->write(fs->dev, file_blkno, 1, subdir_de) != SUCCESS) {
+        // overlaps with directory block write
+        if (blkdev_submit(fs->dev, &subdir_req) != SUCCESS) {
+            free_new_file(fs, file_ino, file_blkno);
             return -EIO;
         }
+    }
+
+    // write directory block with new file entry back to disk
+    int dir_status = fs_dir_write(fs, &dir_blk);
+    int subdir_status = (flag == -S_IFDIR) ? blkdev_wait(fs->dev, &subdir_req) : SUCCESS;
+
+    // mark dir and file inodes changed
+    struct fs_inode *dir_in = NULL, *file_in = NULL;
+    if ((dir_status == 0) && (subdir_status == SUCCESS)) {
+        dir_in = fs_inode_mut(fs, dir_ino);
+        file_in = fs_inode_mut(fs, file_ino);
+    }
+    if ((dir_in == NULL) || (file_in == NULL)) {
+        // remove the entry if it was written, and
+        // release the inode and block of a new file
+        if (dir_status == 0) {
+            memset(&dir_de[entry], 0, sizeof(struct fs_dirent));
+            fs_dir_write(fs, &dir_blk);
+        }
+        if (flag < 0) {
+            free_new_file(fs, file_ino, file_blkno);
+        }
+        return -EIO;
+    }
+    fs_dcache_invalidate(fs->dcache, dir_ino, name);  // drop cached miss
 
+    // increase size of dir_inode by size of new directory entry
+    dir_in->size += sizeof(struct fs_dirent);
+    dir_in->mtime = t;
+
+    // increment link count of file for new directory entry
+    file_in->nlink++;
+
+    // update counts for "." and ".." entries in new subdirectory
+    if (flag == -S_IFDIR) {
         // increase size of subdir inode for "." and ".." entries
-        fs->inodes[file_ino].size += 2*sizeof(struct fs_dirent);
+        file_in->size += 2*sizeof(struct fs_dirent);
 
         // increase link count of subdir inode for "." subdir entry
-        fs->inodes[file_ino].nlink++;
+        file_in->nlink++;
 
         // increase link count of dir inode for ".." subdir entry
-        fs->inodes[dir_ino].nlink++;
+        dir_in->nlink++;
     }
 
-    fs_sync_metadata(fs);  // sync changed metadata
+    // commit changed metadata
+    if (fs_commit_metadata(fs) != 0) {
+        return -EIO;
+    }
     return file_ino;  // success
 }
 
@@ -11,13 +11,16 @@
 #include <sys/stat.h>
 
 #include "fs_op_readdir.h"
+#include "fs_util_dir.h"
 #include "fs_dev_blkdev.h"
 #include "fsx600.h"
 
 /** struct for a directory stream */
 struct FS_DIR {
-    struct fs_dirent *de;
-    int cur_entry;
+    struct fs_ext2 *fs;		/** the file system */
+    int dir_ino;			/** inode of directory */
+    struct fs_dirblk blk;	/** current directory block */
+    int cur_entry;			/** next entry in current block */
 };
 
 /**
@@ -32,26 +35,23 @@ struct FS_DIR {
  */
 FS_DIR* fs_opendir(struct fs_ext2 *fs, int dir_ino) {
     // ensure dir_ino is a directory
-    if (!S_ISDIR(fs->inodes[dir_ino].mode)) {
+    const struct fs_inode *in = fs_inode(fs, dir_ino);
+    if ((in == NULL) || !S_ISDIR(in->mode)) {
         return NULL;
     }
 
     // create and initialize directory stream
     FS_DIR *dir = malloc(sizeof(FS_DIR));
-    dir->de = calloc(1, FS_BLOCK_SIZE);
+    dir->fs = fs;
+    dir->dir_ino = dir_ino;
     dir->cur_entry = 0;
 
-    // get block number of first file block
-    int file_blkno = fs->inodes[dir_ino].direct[0];
-    if (file_blkno > 0) {
-        // read file block from disk
-        if (fs->dev->ops->read(fs->dev, file_blkno, 1, dir->de) == SUCCESS) {
-            return dir;
-        }
+    // read first directory block from disk
+    if (fs_dir_read(fs, dir_ino, 0, &dir->blk) == 0) {
+        return dir;
     }
 
     // cannot read directory
-    free(dir->de);
     free(dir);
     return NULL;
 }
@@ -62,7 +62,6 @@ FS_DIR* fs_opendir(struct fs_ext2 *fs, int dir_ino) {
  * @param dirp the directory stream
  */
 void fs_closedir(FS_DIR *dirp) {
-    free(dirp->de);
     free(dirp);
 }
 
@@ -78,12 +77,19 @@ void fs_closedir(FS_DIR *dirp) {
  */
 struct fs_dirent *fs_readdir(FS_DIR *dirp)
 {
-    for ( ; dirp->cur_entry < DIRENTS_PER_BLK; dirp->cur_entry++) {
-        // find and return next valid entry
-        if (dirp->de[dirp->cur_entry].valid) {
-            return &dirp->de[dirp->cur_entry++];  // move cursor for next read
+    for (;;) {
+        for ( ; dirp->cur_entry < dirp->blk.n_entries; dirp->cur_entry++) {
+            // find and return next valid entry
+            if (dirp->blk.de[dirp->cur_entry].valid) {
+                return &dirp->blk.de[dirp->cur_entry++];  // move cursor for next read
+            }
+        }
+
+        // advance to next directory block
+        if (fs_dir_next(dirp->fs, dirp->dir_ino, &dirp->blk) != 0) {
+            dirp->cur_entry = dirp->blk.n_entries;
+            return NULL;  // no more entries
         }
+        dirp->cur_entry = 0;
     }
-    // no more entries
-    return NULL;
-}
\ No newline at end of file
+}
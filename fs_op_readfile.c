@@ -12,14 +12,18 @@
 #include <errno.h>
 
 #include "fs_op_readfile.h"
+#include "fs_util_bmap.h"
 #include "fs_dev_blkdev.h"
 
+/** maximum file blocks read with one device call */
+enum {FS_READ_BATCH = 32};
+
 /**
  * Read contents from a file starting at a file offset.
+ * Unmapped blocks within the file read as zeros.
  *
  * Errors
  *   -ENISDIR  - file_ino is a directory
- *   -ENOSPC   - block not found
  *   -EIO      - i/o error
  *
  * @param fs the file system
@@ -32,31 +36,66 @@
 int fs_preadfile(struct fs_ext2 *fs, int file_ino, void *content, int n_bytes, int offset)
 {
     // ensure file_ino is a regular file
-    if (!S_ISREG(fs->inodes[file_ino].mode)) {
-        return -EISDIR;
+    const struct fs_inode *in = fs_inode(fs, file_ino);
+    if (in == NULL) {
+        return -EIO;
     }
-
-    // get block number of first file block
-    int file_blkno = fs->inodes[file_ino].direct[0];
-    if (file_blkno == 0) {
-        return -ENOSPC;  // no file block
+    if (!S_ISREG(in->mode)) {
+        return -EISDIR;
     }
 
     // compute number of bytes to read
-    int n_avail = fs->inodes[file_ino].size - offset;
+    int n_avail = in->size - offset;
     int n_read =  (n_bytes < n_avail) ? n_bytes : n_avail;
     if ((n_bytes <= 0) || (offset < 0) || (n_read <= 0)) {
         return 0;
     }
 
-    // read file block from disk
-    block file_blk;
-    if (fs->dev->ops->read(fs->dev, file_blkno, 1, file_blk) != SUCCESS) {
-        return -EIO;
-    }
+    // read file blocks that overlap the range in batches
+    uint8_t *dst = content;
+    uint8_t part_blk[2][FS_MAX_BLOCK_SIZE];  // first and last blocks may be partial
+    struct blkdev_iovec iov[FS_READ_BATCH];
+    for (int pos = offset; pos < offset + n_read; ) {
+        int n_iov = 0, n_part = 0;
+        int part_off[2], part_len[2];
+        uint8_t *part_dst[2];
+
+        // map blocks of batch, zeroing unmapped blocks
+        for ( ; (n_iov < FS_READ_BATCH) && (pos < offset + n_read); ) {
+            int blk_off = pos % fs->blk_size;
+            int n = fs->blk_size - blk_off;
+            if (n > offset + n_read - pos) {
+                n = offset + n_read - pos;
+            }
+
+            // get block number of file block
+            int file_blkno = fs_bmap(fs, file_ino, pos / fs->blk_size, 0, NULL);
+            if (file_blkno < 0) {
+                return file_blkno;
+            }
 
-    // copy block to contents
-    memcpy(content, file_blk + offset, n_read);
+            if (file_blkno == 0) {  // unmapped block reads as zeros
+                memset(dst, 0, n);
+            } else if (n == fs->blk_size) {  // read whole block to contents
+                iov[n_iov++] = (struct blkdev_iovec) {.blkno = file_blkno, .buf = dst};
+            } else {  // read file block and copy part to contents
+                part_off[n_part] = blk_off;
+                part_len[n_part] = n;
+                part_dst[n_part] = dst;
+                iov[n_iov++] = (struct blkdev_iovec) {.blkno = file_blkno, .buf = part_blk[n_part++]};
+            }
+            dst += n;
+            pos += n;
+        }
+
+        // read mapped blocks of batch
+        if (blkdev_readv(fs->dev, iov, n_iov) != SUCCESS) {
+            return -EIO;
+        }
+        for (int i = 0; i < n_part; i++) {
+            memcpy(part_dst[i], part_blk[i] + part_off[i], part_len[i]);
+        }
+    }
 
     return n_read;  // success
 }
@@ -67,7 +106,6 @@ int fs_preadfile(struct fs_ext2 *fs, int file_ino, void *content, int n_bytes, i
  *
  * Errors
  *   -ENISDIR  - file_ino is a directory
- *   -ENOSPC   - block not found
  *   -EIO      - i/o error
  *
  * @param fs the file system
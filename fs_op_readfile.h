@@ -14,10 +14,10 @@
 
 /**
  * Read contents from a file starting at a file offset.
+ * Unmapped blocks within the file read as zeros.
  *
  * Errors
  *   -ENISDIR  - file_ino is a directory
- *   -ENOSPC   - block not found
  *   -EIO      - i/o error
  *
  * @param fs the file system
@@ -34,7 +34,6 @@ int fs_preadfile(struct fs_ext2 *fs, int file_ino, void *content, int n_bytes, i
  *
  * Errors
  *   -ENISDIR  - file_ino is a directory
- *   -ENOSPC   - block not found
  *   -EIO      - i/o error
  *
  * @param fs the file system
@@ -9,6 +9,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 
 #include "fs_op_statfile.h"
 #include "fs_dev_blkdev.h"
@@ -35,11 +36,15 @@ static inline int div_round_up(int n, int m) {
  * since last access time is not recorded
  * in struct fs_inode.
  *
+ * Errors
+ *   -EIO      - i/o error
+ *
  * @param fs the file system
  * @param file_ino the inode number
  * @param sb stat buffer
+ * @return 0 if successful, -error if error occurred
  */
-void fs_stat(struct fs_ext2 *fs, int file_ino, struct stat *sb) {
+int fs_stat(struct fs_ext2 *fs, int file_ino, struct stat *sb) {
     // initialize fields to 0
     memset(sb, 0, sizeof(struct stat));
 
@@ -57,8 +62,11 @@ void fs_stat(struct fs_ext2 *fs, int file_ino, struct stat *sb) {
     // st_ctime:        creation time of the file
 
     // point to inode for inum
-    struct fs_inode *in = &fs->inodes[file_ino];
-    sb->st_blksize = FS_BLOCK_SIZE;
+    const struct fs_inode *in = fs_inode(fs, file_ino);
+    if (in == NULL) {
+        return -EIO;
+    }
+    sb->st_blksize = fs->blk_size;
     sb->st_ino = file_ino;
     sb->st_mode = in->mode;
     sb->st_nlink = in->nlink;
@@ -66,8 +74,9 @@ void fs_stat(struct fs_ext2 *fs, int file_ino, struct stat *sb) {
     sb->st_gid = in->gid;
     sb->st_size = in->size;
     // actual number of blocks expressed as multiples of 512 byte blocks
-    int n_blks = div_round_up(in->size, FS_BLOCK_SIZE);
-    sb->st_blocks =  n_blks * FS_BLOCK_SIZE / 512;
+    int n_blks = div_round_up(in->size, fs->blk_size);
+    sb->st_blocks =  n_blks * (fs->blk_size / 512);
     sb->st_atime = sb->st_mtime = in->mtime;
     sb->st_ctime = in->ctime;
+    return 0;
 }
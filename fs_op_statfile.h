@@ -24,10 +24,14 @@
  * since last access time is not recorded
  * in struct fs_inode.
  *
+ * Errors
+ *   -EIO      - i/o error
+ *
  * @param fs the file system
  * @param file_ino the inode number
  * @param sb stat buffer
+ * @return 0 if successful, -error if error occurred
  */
-void fs_stat(struct fs_ext2 *fs, int file_ino, struct stat *sb);
+int fs_stat(struct fs_ext2 *fs, int file_ino, struct stat *sb);
 
 #endif /* FS_OP_STATFILE_H_ */
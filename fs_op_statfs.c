@@ -37,23 +37,11 @@ void fs_statfs(struct fs_ext2 *fs, struct statvfs *sb)
     //  f_favail:	total free file nodes available (same as ffree to non-superuser)
     //  f_namemax:	maximum length of file name (not including null terminator)
 
-    // compute number of free blocks
-    int n_blocks_free = 0;
-    for (int i = 0; i < fs->n_blocks; i++) {
-        if (FD_ISSET(i, fs->block_map) == 0) {
-            n_blocks_free++;
-        }
-    }
+    // free counts are kept in the superblock
+    int n_blocks_free = fs->super->free_blocks;
+    int n_inodes_free = fs->super->free_inodes;
 
-    // compute number of free inodes
-    int n_inodes_free = 0;
-    for (int i = 0; i < fs->n_inodes; i++) {
-        if (FD_ISSET(i, fs->inode_map) == 0) {
-            n_inodes_free++;
-        }
-    }
-
-    sb->f_bsize = FS_BLOCK_SIZE;
+    sb->f_bsize = fs->blk_size;
     sb->f_blocks = fs->n_blocks;
     sb->f_bfree = n_blocks_free;
     sb->f_bavail = sb->f_bfree;
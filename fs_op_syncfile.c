@@ -0,0 +1,55 @@
+/*
+ * fs_op_syncfile.c
+ *
+ * description: fsync, syncfs for CS 5600 / 7600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Philip Gust, March 2021
+ */
+
+#include <errno.h>
+
+#include "fs_op_syncfile.h"
+
+/**
+ * Make the contents and metadata of a file durable.
+ * File data is written when changed. Changed metadata
+ * is not tracked per file and is committed as one
+ * journal transaction, so this is the same as
+ * fs_syncfs: all changed metadata is written and
+ * the device is flushed.
+ *
+ * Errors
+ *   -EINVAL   - invalid inode number
+ *   -EBUSY    - transaction active
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param file_ino the inode number
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_fsync(struct fs_ext2 *fs, int file_ino)
+{
+    if ((file_ino <= 0) || (file_ino >= fs->n_inodes)) {
+        return -EINVAL;
+    }
+    return fs_syncfs(fs);
+}
+
+/**
+ * Make all changes to the file system durable.
+ *
+ * Errors
+ *   -EBUSY    - transaction active
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_syncfs(struct fs_ext2 *fs)
+{
+    if (fs->txn_active) {
+        return -EBUSY;  // metadata is synchronized by fs_txn_commit
+    }
+    return fs_sync_volume(fs);
+}
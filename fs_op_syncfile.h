@@ -0,0 +1,43 @@
+/*
+ * fs_op_syncfile.h
+ *
+ * description: fsync, syncfs for CS 5600 / 7600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Philip Gust, March 2021
+ */
+
+#ifndef FS_OP_SYNCFILE_H_
+#define FS_OP_SYNCFILE_H_
+
+#include "fs_util_volume.h"
+
+/**
+ * Make the contents and metadata of a file durable.
+ * Changed metadata is not tracked per file, so this
+ * is the same as fs_syncfs.
+ *
+ * Errors
+ *   -EINVAL   - invalid inode number
+ *   -EBUSY    - transaction active
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param file_ino the inode number
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_fsync(struct fs_ext2 *fs, int file_ino);
+
+/**
+ * Make all changes to the file system durable.
+ *
+ * Errors
+ *   -EBUSY    - transaction active
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_syncfs(struct fs_ext2 *fs);
+
+#endif /* FS_OP_SYNCFILE_H_ */
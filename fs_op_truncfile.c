@@ -13,7 +13,8 @@
 #include <time.h>
 #include <errno.h>
 
-#include "fs_op_writefile.h"
+#include "fs_op_truncfile.h"
+#include "fs_util_bmap.h"
 #include "fs_dev_blkdev.h"
 
 /**
@@ -22,14 +23,12 @@
  * exceeds length, any extra data is discarded.
  * If the file size is smaller than length, the
  * file is extended and filled with zeros to the
- * indicated length.
- *
- * Note: current implementation supports
- * only 1 block of content
+ * indicated length. Blocks past the new end
+ * of file are freed; extended blocks are not
+ * allocated until written.
  *
  * Errors
  *   -EISDIR   - file_in is a directory
- *   -ENOSPC   - free entry or block not found
  *   -EFBIG    - content too large
  *   -EACCES   - if no write permission
  *   -EIO      - i/o error
@@ -43,47 +42,48 @@
 int fs_truncfile(struct fs_ext2 *fs, int file_ino, int n_bytes)
 {
     // ensure file_ino is a regular file
-    if (!S_ISREG(fs->inodes[file_ino].mode)) {
+    const struct fs_inode *in = fs_inode(fs, file_ino);
+    if (in == NULL) {
+        return -EIO;
+    }
+    if (!S_ISREG(in->mode)) {
         return -EISDIR;
     }
 
-    // ensure bytes fit in block
-    if ((n_bytes < 0) || (n_bytes > FS_BLOCK_SIZE)) {
+    // ensure bytes fit in file
+    if ((n_bytes < 0) || (n_bytes > FS_MAX_FILE_SIZE(fs->blk_size))) {
         return -EFBIG;  // contents too large/small
     }
 
-    // get block number of first file block
-    int file_blkno = fs->inodes[file_ino].direct[0];
-    if (file_blkno == 0) {
-        return -ENOSPC;  // no file block
-    }
-
     // no change
-    int cur_bytes = fs->inodes[file_ino].size;
+    int cur_bytes = in->size;
     if (n_bytes == cur_bytes) {
         return 0;
     }
 
-    // update block to zero extended bytes
+    int status;
     if (n_bytes > cur_bytes) {
-        // read file block from disk
-        block file_blk;
-        if (fs->dev->ops->read(fs->dev, file_blkno, 1, file_blk) != SUCCESS) {
-            return -EIO;
-        }
-        memset(((char*)file_blk)+cur_bytes, 0, n_bytes-cur_bytes);
-
-        // write block back to disk
-        if (fs->dev->ops->write(fs->dev, file_blkno, 1, file_blk) != SUCCESS) {
-            return -EIO;
-        }
+        // zero extended bytes in current last block
+        status = fs_bzero_tail(fs, file_ino, cur_bytes);
+    } else {
+        // free blocks past new end of file
+        status = fs_btrunc(fs, file_ino, (n_bytes + fs->blk_size - 1) / fs->blk_size);
+    }
+    if (status < 0) {
+        return status;
     }
 
     // update file inode for file block
-    fs->inodes[file_ino].mtime = time(NULL); // update modify time
-    fs->inodes[file_ino].size = n_bytes; // update size
-    fs_mark_inode(fs, file_ino);  // mark dir inode changed
+    struct fs_inode *file_in = fs_inode_mut(fs, file_ino);  // mark inode changed
+    if (file_in == NULL) {
+        return -EIO;
+    }
+    file_in->mtime = time(NULL); // update modify time
+    file_in->size = n_bytes; // update size
 
-    fs_sync_metadata(fs);  // sync changed metadata
+    // commit changed metadata
+    if (fs_commit_metadata(fs) != 0) {
+        return -EIO;
+    }
     return 0;  // success
-}
+}
\ No newline at end of file
@@ -18,14 +18,12 @@
  * exceeds length, any extra data is discarded.
  * If the file size is smaller than length, the
  * file is extended and filled with zeros to the
- * indicated length.
- *
- * Note: current implementation supports
- * only 1 block of content
+ * indicated length. Blocks past the new end
+ * of file are freed; extended blocks are not
+ * allocated until written.
  *
  * Errors
  *   -EISDIR   - file_in is a directory
- *   -ENOSPC   - free entry or block not found
  *   -EFBIG    - content too large
  *   -EIO      - i/o error
  *
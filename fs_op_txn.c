@@ -0,0 +1,134 @@
+/*
+ * fs_op_txn.c
+ *
+ * description: multi-operation transactions for
+ * CS 5600 / 7600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Philip Gust, March 2021
+ */
+
+#include <errno.h>
+
+#include "fs_op_txn.h"
+#include "fs_util_journal.h"
+
+/**
+ * Begin a transaction. Metadata, directory blocks, and
+ * indirect blocks changed by operations such as fs_mkfile,
+ * fs_pwritefile, fs_chmod, fs_chown, and fs_utime are held
+ * in memory until fs_txn_commit, and are restored by
+ * fs_txn_abort. On a volume with a journal the commit is
+ * atomic across a crash. Transactions do not nest.
+ * Changed metadata is synchronized first.
+ *
+ * Errors
+ *   -EBUSY    - transaction already active
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_txn_begin(struct fs_ext2 *fs)
+{
+    if (fs->txn_active) {
+        return -EBUSY;
+    }
+
+    // start from synchronized metadata so abort
+    // can restore the last synchronized copy
+    int status = fs_sync_metadata(fs);
+    if (status != 0) {
+        return status;
+    }
+    fs->txn_active = 1;
+    return 0;
+}
+
+/**
+ * Commit a transaction, synchronizing all metadata
+ * changed since fs_txn_begin at once. If the changes
+ * do not fit in one journal transaction, the transaction
+ * remains active so that it can be aborted.
+ *
+ * Errors
+ *   -EINVAL   - no transaction active
+ *   -EFBIG    - changes do not fit in the journal
+ *   -ENOMEM   - cannot allocate journal transaction
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_txn_commit(struct fs_ext2 *fs)
+{
+    if (!fs->txn_active) {
+        return -EINVAL;
+    }
+    if ((fs->journal_base != 0) && (fs->n_dirty > fs_journal_capacity(fs))) {
+        return -EFBIG;  // cannot commit atomically
+    }
+    fs->txn_active = 0;
+    return fs_sync_metadata(fs);
+}
+
+/**
+ * Abort a transaction, restoring the metadata, directory
+ * blocks, and indirect blocks changed since fs_txn_begin.
+ * Overwritten file data is not restored; blocks allocated
+ * by the transaction are freed again.
+ *
+ * Errors
+ *   -EINVAL   - no transaction active
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_txn_abort(struct fs_ext2 *fs)
+{
+    if (!fs->txn_active) {
+        return -EINVAL;
+    }
+    fs->txn_active = 0;
+    int status = 0;
+
+    // drop changed directory, index, indirect, and extent blocks
+    if (fs_blk_discard(fs) != 0) {
+        status = -EIO;
+    }
+
+    // reload changed metadata blocks from their last
+    // synchronized copy; blocks that cannot be read
+    // remain changed
+    for (int i = fs_bitmap_find_set(fs->meta_map, 0); i >= 0; i = fs_bitmap_find_set(fs->meta_map, i+1)) {
+        if (fs_journal_read_blk(fs, i, fs_meta_cached(fs, i)) != 0) {
+            status = -EIO;
+        } else {
+            fs_bitmap_clear(fs->meta_map, i);
+            fs->n_dirty--;
+        }
+    }
+    if (fs->inode_map != NULL) {
+        fs_bitmap_recount(fs->inode_map);
+        fs_bitmap_recount(fs->block_map);
+    }
+    fs_freetree_destroy(fs->free_tree);
+    fs->free_tree = NULL;  // rebuilt on next allocation
+
+    // group descriptors were reloaded and are checked
+    // again on next use; volumes without them are counted
+    if (fs->group_desc_base == 0) {
+        fs_count_groups(fs);
+    } else {
+        for (int g = fs_bitmap_find_set(fs->group_checked, 0); g >= 0;
+             g = fs_bitmap_find_set(fs->group_checked, g+1)) {
+            fs_bitmap_clear(fs->group_checked, g);
+        }
+    }
+
+    // cached lookups may name entries that were removed
+    fs_dcache_invalidate_all(fs->dcache);
+    fs->ext_hint_ino = 0;
+    return status;
+}
@@ -0,0 +1,66 @@
+/*
+ * fs_op_txn.h
+ *
+ * description: multi-operation transactions for
+ * CS 5600 / 7600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Philip Gust, March 2021
+ */
+
+#ifndef FS_OP_TXN_H_
+#define FS_OP_TXN_H_
+
+#include "fs_util_volume.h"
+
+/**
+ * Begin a transaction. Metadata, directory blocks, and
+ * indirect blocks changed by operations such as fs_mkfile,
+ * fs_pwritefile, fs_chmod, fs_chown, and fs_utime are held
+ * in memory until fs_txn_commit, and are restored by
+ * fs_txn_abort. On a volume with a journal the commit is
+ * atomic across a crash. Transactions do not nest.
+ * Changed metadata is synchronized first.
+ *
+ * Errors
+ *   -EBUSY    - transaction already active
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_txn_begin(struct fs_ext2 *fs);
+
+/**
+ * Commit a transaction, synchronizing all metadata
+ * changed since fs_txn_begin at once. If the changes
+ * do not fit in one journal transaction, the transaction
+ * remains active so that it can be aborted.
+ *
+ * Errors
+ *   -EINVAL   - no transaction active
+ *   -EFBIG    - changes do not fit in the journal
+ *   -ENOMEM   - cannot allocate journal transaction
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_txn_commit(struct fs_ext2 *fs);
+
+/**
+ * Abort a transaction, restoring the metadata, directory
+ * blocks, and indirect blocks changed since fs_txn_begin.
+ * Overwritten file data is not restored; blocks allocated
+ * by the transaction are freed again.
+ *
+ * Errors
+ *   -EINVAL   - no transaction active
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_txn_abort(struct fs_ext2 *fs);
+
+#endif /* FS_OP_TXN_H_ */
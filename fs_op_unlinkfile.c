@@ -14,35 +14,11 @@
 #include <errno.h>
 
 #include "fs_op_unlinkfile.h"
+#include "fs_util_alloc.h"
+#include "fs_util_bmap.h"
+#include "fs_util_dir.h"
 #include "fs_dev_blkdev.h"
 
-/**
- * Look up a directory entry in a directory block.
- *
- * Errors
- *   -ENOENT   - does not exists
- *
- * @param de storage for a directory block
- * @param name the entry name
- * @param ignore_case 1 for case-independent, 0 for case-dependent
- * @return entry in directory block or -error if not available
- */
-static int get_entry_in_block(struct fs_dirent* de, const char *name, int ignore_case) {
-    // case-dependent or case-dependent comparison
-    static int (*compare[2])(const char*, const char*) = {strcmp, strcasecmp};
-
-    // find free directory entry
-    for (int i = 0; i < DIRENTS_PER_BLK; i++) {
-        if (de[i].valid == 1) {
-            // check for duplicate existing entry
-            if (compare[ignore_case == 1](de[i].name, name) == 0) {
-                return i;
-            }
-        }
-    }
-    return -ENOENT;
-}
-
 /**
  * Determines whether inode directory is empty.
  * Directory is empty if it only has 2 entries,
@@ -50,41 +26,22 @@ static int get_entry_in_block(struct fs_dirent* de, const char *name, int ignore
  *
  * Errors
  *   -ENOTDIR   - inode not s directory
+ *   -EIO       - i/o error
  *
  * @param fs the file system
  * @param ino the inode
  * @return 1 if empty, 0 if not empty, or -error if not a directory
  */
 static int is_dir_empty(struct fs_ext2 *fs, int ino) {
-    if (!S_ISDIR(fs->inodes[ino].mode)) {
+    const struct fs_inode *in = fs_inode(fs, ino);
+    if (in == NULL) {
+        return -EIO;
+    }
+    if (!S_ISDIR(in->mode)) {
         return -ENOTDIR;
     }
     // empty if only ".' and '..' entries present
-    return (fs->inodes[ino].size == 2*sizeof(struct fs_dirent));
-}
-
-/**
- * Return a inode to the free list.
- *
- * @param  inum the inode number
- */
-static void return_inode(struct fs_ext2 *fs, int ino)
-{
-    // mark inode free
-    FD_CLR(ino, fs->inode_map);
-    fs_mark_inode(fs, ino); // inode metadata changed
-}
-
-/**
- * Return a block to the free list.
- *
- * @param  blkno the block number
- */
-static void return_blk(struct fs_ext2 *fs, int blkno)
-{
-    // mark inode free
-    FD_CLR(blkno, fs->block_map);
-    fs_mark_blk(fs, blkno); // block metadata changed
+    return (in->size == 2*sizeof(struct fs_dirent));
 }
 
 /**
@@ -117,33 +74,31 @@ static void return_blk(struct fs_ext2 *fs, int blkno)
 static int do_unlink(struct fs_ext2 *fs, int dir_ino, const char *name, int typemask)
 {
     // ensure dir_ino is a directory
-    if (!S_ISDIR(fs->inodes[dir_ino].mode)) {
-        return -ENOTDIR;
-    }
-
-    // get block number of first directory block
-    int dir_blkno = fs->inodes[dir_ino].direct[0];
-    if (dir_blkno == 0) {
-        return -ENOENT;  // no entry for file_ino
+    const struct fs_inode *in = fs_inode(fs, dir_ino);
+    if (in == NULL) {
+        return -EIO;
     }
-
-    // read directory block
-    struct fs_dirent de[DIRENTS_PER_BLK];
-    if (fs->dev->ops->read(fs->dev, dir_blkno, 1, de) != SUCCESS) {
-        return -EIO;  // cannot read block
+    if (!S_ISDIR(in->mode)) {
+        return -ENOTDIR;
     }
 
     // find directory entry for file inode
-    int entry = get_entry_in_block(de, name, fs->ignore_case);
-    if (entry < 0) {
-        return entry;
+    struct fs_dirblk dir_blk;
+    int status = fs_dir_lookup(fs, dir_ino, name, &dir_blk);
+    if (status < 0) {
+        return status;
     }
+    struct fs_dirent *de = dir_blk.de;
+    int entry = dir_blk.entry;
 
     // get inode for file
     int file_ino = de[entry].inode;
 
     // does match required file type
-    if ((fs->inodes[file_ino].mode & typemask) == 0) {
+    if ((in = fs_inode(fs, file_ino)) == NULL) {
+        return -EIO;
+    }
+    if ((in->mode & typemask) == 0) {
         return -EINVAL;
     }
 
@@ -160,46 +115,60 @@ static int do_unlink(struct fs_ext2 *fs, int dir_ino, const char *name, int type
     if (empty_subdir == 0) {
         return -ENOTEMPTY;
     }
+    if (empty_subdir == -EIO) {
+        return -EIO;
+    }
 
     // remove the parent directory entry
     de[entry].valid = 0;
 
     // write parent directory block back to disk
-    if (fs->dev->ops->write(fs->dev, dir_blkno, 1, de) != SUCCESS) {
+    if (fs_dir_write(fs, &dir_blk) != 0) {
         return -EIO;  // cannot write block
     }
-    fs_mark_blk(fs, dir_blkno);  // block metadata changed
+    fs_dcache_invalidate(fs->dcache, dir_ino, name);  // drop cached entry
+
+    // dir and file inode metadata changed
+    struct fs_inode *dir_in = fs_inode_mut(fs, dir_ino);
+    struct fs_inode *file_in = fs_inode_mut(fs, file_ino);
+    if ((dir_in == NULL) || (file_in == NULL)) {
+        return -EIO;
+    }
 
     // decrement parent directory size by size of directory entry
-    fs->inodes[dir_ino].size -= sizeof(struct fs_dirent);
+    dir_in->size -= sizeof(struct fs_dirent);
     // update modified time
     int t = time(NULL);
-    fs->inodes[dir_ino].mtime = t;
-    fs_mark_inode(fs, dir_ino);  // dir inode metadata changed
+    dir_in->mtime = t;
 
     if (empty_subdir == 1) { // file is an empty subdir
+        // drop cached entries of removed subdir
+        fs_dcache_invalidate_dir(fs->dcache, file_ino);
+
         // decrement parent directory link count for ".."
-        fs->inodes[dir_ino].nlink--;
+        dir_in->nlink--;
         // decrement child directory link count for "."
-        fs->inodes[file_ino].nlink--;
+        file_in->nlink--;
     }
 
     // decrement child link count for removal from parent
-    fs->inodes[file_ino].nlink--;
-    fs_mark_inode(fs, file_ino);
+    file_in->nlink--;
 
-    // if child link count now 0, free inode and block
-    if (fs->inodes[file_ino].nlink == 0) {
-        // free the inode block
-        int file_blkno = fs->inodes[file_ino].direct[0];
-        return_blk(fs, file_blkno);
-        fs->inodes[file_ino].direct[0] = 0; // clear block number
+    // if child link count now 0, free inode and blocks
+    if (file_in->nlink == 0) {
+        // free the data and indirect blocks
+        if (fs_btrunc(fs, file_ino, 0) < 0) {
+            return -EIO;
+        }
 
         // free the inode
-        return_inode(fs, file_ino);
+        fs_free_inode(fs, file_ino);
     }
 
-    fs_sync_metadata(fs);  // sync changed metadata
+    // commit changed metadata
+    if (fs_commit_metadata(fs) != 0) {
+        return -EIO;
+    }
     return 0;
 }
 
@@ -9,23 +9,33 @@
 
 #include <stdlib.h>
 #include <time.h>
+#include <errno.h>
 
 #include "fs_op_utimefile.h"
 
 /**
  * Change the modification time.
  *
+ * Errors
+ *   -EIO      - i/o error
+ *
  * @param fs the file system
  * @param file_ino the inode number
  * @param mod_time the modification time;
- * @return 0 if successful
+ * @return 0 if successful, -error if error occurred
  */
 int fs_utime(struct fs_ext2 *fs, int file_ino, time_t mod_time)
 {
-    fs->inodes[file_ino].mtime =  mod_time;
+    struct fs_inode *in = fs_inode_mut(fs, file_ino);  // mark inode changed
+    if (in == NULL) {
+        return -EIO;
+    }
+    in->mtime =  mod_time;
 
-    fs_mark_inode(fs, file_ino);  // mark inode changed
-    fs_sync_metadata(fs); // sync changed inode
+    // commit changed inode
+    if (fs_commit_metadata(fs) != 0) {
+        return -EIO;
+    }
 
     return 0;
 }
@@ -16,10 +16,13 @@
 /**
  * Change the modification time.
  *
+ * Errors
+ *   -EIO      - i/o error
+ *
  * @param fs the file system
  * @param file_ino the inode number
  * @param mod_time the modification time;
- * @return 0 if successful
+ * @return 0 if successful, -error if error occurred
  */
 int fs_utime(struct fs_ext2 *fs, int file_ino, time_t mod_time);
 
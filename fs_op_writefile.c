@@ -15,13 +15,15 @@
 #include <limits.h>
 
 #include "fs_op_writefile.h"
+#include "fs_util_bmap.h"
 #include "fs_dev_blkdev.h"
 
+/** maximum file blocks written with one device call */
+enum {FS_WRITE_BATCH = 32};
+
 /**
  * Write contents to a file starting at a file offset.
- *
- * Note: current implementation supports
- * only 1 block of content
+ * File blocks are allocated as needed.
  *
  * Errors
  *   -ENISDIR  - dir_ino not a directory
@@ -40,15 +42,21 @@
 int fs_pwritefile(struct fs_ext2 *fs, int file_ino, const void *content, int n_bytes, int offset)
 {
     // ensure file_ino is a regular file
-    if (!S_ISREG(fs->inodes[file_ino].mode)) {
+    const struct fs_inode *in = fs_inode(fs, file_ino);
+    if (in == NULL) {
+        return -EIO;
+    }
+    if (!S_ISREG(in->mode)) {
         return -EISDIR;
     }
 
     // internal flag used by fs_writefile() for truncation
-    int old_size = fs->inodes[file_ino].size;
+    int old_size = in->size;
+    int truncate = 0;
     if (offset == INT_MIN) {
         offset = 0;
-        old_size = 0; // truncation for single block file
+        old_size = 0; // existing content is replaced
+        truncate = 1;
     }
 
     // invalid n_bytes or offset
@@ -61,54 +69,121 @@ int fs_pwritefile(struct fs_ext2 *fs, int file_ino, const void *content, int n_b
         return 0;
     }
 
-    // ensure bytes fit in block
-    int new_size = offset + n_bytes;
-    if (new_size > FS_BLOCK_SIZE) {
+    // ensure bytes fit in file
+    if (n_bytes > FS_MAX_FILE_SIZE(fs->blk_size) - offset) {
         return -EFBIG;  // contents too large
     }
+    int new_size = offset + n_bytes;
+
+    // clear stale bytes past old end of file if the write starts in a later block
+    if ((offset > old_size) && (offset / fs->blk_size != old_size / fs->blk_size)) {
+        int status = fs_bzero_tail(fs, file_ino, old_size);
+        if (status < 0) {
+            return status;
+        }
+    }
 
-    // get block number of first file block
-    int file_blkno = fs->inodes[file_ino].direct[0];
-    if (file_blkno == 0) {
-        return -ENOSPC;  // no file block
+    // allocate blocks written in full as contiguous runs;
+    // if space runs out, blocks are allocated until it does
+    int first_full = (offset + fs->blk_size - 1) / fs->blk_size;
+    int n_full = new_size / fs->blk_size - first_full;
+    if (n_full > 1) {
+        int status = fs_balloc(fs, file_ino, first_full, n_full);
+        if ((status < 0) && (status != -ENOSPC)) {
+            return status;
+        }
     }
 
-    block file_blk;  // space for block content
+    // write file blocks that overlap the range in batches
+    const uint8_t *src = content;
+    uint8_t part_blk[2][FS_MAX_BLOCK_SIZE];  // first and last blocks may be partial
+    struct blkdev_iovec iov[FS_WRITE_BATCH];
+    int status = 0;
+    int pos = offset;
+    while ((status == 0) && (pos < new_size)) {
+        int n_iov = 0, n_part = 0;
+        int end = pos;  // end of bytes mapped in batch
+
+        // map blocks of batch, allocating if necessary
+        while ((n_iov < FS_WRITE_BATCH) && (end < new_size)) {
+            int blk_start = end - end % fs->blk_size;
+            int blk_off = end - blk_start;
+            int n = fs->blk_size - blk_off;
+            if (n > new_size - end) {
+                n = new_size - end;
+            }
+
+            // get block number of file block, allocating if necessary
+            int is_new;
+            int file_blkno = fs_bmap(fs, file_ino, end / fs->blk_size, 1, &is_new);
+            if (file_blkno < 0) {
+                status = file_blkno;
+                break;
+            }
 
-    // read current block if partial overwrite
-    if (old_size > 0) {  // file not empty
-        if ((offset > 0) || (new_size < old_size)) {
-            if (fs->dev->ops->read(fs->dev, file_blkno, 1, file_blk) != SUCCESS) {
-                return -EIO;
+            void *out = (void*)(src + (end - offset));
+            if (n < fs->blk_size) {  // partial block
+                uint8_t *file_blk = part_blk[n_part++];
+                if (!is_new && (blk_start < old_size)) {
+                    // read current block for partial overwrite
+                    if (fs->dev->ops->read(fs->dev, file_blkno, 1, file_blk) != SUCCESS) {
+                        status = -EIO;
+                        break;
+                    }
+                    // clear block past old end of file
+                    if (old_size - blk_start < fs->blk_size) {
+                        memset(file_blk + (old_size - blk_start), 0, fs->blk_size - (old_size - blk_start));
+                    }
+                } else {
+                    memset(file_blk, 0, fs->blk_size);
+                }
+                memcpy(file_blk + blk_off, out, n);
+                out = file_blk;
             }
+            iov[n_iov++] = (struct blkdev_iovec) {.blkno = file_blkno, .buf = out};
+            end += n;
         }
-    }
 
-    // clear block between old_size and offset if extending file
-    if (old_size < offset) {
-        memset(file_blk + old_size, 0, offset - old_size);
+        // write mapped blocks of batch; adjacent blocks
+        // are written with one device call
+        if ((n_iov > 0) && (blkdev_writev(fs->dev, iov, n_iov) != SUCCESS)) {
+            status = -EIO;
+            break;
+        }
+        pos = end;
     }
 
-    // write file block contents to disk
-    memcpy((uint8_t*)file_blk + offset, content, n_bytes);
-    if (fs->dev->ops->write(fs->dev, file_blkno, 1, file_blk) != SUCCESS) {
-        return -EIO;
+    // update file inode for bytes written
+    if (pos > offset) {
+        int trunc_status = 0;
+        if (truncate) {
+            // free blocks past new end of file
+            trunc_status = fs_btrunc(fs, file_ino, (pos + fs->blk_size - 1) / fs->blk_size);
+        }
+        struct fs_inode *file_in = fs_inode_mut(fs, file_ino);  // mark inode changed
+        if (file_in == NULL) {
+            trunc_status = -EIO;
+        } else {
+            if (truncate || ((uint32_t)pos > file_in->size)) {
+                file_in->size = pos;
+            }
+            file_in->mtime = time(NULL); // update modify time
+        }
+        if (status == 0) {
+            status = trunc_status;
+        }
     }
 
-    // update file inode for file block
-    fs->inodes[file_ino].mtime = time(NULL); // update modify time
-    fs->inodes[file_ino].size = (new_size > old_size) ? new_size : old_size; // update size
-    fs_mark_inode(fs, file_ino);  // mark inode changed
-
-    fs_sync_metadata(fs);  // sync changed metadata
-    return 0;  // success
+    // commit changed metadata
+    if ((fs_commit_metadata(fs) != 0) && (status == 0)) {
+        status = -EIO;
+    }
+    return status;  // 0 if success
 }
 
 /**
- * Write contents to a file.
- *
- * Note: current implementation supports
- * only 1 block of content
+ * Write contents to a file, replacing
+ * its existing content.
  *
  * Errors
  *   -ENISDIR  - dir_ino not a directory
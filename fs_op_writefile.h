@@ -14,9 +14,7 @@
 
 /**
  * Write contents to a file starting at a file offset.
- *
- * Note: current implementation supports
- * only 1 block of content
+ * File blocks are allocated as needed.
  *
  * Errors
  *   -ENISDIR  - dir_ino not a directory
@@ -35,10 +33,8 @@
 int fs_pwritefile(struct fs_ext2 *fs, int file_ino, const void *content, int n_bytes, int offset);
 
 /**
- * Write contents to a file.
- *
- * Note: current implementation supports
- * only 1 block of content
+ * Write contents to a file, replacing
+ * its existing content.
  *
  * Errors
  *   -ENISDIR  - dir_ino not a directory
@@ -0,0 +1,393 @@
+/*
+ * fs_util_alloc.c
+ *
+ * description: allocate and free inodes and blocks
+ * for CS 7600 / CS 5600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Peter Desnoyers,  November 2016
+ * Philip Gust, March 2021
+ */
+
+#include <errno.h>
+
+#include "fs_util_alloc.h"
+#include "fs_util_map.h"
+
+/** directories a group may hold above average before
+ *  subdirectories spread, as a divisor of group inodes */
+enum { ORLOV_DIR_SLACK = 16 };
+
+/**
+ * Allocate an inode from the first block group with a
+ * free inode, starting with a preferred group and
+ * wrapping around. Groups whose maps cannot be read
+ * are skipped.
+ *
+ * @param fs the file system
+ * @param group the preferred group
+ * @return the inode number or -1 if none available
+ */
+static int alloc_in_groups(struct fs_ext2 *fs, int group)
+{
+    if ((group < 0) || (group >= fs->n_groups)) {
+        group = 0;
+    }
+    for (int k = 0; k < fs->n_groups; k++) {
+        int g = (group + k) % fs->n_groups;
+        struct fs_group_desc *gd = &fs->groups[g];
+        if ((fs_check_group(fs, g) != 0) || (gd->free_inodes == 0)) {
+            continue;  // skip unreadable or full group
+        }
+        int ino = fs_map_alloc_in(fs, FS_INODE_MAP, g*fs->group_inodes,
+                                  (g+1)*fs->group_inodes, &gd->ino_cursor);
+        if (ino >= 0) {
+            gd->free_inodes--;
+            fs_mark_group(fs, g);
+            return ino;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Find the first run of at least min_len free blocks
+ * in a paged block map by scanning the range. Runs are
+ * measured up to max_len blocks.
+ *
+ * @param fs the file system
+ * @param start the first block to consider
+ * @param end the block after the last block to consider
+ * @param min_len the minimum run length
+ * @param max_len the maximum run length to measure
+ * @param run_len set to the length of the run
+ * @return the first block of the run, -1 if none, -EIO if error occurred
+ */
+static int scan_run(struct fs_ext2 *fs, int start, int end, int min_len, int max_len, int *run_len)
+{
+    if (end > fs->n_blocks) {
+        end = fs->n_blocks;
+    }
+    for (int i = start; i < end; ) {
+        int blkno = fs_map_find_zero(fs, FS_BLOCK_MAP, i, end);
+        if (blkno < 0) {
+            return blkno;
+        }
+        int limit = (blkno + max_len < end) ? blkno + max_len : end;
+        int used = fs_map_find_set(fs, FS_BLOCK_MAP, blkno, limit);
+        if (used < -1) {
+            return used;
+        }
+        int len = ((used < 0) ? limit : used) - blkno;
+        if (len >= min_len) {
+            *run_len = len;
+            return blkno;
+        }
+        if (used < 0) {
+            break;  // short run at end of range
+        }
+        i = used + 1;
+    }
+    return -1;
+}
+
+/**
+ * Find the first run of at least min_len free blocks in
+ * a range of blocks, from the free extents if they are
+ * built and otherwise from the block map.
+ *
+ * @param fs the file system
+ * @param start the first block to consider
+ * @param end the block after the last block to consider
+ * @param min_len the minimum run length
+ * @param max_len the maximum run length wanted
+ * @param run_len set to the length of the run
+ * @return the first block of the run, -1 if none, -EIO if error occurred
+ */
+static int find_free(struct fs_ext2 *fs, int start, int end, int min_len, int max_len, int *run_len)
+{
+    if (fs->free_tree != NULL) {
+        return fs_freetree_find(fs->free_tree, start, end, min_len, run_len);
+    }
+    return scan_run(fs, start, end, min_len, max_len, run_len);
+}
+
+/**
+ * Find a run of free blocks in a range of blocks,
+ * preferring a run of the wanted length.
+ *
+ * @param fs the file system
+ * @param start the first block to consider
+ * @param end the block after the last block to consider
+ * @param n_blks the number of blocks wanted
+ * @param run_len set to the length of the run
+ * @return the first block of the run, -1 if none, -EIO if error occurred
+ */
+static int find_run(struct fs_ext2 *fs, int start, int end, int n_blks, int *run_len)
+{
+    int blkno = find_free(fs, start, end, n_blks, n_blks, run_len);
+    if ((blkno == -1) && (n_blks > 1)) {
+        blkno = find_free(fs, start, end, 1, n_blks, run_len);
+    }
+    return blkno;
+}
+
+/**
+ * Choose the block group for a new directory. Top-level
+ * directories go to the group with the fewest directories
+ * among those with at least the average free inodes and
+ * blocks. Other directories stay in the group of their
+ * parent unless it is short of free inodes or blocks, or
+ * has many more directories than average.
+ *
+ * @param fs the file system
+ * @param dir_ino the inode of the parent directory
+ * @return the block group
+ */
+static int dir_group(struct fs_ext2 *fs, int dir_ino)
+{
+    int parent = dir_ino / fs->group_inodes;
+    int avg_inodes = fs->super->free_inodes / fs->n_groups;
+    int avg_blocks = fs->super->free_blocks / fs->n_groups;
+    int n_dirs = 0;
+    for (int g = 0; g < fs->n_groups; g++) {
+        n_dirs += fs->groups[g].n_dirs;
+    }
+    int max_dirs = n_dirs / fs->n_groups + fs->group_inodes / ORLOV_DIR_SLACK;
+
+    // keep subdirectory near its parent
+    struct fs_group_desc *grp = &fs->groups[parent];
+    if (   (dir_ino != fs->root_inode)
+        && (grp->free_inodes > 0) && (grp->free_inodes >= avg_inodes / 4)
+        && (grp->free_blocks >= avg_blocks / 4) && (grp->n_dirs <= max_dirs)) {
+        return parent;
+    }
+
+    // spread directory to the least used group with room
+    int best = -1;
+    for (int k = 1; k <= fs->n_groups; k++) {
+        int g = (parent + k) % fs->n_groups;
+        grp = &fs->groups[g];
+        if (   (grp->free_inodes == 0)
+            || (grp->free_inodes < avg_inodes) || (grp->free_blocks < avg_blocks)) {
+            continue;
+        }
+        if ((best < 0) || (grp->n_dirs < fs->groups[best].n_dirs)) {
+            best = g;
+        }
+    }
+    return (best >= 0) ? best : parent;
+}
+
+/**
+ * Gets a free inode number from the free list and sets
+ * its mode. Files are placed after their directory inode
+ * in its block group. Top-level directories are spread
+ * across block groups; other directories stay in the
+ * group of their parent while it has room.
+ *
+ * Errors
+ *   -ENOSPC   - free entry not found
+ *   -ENOMEM   - cannot allocate zeroed inode blocks
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param dir_ino the inode of the parent directory
+ * @param mode the mode of the new inode
+ * @return a free inode number or -error if none available
+ */
+int fs_alloc_inode(struct fs_ext2 *fs, int dir_ino, mode_t mode)
+{
+    // allocate inode for file; inode 0 is always in use
+    int ino = -1;
+    int group = dir_ino / fs->group_inodes;
+    if (S_ISDIR(mode)) {
+        group = dir_group(fs, dir_ino);
+    } else if ((fs_check_group(fs, group) == 0) && (fs->groups[group].free_inodes > 0)) {
+        // cluster file after its directory inode
+        ino = fs_map_find_zero(fs, FS_INODE_MAP, dir_ino + 1, (group+1) * fs->group_inodes);
+        if ((ino >= 0) && (fs_map_set(fs, FS_INODE_MAP, ino) < 0)) {
+            ino = -1;
+        }
+        if (ino >= 0) {
+            fs->groups[group].free_inodes--;
+            fs_mark_group(fs, group);
+        }
+    }
+    if (ino < 0) {
+        ino = alloc_in_groups(fs, group);
+        if (ino < 0) {
+            return -ENOSPC;
+        }
+    }
+
+    // write inode blocks of group on first use
+    int status = fs_init_itable(fs, ino / fs->group_inodes);
+    struct fs_inode *in = (status == 0) ? fs_inode_mut(fs, ino) : NULL;
+    if (in == NULL) {
+        fs_map_clear(fs, FS_INODE_MAP, ino);
+        fs->groups[ino / fs->group_inodes].free_inodes++;
+        fs_mark_group(fs, ino / fs->group_inodes);
+        return (status != 0) ? status : -EIO;
+    }
+    in->mode = mode;  // inode metadata changed
+    if (S_ISDIR(mode)) {
+        fs->groups[ino / fs->group_inodes].n_dirs++;
+    }
+    fs->super->free_inodes--;
+    fs_mark_super(fs);
+    return ino;
+}
+
+/**
+ * Return an inode to the free list.
+ *
+ * @param fs the file system
+ * @param ino the inode number
+ */
+void fs_free_inode(struct fs_ext2 *fs, int ino)
+{
+    // mark inode free; an inode whose map block cannot be read stays in use
+    if (fs_map_clear(fs, FS_INODE_MAP, ino) > 0) {
+        struct fs_group_desc *gd = &fs->groups[ino / fs->group_inodes];
+        gd->free_inodes++;
+        const struct fs_inode *in = fs_inode(fs, ino);
+        if ((in != NULL) && S_ISDIR(in->mode)) {
+            gd->n_dirs--;
+        }
+        fs_mark_group(fs, ino / fs->group_inodes);
+        fs->super->free_inodes++;
+        fs_mark_super(fs);
+    }
+    fs_mark_inode(fs, ino); // inode metadata changed
+}
+
+/**
+ * Gets a run of up to n_blks contiguous free blocks.
+ * The run continues at the goal block if it is free;
+ * otherwise the search prefers a run of n_blks blocks
+ * from the goal to the end of its block group, then in
+ * the block group of the file inode and the groups
+ * after it. Runs never cross a block group.
+ *
+ * Errors
+ *   -ENOSPC   - free entry not found
+ *   -ENOMEM   - cannot build free extents
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param ino the inode of the file for the blocks
+ * @param goal the block to allocate at or after, 0 for none
+ * @param n_blks the number of blocks wanted
+ * @param n_alloc set to the number of blocks allocated
+ * @return first block number or -error if none available
+ */
+int fs_alloc_blks(struct fs_ext2 *fs, int ino, int goal, int n_blks, int *n_alloc)
+{
+    // free extents of a resident block map are rebuilt after
+    // an aborted transaction; a paged block map is scanned
+    if ((fs->free_tree == NULL) && (fs->block_map != NULL)) {
+        fs->free_tree = fs_freetree_create(fs->block_map);
+        if (fs->free_tree == NULL) {
+            return -ENOMEM;
+        }
+    }
+    int blkno = -1;
+    int run_len = 0;
+
+    // search forward from goal within its group
+    if ((goal > 0) && (goal < fs->n_blocks) && (fs_check_group(fs, goal / fs->group_blks) == 0)) {
+        int group_end = (goal / fs->group_blks + 1) * fs->group_blks;
+        blkno = find_free(fs, goal, group_end, 1, n_blks, &run_len);
+        if ((blkno != goal) && (n_blks > 1)) {
+            blkno = find_run(fs, goal, group_end, n_blks, &run_len);
+        }
+    }
+
+    // search groups starting with the group of the inode;
+    // metadata blocks are always in use
+    int group = ino / fs->group_inodes;
+    if ((group < 0) || (group >= fs->n_groups)) {
+        group = 0;
+    }
+    for (int k = 0; (blkno < 0) && (k < fs->n_groups); k++) {
+        int g = (group + k) % fs->n_groups;
+        if ((fs_check_group(fs, g) == 0) && (fs->groups[g].free_blocks > 0)) {
+            blkno = find_run(fs, g*fs->group_blks, (g+1)*fs->group_blks, n_blks, &run_len);
+        }
+    }
+    if (blkno < 0) {
+        return (blkno == -1) ? -ENOSPC : blkno;
+    }
+
+    // take the run from the free extents and the block map; a
+    // paged run ends early at a map block that cannot be read
+    int n = (run_len < n_blks) ? run_len : n_blks;
+    if ((fs->free_tree != NULL) && (fs_freetree_remove(fs->free_tree, blkno, n) != 0)) {
+        return -ENOSPC;
+    }
+    for (int i = 0; i < n; i++) {
+        if (fs_map_set(fs, FS_BLOCK_MAP, blkno + i) < 0) {
+            n = i;
+        }
+    }
+    if (n == 0) {
+        return -EIO;
+    }
+    fs->groups[blkno / fs->group_blks].free_blocks -= n;
+    fs_mark_group(fs, blkno / fs->group_blks);
+    fs->super->free_blocks -= n;
+    fs_mark_super(fs);
+    *n_alloc = n;
+    return blkno;
+}
+
+/**
+ * Gets a free block number from the free list. The
+ * search starts at the goal block and continues to the
+ * end of its block group; without a goal, or if none is
+ * free there, the block group of the file inode is
+ * preferred.
+ *
+ * Errors
+ *   -ENOSPC   - free entry not found
+ *   -ENOMEM   - cannot build free extents
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param ino the inode of the file for the block
+ * @param goal the block to allocate at or after, 0 for none
+ * @return free block number or -error if none available
+ */
+int fs_alloc_blk(struct fs_ext2 *fs, int ino, int goal)
+{
+    int n_alloc;
+    return fs_alloc_blks(fs, ino, goal, 1, &n_alloc);
+}
+
+/**
+ * Return a block to the free list. A block held in
+ * memory is released first; one whose journal copy
+ * cannot be checkpointed stays in use.
+ *
+ * @param fs the file system
+ * @param blkno the block number
+ */
+void fs_free_blk(struct fs_ext2 *fs, int blkno)
+{
+    if (fs_blk_release(fs, blkno) != 0) {
+        return;
+    }
+
+    // mark block free; a block whose map block cannot be read stays in use
+    if (fs_map_clear(fs, FS_BLOCK_MAP, blkno) > 0) {
+        fs->groups[blkno / fs->group_blks].free_blocks++;
+        fs_mark_group(fs, blkno / fs->group_blks);
+        fs->super->free_blocks++;
+        fs_mark_super(fs);
+        if ((fs->free_tree != NULL) && (fs_freetree_add(fs->free_tree, blkno, 1) != 0)) {
+            fs_freetree_destroy(fs->free_tree);
+            fs->free_tree = NULL;  // rebuilt on next allocation
+        }
+    }
+}
@@ -0,0 +1,96 @@
+/*
+ * fs_util_alloc.h
+ *
+ * description: allocate and free inodes and blocks
+ * for CS 7600 / CS 5600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Peter Desnoyers,  November 2016
+ * Philip Gust, March 2021
+ */
+
+#ifndef FS_UTIL_ALLOC_H_
+#define FS_UTIL_ALLOC_H_
+
+#include <sys/stat.h>
+#include "fs_util_volume.h"
+
+/**
+ * Gets a free inode number from the free list and sets
+ * its mode. Files are placed after their directory inode
+ * in its block group. Top-level directories are spread
+ * across block groups; other directories stay in the
+ * group of their parent while it has room.
+ *
+ * Errors
+ *   -ENOSPC   - free entry not found
+ *   -ENOMEM   - cannot allocate zeroed inode blocks
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param dir_ino the inode of the parent directory
+ * @param mode the mode of the new inode
+ * @return a free inode number or -error if none available
+ */
+int fs_alloc_inode(struct fs_ext2 *fs, int dir_ino, mode_t mode);
+
+/**
+ * Return an inode to the free list.
+ *
+ * @param fs the file system
+ * @param ino the inode number
+ */
+void fs_free_inode(struct fs_ext2 *fs, int ino);
+
+/**
+ * Gets a run of up to n_blks contiguous free blocks.
+ * The run continues at the goal block if it is free;
+ * otherwise the search prefers a run of n_blks blocks
+ * from the goal to the end of its block group, then in
+ * the block group of the file inode and the groups
+ * after it. Runs never cross a block group.
+ *
+ * Errors
+ *   -ENOSPC   - free entry not found
+ *   -ENOMEM   - cannot build free extents
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param ino the inode of the file for the blocks
+ * @param goal the block to allocate at or after, 0 for none
+ * @param n_blks the number of blocks wanted
+ * @param n_alloc set to the number of blocks allocated
+ * @return first block number or -error if none available
+ */
+int fs_alloc_blks(struct fs_ext2 *fs, int ino, int goal, int n_blks, int *n_alloc);
+
+/**
+ * Gets a free block number from the free list. The
+ * search starts at the goal block and continues to the
+ * end of its block group; without a goal, or if none is
+ * free there, the block group of the file inode is
+ * preferred.
+ *
+ * Errors
+ *   -ENOSPC   - free entry not found
+ *   -ENOMEM   - cannot build free extents
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param ino the inode of the file for the block
+ * @param goal the block to allocate at or after, 0 for none
+ * @return free block number or -error if none available
+ */
+int fs_alloc_blk(struct fs_ext2 *fs, int ino, int goal);
+
+/**
+ * Return a block to the free list. A block held in
+ * memory is released first; one whose journal copy
+ * cannot be checkpointed stays in use.
+ *
+ * @param fs the file system
+ * @param blkno the block number
+ */
+void fs_free_blk(struct fs_ext2 *fs, int blkno);
+
+#endif /* FS_UTIL_ALLOC_H_ */
@@ -0,0 +1,306 @@
+/*
+ * fs_util_bitmap.c
+ *
+ * description: word-level bitmaps with free-count summaries
+ * for inode, block, and metadata maps
+ * for CS 7600 / CS 5600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Peter Desnoyers,  November 2016
+ * Philip Gust, March 2021
+ */
+
+#include <stdlib.h>
+
+#include "fs_util_bitmap.h"
+
+/** bits per bitmap word */
+enum { WORD_BITS = 64 };
+
+/**
+ * Calculate highest multiple m of n
+ *
+ * @param n the divisor
+ * @param m the dividend
+ * @return quotient rounded up
+ */
+static inline int div_round_up(int n, int m) {
+    return (n + m - 1) / m;
+}
+
+/**
+ * Create a bitmap. If words is NULL, zeroed storage is
+ * allocated; otherwise the bitmap uses the words, which
+ * must have room for n_bits rounded up to whole words.
+ *
+ * @param words the bit storage or NULL
+ * @param n_bits the number of bits
+ * @return the bitmap or NULL if cannot create
+ */
+struct fs_bitmap *fs_bitmap_create(void *words, int n_bits)
+{
+    struct fs_bitmap *bm = malloc(sizeof(struct fs_bitmap));
+    if (bm == NULL) {
+        return NULL;
+    }
+    bm->own_words = (words == NULL);
+    bm->words = (words != NULL) ? words : calloc(div_round_up(n_bits, WORD_BITS), sizeof(uint64_t));
+    bm->n_bits = n_bits;
+    bm->cursor = 0;
+    bm->n_chunks = div_round_up(n_bits, FS_BITMAP_CHUNK_BITS);
+    bm->chunk_free = malloc(bm->n_chunks * sizeof(int));
+    if ((bm->words == NULL) || (bm->chunk_free == NULL)) {
+        fs_bitmap_destroy(bm);
+        return NULL;
+    }
+    fs_bitmap_recount(bm);
+    return bm;
+}
+
+/**
+ * Destroy a bitmap. Storage passed to fs_bitmap_create
+ * is not freed.
+ *
+ * @param bm the bitmap
+ */
+void fs_bitmap_destroy(struct fs_bitmap *bm)
+{
+    if (bm == NULL) {
+        return;
+    }
+    if (bm->own_words) {
+        free(bm->words);
+    }
+    free(bm->chunk_free);
+    free(bm);
+}
+
+/**
+ * Get the word of a bitmap with bits past the
+ * end of the bitmap set.
+ *
+ * @param bm the bitmap
+ * @param w the word number
+ * @return the word
+ */
+static inline uint64_t get_word(const struct fs_bitmap *bm, int w)
+{
+    uint64_t word = bm->words[w];
+    int n = bm->n_bits - w*WORD_BITS;
+    if (n < WORD_BITS) {
+        word |= ~(uint64_t)0 << n;  // bits past end are in use
+    }
+    return word;
+}
+
+/**
+ * Recompute the free counts after the bit storage
+ * was changed directly.
+ *
+ * @param bm the bitmap
+ */
+void fs_bitmap_recount(struct fs_bitmap *bm)
+{
+    int n_words = div_round_up(bm->n_bits, WORD_BITS);
+    bm->n_free = 0;
+    for (int c = 0; c < bm->n_chunks; c++) {
+        bm->chunk_free[c] = 0;
+    }
+    for (int w = 0; w < n_words; w++) {
+        int n = WORD_BITS - __builtin_popcountll(get_word(bm, w));
+        bm->chunk_free[w*WORD_BITS / FS_BITMAP_CHUNK_BITS] += n;
+        bm->n_free += n;
+    }
+}
+
+/**
+ * Set a bit.
+ *
+ * @param bm the bitmap
+ * @param i the bit number
+ * @return 1 if the bit was clear, 0 if already set
+ */
+int fs_bitmap_set(struct fs_bitmap *bm, int i)
+{
+    if (fs_bit_test(bm->words, i)) {
+        return 0;
+    }
+    fs_bit_set(bm->words, i);
+    bm->chunk_free[i / FS_BITMAP_CHUNK_BITS]--;
+    bm->n_free--;
+    return 1;
+}
+
+/**
+ * Clear a bit.
+ *
+ * @param bm the bitmap
+ * @param i the bit number
+ * @return 1 if the bit was set, 0 if already clear
+ */
+int fs_bitmap_clear(struct fs_bitmap *bm, int i)
+{
+    if (!fs_bit_test(bm->words, i)) {
+        return 0;
+    }
+    bm->words[i / WORD_BITS] &= ~((uint64_t)1 << (i % WORD_BITS));
+    bm->chunk_free[i / FS_BITMAP_CHUNK_BITS]++;
+    bm->n_free++;
+    return 1;
+}
+
+/**
+ * Find the first clear bit in a range of bits.
+ * Chunks without clear bits are skipped, and
+ * words are searched with count-trailing-zeros.
+ *
+ * @param bm the bitmap
+ * @param start the first bit to consider
+ * @param end the bit after the last bit to consider
+ * @return the bit number or -1 if none
+ */
+int fs_bitmap_find_zero_in(const struct fs_bitmap *bm, int start, int end)
+{
+    if (end > bm->n_bits) {
+        end = bm->n_bits;
+    }
+    int i = (start > 0) ? start : 0;
+    while (i < end) {
+        int c = i / FS_BITMAP_CHUNK_BITS;
+        int chunk_end = (c+1) * FS_BITMAP_CHUNK_BITS;
+        if (bm->chunk_free[c] > 0) {
+            int last = (chunk_end < end) ? chunk_end : end;
+            int w = i / WORD_BITS;
+            uint64_t clear = ~get_word(bm, w) & (~(uint64_t)0 << (i % WORD_BITS));
+            for (;;) {
+                if (clear != 0) {
+                    int found = w*WORD_BITS + __builtin_ctzll(clear);
+                    return (found < end) ? found : -1;
+                }
+                if (++w*WORD_BITS >= last) {
+                    break;
+                }
+                clear = ~get_word(bm, w);
+            }
+        }
+        i = chunk_end;
+    }
+    return -1;
+}
+
+/**
+ * Find the first clear bit at or after a bit.
+ *
+ * @param bm the bitmap
+ * @param start the first bit to consider
+ * @return the bit number or -1 if none
+ */
+int fs_bitmap_find_zero(const struct fs_bitmap *bm, int start)
+{
+    return fs_bitmap_find_zero_in(bm, start, bm->n_bits);
+}
+
+/**
+ * Count the clear bits in a range of bits.
+ *
+ * @param bm the bitmap
+ * @param start the first bit to count
+ * @param end the bit after the last bit to count
+ * @return the number of clear bits
+ */
+int fs_bitmap_count_zero(const struct fs_bitmap *bm, int start, int end)
+{
+    if (end > bm->n_bits) {
+        end = bm->n_bits;
+    }
+    int n = 0;
+    for (int i = start; i < end; ) {
+        int w = i / WORD_BITS;
+        uint64_t clear = ~get_word(bm, w) & (~(uint64_t)0 << (i % WORD_BITS));
+        int next = (w+1) * WORD_BITS;
+        if (next > end) {
+            clear &= ~(~(uint64_t)0 << (end % WORD_BITS));
+            next = end;
+        }
+        n += __builtin_popcountll(clear);
+        i = next;
+    }
+    return n;
+}
+
+/**
+ * Find the first set bit at or after a bit.
+ * Chunks without set bits are skipped, and
+ * words are searched with count-trailing-zeros.
+ *
+ * @param bm the bitmap
+ * @param start the first bit to consider
+ * @return the bit number or -1 if none
+ */
+int fs_bitmap_find_set(const struct fs_bitmap *bm, int start)
+{
+    int i = (start > 0) ? start : 0;
+    while (i < bm->n_bits) {
+        int c = i / FS_BITMAP_CHUNK_BITS;
+        int chunk_end = (c+1) * FS_BITMAP_CHUNK_BITS;
+        int end = (chunk_end < bm->n_bits) ? chunk_end : bm->n_bits;
+        if (bm->chunk_free[c] < end - c*FS_BITMAP_CHUNK_BITS) {
+            int w = i / WORD_BITS;
+            uint64_t used = bm->words[w] & (~(uint64_t)0 << (i % WORD_BITS));
+            for (;;) {
+                if (used != 0) {
+                    int found = w*WORD_BITS + __builtin_ctzll(used);
+                    return (found < bm->n_bits) ? found : -1;
+                }
+                if (++w*WORD_BITS >= end) {
+                    break;
+                }
+                used = bm->words[w];
+            }
+        }
+        i = chunk_end;
+    }
+    return -1;
+}
+
+/**
+ * Find and set a clear bit, searching from the bit
+ * after the last one allocated and wrapping around.
+ *
+ * @param bm the bitmap
+ * @return the bit number or -1 if all bits are set
+ */
+int fs_bitmap_alloc(struct fs_bitmap *bm)
+{
+    if (bm->n_free == 0) {
+        return -1;
+    }
+    return fs_bitmap_alloc_in(bm, 0, bm->n_bits, &bm->cursor);
+}
+
+/**
+ * Find and set a clear bit in a range of bits,
+ * searching from a cursor and wrapping around to
+ * the start of the range. The cursor is advanced
+ * past the bit.
+ *
+ * @param bm the bitmap
+ * @param start the first bit of the range
+ * @param end the bit after the last bit of the range
+ * @param cursor the search position
+ * @return the bit number or -1 if all bits in range are set
+ */
+int fs_bitmap_alloc_in(struct fs_bitmap *bm, int start, int end, int *cursor)
+{
+    int from = ((*cursor >= start) && (*cursor < end)) ? *cursor : start;
+    int i = fs_bitmap_find_zero_in(bm, from, end);
+    if ((i < 0) && (from > start)) {
+        i = fs_bitmap_find_zero_in(bm, start, from);  // wrap around
+    }
+    if (i < 0) {
+        return -1;
+    }
+    fs_bitmap_set(bm, i);
+    *cursor = i + 1;
+    return i;
+}
@@ -0,0 +1,187 @@
+/*
+ * fs_util_bitmap.h
+ *
+ * description: word-level bitmaps with free-count summaries
+ * for inode, block, and metadata maps
+ * for CS 7600 / CS 5600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Peter Desnoyers,  November 2016
+ * Philip Gust, March 2021
+ */
+
+#ifndef FS_UTIL_BITMAP_H_
+#define FS_UTIL_BITMAP_H_
+
+#include <stdint.h>
+
+/** number of bits summarized by one free count (64 words) */
+enum { FS_BITMAP_CHUNK_BITS = 4096 };
+
+/**
+ * Bitmap stored as 64-bit words; bit i is bit i%64 of
+ * word i/64, matching the on-disk map layout. A free
+ * count per chunk lets searches skip full chunks.
+ */
+struct fs_bitmap {
+    /** bit storage */
+    uint64_t *words;
+
+    /** 1 if storage is owned by the bitmap */
+    int own_words;
+
+    /** number of bits */
+    int n_bits;
+
+    /** number of clear bits */
+    int n_free;
+
+    /** next-fit search position */
+    int cursor;
+
+    /** number of chunks */
+    int n_chunks;
+
+    /** number of clear bits in each chunk */
+    int *chunk_free;
+};
+
+/**
+ * Test a bit in raw bitmap storage.
+ *
+ * @param words the bitmap storage
+ * @param i the bit number
+ * @return 1 if set, 0 if clear
+ */
+static inline int fs_bit_test(const void *words, int i) {
+    return (int)((((const uint64_t*)words)[i / 64] >> (i % 64)) & 1);
+}
+
+/**
+ * Set a bit in raw bitmap storage.
+ *
+ * @param words the bitmap storage
+ * @param i the bit number
+ */
+static inline void fs_bit_set(void *words, int i) {
+    ((uint64_t*)words)[i / 64] |= (uint64_t)1 << (i % 64);
+}
+
+/**
+ * Create a bitmap. If words is NULL, zeroed storage is
+ * allocated; otherwise the bitmap uses the words, which
+ * must have room for n_bits rounded up to whole words.
+ *
+ * @param words the bit storage or NULL
+ * @param n_bits the number of bits
+ * @return the bitmap or NULL if cannot create
+ */
+struct fs_bitmap *fs_bitmap_create(void *words, int n_bits);
+
+/**
+ * Destroy a bitmap. Storage passed to fs_bitmap_create
+ * is not freed.
+ *
+ * @param bm the bitmap
+ */
+void fs_bitmap_destroy(struct fs_bitmap *bm);
+
+/**
+ * Recompute the free counts after the bit storage
+ * was changed directly.
+ *
+ * @param bm the bitmap
+ */
+void fs_bitmap_recount(struct fs_bitmap *bm);
+
+/**
+ * Test a bit.
+ *
+ * @param bm the bitmap
+ * @param i the bit number
+ * @return 1 if set, 0 if clear
+ */
+static inline int fs_bitmap_test(const struct fs_bitmap *bm, int i) {
+    return fs_bit_test(bm->words, i);
+}
+
+/**
+ * Set a bit.
+ *
+ * @param bm the bitmap
+ * @param i the bit number
+ * @return 1 if the bit was clear, 0 if already set
+ */
+int fs_bitmap_set(struct fs_bitmap *bm, int i);
+
+/**
+ * Clear a bit.
+ *
+ * @param bm the bitmap
+ * @param i the bit number
+ * @return 1 if the bit was set, 0 if already clear
+ */
+int fs_bitmap_clear(struct fs_bitmap *bm, int i);
+
+/**
+ * Find the first clear bit at or after a bit.
+ *
+ * @param bm the bitmap
+ * @param start the first bit to consider
+ * @return the bit number or -1 if none
+ */
+int fs_bitmap_find_zero(const struct fs_bitmap *bm, int start);
+
+/**
+ * Find the first clear bit in a range of bits.
+ *
+ * @param bm the bitmap
+ * @param start the first bit to consider
+ * @param end the bit after the last bit to consider
+ * @return the bit number or -1 if none
+ */
+int fs_bitmap_find_zero_in(const struct fs_bitmap *bm, int start, int end);
+
+/**
+ * Count the clear bits in a range of bits.
+ *
+ * @param bm the bitmap
+ * @param start the first bit to count
+ * @param end the bit after the last bit to count
+ * @return the number of clear bits
+ */
+int fs_bitmap_count_zero(const struct fs_bitmap *bm, int start, int end);
+
+/**
+ * Find the first set bit at or after a bit.
+ *
+ * @param bm the bitmap
+ * @param start the first bit to consider
+ * @return the bit number or -1 if none
+ */
+int fs_bitmap_find_set(const struct fs_bitmap *bm, int start);
+
+/**
+ * Find and set a clear bit, searching from the bit
+ * after the last one allocated and wrapping around.
+ *
+ * @param bm the bitmap
+ * @return the bit number or -1 if all bits are set
+ */
+int fs_bitmap_alloc(struct fs_bitmap *bm);
+
+/**
+ * Find and set a clear bit in a range of bits,
+ * searching from a cursor and wrapping around to
+ * the start of the range. The cursor is advanced
+ * past the bit.
+ *
+ * @param bm the bitmap
+ * @param start the first bit of the range
+ * @param end the bit after the last bit of the range
+ * @param cursor the search position
+ * @return the bit number or -1 if all bits in range are set
+ */
+int fs_bitmap_alloc_in(struct fs_bitmap *bm, int start, int end, int *cursor);
+
+#endif /* FS_UTIL_BITMAP_H_ */
@@ -0,0 +1,359 @@
+/*
+ * fs_util_bmap.c
+ *
+ * description: map file blocks to device blocks
+ * for CS 7600 / CS 5600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Peter Desnoyers,  November 2016
+ * Philip Gust, March 2021
+ */
+
+#include <string.h>
+#include <errno.h>
+
+#include "fs_util_bmap.h"
+#include "fs_util_alloc.h"
+#include "fs_util_extent.h"
+#include "fs_dev_blkdev.h"
+
+/**
+ * Map an index within the subtree rooted at a block
+ * pointer slot. A depth 0 slot points to a data block,
+ * depth 1 to a single-indirect and depth 2 to a
+ * double-indirect block.
+ *
+ * @param fs the file system
+ * @param ino the inode number
+ * @param slot the block pointer slot
+ * @param slot_dirty set to 1 if the slot was changed
+ * @param idx the block index within the subtree
+ * @param depth the depth of the subtree
+ * @param create 1 to allocate missing blocks
+ * @param is_new if not NULL, set to 1 if data block allocated
+ * @param goal block to allocate near, 0 for none
+ * @return device block number, 0 if not mapped, or -error
+ */
+static int bmap_slot(struct fs_ext2 *fs, int ino, uint32_t *slot, int *slot_dirty,
+                     int idx, int depth, int create, int *is_new, int goal)
+{
+    int fresh = 0;  // 1 if indirect block newly allocated
+    if (*slot == 0) {
+        if (!create) {
+            return 0;  // not mapped
+        }
+        int blkno = fs_alloc_blk(fs, ino, goal);
+        if (blkno < 0) {
+            return blkno;  // no block available
+        }
+        *slot = blkno;
+        *slot_dirty = 1;
+        if (depth == 0) {
+            if (is_new != NULL) {
+                *is_new = 1;
+            }
+            return blkno;
+        }
+        fresh = 1;
+    }
+    if (depth == 0) {
+        return *slot;
+    }
+
+    // read indirect block unless it was just allocated
+    uint32_t ptrs[PTRS_PER_BLK(FS_MAX_BLOCK_SIZE)];
+    if (fresh) {
+        memset(ptrs, 0, fs->blk_size);
+    } else if (fs_blk_read(fs, *slot, ptrs) != 0) {
+        return -EIO;
+    }
+
+    // map index within child subtree, allocating after
+    // the previous child or else after this block
+    int span = (depth == 2) ? PTRS_PER_BLK(fs->blk_size) : 1;
+    int child = idx / span;
+    goal = ((child > 0) && (ptrs[child-1] != 0)) ? ptrs[child-1] + 1 : *slot + 1;
+    int dirty = 0;
+    int blkno = bmap_slot(fs, ino, &ptrs[child], &dirty, idx % span, depth-1, create, is_new, goal);
+
+    // write indirect block back if changed
+    if ((dirty || fresh) && (fs_blk_write(fs, *slot, ptrs) != 0)) {
+        return -EIO;
+    }
+    return blkno;
+}
+
+/**
+ * Get the inode block pointer slot whose subtree
+ * maps a logical file block.
+ *
+ * @param fs the file system
+ * @param in the inode
+ * @param lblk the logical block in the file
+ * @param idx returns the block index within the subtree
+ * @param depth returns the depth of the subtree
+ * @return the block pointer slot
+ */
+static uint32_t *inode_slot(struct fs_ext2 *fs, struct fs_inode *in, int lblk, int *idx, int *depth)
+{
+    int ptrs_per_blk = PTRS_PER_BLK(fs->blk_size);
+    if (lblk < N_DIRECT) {
+        *idx = 0;
+        *depth = 0;
+        return &in->direct[lblk];
+    }
+    lblk -= N_DIRECT;
+    if (lblk < ptrs_per_blk) {
+        *idx = lblk;
+        *depth = 1;
+        return &in->indir_1;
+    }
+    *idx = lblk - ptrs_per_blk;
+    *depth = 2;
+    return &in->indir_2;
+}
+
+/**
+ * Map a logical file block to its device block
+ * through the direct, single-indirect, and double-
+ * indirect pointers of the inode. If create is set,
+ * missing data and indirect blocks are allocated after
+ * the block of the previous logical block.
+ *
+ * Errors
+ *   -EFBIG    - logical block beyond maximum file size
+ *   -ENOSPC   - free block not found
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param ino the inode number
+ * @param lblk the logical block in the file
+ * @param create 1 to allocate a missing block, 0 to look up only
+ * @param is_new if not NULL, set to 1 if the data block was allocated
+ * @return device block number, 0 if not mapped, or -error
+ */
+int fs_bmap(struct fs_ext2 *fs, int ino, int lblk, int create, int *is_new)
+{
+    if (is_new != NULL) {
+        *is_new = 0;
+    }
+    if ((lblk < 0) || (lblk >= MAX_FILE_BLKS(fs->blk_size))) {
+        return -EFBIG;
+    }
+    const struct fs_inode *cur = fs_inode(fs, ino);
+    if (cur == NULL) {
+        return -EIO;
+    }
+    if (cur->flags & FS_INODE_EXTENTS) {
+        return fs_extent_bmap(fs, ino, lblk, create, is_new);
+    }
+
+    // look up in a copy of the inode; the inode is
+    // marked changed only if a block pointer changes
+    struct fs_inode copy = *cur;
+    int idx, depth;
+    uint32_t *slot = inode_slot(fs, &copy, lblk, &idx, &depth);
+
+    // allocate after the previous block of the file
+    int ptrs_per_blk = PTRS_PER_BLK(fs->blk_size);
+    int goal = 0;
+    if ((lblk > 0) && (lblk <= N_DIRECT)) {
+        goal = (copy.direct[lblk-1] != 0) ? copy.direct[lblk-1] + 1 : 0;
+    } else if (lblk == N_DIRECT + ptrs_per_blk) {
+        // past the single-indirect blocks if they are contiguous
+        goal = (copy.indir_1 != 0) ? copy.indir_1 + ptrs_per_blk + 1 : 0;
+    }
+
+    int dirty = 0;
+    int blkno = bmap_slot(fs, ino, slot, &dirty, idx, depth, create, is_new, goal);
+
+    // store a changed pointer, even if a block below it
+    // could not be allocated
+    if (dirty) {
+        struct fs_inode *in = fs_inode_mut(fs, ino);
+        if (in == NULL) {
+            return -EIO;
+        }
+        *inode_slot(fs, in, lblk, &idx, &depth) = *slot;
+    }
+    return blkno;
+}
+
+/**
+ * Free blocks at or after an index within the subtree
+ * rooted at a block pointer slot. The slot is cleared
+ * if no blocks remain mapped in the subtree.
+ *
+ * @param fs the file system
+ * @param slot the block pointer slot
+ * @param first the first block index to free in the subtree
+ * @param depth the depth of the subtree
+ * @return 1 if the slot was cleared, 0 if not, or -error
+ */
+static int free_slot(struct fs_ext2 *fs, uint32_t *slot, int first, int depth)
+{
+    if (*slot == 0) {
+        return 0;  // nothing mapped
+    }
+
+    if (depth > 0) {
+        uint32_t ptrs[PTRS_PER_BLK(FS_MAX_BLOCK_SIZE)];
+        if (fs_blk_read(fs, *slot, ptrs) != 0) {
+            return -EIO;
+        }
+
+        // free child subtrees at or after first index
+        int ptrs_per_blk = PTRS_PER_BLK(fs->blk_size);
+        int span = (depth == 2) ? ptrs_per_blk : 1;
+        int dirty = 0;
+        for (int i = first / span; i < ptrs_per_blk; i++) {
+            int child_first = (i == first / span) ? first % span : 0;
+            int status = free_slot(fs, &ptrs[i], child_first, depth-1);
+            if (status < 0) {
+                return status;
+            }
+            dirty |= status;
+        }
+
+        // keep indirect block if it still maps blocks;
+        // those after the first index were all freed
+        int in_use = 0;
+        for (int i = 0; !in_use && (i <= first / span) && (i < ptrs_per_blk); i++) {
+            in_use = (ptrs[i] != 0);
+        }
+        if (in_use) {
+            if (dirty && (fs_blk_write(fs, *slot, ptrs) != 0)) {
+                return -EIO;
+            }
+            return 0;
+        }
+    }
+
+    // free the block itself
+    fs_free_blk(fs, *slot);
+    *slot = 0;
+    return 1;
+}
+
+/**
+ * Allocate the unmapped blocks of a range of logical
+ * blocks before they are written, so they can be taken
+ * as contiguous runs in one pass. Only files mapped by
+ * extents allocate ahead; for others nothing is done
+ * and fs_bmap allocates each block as it is mapped.
+ *
+ * Errors
+ *   -EFBIG    - logical block beyond maximum file size
+ *   -ENOSPC   - free block not found
+ *   -ENOMEM   - cannot allocate extent list
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param ino the inode number
+ * @param lblk the first logical block
+ * @param n_blks the number of logical blocks
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_balloc(struct fs_ext2 *fs, int ino, int lblk, int n_blks)
+{
+    if ((lblk < 0) || (n_blks < 0) || (n_blks > MAX_FILE_BLKS(fs->blk_size) - lblk)) {
+        return -EFBIG;
+    }
+    const struct fs_inode *in = fs_inode(fs, ino);
+    if (in == NULL) {
+        return -EIO;
+    }
+    if ((in->flags & FS_INODE_EXTENTS) && (n_blks > 0)) {
+        return fs_extent_alloc(fs, ino, lblk, n_blks);
+    }
+    return 0;
+}
+
+/**
+ * Free all data and indirect blocks of a file starting
+ * with a logical block. Each indirect block is read and
+ * written at most once, and freed when it no longer
+ * maps any blocks.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param ino the inode number
+ * @param first_lblk the first logical block to free
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_btrunc(struct fs_ext2 *fs, int ino, int first_lblk)
+{
+    if (first_lblk >= MAX_FILE_BLKS(fs->blk_size)) {
+        return 0;  // nothing mapped
+    }
+    if (first_lblk < 0) {
+        first_lblk = 0;
+    }
+    const struct fs_inode *cur = fs_inode(fs, ino);
+    if (cur == NULL) {
+        return -EIO;
+    }
+    if (cur->flags & FS_INODE_EXTENTS) {
+        return fs_extent_trunc(fs, ino, first_lblk);
+    }
+    struct fs_inode *in = fs_inode_mut(fs, ino);  // block pointers may change
+    if (in == NULL) {
+        return -EIO;
+    }
+
+    int status = 0;
+
+    // free direct blocks
+    for (int i = first_lblk; i < N_DIRECT; i++) {
+        free_slot(fs, &in->direct[i], 0, 0);
+    }
+
+    // free single-indirect blocks
+    int first = first_lblk - N_DIRECT;
+    if (first < PTRS_PER_BLK(fs->blk_size)) {
+        status = free_slot(fs, &in->indir_1, (first > 0) ? first : 0, 1);
+    }
+
+    // free double-indirect blocks
+    first -= PTRS_PER_BLK(fs->blk_size);
+    if (status >= 0) {
+        status = free_slot(fs, &in->indir_2, (first > 0) ? first : 0, 2);
+    }
+    return (status < 0) ? status : 0;
+}
+
+/**
+ * Zero the bytes of the file block containing a file
+ * offset, from that offset to the end of the block.
+ * Nothing is written if the block is not mapped.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param ino the inode number
+ * @param offset the file offset
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_bzero_tail(struct fs_ext2 *fs, int ino, int offset)
+{
+    int blkno = fs_bmap(fs, ino, offset / fs->blk_size, 0, NULL);
+    if (blkno <= 0) {
+        return (blkno == -EFBIG) ? 0 : blkno;  // nothing to zero
+    }
+
+    uint8_t file_blk[FS_MAX_BLOCK_SIZE];
+    int blk_off = offset % fs->blk_size;
+    if (blk_off > 0) {
+        if (fs->dev->ops->read(fs->dev, blkno, 1, file_blk) != SUCCESS) {
+            return -EIO;
+        }
+    }
+    memset(file_blk + blk_off, 0, fs->blk_size - blk_off);
+    if (fs->dev->ops->write(fs->dev, blkno, 1, file_blk) != SUCCESS) {
+        return -EIO;
+    }
+    return 0;
+}
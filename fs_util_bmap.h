@@ -0,0 +1,89 @@
+/*
+ * fs_util_bmap.h
+ *
+ * description: map file blocks to device blocks
+ * for CS 7600 / CS 5600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Peter Desnoyers,  November 2016
+ * Philip Gust, March 2021
+ */
+
+#ifndef FS_UTIL_BMAP_H_
+#define FS_UTIL_BMAP_H_
+
+#include "fs_util_volume.h"
+
+/**
+ * Map a logical file block to its device block
+ * through the direct, single-indirect, and double-
+ * indirect pointers of the inode. If create is set,
+ * missing data and indirect blocks are allocated.
+ *
+ * Errors
+ *   -EFBIG    - logical block beyond maximum file size
+ *   -ENOSPC   - free block not found
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param ino the inode number
+ * @param lblk the logical block in the file
+ * @param create 1 to allocate a missing block, 0 to look up only
+ * @param is_new if not NULL, set to 1 if the data block was allocated
+ * @return device block number, 0 if not mapped, or -error
+ */
+int fs_bmap(struct fs_ext2 *fs, int ino, int lblk, int create, int *is_new);
+
+/**
+ * Allocate the unmapped blocks of a range of logical
+ * blocks before they are written, so they can be taken
+ * as contiguous runs in one pass. Only files mapped by
+ * extents allocate ahead; for others nothing is done
+ * and fs_bmap allocates each block as it is mapped.
+ *
+ * Errors
+ *   -EFBIG    - logical block beyond maximum file size
+ *   -ENOSPC   - free block not found
+ *   -ENOMEM   - cannot allocate extent list
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param ino the inode number
+ * @param lblk the first logical block
+ * @param n_blks the number of logical blocks
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_balloc(struct fs_ext2 *fs, int ino, int lblk, int n_blks);
+
+/**
+ * Free all data and indirect blocks of a file starting
+ * with a logical block. Each indirect block is read and
+ * written at most once, and freed when it no longer
+ * maps any blocks.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param ino the inode number
+ * @param first_lblk the first logical block to free
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_btrunc(struct fs_ext2 *fs, int ino, int first_lblk);
+
+/**
+ * Zero the bytes of the file block containing a file
+ * offset, from that offset to the end of the block.
+ * Nothing is written if the block is not mapped.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param ino the inode number
+ * @param offset the file offset
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_bzero_tail(struct fs_ext2 *fs, int ino, int offset);
+
+#endif /* FS_UTIL_BMAP_H_ */
@@ -0,0 +1,302 @@
+/*
+ * fs_util_dcache.c
+ *
+ * description: directory entry cache mapping (directory
+ * inode, name) to file inode, including missing names
+ * for CS 7600 / CS 5600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Peter Desnoyers,  November 2016
+ * Philip Gust, March 2021
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "fs_util_dcache.h"
+#include "fsx600.h"
+
+/** cached directory entry */
+struct dentry {
+    int dir_ino;				/** inode of directory */
+    int ino;					/** inode of entry, 0 if missing */
+    uint32_t hash;				/** hash of dir_ino and name */
+    int next;					/** next entry in bucket or free list */
+    int lru_prev, lru_next;		/** least recently used list */
+    char name[FS_FILENAME_SIZE];/** entry name */
+};
+
+/** directory entry cache */
+struct fs_dcache {
+    int ignore_case;			/** 1 if case-independent names */
+    int n_buckets;				/** number of hash buckets (power of 2) */
+    int *buckets;				/** first entry in each bucket */
+    struct dentry *entries;		/** entry storage */
+    int free;					/** first free entry */
+    int lru_head;				/** most recently used entry */
+    int lru_tail;				/** least recently used entry */
+};
+
+/**
+ * Compute hash of directory inode and name.
+ *
+ * @param dc the cache
+ * @param dir_ino inode of directory
+ * @param name the entry name
+ * @return the hash
+ */
+static uint32_t dentry_hash(struct fs_dcache *dc, int dir_ino, const char *name)
+{
+    uint32_t hash = 2166136261u ^ (uint32_t)dir_ino;
+    for (const unsigned char *p = (const unsigned char*)name; *p != '\0'; p++) {
+        hash ^= (dc->ignore_case ? (unsigned char)toupper(*p) : *p);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Find an entry and its predecessor link in its bucket.
+ *
+ * @param dc the cache
+ * @param dir_ino inode of directory
+ * @param name the entry name
+ * @param hash the entry hash
+ * @return pointer to link to entry, or to -1 at end of bucket
+ */
+static int *dentry_find(struct fs_dcache *dc, int dir_ino, const char *name, uint32_t hash)
+{
+    // case-dependent or case-dependent comparison
+    static int (*compare[2])(const char*, const char*) = {strcmp, strcasecmp};
+
+    int *link = &dc->buckets[hash & (dc->n_buckets-1)];
+    while (*link >= 0) {
+        struct dentry *d = &dc->entries[*link];
+        if (   (d->hash == hash) && (d->dir_ino == dir_ino)
+            && (compare[dc->ignore_case == 1](d->name, name) == 0)) {
+            break;
+        }
+        link = &d->next;
+    }
+    return link;
+}
+
+/**
+ * Remove an entry from the least recently used list.
+ *
+ * @param dc the cache
+ * @param i the entry
+ */
+static void lru_unlink(struct fs_dcache *dc, int i)
+{
+    struct dentry *d = &dc->entries[i];
+    if (d->lru_prev >= 0) {
+        dc->entries[d->lru_prev].lru_next = d->lru_next;
+    } else {
+        dc->lru_head = d->lru_next;
+    }
+    if (d->lru_next >= 0) {
+        dc->entries[d->lru_next].lru_prev = d->lru_prev;
+    } else {
+        dc->lru_tail = d->lru_prev;
+    }
+}
+
+/**
+ * Add an entry at the head of the least recently used list.
+ *
+ * @param dc the cache
+ * @param i the entry
+ */
+static void lru_push(struct fs_dcache *dc, int i)
+{
+    struct dentry *d = &dc->entries[i];
+    d->lru_prev = -1;
+    d->lru_next = dc->lru_head;
+    if (dc->lru_head >= 0) {
+        dc->entries[dc->lru_head].lru_prev = i;
+    } else {
+        dc->lru_tail = i;
+    }
+    dc->lru_head = i;
+}
+
+/**
+ * Remove an entry from the cache.
+ *
+ * @param dc the cache
+ * @param link the link to the entry in its bucket
+ */
+static void dentry_remove(struct fs_dcache *dc, int *link)
+{
+    int i = *link;
+    *link = dc->entries[i].next;
+    lru_unlink(dc, i);
+    dc->entries[i].next = dc->free;
+    dc->free = i;
+}
+
+/**
+ * Create a directory entry cache.
+ *
+ * @param n_entries maximum number of cached entries
+ * @param ignore_case 1 for case-independent names, 0 for case-dependent
+ * @return the cache or NULL if cannot create
+ */
+struct fs_dcache *fs_dcache_create(int n_entries, int ignore_case)
+{
+    struct fs_dcache *dc = malloc(sizeof(struct fs_dcache));
+    if (dc == NULL) {
+        return NULL;
+    }
+    dc->ignore_case = ignore_case;
+    for (dc->n_buckets = 1; dc->n_buckets < n_entries; dc->n_buckets *= 2) {
+    }
+    dc->buckets = malloc(dc->n_buckets * sizeof(int));
+    dc->entries = malloc(n_entries * sizeof(struct dentry));
+    if ((dc->buckets == NULL) || (dc->entries == NULL)) {
+        fs_dcache_destroy(dc);
+        return NULL;
+    }
+
+    // all buckets empty and all entries free
+    memset(dc->buckets, -1, dc->n_buckets * sizeof(int));
+    for (int i = 0; i < n_entries; i++) {
+        dc->entries[i].next = (i+1 < n_entries) ? i+1 : -1;
+    }
+    dc->free = (n_entries > 0) ? 0 : -1;
+    dc->lru_head = dc->lru_tail = -1;
+    return dc;
+}
+
+/**
+ * Destroy a directory entry cache.
+ *
+ * @param dc the cache
+ */
+void fs_dcache_destroy(struct fs_dcache *dc)
+{
+    if (dc != NULL) {
+        free(dc->buckets);
+        free(dc->entries);
+        free(dc);
+    }
+}
+
+/**
+ * Look up a name in a directory. A cached miss
+ * returns a hit with inode number 0.
+ *
+ * @param dc the cache
+ * @param dir_ino inode of directory
+ * @param name the entry name
+ * @param ino returns the inode, or 0 if cached as missing
+ * @return 1 if cached, 0 if not cached
+ */
+int fs_dcache_lookup(struct fs_dcache *dc, int dir_ino, const char *name, int *ino)
+{
+    int *link = dentry_find(dc, dir_ino, name, dentry_hash(dc, dir_ino, name));
+    if (*link < 0) {
+        return 0;
+    }
+
+    // move to head of least recently used list
+    lru_unlink(dc, *link);
+    lru_push(dc, *link);
+    *ino = dc->entries[*link].ino;
+    return 1;
+}
+
+/**
+ * Cache the inode for a name in a directory, replacing
+ * the least recently used entry if the cache is full.
+ *
+ * @param dc the cache
+ * @param dir_ino inode of directory
+ * @param name the entry name
+ * @param ino the inode, or 0 to cache a missing name
+ */
+void fs_dcache_insert(struct fs_dcache *dc, int dir_ino, const char *name, int ino)
+{
+    uint32_t hash = dentry_hash(dc, dir_ino, name);
+    int *link = dentry_find(dc, dir_ino, name, hash);
+    if (*link >= 0) {
+        dentry_remove(dc, link);  // replace existing entry
+    }
+
+    // evict least recently used entry if full
+    if (dc->free < 0) {
+        if (dc->lru_tail < 0) {
+            return;  // no entries
+        }
+        struct dentry *d = &dc->entries[dc->lru_tail];
+        dentry_remove(dc, dentry_find(dc, d->dir_ino, d->name, d->hash));
+    }
+
+    // add entry at head of bucket
+    int i = dc->free;
+    struct dentry *d = &dc->entries[i];
+    dc->free = d->next;
+    d->dir_ino = dir_ino;
+    d->ino = ino;
+    d->hash = hash;
+    strncpy(d->name, name, FS_FILENAME_SIZE-1);
+    d->name[FS_FILENAME_SIZE-1] = '\0';
+    int *bucket = &dc->buckets[hash & (dc->n_buckets-1)];
+    d->next = *bucket;
+    *bucket = i;
+    lru_push(dc, i);
+}
+
+/**
+ * Invalidate the cached entry for a name in a directory.
+ *
+ * @param dc the cache
+ * @param dir_ino inode of directory
+ * @param name the entry name
+ */
+void fs_dcache_invalidate(struct fs_dcache *dc, int dir_ino, const char *name)
+{
+    int *link = dentry_find(dc, dir_ino, name, dentry_hash(dc, dir_ino, name));
+    if (*link >= 0) {
+        dentry_remove(dc, link);
+    }
+}
+
+/**
+ * Invalidate all cached entries for a directory.
+ *
+ * @param dc the cache
+ * @param dir_ino inode of directory
+ */
+void fs_dcache_invalidate_dir(struct fs_dcache *dc, int dir_ino)
+{
+    for (int b = 0; b < dc->n_buckets; b++) {
+        int *link = &dc->buckets[b];
+        while (*link >= 0) {
+            if (dc->entries[*link].dir_ino == dir_ino) {
+                dentry_remove(dc, link);
+            } else {
+                link = &dc->entries[*link].next;
+            }
+        }
+    }
+}
+
+/**
+ * Invalidate all cached entries.
+ *
+ * @param dc the cache
+ */
+void fs_dcache_invalidate_all(struct fs_dcache *dc)
+{
+    for (int b = 0; b < dc->n_buckets; b++) {
+        int *link = &dc->buckets[b];
+        while (*link >= 0) {
+            dentry_remove(dc, link);
+        }
+    }
+}
@@ -0,0 +1,85 @@
+/*
+ * fs_util_dcache.h
+ *
+ * description: directory entry cache mapping (directory
+ * inode, name) to file inode, including missing names
+ * for CS 7600 / CS 5600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Peter Desnoyers,  November 2016
+ * Philip Gust, March 2021
+ */
+
+#ifndef FS_UTIL_DCACHE_H_
+#define FS_UTIL_DCACHE_H_
+
+/** default number of entries in a directory entry cache */
+enum { FS_DCACHE_ENTRIES = 1024 };
+
+/** struct for a directory entry cache */
+struct fs_dcache;
+
+/**
+ * Create a directory entry cache.
+ *
+ * @param n_entries maximum number of cached entries
+ * @param ignore_case 1 for case-independent names, 0 for case-dependent
+ * @return the cache or NULL if cannot create
+ */
+struct fs_dcache *fs_dcache_create(int n_entries, int ignore_case);
+
+/**
+ * Destroy a directory entry cache.
+ *
+ * @param dc the cache
+ */
+void fs_dcache_destroy(struct fs_dcache *dc);
+
+/**
+ * Look up a name in a directory. A cached miss
+ * returns a hit with inode number 0.
+ *
+ * @param dc the cache
+ * @param dir_ino inode of directory
+ * @param name the entry name
+ * @param ino returns the inode, or 0 if cached as missing
+ * @return 1 if cached, 0 if not cached
+ */
+int fs_dcache_lookup(struct fs_dcache *dc, int dir_ino, const char *name, int *ino);
+
+/**
+ * Cache the inode for a name in a directory, replacing
+ * the least recently used entry if the cache is full.
+ *
+ * @param dc the cache
+ * @param dir_ino inode of directory
+ * @param name the entry name
+ * @param ino the inode, or 0 to cache a missing name
+ */
+void fs_dcache_insert(struct fs_dcache *dc, int dir_ino, const char *name, int ino);
+
+/**
+ * Invalidate the cached entry for a name in a directory.
+ *
+ * @param dc the cache
+ * @param dir_ino inode of directory
+ * @param name the entry name
+ */
+void fs_dcache_invalidate(struct fs_dcache *dc, int dir_ino, const char *name);
+
+/**
+ * Invalidate all cached entries for a directory.
+ *
+ * @param dc the cache
+ * @param dir_ino inode of directory
+ */
+void fs_dcache_invalidate_dir(struct fs_dcache *dc, int dir_ino);
+
+/**
+ * Invalidate all cached entries.
+ *
+ * @param dc the cache
+ */
+void fs_dcache_invalidate_all(struct fs_dcache *dc);
+
+#endif /* FS_UTIL_DCACHE_H_ */
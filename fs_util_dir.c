@@ -0,0 +1,792 @@
+/*
+ * fs_util_dir.c
+ *
+ * description: look up, add, and remove directory entries
+ * for CS 7600 / CS 5600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Peter Desnoyers,  November 2016
+ * Philip Gust, March 2021
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "fs_util_dir.h"
+#include "fs_util_bmap.h"
+#include "fs_dev_blkdev.h"
+
+/** path through a hashed directory index to a leaf block */
+struct dx_path {
+    struct fs_dirblk root;	/** directory block 0 with index root */
+    struct fs_dirblk node;	/** index node block if two levels */
+    int pos[2];				/** root and node entry positions */
+    int leaf_lblk;			/** logical block of leaf */
+};
+
+/** directory entry with its name hash for splitting leaf blocks */
+struct dx_hashed_dirent {
+    uint32_t hash;
+    struct fs_dirent de;
+};
+
+/**
+ * Determines whether a directory has a hashed index.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param dir_ino inode of directory
+ * @return 1 if indexed, 0 if linear, or -error
+ */
+static inline int is_indexed(struct fs_ext2 *fs, int dir_ino)
+{
+    const struct fs_inode *in = fs_inode(fs, dir_ino);
+    if (in == NULL) {
+        return -EIO;
+    }
+    return (in->flags & FS_INODE_INDEX) != 0;
+}
+
+/**
+ * Index root stored in directory block 0 after "." and "..".
+ *
+ * @param db directory block 0
+ * @return the index root
+ */
+static inline struct fs_dx_root *dx_root(struct fs_dirblk *db)
+{
+    return (struct fs_dx_root*)&db->de[2];
+}
+
+/**
+ * Index node stored in an index node block.
+ *
+ * @param db the index node block
+ * @return the index node
+ */
+static inline struct fs_dx_node *dx_node(struct fs_dirblk *db)
+{
+    return (struct fs_dx_node*)db->de;
+}
+
+/**
+ * Compute the index hash of a name (32-bit FNV-1a).
+ * Names hash case-independently on case-independent
+ * volumes so equal names always hash the same.
+ *
+ * @param name the entry name
+ * @param ignore_case 1 for case-independent, 0 for case-dependent
+ * @return the name hash
+ */
+static uint32_t dx_hash(const char *name, int ignore_case)
+{
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char*)name; *p != '\0'; p++) {
+        hash ^= (ignore_case ? (unsigned char)toupper(*p) : *p);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Find the index entry whose hash range includes a hash.
+ * The first entry of an index always has hash 0.
+ *
+ * @param entries the index entries
+ * @param count the number of entries
+ * @param hash the name hash
+ * @return position of last entry with hash <= hash
+ */
+static int dx_search(const struct fs_dx_entry *entries, int count, uint32_t hash)
+{
+    int lo = 0, hi = count - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (entries[mid].hash <= hash) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+/**
+ * Insert an index entry at a position.
+ *
+ * @param entries the index entries
+ * @param count the number of entries, incremented
+ * @param pos the position for the new entry
+ * @param hash the lowest hash for the child
+ * @param lblk the logical block of the child
+ */
+static void dx_insert(struct fs_dx_entry *entries, uint32_t *count, int pos, uint32_t hash, int lblk)
+{
+    memmove(&entries[pos+1], &entries[pos], (*count - pos) * sizeof(struct fs_dx_entry));
+    entries[pos] = (struct fs_dx_entry) { .hash = hash, .lblk = lblk };
+    (*count)++;
+}
+
+/**
+ * Compare hashed entries by hash for qsort.
+ */
+static int dx_compare(const void *a, const void *b)
+{
+    uint32_t ha = ((const struct dx_hashed_dirent*)a)->hash;
+    uint32_t hb = ((const struct dx_hashed_dirent*)b)->hash;
+    return (ha > hb) - (ha < hb);
+}
+
+/**
+ * Look up a directory entry in a directory block,
+ * also finding the first free entry in the block.
+ *
+ * @param de storage for a directory block
+ * @param n_entries number of entry slots in block
+ * @param name the entry name
+ * @param ignore_case 1 for case-independent, 0 for case-dependent
+ * @param free_entry returns first free entry or -1 if none
+ * @return entry in directory block or -ENOENT if not found
+ */
+static inline int get_entry_in_block(struct fs_dirent* de, int n_entries, const char *name,
+                                     int ignore_case, int *free_entry)
+{
+    // case-dependent or case-dependent comparison
+    static int (*compare[2])(const char*, const char*) = {strcmp, strcasecmp};
+
+    *free_entry = -1;
+    for (int i = 0; i < n_entries; i++) {
+        if (de[i].valid == 1) {
+            // check for existing entry
+            if (compare[ignore_case == 1](de[i].name, name) == 0) {
+                return i;
+            }
+        } else if (*free_entry < 0) { // first found
+            *free_entry = i;
+        }
+    }
+    return -ENOENT;
+}
+
+/**
+ * Define get_entry_in_full_<suffix>, which looks up a
+ * directory entry in a full block of one block size.
+ */
+#define DEFINE_GET_ENTRY_IN_FULL(sfx, bs) \
+static int get_entry_in_full_##sfx(struct fs_dirent* de, const char *name, \
+                                   int ignore_case, int *free_entry) \
+{ \
+    return get_entry_in_block(de, DIRENTS_PER_BLK(bs), name, ignore_case, free_entry); \
+}
+FS_FOR_EACH_BLK_SIZE(DEFINE_GET_ENTRY_IN_FULL)
+
+/**
+ * Look up a directory entry in a directory block, also
+ * finding the first free entry in the block. Full blocks
+ * are scanned by the copy of the loop for the volume
+ * block size.
+ *
+ * @param fs the file system
+ * @param db the directory block
+ * @param name the entry name
+ * @param free_entry returns first free entry or -1 if none
+ * @return entry in directory block or -ENOENT if not found
+ */
+static int get_entry(struct fs_ext2 *fs, struct fs_dirblk *db, const char *name, int *free_entry)
+{
+    if (db->n_entries == DIRENTS_PER_BLK(fs->blk_size)) {
+        return FS_BLK_SIZE_CALL(fs->blk_size, get_entry_in_full, db->de, name, fs->ignore_case, free_entry);
+    }
+    return get_entry_in_block(db->de, db->n_entries, name, fs->ignore_case, free_entry);
+}
+
+/**
+ * Read a directory block by logical block number.
+ *
+ * Errors
+ *   -ENOENT   - block not mapped
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param dir_ino inode of directory
+ * @param lblk the logical block in the directory
+ * @param db returns the directory block
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_dir_read(struct fs_ext2 *fs, int dir_ino, int lblk, struct fs_dirblk *db)
+{
+    int blkno = fs_bmap(fs, dir_ino, lblk, 0, NULL);
+    if (blkno <= 0) {
+        return (blkno == 0 || blkno == -EFBIG) ? -ENOENT : blkno;
+    }
+    if (fs_blk_read(fs, blkno, db->de) != 0) {
+        return -EIO;  // cannot read block
+    }
+    int indexed = (lblk == 0) ? is_indexed(fs, dir_ino) : 0;
+    if (indexed < 0) {
+        return indexed;
+    }
+    db->lblk = lblk;
+    db->blkno = blkno;
+    db->entry = -1;
+    // block 0 of an indexed directory only has "." and ".." entries
+    db->n_entries = indexed ? 2 : DIRENTS_PER_BLK(fs->blk_size);
+    db->dx_pos[0] = db->dx_pos[1] = 0;
+    return 0;
+}
+
+/**
+ * Write a directory block back to disk.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param db the directory block
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_dir_write(struct fs_ext2 *fs, struct fs_dirblk *db)
+{
+    if (fs_blk_write(fs, db->blkno, db->de) != 0) {
+        return -EIO;  // cannot write block
+    }
+    return 0;
+}
+
+/**
+ * Walk the hashed index of a directory to the
+ * leaf block for a name hash.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param dir_ino inode of directory
+ * @param hash the name hash
+ * @param path returns the index blocks and leaf
+ * @return 0 if successful, -error if error occurred
+ */
+static int dx_walk(struct fs_ext2 *fs, int dir_ino, uint32_t hash, struct dx_path *path)
+{
+    int status = fs_dir_read(fs, dir_ino, 0, &path->root);
+    if (status < 0) {
+        return (status == -ENOENT) ? -EIO : status;
+    }
+    struct fs_dx_root *root = dx_root(&path->root);
+    path->pos[0] = dx_search(root->entries, root->count, hash);
+    path->pos[1] = 0;
+    path->leaf_lblk = root->entries[path->pos[0]].lblk;
+
+    if (root->levels == 2) {
+        status = fs_dir_read(fs, dir_ino, path->leaf_lblk, &path->node);
+        if (status < 0) {
+            return (status == -ENOENT) ? -EIO : status;
+        }
+        struct fs_dx_node *node = dx_node(&path->node);
+        path->pos[1] = dx_search(node->entries, node->count, hash);
+        path->leaf_lblk = node->entries[path->pos[1]].lblk;
+    }
+    return 0;
+}
+
+/**
+ * Allocate a new empty block at the end of an indexed
+ * directory. The caller writes the index root to record
+ * the updated next logical block.
+ *
+ * Errors
+ *   -ENOSPC   - free block not found
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param dir_ino inode of directory
+ * @param root directory block 0 with index root
+ * @param db returns the new block
+ * @return 0 if successful, -error if error occurred
+ */
+static int dx_new_blk(struct fs_ext2 *fs, int dir_ino, struct fs_dirblk *root, struct fs_dirblk *db)
+{
+    struct fs_dx_root *r = dx_root(root);
+    int blkno = fs_bmap(fs, dir_ino, r->next_lblk, 1, NULL);
+    if (blkno < 0) {
+        return (blkno == -EFBIG) ? -ENOSPC : blkno;
+    }
+    db->lblk = r->next_lblk++;
+    db->blkno = blkno;
+    db->entry = -1;
+    db->n_entries = DIRENTS_PER_BLK(fs->blk_size);
+    db->dx_pos[0] = db->dx_pos[1] = 0;
+    memset(db->de, 0, fs->blk_size);
+    return 0;
+}
+
+/**
+ * Ensure the index block that is parent of the leaf
+ * on a path has room for another entry, by growing
+ * the index to two levels or splitting the node.
+ *
+ * Errors
+ *   -ENOSPC   - index is full
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param dir_ino inode of directory
+ * @param path the index path
+ * @return 1 if index changed, 0 if room already, -error if error occurred
+ */
+static int dx_make_room(struct fs_ext2 *fs, int dir_ino, struct dx_path *path)
+{
+    struct fs_dx_root *root = dx_root(&path->root);
+    struct fs_dirblk new_blk;
+    int status;
+
+    if (root->levels == 1) {
+        if (root->count < (uint32_t)DX_ROOT_LIMIT(fs->blk_size)) {
+            return 0;
+        }
+
+        // grow index to two levels by moving root entries to a node
+        if ((status = dx_new_blk(fs, dir_ino, &path->root, &new_blk)) < 0) {
+            return status;
+        }
+        struct fs_dx_node *node = dx_node(&new_blk);
+        node->count = root->count;
+        memcpy(node->entries, root->entries, root->count * sizeof(struct fs_dx_entry));
+        if ((status = fs_dir_write(fs, &new_blk)) < 0) {
+            return status;
+        }
+        root->levels = 2;
+        root->count = 1;
+        root->entries[0] = (struct fs_dx_entry) { .hash = 0, .lblk = new_blk.lblk };
+    } else {
+        struct fs_dx_node *node = dx_node(&path->node);
+        if (node->count < (uint32_t)DX_NODE_LIMIT(fs->blk_size)) {
+            return 0;
+        }
+        if (root->count >= (uint32_t)DX_ROOT_LIMIT(fs->blk_size)) {
+            return -ENOSPC;  // directory index full
+        }
+
+        // split index node, moving upper half of entries to a new node
+        if ((status = dx_new_blk(fs, dir_ino, &path->root, &new_blk)) < 0) {
+            return status;
+        }
+        struct fs_dx_node *new_node = dx_node(&new_blk);
+        int mid = node->count / 2;
+        new_node->count = node->count - mid;
+        memcpy(new_node->entries, &node->entries[mid], new_node->count * sizeof(struct fs_dx_entry));
+        node->count = mid;
+        if (   ((status = fs_dir_write(fs, &new_blk)) < 0)
+            || ((status = fs_dir_write(fs, &path->node)) < 0)) {
+            return status;
+        }
+        dx_insert(root->entries, &root->count, path->pos[0]+1, new_node->entries[0].hash, new_blk.lblk);
+    }
+
+    // write root for new entries and next logical block
+    if ((status = fs_dir_write(fs, &path->root)) < 0) {
+        return status;
+    }
+    return 1;
+}
+
+/**
+ * Split a full leaf block of an indexed directory,
+ * moving the entries with the upper half of the hashes
+ * to a new leaf block. The parent index block must
+ * have room for another entry.
+ *
+ * Errors
+ *   -ENOSPC   - free block not found or hashes cannot be split
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param dir_ino inode of directory
+ * @param path the index path to the leaf
+ * @param leaf the full leaf block
+ * @return 0 if successful, -error if error occurred
+ */
+static int dx_split_leaf(struct fs_ext2 *fs, int dir_ino, struct dx_path *path, struct fs_dirblk *leaf)
+{
+    // sort valid entries by hash
+    struct dx_hashed_dirent ents[DIRENTS_PER_BLK(FS_MAX_BLOCK_SIZE)];
+    int n = 0;
+    for (int i = 0; i < DIRENTS_PER_BLK(fs->blk_size); i++) {
+        if (leaf->de[i].valid) {
+            ents[n].hash = dx_hash(leaf->de[i].name, fs->ignore_case);
+            ents[n++].de = leaf->de[i];
+        }
+    }
+    qsort(ents, n, sizeof(struct dx_hashed_dirent), dx_compare);
+
+    // find split point near middle between different hashes
+    int mid = n / 2;
+    while ((mid < n) && (ents[mid].hash == ents[mid-1].hash)) {
+        mid++;
+    }
+    if (mid == n) {
+        for (mid = n / 2; (mid > 0) && (ents[mid].hash == ents[mid-1].hash); mid--) {
+        }
+        if (mid == 0) {
+            return -ENOSPC;  // all names have the same hash
+        }
+    }
+
+    // move upper half of entries to new leaf block
+    struct fs_dirblk new_leaf;
+    int status = dx_new_blk(fs, dir_ino, &path->root, &new_leaf);
+    if (status < 0) {
+        return status;
+    }
+    memset(leaf->de, 0, fs->blk_size);
+    for (int i = 0; i < n; i++) {
+        if (i < mid) {
+            leaf->de[i] = ents[i].de;
+        } else {
+            new_leaf.de[i - mid] = ents[i].de;
+        }
+    }
+    if (   ((status = fs_dir_write(fs, &new_leaf)) < 0)
+        || ((status = fs_dir_write(fs, leaf)) < 0)) {
+        return status;
+    }
+
+    // add new leaf to parent index block
+    struct fs_dx_root *root = dx_root(&path->root);
+    if (root->levels == 1) {
+        dx_insert(root->entries, &root->count, path->pos[0]+1, ents[mid].hash, new_leaf.lblk);
+    } else {
+        struct fs_dx_node *node = dx_node(&path->node);
+        dx_insert(node->entries, &node->count, path->pos[1]+1, ents[mid].hash, new_leaf.lblk);
+        if ((status = fs_dir_write(fs, &path->node)) < 0) {
+            return status;
+        }
+    }
+
+    // write root for new entries and next logical block
+    return fs_dir_write(fs, &path->root);
+}
+
+/**
+ * Convert a full single block linear directory to an
+ * indexed directory. Entries other than "." and ".." move
+ * to a new leaf block, and the rest of block 0 becomes
+ * the index root.
+ *
+ * Errors
+ *   -ENOSPC   - free block not found
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param dir_ino inode of directory
+ * @param blk0 directory block 0
+ * @return 0 if converted, 1 if cannot be indexed, -error if error occurred
+ */
+static int dx_convert(struct fs_ext2 *fs, int dir_ino, struct fs_dirblk *blk0)
+{
+    // block 0 must start with "." and ".." entries
+    struct fs_dirent *de = blk0->de;
+    if (   !de[0].valid || (strcmp(de[0].name, ".") != 0)
+        || !de[1].valid || (strcmp(de[1].name, "..") != 0)) {
+        return 1;
+    }
+
+    // move other entries to new leaf block 1
+    int blkno = fs_bmap(fs, dir_ino, 1, 1, NULL);
+    if (blkno < 0) {
+        return blkno;
+    }
+    struct fs_dirblk leaf = { .lblk = 1, .blkno = blkno, .n_entries = DIRENTS_PER_BLK(fs->blk_size) };
+    memset(leaf.de, 0, fs->blk_size);
+    for (int i = 2, n = 0; i < DIRENTS_PER_BLK(fs->blk_size); i++) {
+        if (de[i].valid) {
+            leaf.de[n++] = de[i];
+        }
+    }
+    int status = fs_dir_write(fs, &leaf);
+    if (status < 0) {
+        return status;
+    }
+
+    // initialize index root with single leaf
+    memset(&de[2], 0, fs->blk_size - 2*sizeof(struct fs_dirent));
+    struct fs_dx_root *root = dx_root(blk0);
+    root->levels = 1;
+    root->count = 1;
+    root->next_lblk = 2;
+    root->entries[0] = (struct fs_dx_entry) { .hash = 0, .lblk = 1 };
+    if ((status = fs_dir_write(fs, blk0)) < 0) {
+        return status;
+    }
+
+    struct fs_inode *in = fs_inode_mut(fs, dir_ino);  // mark dir inode changed
+    if (in == NULL) {
+        return -EIO;
+    }
+    in->flags |= FS_INODE_INDEX;
+    return 0;
+}
+
+/**
+ * Find a free entry for a name in the leaf block of an
+ * indexed directory for the name hash, splitting the
+ * leaf if it is full.
+ *
+ * Errors
+ *   -EEXIST   - entry already exists
+ *   -ENOSPC   - free entry or block not found
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param dir_ino inode of directory
+ * @param name the entry name
+ * @param db returns the leaf block and free entry
+ * @return 0 if successful, -error if dup or not available
+ */
+static int dx_alloc_entry(struct fs_ext2 *fs, int dir_ino, const char *name, struct fs_dirblk *db)
+{
+    uint32_t hash = dx_hash(name, fs->ignore_case);
+    struct dx_path path;
+    int free_entry;
+
+    for (;;) {
+        int status = dx_walk(fs, dir_ino, hash, &path);
+        if (status < 0) {
+            return status;
+        }
+
+        // check for "." and ".." in block 0
+        if (get_entry_in_block(path.root.de, 2, name, fs->ignore_case, &free_entry) >= 0) {
+            return -EEXIST;
+        }
+
+        // find existing or free entry in leaf block
+        if ((status = fs_dir_read(fs, dir_ino, path.leaf_lblk, db)) < 0) {
+            return (status == -ENOENT) ? -EIO : status;
+        }
+        if (get_entry(fs, db, name, &free_entry) >= 0) {
+            return -EEXIST;
+        }
+        if (free_entry >= 0) {
+            db->entry = free_entry;
+            db->dx_pos[0] = path.pos[0];
+            db->dx_pos[1] = path.pos[1];
+            return 0;
+        }
+
+        // leaf full: ensure parent has room, then split leaf and retry
+        if ((status = dx_make_room(fs, dir_ino, &path)) < 0) {
+            return status;
+        }
+        if ((status == 0) && ((status = dx_split_leaf(fs, dir_ino, &path, db)) < 0)) {
+            return status;
+        }
+    }
+}
+
+/**
+ * Look up a directory entry by name. A linear directory
+ * is scanned in logical block order; an indexed directory
+ * reads only the index blocks and the leaf block for the
+ * hash of the name.
+ *
+ * Errors
+ *   -ENOENT   - does not exist
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param dir_ino inode of directory
+ * @param name the entry name
+ * @param db returns the directory block and entry
+ * @return 0 if successful, -error if not found
+ */
+int fs_dir_lookup(struct fs_ext2 *fs, int dir_ino, const char *name, struct fs_dirblk *db)
+{
+    int free_entry;
+
+    int indexed = is_indexed(fs, dir_ino);
+    if (indexed < 0) {
+        return indexed;
+    }
+    if (indexed) {
+        struct dx_path path;
+        int status = dx_walk(fs, dir_ino, dx_hash(name, fs->ignore_case), &path);
+        if (status < 0) {
+            return status;
+        }
+
+        // "." and ".." are in block 0
+        path.root.entry = get_entry_in_block(path.root.de, 2, name, fs->ignore_case, &free_entry);
+        if (path.root.entry >= 0) {
+            *db = path.root;
+            return 0;
+        }
+
+        // other entries are in leaf block for name hash
+        if ((status = fs_dir_read(fs, dir_ino, path.leaf_lblk, db)) < 0) {
+            return (status == -ENOENT) ? -EIO : status;
+        }
+        db->dx_pos[0] = path.pos[0];
+        db->dx_pos[1] = path.pos[1];
+        db->entry = get_entry(fs, db, name, &free_entry);
+        return (db->entry >= 0) ? 0 : -ENOENT;
+    }
+
+    for (int lblk = 0; ; lblk++) {
+        int status = fs_dir_read(fs, dir_ino, lblk, db);
+        if (status < 0) {
+            return status;  // -ENOENT at end of directory
+        }
+        db->entry = get_entry(fs, db, name, &free_entry);
+        if (db->entry >= 0) {
+            return 0;
+        }
+    }
+}
+
+/**
+ * Find a free directory entry for a name that is not
+ * already in the directory. A new directory block is
+ * allocated if all existing blocks are full. A single
+ * block linear directory is converted to an indexed
+ * directory when its block is full, and leaf blocks of
+ * an indexed directory are split when full.
+ *
+ * Errors
+ *   -EEXIST   - entry already exists
+ *   -ENOSPC   - free entry or block not found
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param dir_ino inode of directory
+ * @param name the entry name
+ * @param db returns the directory block and free entry
+ * @return 0 if successful, -error if dup or not available
+ */
+int fs_dir_alloc_entry(struct fs_ext2 *fs, int dir_ino, const char *name, struct fs_dirblk *db)
+{
+    int indexed = is_indexed(fs, dir_ino);
+    if (indexed < 0) {
+        return indexed;
+    }
+    if (indexed) {
+        return dx_alloc_entry(fs, dir_ino, name, db);
+    }
+
+    // scan entire directory to check for dups,
+    // keeping the first block with a free entry
+    struct fs_dirblk scan;
+    db->entry = -1;
+    int lblk;
+    for (lblk = 0; ; lblk++) {
+        int free_entry;
+        int status = fs_dir_read(fs, dir_ino, lblk, &scan);
+        if (status == -ENOENT) {
+            break;  // end of directory
+        } else if (status < 0) {
+            return status;
+        }
+        if (get_entry(fs, &scan, name, &free_entry) >= 0) {
+            return -EEXIST;
+        }
+        if ((db->entry < 0) && (free_entry >= 0)) {
+            *db = scan;
+            db->entry = free_entry;
+        }
+    }
+    if (db->entry >= 0) {
+        return 0;
+    }
+
+    // index a full single block directory
+    if (lblk == 1) {
+        int status = dx_convert(fs, dir_ino, &scan);
+        if (status == 0) {
+            return dx_alloc_entry(fs, dir_ino, name, db);
+        } else if (status < 0) {
+            return status;
+        }
+    }
+
+    // allocate a new block at end of directory
+    int blkno = fs_bmap(fs, dir_ino, lblk, 1, NULL);
+    if (blkno < 0) {
+        return (blkno == -EFBIG) ? -ENOSPC : blkno;
+    }
+    db->lblk = lblk;
+    db->blkno = blkno;
+    db->entry = 0;
+    db->n_entries = DIRENTS_PER_BLK(fs->blk_size);
+    memset(db->de, 0, fs->blk_size);
+
+    // write empty block so directory never maps stale content
+    return fs_dir_write(fs, db);
+}
+
+/**
+ * Read the directory block that follows a directory
+ * block in directory stream order: logical block order
+ * for a linear directory, and hash order of the leaf
+ * blocks for an indexed directory.
+ *
+ * Errors
+ *   -ENOENT   - no more blocks
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param dir_ino inode of directory
+ * @param db the current block, returns the next block
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_dir_next(struct fs_ext2 *fs, int dir_ino, struct fs_dirblk *db)
+{
+    int indexed = is_indexed(fs, dir_ino);
+    if (indexed < 0) {
+        return indexed;
+    }
+    if (!indexed) {
+        return fs_dir_read(fs, dir_ino, db->lblk+1, db);
+    }
+
+    // position of next leaf after block 0 or current leaf
+    int ri = 0, ni = 0;
+    if (db->lblk != 0) {
+        ri = db->dx_pos[0];
+        ni = db->dx_pos[1] + 1;
+    }
+
+    struct fs_dirblk root, node;
+    int status = fs_dir_read(fs, dir_ino, 0, &root);
+    if (status < 0) {
+        return status;
+    }
+    struct fs_dx_root *r = dx_root(&root);
+    for ( ; ri < (int)r->count; ri++, ni = 0) {
+        int lblk = r->entries[ri].lblk;
+        if (r->levels == 2) {
+            if ((status = fs_dir_read(fs, dir_ino, lblk, &node)) < 0) {
+                return status;
+            }
+            struct fs_dx_node *n = dx_node(&node);
+            if (ni >= (int)n->count) {
+                continue;
+            }
+            lblk = n->entries[ni].lblk;
+        } else if (ni > 0) {
+            continue;
+        }
+
+        if ((status = fs_dir_read(fs, dir_ino, lblk, db)) < 0) {
+            return status;
+        }
+        db->dx_pos[0] = ri;
+        db->dx_pos[1] = ni;
+        return 0;
+    }
+    return -ENOENT;  // no more leaf blocks
+}
@@ -0,0 +1,110 @@
+/*
+ * fs_util_dir.h
+ *
+ * description: look up, add, and remove directory entries
+ * for CS 7600 / CS 5600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Peter Desnoyers,  November 2016
+ * Philip Gust, March 2021
+ */
+
+#ifndef FS_UTIL_DIR_H_
+#define FS_UTIL_DIR_H_
+
+#include "fs_util_volume.h"
+
+/** a directory block and an entry position within it */
+struct fs_dirblk {
+    int lblk;		/** logical block in directory */
+    int blkno;		/** device block number */
+    int entry;		/** entry index within block */
+    int n_entries;	/** number of entry slots in block */
+    int dx_pos[2];	/** index root and node position of leaf block */
+    struct fs_dirent de[DIRENTS_PER_BLK(FS_MAX_BLOCK_SIZE)];	/** block content */
+};
+
+/**
+ * Look up a directory entry by name. A linear directory
+ * is scanned in logical block order; an indexed directory
+ * reads only the index blocks and the leaf block for the
+ * hash of the name.
+ *
+ * Errors
+ *   -ENOENT   - does not exist
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param dir_ino inode of directory
+ * @param name the entry name
+ * @param db returns the directory block and entry
+ * @return 0 if successful, -error if not found
+ */
+int fs_dir_lookup(struct fs_ext2 *fs, int dir_ino, const char *name, struct fs_dirblk *db);
+
+/**
+ * Find a free directory entry for a name that is not
+ * already in the directory. A new directory block is
+ * allocated if all existing blocks are full. A single
+ * block linear directory is converted to an indexed
+ * directory when its block is full, and leaf blocks of
+ * an indexed directory are split when full.
+ *
+ * Errors
+ *   -EEXIST   - entry already exists
+ *   -ENOSPC   - free entry or block not found
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param dir_ino inode of directory
+ * @param name the entry name
+ * @param db returns the directory block and free entry
+ * @return 0 if successful, -error if dup or not available
+ */
+int fs_dir_alloc_entry(struct fs_ext2 *fs, int dir_ino, const char *name, struct fs_dirblk *db);
+
+/**
+ * Write a directory block back to disk.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param db the directory block
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_dir_write(struct fs_ext2 *fs, struct fs_dirblk *db);
+
+/**
+ * Read a directory block by logical block number.
+ *
+ * Errors
+ *   -ENOENT   - block not mapped
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param dir_ino inode of directory
+ * @param lblk the logical block in the directory
+ * @param db returns the directory block
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_dir_read(struct fs_ext2 *fs, int dir_ino, int lblk, struct fs_dirblk *db);
+
+/**
+ * Read the directory block that follows a directory
+ * block in directory stream order: logical block order
+ * for a linear directory, and hash order of the leaf
+ * blocks for an indexed directory.
+ *
+ * Errors
+ *   -ENOENT   - no more blocks
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param dir_ino inode of directory
+ * @param db the current block, returns the next block
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_dir_next(struct fs_ext2 *fs, int dir_ino, struct fs_dirblk *db);
+
+#endif /* FS_UTIL_DIR_H_ */
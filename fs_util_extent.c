@@ -0,0 +1,527 @@
+/*
+ * fs_util_extent.c
+ *
+ * description: map file blocks to device blocks
+ * through extents for CS 7600 / CS 5600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Peter Desnoyers,  November 2016
+ * Philip Gust, March 2021
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "fs_util_extent.h"
+#include "fs_util_alloc.h"
+#include "fs_dev_blkdev.h"
+
+/** extents of a file loaded for update */
+struct ext_list {
+    struct fs_extent *ext;		/** extents sorted by logical block */
+    int n;						/** number of extents */
+    int max;					/** capacity of extent array */
+    uint32_t *blknos;			/** overflow extent blocks */
+    int n_blks;					/** number of overflow extent blocks */
+    int max_blks;				/** capacity of overflow block array */
+};
+
+/**
+ * Calculate highest multiple m of n
+ *
+ * @param n the divisor
+ * @param m the dividend
+ * @return quotient rounded up
+ */
+static inline int div_round_up(int n, int m) {
+    return (n + m - 1) / m;
+}
+
+/**
+ * Determine whether an extent maps a logical block.
+ *
+ * @param e the extent
+ * @param lblk the logical block
+ * @return 1 if mapped, 0 if not
+ */
+static inline int ext_maps(const struct fs_extent *e, int lblk) {
+    return ((uint32_t)lblk >= e->lblk) && ((uint32_t)lblk - e->lblk < e->len);
+}
+
+/**
+ * Find the extent that maps a logical block without
+ * loading the whole extent list. Overflow blocks are
+ * read only until one starts past the logical block.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param in the inode
+ * @param lblk the logical block
+ * @param found set to the extent if found
+ * @return 1 if found, 0 if not mapped, or -error
+ */
+static int ext_find(struct fs_ext2 *fs, const struct fs_inode *in, int lblk, struct fs_extent *found)
+{
+    int n = in->ext.n_extents;
+    int n_inode = (n < N_INODE_EXTENTS) ? n : N_INODE_EXTENTS;
+    for (int i = 0; i < n_inode; i++) {
+        if (ext_maps(&in->ext.extents[i], lblk)) {
+            *found = in->ext.extents[i];
+            return 1;
+        }
+    }
+
+    struct fs_extent_blk eb;
+    for (uint32_t b = in->ext.overflow; b != 0; b = eb.next) {
+        if (fs_blk_read(fs, b, &eb) != 0) {
+            return -EIO;
+        }
+        if ((eb.n_extents == 0) || (eb.n_extents > (uint32_t)EXTENTS_PER_BLK(fs->blk_size))
+            || ((uint32_t)lblk < eb.extents[0].lblk)) {
+            break;  // extents are sorted
+        }
+        for (int i = 0; i < (int)eb.n_extents; i++) {
+            if (ext_maps(&eb.extents[i], lblk)) {
+                *found = eb.extents[i];
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Free an extent list.
+ *
+ * @param l the extent list
+ */
+static void list_free(struct ext_list *l)
+{
+    free(l->ext);
+    free(l->blknos);
+}
+
+/**
+ * Load the extents of an inode, with room for one more.
+ *
+ * Errors
+ *   -ENOMEM   - cannot allocate extent list
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param in the inode
+ * @param l the extent list
+ * @return 0 if successful, -error if error occurred
+ */
+static int list_load(struct fs_ext2 *fs, const struct fs_inode *in, struct ext_list *l)
+{
+    int n = in->ext.n_extents;
+    l->n = 0;
+    l->n_blks = 0;
+    l->max = n + 1;
+    l->max_blks = n / EXTENTS_PER_BLK(fs->blk_size) + 2;
+    l->ext = malloc(l->max * sizeof(struct fs_extent));
+    l->blknos = malloc(l->max_blks * sizeof(uint32_t));
+    if ((l->ext == NULL) || (l->blknos == NULL)) {
+        list_free(l);
+        return -ENOMEM;
+    }
+
+    l->n = (n < N_INODE_EXTENTS) ? n : N_INODE_EXTENTS;
+    memcpy(l->ext, in->ext.extents, l->n * sizeof(struct fs_extent));
+
+    struct fs_extent_blk eb;
+    for (uint32_t b = in->ext.overflow; (b != 0) && (l->n < n) && (l->n_blks < l->max_blks); b = eb.next) {
+        if (fs_blk_read(fs, b, &eb) != 0) {
+            list_free(l);
+            return -EIO;
+        }
+        l->blknos[l->n_blks++] = b;
+        int m = ((int)eb.n_extents < n - l->n) ? (int)eb.n_extents : n - l->n;
+        memcpy(&l->ext[l->n], eb.extents, m * sizeof(struct fs_extent));
+        l->n += m;
+    }
+    return 0;
+}
+
+/**
+ * Map a run of logical blocks to a run of device blocks
+ * in an extent list. The run joins the extents before
+ * and after it when adjacent, or is inserted as a new
+ * extent at its position.
+ *
+ * Errors
+ *   -ENOMEM   - cannot grow extent list
+ *
+ * @param l the extent list
+ * @param pos index of first extent after the run
+ * @param lblk the first logical block
+ * @param pblk the first device block
+ * @param len the number of blocks
+ * @return index of extent holding the run, or -error
+ */
+static int list_map(struct ext_list *l, int pos, int lblk, int pblk, int len)
+{
+    struct fs_extent *prev = (pos > 0) ? &l->ext[pos-1] : NULL;
+    struct fs_extent *next = (pos < l->n) ? &l->ext[pos] : NULL;
+    int joins_next =    (next != NULL) && (next->lblk == (uint32_t)(lblk+len))
+                   && (next->pblk == (uint32_t)(pblk+len));
+    if (   (prev != NULL) && (prev->lblk + prev->len == (uint32_t)lblk)
+        && (prev->pblk + prev->len == (uint32_t)pblk)) {
+        // extend previous extent, joining next if adjacent
+        prev->len += len;
+        if (joins_next) {
+            prev->len += next->len;
+            memmove(next, next+1, (l->n - pos - 1) * sizeof(struct fs_extent));
+            l->n--;
+        }
+        return pos-1;
+    }
+    if (joins_next) {
+        // extend next extent backward
+        next->lblk -= len;
+        next->pblk -= len;
+        next->len += len;
+        return pos;
+    }
+
+    // insert new extent
+    if (l->n == l->max) {
+        struct fs_extent *ext = realloc(l->ext, 2 * l->max * sizeof(struct fs_extent));
+        if (ext == NULL) {
+            return -ENOMEM;
+        }
+        l->ext = ext;
+        l->max *= 2;
+    }
+    memmove(&l->ext[pos+1], &l->ext[pos], (l->n - pos) * sizeof(struct fs_extent));
+    l->ext[pos] = (struct fs_extent) {.lblk = lblk, .pblk = pblk, .len = len};
+    l->n++;
+    return pos;
+}
+
+/**
+ * Store an extent list in an inode and its overflow
+ * blocks. The first extents are kept in the inode, the
+ * rest packed in overflow blocks, which are allocated or
+ * freed as needed. Only overflow blocks holding changed
+ * extents are written.
+ *
+ * Errors
+ *   -ENOSPC   - free block not found
+ *   -ENOMEM   - cannot grow overflow block list
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param ino the inode number
+ * @param l the extent list
+ * @param first_dirty index of first changed extent
+ * @return 0 if successful, -error if error occurred
+ */
+static int list_store(struct fs_ext2 *fs, int ino, struct ext_list *l, int first_dirty)
+{
+    struct fs_inode *in = fs_inode_mut(fs, ino);  // mark inode changed
+    if (in == NULL) {
+        return -EIO;
+    }
+    int per_blk = EXTENTS_PER_BLK(fs->blk_size);
+    int n_over = l->n - N_INODE_EXTENTS;
+    int need = (n_over > 0) ? div_round_up(n_over, per_blk) : 0;
+    int old_blks = l->n_blks;
+    if (need > l->max_blks) {
+        uint32_t *blknos = realloc(l->blknos, need * sizeof(uint32_t));
+        if (blknos == NULL) {
+            return -ENOMEM;
+        }
+        l->blknos = blknos;
+        l->max_blks = need;
+    }
+
+    // allocate overflow blocks after the last one
+    while (l->n_blks < need) {
+        int goal = (l->n_blks > 0) ? l->blknos[l->n_blks-1] + 1 : 0;
+        int blkno = fs_alloc_blk(fs, ino, goal);
+        if (blkno < 0) {
+            while (l->n_blks > old_blks) {
+                fs_free_blk(fs, l->blknos[--l->n_blks]);
+            }
+            return blkno;
+        }
+        l->blknos[l->n_blks++] = blkno;
+    }
+
+    // write overflow blocks with changed extents or links;
+    // the link of the last block kept changes if the chain
+    // grows or shrinks
+    int last_kept = ((need < old_blks) ? need : old_blks) - 1;
+    for (int k = 0; k < need; k++) {
+        int first = N_INODE_EXTENTS + k*per_blk;
+        int fresh = (k >= old_blks);
+        int relinked = (k == last_kept) && (need != old_blks);
+        if (!fresh && !relinked && (first + per_blk <= first_dirty)) {
+            continue;  // unchanged
+        }
+        struct fs_extent_blk eb;
+        memset(&eb, 0, fs->blk_size);
+        eb.next = (k+1 < need) ? l->blknos[k+1] : 0;
+        eb.n_extents = (l->n - first < per_blk) ? l->n - first : per_blk;
+        memcpy(eb.extents, &l->ext[first], eb.n_extents * sizeof(struct fs_extent));
+        if (fs_blk_write(fs, l->blknos[k], &eb) != 0) {
+            return -EIO;
+        }
+    }
+
+    // free overflow blocks no longer needed
+    while (l->n_blks > need) {
+        fs_free_blk(fs, l->blknos[--l->n_blks]);
+    }
+
+    // update extent root in inode
+    in->ext.n_extents = l->n;
+    in->ext.overflow = (need > 0) ? l->blknos[0] : 0;
+    memset(in->ext.extents, 0, sizeof(in->ext.extents));
+    memcpy(in->ext.extents, l->ext,
+           ((l->n < N_INODE_EXTENTS) ? l->n : N_INODE_EXTENTS) * sizeof(struct fs_extent));
+
+    if (fs->ext_hint_ino == ino) {
+        fs->ext_hint_ino = 0;  // hint may be stale
+    }
+    return 0;
+}
+
+/**
+ * Map a logical file block to its device block through
+ * the extents of an inode with the FS_INODE_EXTENTS flag.
+ * If create is set, a missing block is allocated after
+ * the block of the previous logical block, extending its
+ * extent when the blocks are adjacent.
+ *
+ * Errors
+ *   -ENOSPC   - free block not found
+ *   -ENOMEM   - cannot allocate extent list
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param ino the inode number
+ * @param lblk the logical block in the file
+ * @param create 1 to allocate a missing block, 0 to look up only
+ * @param is_new if not NULL, set to 1 if the data block was allocated
+ * @return device block number, 0 if not mapped, or -error
+ */
+int fs_extent_bmap(struct fs_ext2 *fs, int ino, int lblk, int create, int *is_new)
+{
+    // sequential access usually stays within last extent found
+    if ((fs->ext_hint_ino == ino) && ext_maps(&fs->ext_hint, lblk)) {
+        return fs->ext_hint.pblk + (lblk - fs->ext_hint.lblk);
+    }
+    const struct fs_inode *in = fs_inode(fs, ino);
+    if (in == NULL) {
+        return -EIO;
+    }
+    struct fs_extent e;
+    int status = ext_find(fs, in, lblk, &e);
+    if (status < 0) {
+        return status;
+    }
+    if (status > 0) {
+        fs->ext_hint_ino = ino;
+        fs->ext_hint = e;
+        return e.pblk + (lblk - e.lblk);
+    }
+    if (!create) {
+        return 0;  // not mapped
+    }
+
+    // find position of new extent
+    struct ext_list l;
+    status = list_load(fs, in, &l);
+    if (status < 0) {
+        return status;
+    }
+    int pos = 0;
+    while ((pos < l.n) && (l.ext[pos].lblk < (uint32_t)lblk)) {
+        pos++;
+    }
+
+    // allocate block where the previous extent would continue
+    struct fs_extent *prev = (pos > 0) ? &l.ext[pos-1] : NULL;
+    int goal = (prev != NULL) ? prev->pblk + (lblk - prev->lblk) : 0;
+    int blkno = fs_alloc_blk(fs, ino, goal);
+    if (blkno < 0) {
+        list_free(&l);
+        return blkno;
+    }
+
+    // list has room for one more extent
+    int first_dirty = list_map(&l, pos, lblk, blkno, 1);
+    status = list_store(fs, ino, &l, first_dirty);
+    list_free(&l);
+    if (status < 0) {
+        if (status != -EIO) {
+            fs_free_blk(fs, blkno);  // extent list unchanged
+        }
+        return status;
+    }
+    if (is_new != NULL) {
+        *is_new = 1;
+    }
+    return blkno;
+}
+
+/**
+ * Allocate the unmapped blocks of a range of logical
+ * blocks of an inode with the FS_INODE_EXTENTS flag.
+ * Each gap between mapped blocks is allocated as runs
+ * of contiguous blocks that continue the extent before
+ * it where possible, and the extents are stored once.
+ *
+ * Errors
+ *   -ENOSPC   - free block not found
+ *   -ENOMEM   - cannot allocate extent list
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param ino the inode number
+ * @param lblk the first logical block
+ * @param n_blks the number of logical blocks
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_extent_alloc(struct fs_ext2 *fs, int ino, int lblk, int n_blks)
+{
+    const struct fs_inode *in = fs_inode(fs, ino);
+    if (in == NULL) {
+        return -EIO;
+    }
+    struct ext_list l;
+    int status = list_load(fs, in, &l);
+    if (status < 0) {
+        return status;
+    }
+
+    // runs allocated, to free if extents cannot be stored
+    struct fs_extent *runs = NULL;
+    int n_runs = 0;
+    int first_dirty = -1;
+
+    int end = lblk + n_blks;
+    int pos = 0;
+    for (int cur = lblk; cur < end; ) {
+        // skip extents before cur and blocks already mapped
+        while ((pos < l.n) && (l.ext[pos].lblk + l.ext[pos].len <= (uint32_t)cur)) {
+            pos++;
+        }
+        if ((pos < l.n) && (l.ext[pos].lblk <= (uint32_t)cur)) {
+            cur = l.ext[pos].lblk + l.ext[pos].len;
+            continue;
+        }
+
+        // allocate run for gap where the previous extent would continue
+        int gap_end = ((pos < l.n) && (l.ext[pos].lblk < (uint32_t)end)) ? (int)l.ext[pos].lblk : end;
+        struct fs_extent *prev = (pos > 0) ? &l.ext[pos-1] : NULL;
+        int goal = (prev != NULL) ? prev->pblk + (cur - prev->lblk) : 0;
+        int n_alloc;
+        int blkno = fs_alloc_blks(fs, ino, goal, gap_end - cur, &n_alloc);
+        if (blkno < 0) {
+            status = blkno;
+            break;
+        }
+        struct fs_extent *more = realloc(runs, (n_runs+1) * sizeof(struct fs_extent));
+        int idx = (more != NULL) ? list_map(&l, pos, cur, blkno, n_alloc) : -ENOMEM;
+        if (idx < 0) {
+            for (int k = 0; k < n_alloc; k++) {
+                fs_free_blk(fs, blkno + k);
+            }
+            runs = (more != NULL) ? more : runs;
+            status = idx;
+            break;
+        }
+        runs = more;
+        runs[n_runs++] = (struct fs_extent) {.lblk = cur, .pblk = blkno, .len = n_alloc};
+        if ((first_dirty < 0) || (idx < first_dirty)) {
+            first_dirty = idx;
+        }
+        pos = idx;
+        cur += n_alloc;
+    }
+
+    // store extents for runs allocated so far
+    if (first_dirty >= 0) {
+        int store_status = list_store(fs, ino, &l, first_dirty);
+        if (store_status < 0) {
+            if (store_status != -EIO) {
+                // extent list unchanged
+                for (int i = 0; i < n_runs; i++) {
+                    for (int k = 0; k < (int)runs[i].len; k++) {
+                        fs_free_blk(fs, runs[i].pblk + k);
+                    }
+                }
+            }
+            status = store_status;
+        }
+    }
+    free(runs);
+    list_free(&l);
+    return status;
+}
+
+/**
+ * Free all data blocks of an inode with the FS_INODE_EXTENTS
+ * flag starting with a logical block. Extents are shortened
+ * or removed, and overflow extent blocks no longer needed
+ * are freed.
+ *
+ * Errors
+ *   -ENOMEM   - cannot allocate extent list
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param ino the inode number
+ * @param first_lblk the first logical block to free
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_extent_trunc(struct fs_ext2 *fs, int ino, int first_lblk)
+{
+    const struct fs_inode *in = fs_inode(fs, ino);
+    if (in == NULL) {
+        return -EIO;
+    }
+    if (in->ext.n_extents == 0) {
+        return 0;  // nothing mapped
+    }
+    struct ext_list l;
+    int status = list_load(fs, in, &l);
+    if (status < 0) {
+        return status;
+    }
+
+    // free blocks at or after first block; extents are
+    // sorted, so removed extents are at the end
+    int first_dirty = l.n;
+    int n_kept = 0;
+    for (int i = 0; i < l.n; i++) {
+        struct fs_extent *e = &l.ext[i];
+        if (e->lblk + e->len <= (uint32_t)first_lblk) {
+            n_kept++;
+            continue;  // entirely before first block
+        }
+        int n_keep = ((uint32_t)first_lblk > e->lblk) ? first_lblk - e->lblk : 0;
+        for (int k = n_keep; k < (int)e->len; k++) {
+            fs_free_blk(fs, e->pblk + k);
+        }
+        e->len = n_keep;
+        n_kept += (n_keep > 0);
+        if (first_dirty > i) {
+            first_dirty = i;
+        }
+    }
+
+    if (first_dirty < l.n) {
+        l.n = n_kept;
+        status = list_store(fs, ino, &l, first_dirty);
+    }
+    list_free(&l);
+    return status;
+}
@@ -0,0 +1,75 @@
+/*
+ * fs_util_extent.h
+ *
+ * description: map file blocks to device blocks
+ * through extents for CS 7600 / CS 5600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Peter Desnoyers,  November 2016
+ * Philip Gust, March 2021
+ */
+
+#ifndef FS_UTIL_EXTENT_H_
+#define FS_UTIL_EXTENT_H_
+
+#include "fs_util_volume.h"
+
+/**
+ * Map a logical file block to its device block through
+ * the extents of an inode with the FS_INODE_EXTENTS flag.
+ * If create is set, a missing block is allocated after
+ * the block of the previous logical block, extending its
+ * extent when the blocks are adjacent.
+ *
+ * Errors
+ *   -ENOSPC   - free block not found
+ *   -ENOMEM   - cannot allocate extent list
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param ino the inode number
+ * @param lblk the logical block in the file
+ * @param create 1 to allocate a missing block, 0 to look up only
+ * @param is_new if not NULL, set to 1 if the data block was allocated
+ * @return device block number, 0 if not mapped, or -error
+ */
+int fs_extent_bmap(struct fs_ext2 *fs, int ino, int lblk, int create, int *is_new);
+
+/**
+ * Allocate the unmapped blocks of a range of logical
+ * blocks of an inode with the FS_INODE_EXTENTS flag.
+ * Each gap between mapped blocks is allocated as runs
+ * of contiguous blocks that continue the extent before
+ * it where possible, and the extents are stored once.
+ *
+ * Errors
+ *   -ENOSPC   - free block not found
+ *   -ENOMEM   - cannot allocate extent list
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param ino the inode number
+ * @param lblk the first logical block
+ * @param n_blks the number of logical blocks
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_extent_alloc(struct fs_ext2 *fs, int ino, int lblk, int n_blks);
+
+/**
+ * Free all data blocks of an inode with the FS_INODE_EXTENTS
+ * flag starting with a logical block. Extents are shortened
+ * or removed, and overflow extent blocks no longer needed
+ * are freed.
+ *
+ * Errors
+ *   -ENOMEM   - cannot allocate extent list
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param ino the inode number
+ * @param first_lblk the first logical block to free
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_extent_trunc(struct fs_ext2 *fs, int ino, int first_lblk);
+
+#endif /* FS_UTIL_EXTENT_H_ */
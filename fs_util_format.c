@@ -9,16 +9,21 @@
  * Philip Gust, March 2021
  */
 
-#include <sys/select.h>
 #include <sys/stat.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <errno.h>
 
 #include "fs_dev_blkdev.h"
+#include "fs_dev_scaledev.h"
 #include "fs_util_format.h"
+#include "fs_util_bitmap.h"
 #include "fsx600.h"
 
+/** metadata blocks built and written at a time */
+enum { FORMAT_CHUNK_BLKS = 16 };
+
 /**
  * Calculate highest multiple m of n
  *
@@ -30,6 +35,61 @@ static inline int div_round_up(int n, int m) {
     return (n + m - 1) / m;
 }
 
+/**
+ * Write an empty journal region. The log is cleared so
+ * blocks left by an earlier volume are not replayed.
+ *
+ * @param dev the block device
+ * @param base blkno of journal header
+ * @param n_blks journal size in blocks, including header
+ * @param blk_size the block size in bytes
+ * @return status 0 for success, -error for errors
+ */
+static int format_journal(struct fs_dev_blkdev* dev, int base, int n_blks, int blk_size)
+{
+    uint8_t zeros[16 * FS_MIN_BLOCK_SIZE];
+    memset(zeros, 0, sizeof(zeros));
+    const int zero_blks = sizeof(zeros) / blk_size;
+    for (int i = 1; i < n_blks; i += zero_blks) {
+        int n = (n_blks - i < zero_blks) ? n_blks - i : zero_blks;
+        if (dev->ops->write(dev, base + i, n, zeros) != SUCCESS) {
+            return -EIO;
+        }
+    }
+
+    struct fs_journal_super jsb = {.magic = FS_JOURNAL_MAGIC, .tail = 0, .seq = 1};
+    if (dev->ops->write(dev, base, 1, &jsb) != SUCCESS) {
+        return -EIO;
+    }
+    return 0;
+}
+
+/**
+ * Initialize the descriptor of a block group. The first
+ * n_used_blks blocks of the volume are in use, as are
+ * inode 0 and the root directory inode in group 0.
+ *
+ * @param gd the group descriptor
+ * @param g the block group
+ * @param group_blks blocks per group
+ * @param group_inos inodes per group
+ * @param n_blks number of blocks in volume
+ * @param n_used_blks number of blocks in use
+ */
+static void init_group_desc(struct fs_group_desc *gd, int g, int group_blks, int group_inos,
+                            int n_blks, int n_used_blks)
+{
+    int first = g * group_blks;
+    int end = (first + group_blks < n_blks) ? first + group_blks : n_blks;
+    int used = (n_used_blks < end) ? n_used_blks - first : end - first;
+    *gd = (struct fs_group_desc) {
+        .free_blocks = end - first - ((used > 0) ? used : 0),
+        .free_inodes = (g == 0) ? group_inos - 2 : group_inos,  // less inode 0 and root
+        .n_dirs = (g == 0) ? 1 : 0,  // root directory
+        .ino_cursor = 0
+    };
+}
+
 /**
  * Format a file system volume for block device.
  * New volume occupies entire block device.
@@ -44,25 +104,97 @@ static inline int div_round_up(int n, int m) {
  */
 int fs_format_volume(struct fs_dev_blkdev* dev, int ignore_case, int fold_case)
 {
+    struct fs_format_opts opts = {
+        .ignore_case = ignore_case,
+        .fold_case = fold_case,
+        .journal_blks = FS_JOURNAL_DEFAULT
+    };
+    return fs_format_volume_opts(dev, &opts);
+}
+
+/**
+ * Format a file system volume with options on a block
+ * device whose blocks are the volume blocks.
+ *
+ * Errors
+ *   -EINVAL   - invalid option
+ *   -ENOSPC   - device too small for volume
+ *   -ENOMEM   - cannot allocate metadata buffer
+ *   -EIO      - i/o error
+ *
+ * @param dev the block device, in blocks of the volume
+ * @param opts the format options
+ * @param blk_size the block size in bytes
+ * @return status 0 for success, -error for errors
+ */
+static int format_volume(struct fs_dev_blkdev* dev, const struct fs_format_opts *opts, int blk_size)
+{
+    const int ignore_case = opts->ignore_case;
+    const int fold_case = opts->fold_case;
+
     // number of blocks for device
     const int n_blks = dev->ops->num_blocks(dev);
 
+    // divide volume into block groups, each with a slice
+    // of the block map, inode map, and inode blocks
+    const int group_blks = (opts->group_blks == FS_GROUP_DEFAULT) ? BITS_PER_BLK(blk_size) : opts->group_blks;
+    if (group_blks < FS_GROUP_MIN) {
+        return -EINVAL;
+    }
+    const int n_groups = div_round_up(n_blks, group_blks);
+
+    // inodes wanted: an explicit count, or one for every
+    // inode_ratio bytes of the volume (default 4 blocks)
+    long long n_wanted_inos = opts->n_inodes;
+    if (n_wanted_inos == 0) {
+        long long inode_ratio = opts->inode_ratio;
+        if (inode_ratio == FS_INODE_RATIO_DEFAULT) {
+            inode_ratio = 4 * blk_size;
+        } else if (inode_ratio < blk_size) {
+            return -EINVAL;
+        }
+        n_wanted_inos = ((long long)n_blks * blk_size + inode_ratio - 1) / inode_ratio;
+    } else if ((n_wanted_inos < 2) || (n_wanted_inos > n_blks)) {
+        return -EINVAL;  // inode 0 and root; no more than blocks
+    }
+
     // calculate number of blocks in metadata segments
-    const int n_inos = div_round_up(n_blks, 4);  // 1 inode for every 4 blocks
-    const int n_ino_map_blks = div_round_up(n_inos, BITS_PER_BLK);
-    const int n_ino_blks = div_round_up(n_inos*sizeof(struct fs_inode), FS_BLOCK_SIZE);
-    const int n_map_blks = div_round_up(n_blks, BITS_PER_BLK);
-    const int n_meta_blks = 1 + n_ino_map_blks + n_map_blks + n_ino_blks;
+    // whole inode blocks per group
+    const int inodes_per_blk = INODES_PER_BLK(blk_size);
+    const int group_inos = div_round_up((int)n_wanted_inos, n_groups*inodes_per_blk) * inodes_per_blk;
+    const int n_inos = n_groups * group_inos;
+    const int n_ino_map_blks = div_round_up(n_inos, BITS_PER_BLK(blk_size));
+    const int n_ino_blks = div_round_up(n_inos*sizeof(struct fs_inode), blk_size);
+    const int n_map_blks = div_round_up(n_blks, BITS_PER_BLK(blk_size));
+    const int n_desc_blks = div_round_up(n_groups, GROUP_DESCS_PER_BLK(blk_size));
+    const int n_meta_blks = 1 + n_desc_blks + n_ino_map_blks + n_map_blks + n_ino_blks;
     const int root_ino = 1;
 
-    // initialize file system metadata blocks
-    block meta[n_meta_blks];
-    memset(meta, 0, n_meta_blks * FS_BLOCK_SIZE);
+    // journal follows metadata: 1 block for every 32, within limits
+    int n_journal_blks = opts->journal_blks;
+    if (n_journal_blks == FS_JOURNAL_DEFAULT) {
+        n_journal_blks = n_blks / 32;
+        if (n_journal_blks < FS_JOURNAL_MIN) {
+            n_journal_blks = (n_blks >= 8*FS_JOURNAL_MIN) ? FS_JOURNAL_MIN : 0;
+        } else if (n_journal_blks > FS_JOURNAL_MAX) {
+            n_journal_blks = FS_JOURNAL_MAX;
+        }
+    } else if ((n_journal_blks != 0) && (n_journal_blks < FS_JOURNAL_MIN)) {
+        return -EINVAL;
+    }
+    const int journal_base = (n_journal_blks > 0) ? n_meta_blks : 0;
+    if (n_meta_blks + n_journal_blks + 1 > n_blks) {
+        return -ENOSPC;  // no room for root directory block
+    }
 
-    // initialize superblock
-    const int superblk = 0;
-    struct fs_super* sb = (void*)&meta[0];
-    *sb = (struct fs_super) {
+    // superblock; inode blocks of groups other than the
+    // group of the root inode are written on first use
+    const int group_desc_base = 1;
+    const int inode_map_base = group_desc_base + n_desc_blks;
+    const int block_map_base = inode_map_base + n_ino_map_blks;
+    const int inode_base = block_map_base + n_map_blks;
+    const int rootdir_blkno = n_meta_blks + n_journal_blks; // after metadata and journal
+    struct fs_super sb = {
             .magic = FS_MAGIC,
             .inode_map_sz = n_ino_map_blks,
             .inode_region_sz = n_ino_blks,
@@ -70,47 +202,42 @@ int fs_format_volume(struct fs_dev_blkdev* dev, int ignore_case, int fold_case)
             .num_blocks = n_blks,
             .fold_case = fold_case,
             .ignore_case = (ignore_case || fold_case), // ignore case if folding
-            .root_inode = root_ino
+            .root_inode = root_ino,
+            .journal_base = journal_base,
+            .journal_sz = n_journal_blks,
+            .free_blocks = n_blks - (n_meta_blks + n_journal_blks + 1),
+            .free_inodes = n_inos - 2,  // less inode 0 and root
+            .num_inodes = n_inos,
+            .group_blks = group_blks,
+            .group_inodes = group_inos,
+            .features = (opts->extents ? FS_FEATURE_EXTENTS : 0),
+            .blk_size = blk_size,
+            .group_desc_sz = n_desc_blks
     };
+    for (int g = root_ino / group_inos + 1; (g < n_groups) && (g < FS_MAX_LAZY_GROUPS); g++) {
+        fs_bit_set(sb.itable_uninit, g);
+    }
 
-    // initialize inode bitmap
-    const int inode_map_base = 1;
-    fd_set* inode_map = (void*)&meta[inode_map_base];
-
-    // set root directory inode map allocated
-    FD_SET(0, inode_map);  // inode 0 is unused
-    FD_SET(root_ino, inode_map);  // inode for root directory
-
-    // initialize block bitmap
-    const int block_map_base = inode_map_base + n_ino_map_blks;
-    fd_set* block_map = (void*)&meta[block_map_base];
-
-    // initialize root directory inode
-    const int inode_base = block_map_base + n_map_blks;
-    struct fs_inode* inodes = (void*)&meta[inode_base];
-
+    // root directory inode
     int t  = time(NULL);
-    const int rootdir_blkno = n_meta_blks; // after metadata blocks
-    inodes[root_ino] = (struct fs_inode) {
+    struct fs_inode root_inode = {
         .uid = 1001, .gid = 125, // user group id
         .mode = (S_IFDIR | 0755), // directory w/ permissions rwxr-xr-x
         .ctime = t, .mtime = t,
-        .size = 0, .nlink = 0,
+        .size = 2*sizeof(struct fs_dirent), // "." and ".." entries
+        .nlink = 2,	// links for "." and ".."
         .direct = {rootdir_blkno, 0, 0, 0, 0, 0},
         .indir_1 = 0, .indir_2 = 0
     };
 
-    // set all metadata blocks allocated
-    for (int i = 0; i < n_meta_blks; i++) {
-        FD_SET(i, block_map);
+    // write empty journal to block device
+    if ((n_journal_blks > 0) && (format_journal(dev, journal_base, n_journal_blks, blk_size) != 0)) {
+        return -EIO;
     }
 
-    // set root dir block allocated
-    FD_SET(rootdir_blkno, block_map);
-
     // init root directory block for "." and ".." entries
-    struct fs_dirent root_de[DIRENTS_PER_BLK];
-    memset(root_de, 0, FS_BLOCK_SIZE);
+    struct fs_dirent root_de[DIRENTS_PER_BLK(FS_MAX_BLOCK_SIZE)];
+    memset(root_de, 0, blk_size);
 
     //  entry "/.", links to "/" directory
     root_de[0] = (struct fs_dirent) {
@@ -131,14 +258,94 @@ int fs_format_volume(struct fs_dev_blkdev* dev, int ignore_case, int fold_case)
         return -EIO;
     }
 
-    // update root dir inode for "." and ".." entries
-    inodes[root_ino].size += 2*sizeof(struct fs_dirent);
-    inodes[root_ino].nlink+= 2;	// links for "." and ".."
+    // build and write metadata a chunk at a time; the
+    // metadata and journal blocks and the root directory
+    // block are the first blocks of the block map
+    const int n_used_blks = rootdir_blkno + 1;
+    const int descs_per_blk = GROUP_DESCS_PER_BLK(blk_size);
+    const int bits_per_blk = BITS_PER_BLK(blk_size);
+    uint8_t *chunk = malloc((size_t)FORMAT_CHUNK_BLKS * blk_size);
+    if (chunk == NULL) {
+        return -ENOMEM;
+    }
+    int status = 0;
+    for (int base = 0; (status == 0) && (base < n_meta_blks); base += FORMAT_CHUNK_BLKS) {
+        int n = (n_meta_blks - base < FORMAT_CHUNK_BLKS) ? n_meta_blks - base : FORMAT_CHUNK_BLKS;
+        memset(chunk, 0, (size_t)n * blk_size);
+        int first = 0;  // first block of chunk not yet written
+        for (int i = 0; i < n; i++) {
+            int blkno = base + i;
+            uint8_t *blk = chunk + (size_t)i * blk_size;
+            if (blkno == 0) {
+                memcpy(blk, &sb, sizeof(sb));
+            } else if (blkno < inode_map_base) {
+                int first_group = (blkno - group_desc_base) * descs_per_blk;
+                struct fs_group_desc *gd = (struct fs_group_desc*)blk;
+                for (int g = first_group; (g < n_groups) && (g < first_group + descs_per_blk); g++) {
+                    init_group_desc(&gd[g - first_group], g, group_blks, group_inos, n_blks, n_used_blks);
+                }
+            } else if (blkno == inode_map_base) {
+                fs_bit_set(blk, 0);  // inode 0 is unused
+                fs_bit_set(blk, root_ino);  // inode for root directory
+            } else if ((blkno >= block_map_base) && (blkno < inode_base)) {
+                int first_bit = (blkno - block_map_base) * bits_per_blk;
+                for (int b = first_bit; (b < n_used_blks) && (b < first_bit + bits_per_blk); b++) {
+                    fs_bit_set(blk, b - first_bit);
+                }
+            } else if (   (blkno >= inode_base)
+                       && fs_itable_uninit(&sb, (blkno - inode_base) * inodes_per_blk / group_inos)) {
+                // leave inode block of unused group unwritten
+                if (   (i > first)
+                    && (dev->ops->write(dev, base + first, i - first, chunk + (size_t)first * blk_size) != SUCCESS)) {
+                    status = -EIO;
+                    break;
+                }
+                first = i + 1;
+            } else if (blkno == inode_base + root_ino / inodes_per_blk) {
+                ((struct fs_inode*)blk)[root_ino % inodes_per_blk] = root_inode;
+            }
+        }
+        if (   (status == 0) && (n > first)
+            && (dev->ops->write(dev, base + first, n - first, chunk + (size_t)first * blk_size) != SUCCESS)) {
+            status = -EIO;
+        }
+    }
+    free(chunk);
 
-    // write file system metadata to block device
-    if (dev->ops->write(dev, 0, n_meta_blks, meta) != SUCCESS) {
-        return -EIO;
+    return status;  // 0 if successful
+}
+
+/**
+ * Format a file system volume for block device with options.
+ * New volume occupies entire block device. The volume block
+ * size is opts->blk_size, a multiple of the device block size.
+ *
+ * Errors
+ *   -EINVAL   - invalid option
+ *   -ENOSPC   - device too small for volume
+ *   -ENOMEM   - cannot allocate metadata buffer
+ *   -EIO      - i/o error
+ *
+ * @param dev the block device
+ * @param opts the format options
+ * @return status 0 for success, -error for errors
+ */
+int fs_format_volume_opts(struct fs_dev_blkdev* dev, const struct fs_format_opts *opts)
+{
+    const int blk_size = (opts->blk_size != 0) ? opts->blk_size : FS_BLOCK_SIZE;
+    if (!FS_VALID_BLK_SIZE(blk_size)) {
+        return -EINVAL;
+    }
+    if (blk_size == BLOCK_SIZE) {
+        return format_volume(dev, opts, blk_size);
     }
 
-    return 0;  // successful
-}
\ No newline at end of file
+    // address the device in blocks of the volume
+    struct fs_dev_blkdev *vdev = scale_blkdev_create(dev, blk_size / BLOCK_SIZE);
+    if (vdev == NULL) {
+        return -ENOMEM;
+    }
+    int status = format_volume(vdev, opts, blk_size);
+    vdev->ops->close(vdev);
+    return status;
+}
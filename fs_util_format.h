@@ -15,6 +15,49 @@
 #include "fs_dev_blkdev.h"
 #include "fs_util_volume.h"
 
+/**
+ * Constants for journal size
+ *   FS_JOURNAL_DEFAULT - size journal from volume size
+ *   FS_JOURNAL_MIN     - smallest journal, in blocks; one
+ *                        operation's changes fit in one transaction
+ *   FS_JOURNAL_MAX     - largest default journal, in blocks
+ */
+enum {
+    FS_JOURNAL_DEFAULT = -1,
+    FS_JOURNAL_MIN = 16,
+    FS_JOURNAL_MAX = 1024
+};
+
+/**
+ * Constants for block group size
+ *   FS_GROUP_DEFAULT   - one block map block per group
+ *   FS_GROUP_MIN       - smallest group, in blocks
+ */
+enum {
+    FS_GROUP_DEFAULT = 0,
+    FS_GROUP_MIN = 64
+};
+
+/**
+ * Constants for inode density
+ *   FS_INODE_RATIO_DEFAULT - one inode for every 4 blocks
+ */
+enum {
+    FS_INODE_RATIO_DEFAULT = 0
+};
+
+/** options for formatting a volume */
+struct fs_format_opts {
+    int ignore_case;	/** ignore case for directory entries */
+    int fold_case;		/** fold case for directory entries */
+    int journal_blks;	/** journal blocks, 0 for none, or FS_JOURNAL_DEFAULT */
+    int group_blks;		/** blocks per group, or FS_GROUP_DEFAULT */
+    int extents;		/** map new regular files by extents */
+    int blk_size;		/** block size in bytes, 0 for FS_BLOCK_SIZE; 1024, 2048, 4096, or 8192 */
+    int inode_ratio;	/** bytes of volume per inode, or FS_INODE_RATIO_DEFAULT */
+    int n_inodes;		/** number of inodes, 0 to size by inode_ratio */
+};
+
 /**
  * Format a file system volume for block device.
  * New volume occupies entire block device.
@@ -29,4 +72,21 @@
  */
 int fs_format_volume(struct fs_dev_blkdev* dev, int ignore_case, int fold_case);
 
+/**
+ * Format a file system volume for block device with options.
+ * New volume occupies entire block device. The volume block
+ * size is opts->blk_size, a multiple of the device block size.
+ *
+ * Errors
+ *   -EINVAL   - invalid option
+ *   -ENOSPC   - device too small for volume
+ *   -ENOMEM   - cannot allocate metadata buffer
+ *   -EIO      - i/o error
+ *
+ * @param dev the block device
+ * @param opts the format options
+ * @return status 0 for success, -error for errors
+ */
+int fs_format_volume_opts(struct fs_dev_blkdev* dev, const struct fs_format_opts *opts);
+
 #endif /* FS_UTIL_FORMAT_H_ */
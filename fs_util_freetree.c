@@ -0,0 +1,399 @@
+/*
+ * fs_util_freetree.c
+ *
+ * description: tree of free block extents for
+ * contiguous block allocation
+ * for CS 7600 / CS 5600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Peter Desnoyers,  November 2016
+ * Philip Gust, March 2021
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+
+#include "fs_util_freetree.h"
+
+/**
+ * Get the next heap priority (xorshift).
+ *
+ * @param ft the tree
+ * @return the priority
+ */
+static unsigned next_prio(struct fs_freetree *ft)
+{
+    unsigned x = ft->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    ft->seed = x;
+    return x;
+}
+
+/**
+ * Get largest extent length of a subtree.
+ *
+ * @param n the subtree or NULL
+ * @return the largest length, 0 if empty
+ */
+static inline int max_len_of(const struct fs_free_ext *n) {
+    return (n != NULL) ? n->max_len : 0;
+}
+
+/**
+ * Recompute the largest extent length of a node
+ * from its extent and its subtrees.
+ *
+ * @param n the node
+ */
+static void update(struct fs_free_ext *n)
+{
+    int m = n->len;
+    if (max_len_of(n->left) > m) {
+        m = max_len_of(n->left);
+    }
+    if (max_len_of(n->right) > m) {
+        m = max_len_of(n->right);
+    }
+    n->max_len = m;
+}
+
+/**
+ * Split a subtree into the extents that start before
+ * a block and those that start at or after it.
+ *
+ * @param n the subtree
+ * @param blk the block
+ * @param l set to extents before blk
+ * @param r set to extents at or after blk
+ */
+static void split(struct fs_free_ext *n, int blk, struct fs_free_ext **l, struct fs_free_ext **r)
+{
+    if (n == NULL) {
+        *l = *r = NULL;
+    } else if (n->start < blk) {
+        split(n->right, blk, &n->right, r);
+        *l = n;
+        update(n);
+    } else {
+        split(n->left, blk, l, &n->left);
+        *r = n;
+        update(n);
+    }
+}
+
+/**
+ * Join two subtrees where all extents of the first
+ * start before those of the second.
+ *
+ * @param l the first subtree
+ * @param r the second subtree
+ * @return the joined subtree
+ */
+static struct fs_free_ext *merge(struct fs_free_ext *l, struct fs_free_ext *r)
+{
+    if (l == NULL) {
+        return r;
+    }
+    if (r == NULL) {
+        return l;
+    }
+    if (l->prio > r->prio) {
+        l->right = merge(l->right, r);
+        update(l);
+        return l;
+    }
+    r->left = merge(l, r->left);
+    update(r);
+    return r;
+}
+
+/**
+ * Insert a detached extent into the tree.
+ *
+ * @param ft the tree
+ * @param e the extent
+ */
+static void insert(struct fs_freetree *ft, struct fs_free_ext *e)
+{
+    struct fs_free_ext *l, *r;
+    e->left = e->right = NULL;
+    update(e);
+    split(ft->root, e->start, &l, &r);
+    ft->root = merge(merge(l, e), r);
+}
+
+/**
+ * Detach the extent starting at a block from the tree.
+ *
+ * @param ft the tree
+ * @param start the first block of the extent
+ * @return the extent, or NULL if not found
+ */
+static struct fs_free_ext *detach(struct fs_freetree *ft, int start)
+{
+    struct fs_free_ext *l, *m, *r;
+    split(ft->root, start, &l, &r);
+    split(r, start+1, &m, &r);
+    ft->root = merge(l, r);
+    return m;
+}
+
+/**
+ * Find the extent with the greatest start at or
+ * before a block.
+ *
+ * @param n the subtree
+ * @param blk the block
+ * @return the extent or NULL if none
+ */
+static struct fs_free_ext *floor_ext(struct fs_free_ext *n, int blk)
+{
+    struct fs_free_ext *found = NULL;
+    while (n != NULL) {
+        if (n->start <= blk) {
+            found = n;
+            n = n->right;
+        } else {
+            n = n->left;
+        }
+    }
+    return found;
+}
+
+/**
+ * Find the first extent starting at or after a block
+ * with at least a minimum length. Subtrees without a
+ * long enough extent are skipped.
+ *
+ * @param n the subtree
+ * @param blk the block
+ * @param min_len the minimum length
+ * @return the extent or NULL if none
+ */
+static struct fs_free_ext *first_fit(struct fs_free_ext *n, int blk, int min_len)
+{
+    if ((n == NULL) || (n->max_len < min_len)) {
+        return NULL;
+    }
+    if (n->start < blk) {
+        return first_fit(n->right, blk, min_len);
+    }
+    struct fs_free_ext *found = first_fit(n->left, blk, min_len);
+    if (found != NULL) {
+        return found;
+    }
+    if (n->len >= min_len) {
+        return n;
+    }
+    return first_fit(n->right, blk, min_len);
+}
+
+/**
+ * Free the extents of a subtree.
+ *
+ * @param n the subtree
+ */
+static void free_exts(struct fs_free_ext *n)
+{
+    if (n != NULL) {
+        free_exts(n->left);
+        free_exts(n->right);
+        free(n);
+    }
+}
+
+/**
+ * Create the tree of free extents of a block map.
+ *
+ * @param bm the block map
+ * @return the tree or NULL if cannot create
+ */
+struct fs_freetree *fs_freetree_create(const struct fs_bitmap *bm)
+{
+    struct fs_freetree *ft = calloc(1, sizeof(struct fs_freetree));
+    if (ft == NULL) {
+        return NULL;
+    }
+    ft->seed = 2463534242u;
+
+    // append each run of clear bits in order
+    for (int start = fs_bitmap_find_zero(bm, 0); start >= 0; ) {
+        int end = fs_bitmap_find_set(bm, start);
+        if (end < 0) {
+            end = bm->n_bits;
+        }
+        struct fs_free_ext *e = malloc(sizeof(struct fs_free_ext));
+        if (e == NULL) {
+            fs_freetree_destroy(ft);
+            return NULL;
+        }
+        *e = (struct fs_free_ext) {
+                .start = start, .len = end - start, .max_len = end - start,
+                .prio = next_prio(ft), .left = NULL, .right = NULL
+        };
+        ft->root = merge(ft->root, e);
+        ft->n_extents++;
+        start = (end < bm->n_bits) ? fs_bitmap_find_zero(bm, end) : -1;
+    }
+    return ft;
+}
+
+/**
+ * Destroy a tree of free extents.
+ *
+ * @param ft the tree
+ */
+void fs_freetree_destroy(struct fs_freetree *ft)
+{
+    if (ft != NULL) {
+        free_exts(ft->root);
+        free(ft);
+    }
+}
+
+/**
+ * Find the first run of free blocks in a range of
+ * blocks that has at least a minimum length within
+ * the range.
+ *
+ * @param ft the tree
+ * @param start the first block to consider
+ * @param end the block after the last block to consider
+ * @param min_len the minimum run length
+ * @param run_len set to the length of the run within the range
+ * @return the first block of the run or -1 if none
+ */
+int fs_freetree_find(const struct fs_freetree *ft, int start, int end, int min_len, int *run_len)
+{
+    if (min_len < 1) {
+        min_len = 1;
+    }
+
+    // extent that holds the start block
+    struct fs_free_ext *e = floor_ext(ft->root, start);
+    if ((e != NULL) && (e->start + e->len > start)) {
+        int len = ((e->start + e->len < end) ? e->start + e->len : end) - start;
+        if (len >= min_len) {
+            *run_len = len;
+            return start;
+        }
+    }
+
+    // first long enough extent after it
+    e = first_fit(ft->root, start, min_len);
+    if ((e != NULL) && (e->start < end)) {
+        int len = ((e->start + e->len < end) ? e->start + e->len : end) - e->start;
+        if (len >= min_len) {
+            *run_len = len;
+            return e->start;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Remove a run of blocks from the free extents after
+ * they are allocated. The run must be free.
+ *
+ * Errors
+ *   -EINVAL   - run not free
+ *   -ENOMEM   - cannot split extent
+ *
+ * @param ft the tree
+ * @param start the first block
+ * @param len the number of blocks
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_freetree_remove(struct fs_freetree *ft, int start, int len)
+{
+    struct fs_free_ext *e = floor_ext(ft->root, start);
+    if ((e == NULL) || (start + len > e->start + e->len)) {
+        return -EINVAL;
+    }
+    int head_len = start - e->start;
+    int tail_len = (e->start + e->len) - (start + len);
+
+    // allocating in the middle splits the extent
+    struct fs_free_ext *tail = NULL;
+    if ((head_len > 0) && (tail_len > 0)) {
+        tail = malloc(sizeof(struct fs_free_ext));
+        if (tail == NULL) {
+            return -ENOMEM;
+        }
+    }
+
+    e = detach(ft, e->start);
+    if (head_len > 0) {
+        e->len = head_len;
+        insert(ft, e);
+        if (tail != NULL) {
+            *tail = (struct fs_free_ext) {.start = start + len, .len = tail_len, .prio = next_prio(ft)};
+            insert(ft, tail);
+            ft->n_extents++;
+        }
+    } else if (tail_len > 0) {
+        e->start = start + len;
+        e->len = tail_len;
+        insert(ft, e);
+    } else {
+        free(e);
+        ft->n_extents--;
+    }
+    return 0;
+}
+
+/**
+ * Add a run of blocks to the free extents after they
+ * are freed, joining adjacent free extents. The run
+ * must not be free.
+ *
+ * Errors
+ *   -EINVAL   - run already free
+ *   -ENOMEM   - cannot allocate extent
+ *
+ * @param ft the tree
+ * @param start the first block
+ * @param len the number of blocks
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_freetree_add(struct fs_freetree *ft, int start, int len)
+{
+    // extents before and after the run
+    struct fs_free_ext *pred = floor_ext(ft->root, start + len - 1);
+    if ((pred != NULL) && (pred->start + pred->len > start)) {
+        return -EINVAL;
+    }
+    struct fs_free_ext *succ = floor_ext(ft->root, start + len);
+    int joins_pred = (pred != NULL) && (pred->start + pred->len == start);
+    int joins_succ = (succ != NULL) && (succ->start == start + len);
+
+    struct fs_free_ext *e = NULL;
+    if (!joins_pred && !joins_succ) {
+        e = malloc(sizeof(struct fs_free_ext));
+        if (e == NULL) {
+            return -ENOMEM;
+        }
+        *e = (struct fs_free_ext) {.start = start, .len = len, .prio = next_prio(ft)};
+        ft->n_extents++;
+    }
+    if (joins_pred) {
+        e = detach(ft, pred->start);
+        e->len += len;
+    }
+    if (joins_succ) {
+        succ = detach(ft, succ->start);
+        if (e == NULL) {
+            e = succ;
+            e->start = start;
+            e->len += len;
+        } else {
+            e->len += succ->len;
+            free(succ);
+            ft->n_extents--;
+        }
+    }
+    insert(ft, e);
+    return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * fs_util_freetree.h
+ *
+ * description: tree of free block extents for
+ * contiguous block allocation
+ * for CS 7600 / CS 5600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Peter Desnoyers,  November 2016
+ * Philip Gust, March 2021
+ */
+
+#ifndef FS_UTIL_FREETREE_H_
+#define FS_UTIL_FREETREE_H_
+
+#include "fs_util_bitmap.h"
+
+/** run of free blocks; node of a treap ordered by start */
+struct fs_free_ext {
+    /** first free block */
+    int start;
+
+    /** number of free blocks */
+    int len;
+
+    /** largest len in subtree */
+    int max_len;
+
+    /** heap priority */
+    unsigned prio;
+
+    /** extents before and after this one */
+    struct fs_free_ext *left, *right;
+};
+
+/**
+ * Free extents of a block map, kept as a treap ordered
+ * by start block. Adjacent free blocks are always joined
+ * into one extent, and each node records the largest
+ * extent in its subtree so a search for a long enough
+ * extent skips subtrees without one.
+ */
+struct fs_freetree {
+    /** root of treap */
+    struct fs_free_ext *root;
+
+    /** number of free extents */
+    int n_extents;
+
+    /** state of priority generator */
+    unsigned seed;
+};
+
+/**
+ * Create the tree of free extents of a block map.
+ *
+ * @param bm the block map
+ * @return the tree or NULL if cannot create
+ */
+struct fs_freetree *fs_freetree_create(const struct fs_bitmap *bm);
+
+/**
+ * Destroy a tree of free extents.
+ *
+ * @param ft the tree
+ */
+void fs_freetree_destroy(struct fs_freetree *ft);
+
+/**
+ * Find the first run of free blocks in a range of
+ * blocks that has at least a minimum length within
+ * the range.
+ *
+ * @param ft the tree
+ * @param start the first block to consider
+ * @param end the block after the last block to consider
+ * @param min_len the minimum run length
+ * @param run_len set to the length of the run within the range
+ * @return the first block of the run or -1 if none
+ */
+int fs_freetree_find(const struct fs_freetree *ft, int start, int end, int min_len, int *run_len);
+
+/**
+ * Remove a run of blocks from the free extents after
+ * they are allocated. The run must be free.
+ *
+ * Errors
+ *   -EINVAL   - run not free
+ *   -ENOMEM   - cannot split extent
+ *
+ * @param ft the tree
+ * @param start the first block
+ * @param len the number of blocks
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_freetree_remove(struct fs_freetree *ft, int start, int len);
+
+/**
+ * Add a run of blocks to the free extents after they
+ * are freed, joining adjacent free extents. The run
+ * must not be free.
+ *
+ * Errors
+ *   -EINVAL   - run already free
+ *   -ENOMEM   - cannot allocate extent
+ *
+ * @param ft the tree
+ * @param start the first block
+ * @param len the number of blocks
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_freetree_add(struct fs_freetree *ft, int start, int len);
+
+#endif /* FS_UTIL_FREETREE_H_ */
@@ -0,0 +1,637 @@
+/*
+ * fs_util_journal.c
+ *
+ * description: write-ahead journal for volume metadata
+ * for CS 7600 / CS 5600 file system
+ *
+ * Changed metadata blocks, and the directory, index,
+ * indirect, and extent blocks of files, are committed as
+ * transactions to a circular log. A transaction is a
+ * descriptor block listing the home blocks, the logged
+ * blocks, and a commit block with a checksum, written
+ * with one call. The home blocks are written later by a
+ * checkpoint, only once the log is half full or the volume
+ * is synchronized. Mounting the volume replays the
+ * committed transactions.
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Peter Desnoyers,  November 2016
+ * Philip Gust, March 2021
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "fs_util_journal.h"
+#include "fs_dev_blkdev.h"
+
+/** blocks written by one checkpoint call */
+enum {CHECKPOINT_BATCH = 16};
+
+/**
+ * Device block of a log position.
+ *
+ * @param fs the file system
+ * @param pos the log position
+ * @return the block number
+ */
+static int log_blkno(struct fs_ext2 *fs, uint32_t pos)
+{
+    return fs->journal_base + 1 + (pos % fs->journal_n_log);
+}
+
+/**
+ * Find the log position of the latest logged copy of a
+ * block since the last checkpoint.
+ *
+ * @param fs the file system
+ * @param blkno the block number
+ * @return the log position + 1, or 0 if not logged
+ */
+static uint32_t logged_pos(const struct fs_ext2 *fs, int blkno)
+{
+    if (blkno < fs->n_meta) {
+        return fs->journal_map[blkno];
+    }
+    for (int i = 0; i < fs->journal_n_blks; i++) {
+        if (fs->journal_blks[i].blkno == blkno) {
+            return fs->journal_blks[i].pos;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Record the log position of the latest logged copy
+ * of a block.
+ *
+ * @param fs the file system
+ * @param blkno the block number
+ * @param pos the log position + 1
+ */
+static void set_logged_pos(struct fs_ext2 *fs, int blkno, uint32_t pos)
+{
+    if (blkno < fs->n_meta) {
+        fs->journal_map[blkno] = pos;
+        return;
+    }
+    int i = 0;
+    while ((i < fs->journal_n_blks) && (fs->journal_blks[i].blkno != blkno)) {
+        i++;
+    }
+    if (i == fs->journal_n_blks) {
+        fs->journal_n_blks++;  // each copy has its own log block
+    }
+    fs->journal_blks[i] = (struct fs_journal_blk) {.blkno = blkno, .pos = pos};
+}
+
+/**
+ * Get the in-memory copy of a changed or logged block.
+ *
+ * @param fs the file system
+ * @param blkno the block number
+ * @return the block or NULL if it is not cached
+ */
+static void *cached_blk(struct fs_ext2 *fs, int blkno)
+{
+    return (blkno < fs->n_meta) ? fs_meta_cached(fs, blkno) : fs_mcache_peek(fs->blk_cache, blkno);
+}
+
+/**
+ * Determine whether a block changed since last commit.
+ *
+ * @param fs the file system
+ * @param blkno the block number
+ * @return 1 if changed, 0 if not
+ */
+static int is_changed(const struct fs_ext2 *fs, int blkno)
+{
+    return fs_bitmap_test((blkno < fs->n_meta) ? fs->meta_map : fs->blk_map, blkno);
+}
+
+/** checksum of an empty transaction */
+#define TXN_CHECKSUM_INIT 2166136261u
+
+/**
+ * Update the checksum of a transaction with the next
+ * blocks written to the log.
+ *
+ * @param hash the checksum of the preceding blocks
+ * @param blks the blocks
+ * @param n the number of blocks
+ * @param blk_size the block size in bytes
+ * @return the checksum
+ */
+static inline uint32_t txn_checksum_blks(uint32_t hash, void *const blks[], int n, int blk_size)
+{
+    for (int k = 0; k < n; k++) {
+        const uint8_t *p = blks[k];
+        for (int i = 0; i < blk_size; i++) {
+            hash = (hash ^ p[i]) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+/**
+ * Define txn_checksum_<suffix>, which updates the
+ * checksum of a transaction with blocks of one size.
+ */
+#define DEFINE_TXN_CHECKSUM(sfx, bs) \
+static uint32_t txn_checksum_##sfx(uint32_t hash, void *const blks[], int n) \
+{ \
+    return txn_checksum_blks(hash, blks, n, bs); \
+}
+FS_FOR_EACH_BLK_SIZE(DEFINE_TXN_CHECKSUM)
+
+/**
+ * Update the checksum of a transaction with the copy
+ * of the loop for the volume block size.
+ *
+ * @param fs the file system
+ * @param hash the checksum of the preceding blocks
+ * @param blks the blocks
+ * @param n the number of blocks
+ * @return the checksum
+ */
+static uint32_t txn_checksum(struct fs_ext2 *fs, uint32_t hash, void *const blks[], int n)
+{
+    return FS_BLK_SIZE_CALL(fs->blk_size, txn_checksum, hash, blks, n);
+}
+
+/**
+ * Number of descriptor blocks that list logged blocks.
+ *
+ * @param fs the file system
+ * @param n the number of logged blocks
+ * @return the number of descriptor blocks
+ */
+static int n_descs(struct fs_ext2 *fs, int n)
+{
+    return (n + JOURNAL_DESC_LIMIT(fs->blk_size) - 1) / JOURNAL_DESC_LIMIT(fs->blk_size);
+}
+
+/**
+ * Make all blocks written to the device durable. The
+ * whole device is flushed because a ranged flush only
+ * starts writeback and is not a write barrier.
+ *
+ * @param fs the file system
+ * @return 0 if successful, -EIO if i/o error
+ */
+static int barrier(struct fs_ext2 *fs)
+{
+    return (fs->dev->ops->flush(fs->dev, 0, fs->n_blocks) == SUCCESS) ? 0 : -EIO;
+}
+
+/**
+ * Write the journal header for the current tail.
+ *
+ * @param fs the file system
+ * @return 0 if successful, -EIO if i/o error
+ */
+static int write_header(struct fs_ext2 *fs)
+{
+    struct fs_journal_super jsb = {
+        .magic = FS_JOURNAL_MAGIC, .tail = fs->journal_tail, .seq = fs->journal_seq
+    };
+    if (   (fs->dev->ops->write(fs->dev, fs->journal_base, 1, &jsb) != SUCCESS)
+        || (barrier(fs) != 0)) {
+        return -EIO;
+    }
+    return 0;
+}
+
+/**
+ * Replay a logged block into the volume. Metadata blocks
+ * are copied into the metadata, and file blocks are held
+ * until checkpointed; other blocks are ignored.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param blkno the home block number
+ * @param blk the logged block
+ * @param pos the log position + 1 of the logged block
+ * @return 0 if successful, -error if error occurred
+ */
+static int replay_blk(struct fs_ext2 *fs, int blkno, const void *blk, uint32_t pos)
+{
+    void *buf = NULL;
+    if ((blkno >= 0) && (blkno < fs->n_meta)) {
+        buf = fs_meta_blk(fs, blkno);
+    } else if ((blkno > fs->journal_base + fs->journal_n_log) && (blkno < fs->n_blocks)) {
+        buf = fs_mcache_peek(fs->blk_cache, blkno);
+        if ((buf == NULL) && ((buf = fs_mcache_insert(fs->blk_cache, blkno)) != NULL)) {
+            fs_bitmap_set(fs->blk_held, blkno);
+        }
+    } else {
+        return 0;  // not a metadata or file block
+    }
+    if (buf == NULL) {
+        return -EIO;
+    }
+    memcpy(buf, blk, fs->blk_size);
+    set_logged_pos(fs, blkno, pos);
+    return 0;
+}
+
+/**
+ * Read the transaction at a log position. A transaction
+ * is one or more descriptor blocks, each followed by the
+ * blocks it lists, then a commit block. Without apply,
+ * the transaction is validated; with apply, the logged
+ * blocks of a validated transaction are replayed.
+ *
+ * Errors
+ *   -EIO      - i/o error replaying a block
+ *
+ * @param fs the file system
+ * @param pos the log position
+ * @param seq the expected sequence number
+ * @param max_len the most log blocks the transaction can use
+ * @param blks buffer for JOURNAL_DESC_LIMIT logged blocks
+ * @param apply 1 to replay the logged blocks, 0 to validate
+ * @return log blocks used by a committed transaction,
+ *  0 if not committed, or -error
+ */
+static int read_txn(struct fs_ext2 *fs, uint32_t pos, uint32_t seq, int max_len,
+                    uint8_t *blks, int apply)
+{
+    struct fs_journal_desc desc;
+    struct blkdev_iovec iov[JOURNAL_DESC_LIMIT(FS_MAX_BLOCK_SIZE)];
+    void *blk_ptrs[JOURNAL_DESC_LIMIT(FS_MAX_BLOCK_SIZE)+1];
+    uint32_t hash = TXN_CHECKSUM_INIT;
+    int len = 0, n_blocks = 0;
+    for (;;) {
+        if (   (len + 1 > max_len)
+            || (fs->dev->ops->read(fs->dev, log_blkno(fs, pos+len), 1, &desc) != SUCCESS)
+            || (desc.magic != FS_JOURNAL_MAGIC) || (desc.seq != seq)) {
+            return 0;
+        }
+        if (desc.type == FS_JOURNAL_COMMIT) {
+            int committed = (len > 0) && (desc.n_blocks == (uint32_t)n_blocks) && (desc.checksum == hash);
+            return committed ? len + 1 : 0;
+        }
+        int n = desc.n_blocks;
+        if (   (desc.type != FS_JOURNAL_DESC) || (n <= 0) || (n > JOURNAL_DESC_LIMIT(fs->blk_size))
+            || (len + 1 + n + 1 > max_len)) {
+            return 0;
+        }
+
+        // read logged blocks listed by descriptor
+        blk_ptrs[0] = &desc;
+        for (int k = 0; k < n; k++) {
+            blk_ptrs[1+k] = blks + (size_t)k * fs->blk_size;
+            iov[k] = (struct blkdev_iovec) {.blkno = log_blkno(fs, pos+len+1+k), .buf = blk_ptrs[1+k]};
+        }
+        if (blkdev_readv(fs->dev, iov, n) != SUCCESS) {
+            return apply ? -EIO : 0;
+        }
+        if (apply) {
+            for (int k = 0; k < n; k++) {
+                int status = replay_blk(fs, desc.blknos[k], blk_ptrs[1+k], pos + len + 1 + k + 1);
+                if (status != 0) {
+                    return status;
+                }
+            }
+        }
+        hash = txn_checksum(fs, hash, blk_ptrs, n+1);
+        len += 1 + n;
+        n_blocks += n;
+    }
+}
+
+/**
+ * Open the journal of a mounted volume and replay committed
+ * transactions into the volume metadata, writing them to
+ * their home blocks. Called by fs_mount_volume after the
+ * metadata is read.
+ *
+ * Errors
+ *   -EINVAL   - invalid journal header
+ *   -ENOMEM   - cannot allocate journal map
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param sb the superblock read from the device
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_journal_replay(struct fs_ext2 *fs, const struct fs_super *sb)
+{
+    fs->journal_base = sb->journal_base;
+    fs->journal_n_log = (sb->journal_base != 0) ? sb->journal_sz - 1 : 0;
+    fs->journal_head = fs->journal_tail = 0;
+    fs->journal_seq = 0;
+    fs->journal_n_blks = 0;
+    fs->journal_map = calloc(fs->n_meta, sizeof(uint32_t));
+    if (fs->journal_map == NULL) {
+        return -ENOMEM;
+    }
+    if (fs->journal_base == 0) {
+        return 0;  // no journal
+    }
+    fs->journal_blks = malloc(fs->journal_n_log * sizeof(struct fs_journal_blk));
+    if (fs->journal_blks == NULL) {
+        return -ENOMEM;
+    }
+
+    // read journal header
+    struct fs_journal_super jsb;
+    if (fs->dev->ops->read(fs->dev, fs->journal_base, 1, &jsb) != SUCCESS) {
+        return -EIO;
+    }
+    if (jsb.magic != FS_JOURNAL_MAGIC) {
+        return -EINVAL;
+    }
+    fs->journal_head = fs->journal_tail = jsb.tail;
+    fs->journal_seq = jsb.seq;
+
+    // validate, then apply committed transactions in order
+    uint8_t *blks = malloc((size_t)JOURNAL_DESC_LIMIT(fs->blk_size) * fs->blk_size);
+    if (blks == NULL) {
+        return -ENOMEM;
+    }
+    for (;;) {
+        int max_len = fs->journal_n_log - (int)(fs->journal_head - fs->journal_tail);
+        int len = read_txn(fs, fs->journal_head, fs->journal_seq, max_len, blks, 0);
+        if (len <= 0) {
+            break;
+        }
+        int status = read_txn(fs, fs->journal_head, fs->journal_seq, max_len, blks, 1);
+        if (status < 0) {
+            free(blks);
+            return status;
+        }
+        fs->journal_head += len;
+        fs->journal_seq++;
+    }
+    free(blks);
+
+    // write replayed blocks to home blocks
+    return fs_journal_checkpoint(fs);
+}
+
+/**
+ * Get the most blocks that one transaction can log.
+ *
+ * @param fs the file system
+ * @return the number of blocks, 0 if no journal
+ */
+int fs_journal_capacity(struct fs_ext2 *fs)
+{
+    // descriptors and a commit block share the log
+    int n = fs->journal_n_log - 2;
+    while ((n > 0) && (n + n_descs(fs, n) + 1 > fs->journal_n_log)) {
+        n--;
+    }
+    return (n > 0) ? n : 0;
+}
+
+/**
+ * Commit changed blocks as one journal transaction
+ * with a single sequential write.
+ *
+ * Errors
+ *   -ENOMEM   - cannot allocate transaction
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param blknos the changed blocks
+ * @param n the number of changed blocks, at most
+ *  fs_journal_capacity() blocks
+ * @return 0 if successful, -error if error occurred
+ */
+static int commit_txn(struct fs_ext2 *fs, const int *blknos, int n)
+{
+    int per_desc = JOURNAL_DESC_LIMIT(fs->blk_size);
+    int n_desc = n_descs(fs, n);
+    int len = n + n_desc + 1;
+
+    // make room in log
+    if (fs->journal_head - fs->journal_tail + len > (uint32_t)fs->journal_n_log) {
+        int status = fs_journal_checkpoint(fs);
+        if (status != 0) {
+            return status;
+        }
+    }
+
+    struct fs_journal_desc *descs = calloc(n_desc + 1, sizeof(struct fs_journal_desc));
+    struct blkdev_iovec *iov = malloc(len * sizeof(struct blkdev_iovec));
+    void **blk_ptrs = malloc((len - 1) * sizeof(void*));
+    if ((descs == NULL) || (iov == NULL) || (blk_ptrs == NULL)) {
+        free(descs);
+        free(iov);
+        free(blk_ptrs);
+        return -ENOMEM;
+    }
+
+    // build descriptors followed by the blocks they list,
+    // then a commit block; log block i is at position pos+i
+    uint32_t pos = fs->journal_head;
+    for (int d = 0, i = 0; d < n_desc; d++) {
+        struct fs_journal_desc *desc = &descs[d];
+        desc->magic = FS_JOURNAL_MAGIC;
+        desc->type = FS_JOURNAL_DESC;
+        desc->seq = fs->journal_seq;
+        desc->n_blocks = (n - d*per_desc < per_desc) ? n - d*per_desc : per_desc;
+        blk_ptrs[i] = desc;
+        iov[i] = (struct blkdev_iovec) {.blkno = log_blkno(fs, pos+i), .buf = desc};
+        i++;
+        for (int k = 0; k < (int)desc->n_blocks; k++, i++) {
+            desc->blknos[k] = blknos[d*per_desc + k];
+            blk_ptrs[i] = cached_blk(fs, desc->blknos[k]);  // changed blocks are cached
+            iov[i] = (struct blkdev_iovec) {.blkno = log_blkno(fs, pos+i), .buf = blk_ptrs[i]};
+        }
+    }
+    struct fs_journal_desc *commit = &descs[n_desc];
+    commit->magic = FS_JOURNAL_MAGIC;
+    commit->type = FS_JOURNAL_COMMIT;
+    commit->seq = fs->journal_seq;
+    commit->n_blocks = n;
+    commit->checksum = txn_checksum(fs, TXN_CHECKSUM_INIT, blk_ptrs, len - 1);
+    iov[len-1] = (struct blkdev_iovec) {.blkno = log_blkno(fs, pos+len-1), .buf = commit};
+
+    // write transaction and make it durable
+    fs->sync_stats.last_calls++;
+    int status = ((blkdev_writev(fs->dev, iov, len) == SUCCESS) && (barrier(fs) == 0)) ? 0 : -EIO;
+    free(descs);
+    free(iov);
+    free(blk_ptrs);
+    if (status != 0) {
+        return status;  // blocks remain changed
+    }
+    fs->sync_stats.last_blocks += len;
+
+    // record logged copies of committed blocks
+    for (int k = 0; k < n; k++) {
+        int blkno = blknos[k];
+        set_logged_pos(fs, blkno, pos + (k / per_desc + 1) + k + 1);
+        fs_bitmap_clear((blkno < fs->n_meta) ? fs->meta_map : fs->blk_map, blkno);
+    }
+    fs->n_dirty -= n;
+    fs->journal_head += len;
+    fs->journal_seq++;
+
+    // checkpoint lazily once log is half full
+    if (fs->journal_head - fs->journal_tail > (uint32_t)fs->journal_n_log / 2) {
+        return fs_journal_checkpoint(fs);
+    }
+    return 0;
+}
+
+/**
+ * Commit the changed metadata blocks and held blocks
+ * to the journal as one transaction with a single
+ * sequential write. If they do not fit in the log
+ * they are committed as several transactions, so only
+ * each transaction is atomic. The journal is
+ * checkpointed once it is half full.
+ *
+ * Errors
+ *   -ENOMEM   - cannot allocate transaction
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_journal_commit(struct fs_ext2 *fs)
+{
+    // list changed blocks
+    int n = (fs->n_meta - fs_bitmap_count_zero(fs->meta_map, 0, fs->n_meta))
+          + (fs->n_blocks - fs_bitmap_count_zero(fs->blk_map, 0, fs->n_blocks));
+    if (n == 0) {
+        return 0;
+    }
+    int *blknos = malloc(n * sizeof(int));
+    if (blknos == NULL) {
+        return -ENOMEM;
+    }
+    int k = 0;
+    for (int i = fs_bitmap_find_set(fs->meta_map, 0); i >= 0; i = fs_bitmap_find_set(fs->meta_map, i+1)) {
+        blknos[k++] = i;
+    }
+    for (int i = fs_bitmap_find_set(fs->blk_map, 0); i >= 0; i = fs_bitmap_find_set(fs->blk_map, i+1)) {
+        blknos[k++] = i;
+    }
+
+    // commit in as few transactions as fit in the log
+    int max = fs_journal_capacity(fs);
+    int status = 0;
+    for (k = 0; (status == 0) && (k < n); k += max) {
+        status = commit_txn(fs, blknos + k, (n - k < max) ? n - k : max);
+    }
+    free(blknos);
+    return status;
+}
+
+/**
+ * Write the latest committed copy of each journaled
+ * block to its home block, then free the journal space
+ * of the checkpointed transactions. Held blocks not
+ * changed since commit are no longer held.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_journal_checkpoint(struct fs_ext2 *fs)
+{
+    if ((fs->journal_base == 0) || (fs->journal_head == fs->journal_tail)) {
+        return 0;
+    }
+
+    // write home blocks in batches; a block changed since
+    // commit or not cached is written from its logged copy
+    struct blkdev_iovec iov[CHECKPOINT_BATCH];
+    uint8_t copies[CHECKPOINT_BATCH * FS_MIN_BLOCK_SIZE];
+    int max_copies = sizeof(copies) / fs->blk_size;
+    int n = 0, n_copies = 0;
+    int n_logged = fs->n_meta + fs->journal_n_blks;  // metadata blocks, then file blocks
+    for (int i = 0; i <= n_logged; i++) {
+        int blkno = i;
+        uint32_t pos = 0;
+        if (i < fs->n_meta) {
+            pos = fs->journal_map[i];
+        } else if (i < n_logged) {
+            blkno = fs->journal_blks[i - fs->n_meta].blkno;
+            pos = fs->journal_blks[i - fs->n_meta].pos;
+        }
+        if (pos != 0) {
+            void *buf = cached_blk(fs, blkno);
+            if ((buf == NULL) || is_changed(fs, blkno)) {
+                buf = copies + (size_t)n_copies++ * fs->blk_size;
+                if (fs->dev->ops->read(fs->dev, log_blkno(fs, pos-1), 1, buf) != SUCCESS) {
+                    return -EIO;
+                }
+            }
+            iov[n++] = (struct blkdev_iovec) {.blkno = blkno, .buf = buf};
+        }
+        if ((n == CHECKPOINT_BATCH) || (n_copies == max_copies) || ((i == n_logged) && (n > 0))) {
+            if (blkdev_writev(fs->dev, iov, n) != SUCCESS) {
+                return -EIO;
+            }
+            n = n_copies = 0;
+        }
+    }
+    if (barrier(fs) != 0) {
+        return -EIO;
+    }
+
+    // free log space; unchanged file blocks need not be held
+    memset(fs->journal_map, 0, fs->n_meta * sizeof(uint32_t));
+    for (int i = 0; i < fs->journal_n_blks; i++) {
+        int blkno = fs->journal_blks[i].blkno;
+        if (!fs_bitmap_test(fs->blk_map, blkno)) {
+            fs_bitmap_clear(fs->blk_held, blkno);
+            fs_mcache_remove(fs->blk_cache, blkno);
+        }
+    }
+    fs->journal_n_blks = 0;
+    fs_mcache_trim(fs->blk_cache);
+    fs->journal_tail = fs->journal_head;
+    return write_header(fs);
+}
+
+/**
+ * Read the latest committed copy of a metadata or
+ * file block, from the journal if it was logged since
+ * the last checkpoint, otherwise from its home block.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param blkno the block number
+ * @param buf buffer for the block
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_journal_read_blk(struct fs_ext2 *fs, int blkno, void *buf)
+{
+    int from = blkno;
+    uint32_t pos = (fs->journal_base != 0) ? logged_pos(fs, blkno) : 0;
+    if (pos != 0) {
+        from = log_blkno(fs, pos-1);
+    }
+    if (fs->dev->ops->read(fs->dev, from, 1, buf) != SUCCESS) {
+        return -EIO;
+    }
+    return 0;
+}
+
+/**
+ * Determine whether a block was logged since the
+ * last checkpoint.
+ *
+ * @param fs the file system
+ * @param blkno the block number
+ * @return 1 if logged, 0 if not
+ */
+int fs_journal_logged(struct fs_ext2 *fs, int blkno)
+{
+    return (fs->journal_base != 0) && (logged_pos(fs, blkno) != 0);
+}
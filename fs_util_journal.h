@@ -0,0 +1,98 @@
+/*
+ * fs_util_journal.h
+ *
+ * description: write-ahead journal for volume metadata
+ * for CS 7600 / CS 5600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Peter Desnoyers,  November 2016
+ * Philip Gust, March 2021
+ */
+
+#ifndef FS_UTIL_JOURNAL_H_
+#define FS_UTIL_JOURNAL_H_
+
+#include "fs_util_volume.h"
+
+/**
+ * Open the journal of a mounted volume and replay committed
+ * transactions into the volume metadata, writing them to
+ * their home blocks. Called by fs_mount_volume after the
+ * metadata is read.
+ *
+ * Errors
+ *   -EINVAL   - invalid journal header
+ *   -ENOMEM   - cannot allocate journal map
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param sb the superblock read from the device
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_journal_replay(struct fs_ext2 *fs, const struct fs_super *sb);
+
+/**
+ * Commit the changed metadata blocks and held blocks
+ * to the journal as one transaction with a single
+ * sequential write. If they do not fit in the log
+ * they are committed as several transactions, so only
+ * each transaction is atomic. The journal is
+ * checkpointed once it is half full.
+ *
+ * Errors
+ *   -ENOMEM   - cannot allocate transaction
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_journal_commit(struct fs_ext2 *fs);
+
+/**
+ * Get the most blocks that one transaction can log.
+ *
+ * @param fs the file system
+ * @return the number of blocks, 0 if no journal
+ */
+int fs_journal_capacity(struct fs_ext2 *fs);
+
+/**
+ * Write the latest committed copy of each journaled
+ * block to its home block, then free the journal space
+ * of the checkpointed transactions. Held blocks not
+ * changed since commit are no longer held.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_journal_checkpoint(struct fs_ext2 *fs);
+
+/**
+ * Read the latest committed copy of a metadata or
+ * file block, from the journal if it was logged since
+ * the last checkpoint, otherwise from its home block.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param blkno the block number
+ * @param buf buffer for the block
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_journal_read_blk(struct fs_ext2 *fs, int blkno, void *buf);
+
+/**
+ * Determine whether a block was logged since the
+ * last checkpoint.
+ *
+ * @param fs the file system
+ * @param blkno the block number
+ * @return 1 if logged, 0 if not
+ */
+int fs_journal_logged(struct fs_ext2 *fs, int blkno);
+
+#endif /* FS_UTIL_JOURNAL_H_ */
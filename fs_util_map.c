@@ -0,0 +1,307 @@
+/*
+ * fs_util_map.c
+ *
+ * description: inode and block maps of a volume, kept
+ * in memory or paged in through the metadata cache
+ * for CS 7600 / CS 5600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Peter Desnoyers,  November 2016
+ * Philip Gust, March 2021
+ */
+
+#include <errno.h>
+
+#include "fs_util_map.h"
+
+/** bits in a map word */
+enum { WORD_BITS = 64 };
+
+/**
+ * Get the resident bitmap of a volume map.
+ *
+ * @param fs the file system
+ * @param map FS_INODE_MAP or FS_BLOCK_MAP
+ * @return the bitmap or NULL if the map is paged
+ */
+static struct fs_bitmap *map_bitmap(const struct fs_ext2 *fs, int map)
+{
+    return (map == FS_INODE_MAP) ? fs->inode_map : fs->block_map;
+}
+
+/**
+ * Get the number of bits of a volume map.
+ *
+ * @param fs the file system
+ * @param map FS_INODE_MAP or FS_BLOCK_MAP
+ * @return the number of bits
+ */
+static int map_bits(const struct fs_ext2 *fs, int map)
+{
+    return (map == FS_INODE_MAP) ? fs->n_inodes : fs->n_blocks;
+}
+
+/**
+ * Get the map block number holding a bit.
+ *
+ * @param fs the file system
+ * @param map FS_INODE_MAP or FS_BLOCK_MAP
+ * @param i the bit number
+ * @return the metadata block number
+ */
+static int map_blkno(const struct fs_ext2 *fs, int map, int i)
+{
+    int base = (map == FS_INODE_MAP) ? fs->inode_map_base : fs->block_map_base;
+    return base + i / BITS_PER_BLK(fs->blk_size);
+}
+
+/**
+ * Find the first set or clear bit of a paged map in a
+ * range, reading each map block of the range once.
+ *
+ * @param fs the file system
+ * @param map FS_INODE_MAP or FS_BLOCK_MAP
+ * @param start the first bit to consider
+ * @param end the bit after the last bit to consider
+ * @param set 1 to find a set bit, 0 to find a clear bit
+ * @return the bit number, -1 if none, -EIO if error occurred
+ */
+static int paged_find(struct fs_ext2 *fs, int map, int start, int end, int set)
+{
+    if (end > map_bits(fs, map)) {
+        end = map_bits(fs, map);
+    }
+    int bits_per_blk = BITS_PER_BLK(fs->blk_size);
+    for (int i = (start > 0) ? start : 0; i < end; ) {
+        const uint64_t *words = fs_meta_blk(fs, map_blkno(fs, map, i));
+        if (words == NULL) {
+            return -EIO;
+        }
+        int first = i - i % bits_per_blk;
+        int last = (first + bits_per_blk < end) ? first + bits_per_blk : end;
+        int w = (i - first) / WORD_BITS;
+        uint64_t bits = (set ? words[w] : ~words[w]) & (~(uint64_t)0 << (i % WORD_BITS));
+        for (;;) {
+            if (bits != 0) {
+                int found = first + w*WORD_BITS + __builtin_ctzll(bits);
+                return (found < end) ? found : -1;
+            }
+            if (first + ++w*WORD_BITS >= last) {
+                break;
+            }
+            bits = set ? words[w] : ~words[w];
+        }
+        i = last;
+    }
+    return -1;
+}
+
+/**
+ * Test a bit of a volume map.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param map FS_INODE_MAP or FS_BLOCK_MAP
+ * @param i the bit number
+ * @return 1 if set, 0 if clear, -error if error occurred
+ */
+int fs_map_test(struct fs_ext2 *fs, int map, int i)
+{
+    const struct fs_bitmap *bm = map_bitmap(fs, map);
+    if (bm != NULL) {
+        return fs_bitmap_test(bm, i);
+    }
+    const void *words = fs_meta_blk(fs, map_blkno(fs, map, i));
+    return (words != NULL) ? fs_bit_test(words, i % BITS_PER_BLK(fs->blk_size)) : -EIO;
+}
+
+/**
+ * Set a bit of a volume map, marking its map block
+ * changed if the bit was clear.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param map FS_INODE_MAP or FS_BLOCK_MAP
+ * @param i the bit number
+ * @return 1 if the bit was clear, 0 if already set,
+ *  -error if error occurred
+ */
+int fs_map_set(struct fs_ext2 *fs, int map, int i)
+{
+    int blkno = map_blkno(fs, map, i);
+    struct fs_bitmap *bm = map_bitmap(fs, map);
+    int changed;
+    if (bm != NULL) {
+        changed = fs_bitmap_set(bm, i);
+    } else {
+        void *words = fs_meta_blk(fs, blkno);
+        if (words == NULL) {
+            return -EIO;
+        }
+        int j = i % BITS_PER_BLK(fs->blk_size);
+        changed = !fs_bit_test(words, j);
+        fs_bit_set(words, j);
+    }
+    if (changed) {
+        fs->n_dirty += fs_bitmap_set(fs->meta_map, blkno);  // changed blocks are not evicted
+    }
+    return changed;
+}
+
+/**
+ * Clear a bit of a volume map, marking its map block
+ * changed if the bit was set.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param map FS_INODE_MAP or FS_BLOCK_MAP
+ * @param i the bit number
+ * @return 1 if the bit was set, 0 if already clear,
+ *  -error if error occurred
+ */
+int fs_map_clear(struct fs_ext2 *fs, int map, int i)
+{
+    int blkno = map_blkno(fs, map, i);
+    struct fs_bitmap *bm = map_bitmap(fs, map);
+    int changed;
+    if (bm != NULL) {
+        changed = fs_bitmap_clear(bm, i);
+    } else {
+        uint64_t *words = fs_meta_blk(fs, blkno);
+        if (words == NULL) {
+            return -EIO;
+        }
+        int j = i % BITS_PER_BLK(fs->blk_size);
+        changed = fs_bit_test(words, j);
+        words[j / WORD_BITS] &= ~((uint64_t)1 << (j % WORD_BITS));
+    }
+    if (changed) {
+        fs->n_dirty += fs_bitmap_set(fs->meta_map, blkno);  // changed blocks are not evicted
+    }
+    return changed;
+}
+
+/**
+ * Find the first clear bit of a volume map in a range.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param map FS_INODE_MAP or FS_BLOCK_MAP
+ * @param start the first bit to consider
+ * @param end the bit after the last bit to consider
+ * @return the bit number, -1 if none, -error if error occurred
+ */
+int fs_map_find_zero(struct fs_ext2 *fs, int map, int start, int end)
+{
+    const struct fs_bitmap *bm = map_bitmap(fs, map);
+    return (bm != NULL) ? fs_bitmap_find_zero_in(bm, start, end) : paged_find(fs, map, start, end, 0);
+}
+
+/**
+ * Find the first set bit of a volume map in a range.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param map FS_INODE_MAP or FS_BLOCK_MAP
+ * @param start the first bit to consider
+ * @param end the bit after the last bit to consider
+ * @return the bit number, -1 if none, -error if error occurred
+ */
+int fs_map_find_set(struct fs_ext2 *fs, int map, int start, int end)
+{
+    const struct fs_bitmap *bm = map_bitmap(fs, map);
+    if (bm == NULL) {
+        return paged_find(fs, map, start, end, 1);
+    }
+    int i = fs_bitmap_find_set(bm, start);
+    return (i < end) ? i : -1;
+}
+
+/**
+ * Count the clear bits of a volume map in a range.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param map FS_INODE_MAP or FS_BLOCK_MAP
+ * @param start the first bit to count
+ * @param end the bit after the last bit to count
+ * @return the number of clear bits, -error if error occurred
+ */
+int fs_map_count_zero(struct fs_ext2 *fs, int map, int start, int end)
+{
+    const struct fs_bitmap *bm = map_bitmap(fs, map);
+    if (bm != NULL) {
+        return fs_bitmap_count_zero(bm, start, end);
+    }
+    if (end > map_bits(fs, map)) {
+        end = map_bits(fs, map);
+    }
+    int bits_per_blk = BITS_PER_BLK(fs->blk_size);
+    int n = 0;
+    for (int i = start; i < end; ) {
+        const uint64_t *words = fs_meta_blk(fs, map_blkno(fs, map, i));
+        if (words == NULL) {
+            return -EIO;
+        }
+        int first = i - i % bits_per_blk;
+        int last = (first + bits_per_blk < end) ? first + bits_per_blk : end;
+        while (i < last) {
+            int w = (i - first) / WORD_BITS;
+            uint64_t clear = ~words[w] & (~(uint64_t)0 << (i % WORD_BITS));
+            int next = first + (w+1) * WORD_BITS;
+            if (next > last) {
+                clear &= ~(~(uint64_t)0 << (last % WORD_BITS));
+                next = last;
+            }
+            n += __builtin_popcountll(clear);
+            i = next;
+        }
+    }
+    return n;
+}
+
+/**
+ * Find and set a clear bit of a volume map in a range,
+ * searching from a cursor and wrapping around to the
+ * start of the range. The cursor is advanced past the bit.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param map FS_INODE_MAP or FS_BLOCK_MAP
+ * @param start the first bit of the range
+ * @param end the bit after the last bit of the range
+ * @param cursor the search position
+ * @return the bit number, -1 if all bits in range are set,
+ *  -error if error occurred
+ */
+int fs_map_alloc_in(struct fs_ext2 *fs, int map, int start, int end, int32_t *cursor)
+{
+    int from = ((*cursor >= start) && (*cursor < end)) ? *cursor : start;
+    int i = fs_map_find_zero(fs, map, from, end);
+    if ((i == -1) && (from > start)) {
+        i = fs_map_find_zero(fs, map, start, from);  // wrap around
+    }
+    if (i < 0) {
+        return i;
+    }
+    int status = fs_map_set(fs, map, i);
+    if (status < 0) {
+        return status;
+    }
+    *cursor = i + 1;
+    return i;
+}
@@ -0,0 +1,127 @@
+/*
+ * fs_util_map.h
+ *
+ * description: inode and block maps of a volume, kept
+ * in memory or paged in through the metadata cache
+ * for CS 7600 / CS 5600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Peter Desnoyers,  November 2016
+ * Philip Gust, March 2021
+ */
+
+#ifndef FS_UTIL_MAP_H_
+#define FS_UTIL_MAP_H_
+
+#include "fs_util_volume.h"
+
+/** volume maps */
+enum {
+    FS_INODE_MAP = 0,	/** map of allocated inodes */
+    FS_BLOCK_MAP = 1	/** map of allocated blocks */
+};
+
+/**
+ * Test a bit of a volume map.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param map FS_INODE_MAP or FS_BLOCK_MAP
+ * @param i the bit number
+ * @return 1 if set, 0 if clear, -error if error occurred
+ */
+int fs_map_test(struct fs_ext2 *fs, int map, int i);
+
+/**
+ * Set a bit of a volume map, marking its map block
+ * changed if the bit was clear.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param map FS_INODE_MAP or FS_BLOCK_MAP
+ * @param i the bit number
+ * @return 1 if the bit was clear, 0 if already set,
+ *  -error if error occurred
+ */
+int fs_map_set(struct fs_ext2 *fs, int map, int i);
+
+/**
+ * Clear a bit of a volume map, marking its map block
+ * changed if the bit was set.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param map FS_INODE_MAP or FS_BLOCK_MAP
+ * @param i the bit number
+ * @return 1 if the bit was set, 0 if already clear,
+ *  -error if error occurred
+ */
+int fs_map_clear(struct fs_ext2 *fs, int map, int i);
+
+/**
+ * Find the first clear bit of a volume map in a range.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param map FS_INODE_MAP or FS_BLOCK_MAP
+ * @param start the first bit to consider
+ * @param end the bit after the last bit to consider
+ * @return the bit number, -1 if none, -error if error occurred
+ */
+int fs_map_find_zero(struct fs_ext2 *fs, int map, int start, int end);
+
+/**
+ * Find the first set bit of a volume map in a range.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param map FS_INODE_MAP or FS_BLOCK_MAP
+ * @param start the first bit to consider
+ * @param end the bit after the last bit to consider
+ * @return the bit number, -1 if none, -error if error occurred
+ */
+int fs_map_find_set(struct fs_ext2 *fs, int map, int start, int end);
+
+/**
+ * Count the clear bits of a volume map in a range.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param map FS_INODE_MAP or FS_BLOCK_MAP
+ * @param start the first bit to count
+ * @param end the bit after the last bit to count
+ * @return the number of clear bits, -error if error occurred
+ */
+int fs_map_count_zero(struct fs_ext2 *fs, int map, int start, int end);
+
+/**
+ * Find and set a clear bit of a volume map in a range,
+ * searching from a cursor and wrapping around to the
+ * start of the range. The cursor is advanced past the bit.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param map FS_INODE_MAP or FS_BLOCK_MAP
+ * @param start the first bit of the range
+ * @param end the bit after the last bit of the range
+ * @param cursor the search position
+ * @return the bit number, -1 if all bits in range are set,
+ *  -error if error occurred
+ */
+int fs_map_alloc_in(struct fs_ext2 *fs, int map, int start, int end, int32_t *cursor);
+
+#endif /* FS_UTIL_MAP_H_ */
@@ -0,0 +1,312 @@
+/*
+ * fs_util_mcache.c
+ *
+ * description: cache of metadata blocks paged in on demand,
+ * evicting the least recently used clean block when full
+ * for CS 7600 / CS 5600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Peter Desnoyers,  November 2016
+ * Philip Gust, March 2021
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fs_util_mcache.h"
+#include "fs_dev_blkdev.h"
+
+/** cached metadata block */
+struct mblock {
+    int blkno;					/** block number */
+    int next;					/** next block in bucket or free list */
+    int lru_prev, lru_next;		/** least recently used list */
+    void *data;					/** block contents, kept when freed */
+};
+
+/** metadata block cache */
+struct fs_mcache {
+    const struct fs_bitmap *dirty;	/** map of changed blocks */
+    int max_blks;				/** blocks cached before evicting */
+    int blk_size;				/** block size in bytes */
+    int n_cached;				/** number of cached blocks */
+    int n_entries;				/** number of entries allocated */
+    int n_buckets;				/** number of hash buckets (power of 2) */
+    int *buckets;				/** first block in each bucket */
+    struct mblock *entries;		/** entry storage */
+    int free;					/** first free entry */
+    int lru_head;				/** most recently used block */
+    int lru_tail;				/** least recently used block */
+};
+
+/**
+ * Find the link to a cached block in its hash bucket.
+ *
+ * @param mc the cache
+ * @param blkno the block number
+ * @return link to the block, or to -1 at end of bucket
+ */
+static int *mblock_find(const struct fs_mcache *mc, int blkno)
+{
+    int *link = &mc->buckets[blkno & (mc->n_buckets-1)];
+    while ((*link >= 0) && (mc->entries[*link].blkno != blkno)) {
+        link = &mc->entries[*link].next;
+    }
+    return link;
+}
+
+/**
+ * Unlink a block from the least recently used list.
+ *
+ * @param mc the cache
+ * @param i the block index
+ */
+static void lru_unlink(struct fs_mcache *mc, int i)
+{
+    struct mblock *b = &mc->entries[i];
+    if (b->lru_prev >= 0) {
+        mc->entries[b->lru_prev].lru_next = b->lru_next;
+    } else {
+        mc->lru_head = b->lru_next;
+    }
+    if (b->lru_next >= 0) {
+        mc->entries[b->lru_next].lru_prev = b->lru_prev;
+    } else {
+        mc->lru_tail = b->lru_prev;
+    }
+}
+
+/**
+ * Push a block at the head of the least recently used list.
+ *
+ * @param mc the cache
+ * @param i the block index
+ */
+static void lru_push(struct fs_mcache *mc, int i)
+{
+    struct mblock *b = &mc->entries[i];
+    b->lru_prev = -1;
+    b->lru_next = mc->lru_head;
+    if (mc->lru_head >= 0) {
+        mc->entries[mc->lru_head].lru_prev = i;
+    } else {
+        mc->lru_tail = i;
+    }
+    mc->lru_head = i;
+}
+
+/**
+ * Remove a block from the cache, keeping its buffer
+ * with the free entry.
+ *
+ * @param mc the cache
+ * @param link the link to the block in its bucket
+ */
+static void mblock_remove(struct fs_mcache *mc, int *link)
+{
+    int i = *link;
+    *link = mc->entries[i].next;
+    lru_unlink(mc, i);
+    mc->entries[i].next = mc->free;
+    mc->free = i;
+    mc->n_cached--;
+}
+
+/**
+ * Add entries to the free list, doubling the entry storage.
+ *
+ * @param mc the cache
+ * @return 0 if successful, -1 if cannot allocate
+ */
+static int grow_entries(struct fs_mcache *mc)
+{
+    int n = (mc->n_entries == 0) ? mc->max_blks : 2*mc->n_entries;
+    struct mblock *entries = realloc(mc->entries, n * sizeof(struct mblock));
+    if (entries == NULL) {
+        return -1;
+    }
+    mc->entries = entries;
+    for (int i = mc->n_entries; i < n; i++) {
+        entries[i].data = NULL;
+        entries[i].next = (i+1 < n) ? i+1 : mc->free;
+    }
+    mc->free = mc->n_entries;
+    mc->n_entries = n;
+    return 0;
+}
+
+/**
+ * Create a metadata block cache. Blocks marked in the
+ * dirty map are never evicted; if every cached block is
+ * dirty, the cache grows past its limit until they are
+ * written and cleared from the map.
+ *
+ * @param n_blks maximum number of cached blocks,
+ *  at least FS_MCACHE_MIN_BLKS
+ * @param blk_size the block size in bytes
+ * @param dirty map of changed blocks
+ * @return the cache or NULL if cannot create
+ */
+struct fs_mcache *fs_mcache_create(int n_blks, int blk_size, const struct fs_bitmap *dirty)
+{
+    struct fs_mcache *mc = calloc(1, sizeof(struct fs_mcache));
+    if (mc == NULL) {
+        return NULL;
+    }
+    mc->dirty = dirty;
+    mc->blk_size = blk_size;
+    mc->max_blks = (n_blks > FS_MCACHE_MIN_BLKS) ? n_blks : FS_MCACHE_MIN_BLKS;
+    for (mc->n_buckets = 1; mc->n_buckets < mc->max_blks; mc->n_buckets *= 2) {
+    }
+    mc->free = mc->lru_head = mc->lru_tail = -1;
+    mc->buckets = malloc(mc->n_buckets * sizeof(int));
+    if ((mc->buckets == NULL) || (grow_entries(mc) != 0)) {
+        fs_mcache_destroy(mc);
+        return NULL;
+    }
+
+    // all buckets empty
+    memset(mc->buckets, -1, mc->n_buckets * sizeof(int));
+    return mc;
+}
+
+/**
+ * Destroy a metadata block cache.
+ *
+ * @param mc the cache
+ */
+void fs_mcache_destroy(struct fs_mcache *mc)
+{
+    if (mc != NULL) {
+        for (int i = 0; i < mc->n_entries; i++) {
+            free(mc->entries[i].data);
+        }
+        free(mc->buckets);
+        free(mc->entries);
+        free(mc);
+    }
+}
+
+/**
+ * Look up a cached block, making it the most
+ * recently used block.
+ *
+ * @param mc the cache
+ * @param blkno the block number
+ * @return the cached block or NULL if not cached
+ */
+void *fs_mcache_lookup(struct fs_mcache *mc, int blkno)
+{
+    int i = *mblock_find(mc, blkno);
+    if (i < 0) {
+        return NULL;
+    }
+
+    // move to head of least recently used list
+    if (i != mc->lru_head) {
+        lru_unlink(mc, i);
+        lru_push(mc, i);
+    }
+    return mc->entries[i].data;
+}
+
+/**
+ * Look up a cached block without changing its use.
+ *
+ * @param mc the cache
+ * @param blkno the block number
+ * @return the cached block or NULL if not cached
+ */
+void *fs_mcache_peek(const struct fs_mcache *mc, int blkno)
+{
+    int i = *mblock_find(mc, blkno);
+    return (i < 0) ? NULL : mc->entries[i].data;
+}
+
+/**
+ * Add a block that is not cached, evicting the least
+ * recently used clean block if the cache is full. The
+ * caller fills in the returned buffer.
+ *
+ * @param mc the cache
+ * @param blkno the block number
+ * @return buffer for the block or NULL if cannot allocate
+ */
+void *fs_mcache_insert(struct fs_mcache *mc, int blkno)
+{
+    // evict least recently used clean block if full
+    if (mc->n_cached >= mc->max_blks) {
+        int i = mc->lru_tail;
+        while ((i >= 0) && fs_bitmap_test(mc->dirty, mc->entries[i].blkno)) {
+            i = mc->entries[i].lru_prev;
+        }
+        if (i >= 0) {
+            mblock_remove(mc, mblock_find(mc, mc->entries[i].blkno));
+        }
+    }
+
+    // take a free entry, growing past the limit if all are dirty
+    if ((mc->free < 0) && (grow_entries(mc) != 0)) {
+        return NULL;
+    }
+    int i = mc->free;
+    struct mblock *b = &mc->entries[i];
+    if ((b->data == NULL) && ((b->data = malloc(mc->blk_size)) == NULL)) {
+        return NULL;
+    }
+    mc->free = b->next;
+
+    // add block at head of bucket
+    b->blkno = blkno;
+    int *bucket = &mc->buckets[blkno & (mc->n_buckets-1)];
+    b->next = *bucket;
+    *bucket = i;
+    lru_push(mc, i);
+    mc->n_cached++;
+    return b->data;
+}
+
+/**
+ * Remove a block from the cache.
+ *
+ * @param mc the cache
+ * @param blkno the block number
+ */
+void fs_mcache_remove(struct fs_mcache *mc, int blkno)
+{
+    int *link = mblock_find(mc, blkno);
+    if (*link >= 0) {
+        mblock_remove(mc, link);
+    }
+}
+
+/**
+ * Evict least recently used clean blocks and free their
+ * buffers until the cache is within its limit, after
+ * dirty blocks that made it grow have been written.
+ *
+ * @param mc the cache
+ */
+void fs_mcache_trim(struct fs_mcache *mc)
+{
+    for (int i = mc->lru_tail; (i >= 0) && (mc->n_cached > mc->max_blks); ) {
+        int prev = mc->entries[i].lru_prev;
+        if (!fs_bitmap_test(mc->dirty, mc->entries[i].blkno)) {
+            mblock_remove(mc, mblock_find(mc, mc->entries[i].blkno));
+            free(mc->entries[i].data);
+            mc->entries[i].data = NULL;
+        }
+        i = prev;
+    }
+}
+
+/**
+ * Get the number of cached blocks.
+ *
+ * @param mc the cache
+ * @return the number of cached blocks
+ */
+int fs_mcache_size(const struct fs_mcache *mc)
+{
+    return mc->n_cached;
+}
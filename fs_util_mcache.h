@@ -0,0 +1,100 @@
+/*
+ * fs_util_mcache.h
+ *
+ * description: cache of metadata blocks paged in on demand,
+ * evicting the least recently used clean block when full
+ * for CS 7600 / CS 5600 file system
+ *
+ * CS 5600, Computer Systems, Northeastern CCIS
+ * Peter Desnoyers,  November 2016
+ * Philip Gust, March 2021
+ */
+
+#ifndef FS_UTIL_MCACHE_H_
+#define FS_UTIL_MCACHE_H_
+
+#include "fs_util_bitmap.h"
+
+/** minimum number of blocks in a metadata cache */
+enum { FS_MCACHE_MIN_BLKS = 8 };
+
+/** struct for a metadata block cache */
+struct fs_mcache;
+
+/**
+ * Create a metadata block cache. Blocks marked in the
+ * dirty map are never evicted; if every cached block is
+ * dirty, the cache grows past its limit until they are
+ * written and cleared from the map.
+ *
+ * @param n_blks maximum number of cached blocks,
+ *  at least FS_MCACHE_MIN_BLKS
+ * @param blk_size the block size in bytes
+ * @param dirty map of changed blocks
+ * @return the cache or NULL if cannot create
+ */
+struct fs_mcache *fs_mcache_create(int n_blks, int blk_size, const struct fs_bitmap *dirty);
+
+/**
+ * Destroy a metadata block cache.
+ *
+ * @param mc the cache
+ */
+void fs_mcache_destroy(struct fs_mcache *mc);
+
+/**
+ * Look up a cached block, making it the most
+ * recently used block.
+ *
+ * @param mc the cache
+ * @param blkno the block number
+ * @return the cached block or NULL if not cached
+ */
+void *fs_mcache_lookup(struct fs_mcache *mc, int blkno);
+
+/**
+ * Look up a cached block without changing its use.
+ *
+ * @param mc the cache
+ * @param blkno the block number
+ * @return the cached block or NULL if not cached
+ */
+void *fs_mcache_peek(const struct fs_mcache *mc, int blkno);
+
+/**
+ * Add a block that is not cached, evicting the least
+ * recently used clean block if the cache is full. The
+ * caller fills in the returned buffer.
+ *
+ * @param mc the cache
+ * @param blkno the block number
+ * @return buffer for the block or NULL if cannot allocate
+ */
+void *fs_mcache_insert(struct fs_mcache *mc, int blkno);
+
+/**
+ * Remove a block from the cache.
+ *
+ * @param mc the cache
+ * @param blkno the block number
+ */
+void fs_mcache_remove(struct fs_mcache *mc, int blkno);
+
+/**
+ * Evict least recently used clean blocks and free their
+ * buffers until the cache is within its limit, after
+ * dirty blocks that made it grow have been written.
+ *
+ * @param mc the cache
+ */
+void fs_mcache_trim(struct fs_mcache *mc);
+
+/**
+ * Get the number of cached blocks.
+ *
+ * @param mc the cache
+ * @return the number of cached blocks
+ */
+int fs_mcache_size(const struct fs_mcache *mc);
+
+#endif /* FS_UTIL_MCACHE_H_ */
@@ -11,10 +11,18 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
 #include "fs_dev_blkdev.h"
+#include "fs_dev_scaledev.h"
 #include "fs_util_volume.h"
+#include "fs_util_journal.h"
+#include "fs_util_map.h"
 #include "fsx600.h"
 
+/** paged blocks written by one sync call */
+enum {SYNC_BATCH = 16};
+
 /**
  * Calculate highest multiple m of n
  *
@@ -26,6 +34,56 @@ static inline int div_round_up(int n, int m) {
     return (n + m - 1) / m;
 }
 
+/**
+ * Resident copy of a metadata block.
+ *
+ * @param fs the file system
+ * @param blkno the metadata block number
+ * @return the block in the volume metadata
+ */
+static inline void *meta_at(const struct fs_ext2 *fs, int blkno) {
+    return fs->meta + (size_t)blkno * fs->blk_size;
+}
+
+/**
+ * Read the volume metadata blocks. Inode blocks of groups
+ * not written since format are zeroed rather than read;
+ * the other blocks are read with one call per run.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param sb the superblock
+ * @param n_meta number of metadata blocks
+ * @return 0 if successful, -error if error occurred
+ */
+static int read_meta(struct fs_ext2 *fs, const struct fs_super *sb, int n_meta)
+{
+    struct fs_dev_blkdev *dev = fs->dev;
+    int inode_base = 1 + sb->group_desc_sz + sb->inode_map_sz + sb->block_map_sz;
+    int group_iblks = (sb->group_blks != 0) ? sb->group_inodes / INODES_PER_BLK(fs->blk_size)
+                                            : sb->inode_region_sz;
+    if (group_iblks <= 0) {
+        group_iblks = n_meta - inode_base;
+    }
+
+    int first = 0;  // first block of run to read
+    for (int blkno = inode_base; blkno < n_meta; blkno += group_iblks) {
+        if (fs_itable_uninit(sb, (blkno - inode_base) / group_iblks)) {
+            if (dev->ops->read(dev, first, blkno - first, meta_at(fs, first)) != SUCCESS) {
+                return -EIO;
+            }
+            memset(meta_at(fs, blkno), 0, (size_t)group_iblks * fs->blk_size);
+            first = blkno + group_iblks;
+        }
+    }
+    if ((n_meta > first) && (dev->ops->read(dev, first, n_meta - first, meta_at(fs, first)) != SUCCESS)) {
+        return -EIO;
+    }
+    return 0;
+}
+
 /**
  * Mount a ext2 file system volume on a block device.
  *
@@ -35,16 +93,30 @@ static inline int div_round_up(int n, int m) {
  */
 struct fs_ext2 *fs_mount_volume(struct fs_dev_blkdev* dev)
 {
-    block *meta = NULL;
-    struct fs_ext2 *fs = malloc(sizeof (struct fs_ext2));
+    struct fs_mount_opts opts = {.mcache_blks = 0};
+    return fs_mount_volume_opts(dev, &opts);
+}
+
+/**
+ * Mount a file system volume on a block device with options.
+ * With a positive mcache_blks, only the superblock and the
+ * group descriptors are read at mount; map and inode blocks
+ * are paged in on first use and the least recently used
+ * clean blocks are evicted to keep at most mcache_blks cached.
+ *
+ * @param disk the block device
+ * @param opts the mount options
+ * @return file system volume or NULL if cannot
+ */
+struct fs_ext2 *fs_mount_volume_opts(struct fs_dev_blkdev* dev, const struct fs_mount_opts *opts)
+{
+    struct fs_ext2 *fs = calloc(1, sizeof (struct fs_ext2));
     if (fs == NULL) {
         goto err;
     }
-    // initialize file system params
-    fs->dev = dev;
-    fs->n_blocks = dev->ops->num_blocks(dev);
+    fs->disk = dev;
 
-    // read the superblock
+    // read the superblock from the start of block 0
     struct fs_super sb;
     if (dev->ops->read(dev, 0, 1, &sb) < 0) {
         goto err;
@@ -55,16 +127,80 @@ struct fs_ext2 *fs_mount_volume(struct fs_dev_blkdev* dev)
         goto err;
     }
 
-    // read volume metadata
-    fs->n_meta = 1 + sb.inode_map_sz + sb.block_map_sz + sb.inode_region_sz;
-    meta = malloc(fs->n_meta*FS_BLOCK_SIZE);
-    if (meta == NULL) {
+    // volumes formatted before the block size was
+    // recorded have 1024 byte blocks
+    fs->blk_size = (sb.blk_size != 0) ? (int)sb.blk_size : FS_MIN_BLOCK_SIZE;
+    if (!FS_VALID_BLK_SIZE(fs->blk_size)) {
+        goto err;
+    }
+
+    // address the device in blocks of the volume
+    fs->dev = dev;
+    if (fs->blk_size != BLOCK_SIZE) {
+        fs->dev = scale_blkdev_create(dev, fs->blk_size / BLOCK_SIZE);
+        if (fs->dev == NULL) {
+            goto err;
+        }
+    }
+    fs->n_blocks = fs->dev->ops->num_blocks(fs->dev);
+
+    // set metadata layout
+    fs->n_meta = 1 + sb.group_desc_sz + sb.inode_map_sz + sb.block_map_sz + sb.inode_region_sz;
+    fs->group_desc_base = (sb.group_desc_sz != 0) ? 1 : 0;
+    fs->inode_map_base = 1 + sb.group_desc_sz;
+    fs->block_map_base = fs->inode_map_base + sb.inode_map_sz;
+    fs->inode_base = fs->block_map_base + sb.block_map_sz;
+
+    // set number of inodes
+    fs->n_inodes = (sb.num_inodes != 0) ? (int)sb.num_inodes
+                                        : (int)sb.inode_region_sz * INODES_PER_BLK(fs->blk_size);
+
+    // set block groups; volumes without groups have one
+    fs->group_blks = (sb.group_blks != 0) ? (int)sb.group_blks : fs->n_blocks;
+    fs->group_inodes = (sb.group_blks != 0) ? (int)sb.group_inodes : fs->n_inodes;
+    fs->n_groups = div_round_up(fs->n_blocks, fs->group_blks);
+
+    // read volume metadata; paged map and inode blocks are read on first use
+    int paged = (opts->mcache_blks > 0);
+    int n_resident = paged ? fs->inode_map_base : fs->n_meta;
+    fs->meta = malloc((size_t)n_resident * fs->blk_size);
+    if (fs->meta == NULL) {
+        goto err;
+    }
+    if (read_meta(fs, &sb, n_resident) != 0) {
+        goto err;
+    }
+    fs->super = meta_at(fs, 0);
+    fs->inodes = paged ? NULL : meta_at(fs, fs->inode_base);
+
+    // set metadata map to mark modified metadata blocks
+    fs->meta_map = fs_bitmap_create(NULL, fs->n_meta);
+    if (fs->meta_map == NULL) {
+        goto err;
+    }
+    if (paged) {
+        fs->mcache = fs_mcache_create(opts->mcache_blks, fs->blk_size, fs->meta_map);
+        if (fs->mcache == NULL) {
+            goto err;
+        }
+    }
+
+    // hold changed and logged directory, index, indirect, and extent blocks
+    fs->blk_held = fs_bitmap_create(NULL, fs->n_blocks);
+    fs->blk_map = fs_bitmap_create(NULL, fs->n_blocks);
+    if ((fs->blk_held == NULL) || (fs->blk_map == NULL)) {
         goto err;
     }
-    if (dev->ops->read(dev, 0, fs->n_meta, meta) < 0) {
+    fs->blk_cache = fs_mcache_create(FS_MCACHE_MIN_BLKS, fs->blk_size, fs->blk_held);
+    if (fs->blk_cache == NULL) {
         goto err;
     }
-    fs->meta = meta;
+
+    // replay committed journal transactions into metadata
+    if (fs_journal_replay(fs, &sb) != 0) {
+        goto err;
+    }
+    sb = *fs->super;
 
     // record root inode
     fs->root_inode = sb.root_inode;
@@ -73,36 +209,288 @@ struct fs_ext2 *fs_mount_volume(struct fs_dev_blkdev* dev)
     fs->ignore_case = sb.ignore_case;
     fs->fold_case = sb.fold_case;
 
-    // read inode map
-    fs->inode_map_base = 1;
-    fs->inode_map = (void*)&meta[fs->inode_map_base];
+    // set inode and block maps; paged maps are read on first use
+    if (!paged) {
+        fs->inode_map = fs_bitmap_create(meta_at(fs, fs->inode_map_base), fs->n_inodes);
+        if (fs->inode_map == NULL) {
+            goto err;
+        }
+        fs->block_map = fs_bitmap_create(meta_at(fs, fs->block_map_base), fs->n_blocks);
+        if (fs->block_map == NULL) {
+            goto err;
+        }
+        fs->free_tree = fs_freetree_create(fs->block_map);
+        if (fs->free_tree == NULL) {
+            goto err;
+        }
+    }
 
-    // set block map
-    fs->block_map_base = fs->inode_map_base + sb.inode_map_sz;
-    fs->block_map = (void*)&meta[fs->block_map_base];
+    // set block group counts; descriptors are checked on
+    // first use, and volumes without them are counted now
+    if (fs->group_desc_base != 0) {
+        fs->groups = meta_at(fs, fs->group_desc_base);
+        fs->group_checked = fs_bitmap_create(NULL, fs->n_groups);
+        if (fs->group_checked == NULL) {
+            goto err;
+        }
+    } else {
+        fs->groups = calloc(fs->n_groups, sizeof(struct fs_group_desc));
+        if (fs->groups == NULL) {
+            goto err;
+        }
+        fs_count_groups(fs);
+    }
+    fs->features = sb.features;
 
-    // set inodes
-    fs->inode_base = fs->block_map_base + sb.block_map_sz;
-    fs->inodes = (void*)&meta[fs->inode_base];
 
-    // set number of inodes
-    fs->n_inodes = sb.inode_region_sz * INODES_PER_BLK;
+    memset(&fs->sync_stats, 0, sizeof(fs->sync_stats));
+    fs->n_dirty = 0;
 
+    // sync metadata after every operation by default
+    fs->sync_mode = FS_SYNC_ALWAYS;
+    fs->sync_max_dirty = FS_SYNC_MAX_DIRTY;
+    fs->sync_interval = FS_SYNC_INTERVAL;
+    fs->last_sync = time(NULL);
 
-    // set metadata map to mark modified metadata blocks
-    const int n_meta_map = div_round_up(fs->n_meta, 8);
-    fs->meta_map = malloc(n_meta_map);
-    memset(fs->meta_map, 0, n_meta_map);
+    // verify free counts in superblock, repairing them from the groups
+    uint32_t free_blocks = 0, free_inodes = 0;
+    for (int g = 0; g < fs->n_groups; g++) {
+        free_blocks += fs->groups[g].free_blocks;
+        free_inodes += fs->groups[g].free_inodes;
+    }
+    if ((fs->super->free_blocks != free_blocks) || (fs->super->free_inodes != free_inodes)) {
+        fs->super->free_blocks = free_blocks;
+        fs->super->free_inodes = free_inodes;
+        fs_mark_super(fs);
+    }
+
+    // no transaction active
+    fs->txn_active = 0;
+
+    // create directory entry cache
+    fs->dcache = fs_dcache_create(FS_DCACHE_ENTRIES, fs->ignore_case);
+    if (fs->dcache == NULL) {
+        goto err;
+    }
 
     // return mounted fs volume
     return fs;
 
     err:  // cleanup if error
+    if (fs != NULL) {
+        fs_bitmap_destroy(fs->meta_map);
+        fs_bitmap_destroy(fs->inode_map);
+        fs_bitmap_destroy(fs->block_map);
+        fs_freetree_destroy(fs->free_tree);
+        fs_bitmap_destroy(fs->group_checked);
+        fs_mcache_destroy(fs->mcache);
+        fs_mcache_destroy(fs->blk_cache);
+        fs_bitmap_destroy(fs->blk_held);
+        fs_bitmap_destroy(fs->blk_map);
+        free(fs->journal_map);
+        free(fs->journal_blks);
+        if (fs->group_desc_base == 0) {
+            free(fs->groups);
+        }
+        if ((fs->dev != NULL) && (fs->dev != dev)) {
+            fs->dev->ops->close(fs->dev);
+        }
+        free(fs->meta);
+    }
     free(fs);
-    free(meta);
     return NULL;
 }
 
+/**
+ * Recompute the free and directory counts of the
+ * block groups from the inode and block maps.
+ *
+ * @param fs the file system
+ */
+void fs_count_groups(struct fs_ext2 *fs) {
+    for (int g = 0; g < fs->n_groups; g++) {
+        struct fs_group_desc *gd = &fs->groups[g];
+        int free_blocks = fs_map_count_zero(fs, FS_BLOCK_MAP, g*fs->group_blks, (g+1)*fs->group_blks);
+        int free_inodes = fs_map_count_zero(fs, FS_INODE_MAP, g*fs->group_inodes, (g+1)*fs->group_inodes);
+        gd->free_blocks = (free_blocks > 0) ? free_blocks : 0;  // unreadable map is full
+        gd->free_inodes = (free_inodes > 0) ? free_inodes : 0;
+        gd->n_dirs = 0;
+    }
+
+    // count directories of allocated inodes
+    for (int ino = fs_map_find_set(fs, FS_INODE_MAP, 1, fs->n_inodes); ino >= 0;
+         ino = fs_map_find_set(fs, FS_INODE_MAP, ino+1, fs->n_inodes)) {
+        const struct fs_inode *in = fs_inode(fs, ino);
+        if ((in != NULL) && S_ISDIR(in->mode)) {
+            fs->groups[ino / fs->group_inodes].n_dirs++;
+        }
+    }
+}
+
+/**
+ * Check the free counts of a block group descriptor
+ * against the inode and block maps on first use of the
+ * group, repairing them and the superblock totals if they
+ * differ. The directory count is only a placement hint;
+ * it is kept within the number of inodes in use.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param g the block group
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_check_group(struct fs_ext2 *fs, int g) {
+    if ((fs->group_checked == NULL) || fs_bitmap_test(fs->group_checked, g)) {
+        return 0;
+    }
+    int free_blocks = fs_map_count_zero(fs, FS_BLOCK_MAP, g*fs->group_blks, (g+1)*fs->group_blks);
+    int free_inodes = fs_map_count_zero(fs, FS_INODE_MAP, g*fs->group_inodes, (g+1)*fs->group_inodes);
+    if ((free_blocks < 0) || (free_inodes < 0)) {
+        return -EIO;
+    }
+
+    struct fs_group_desc *gd = &fs->groups[g];
+    if ((gd->free_blocks != free_blocks) || (gd->free_inodes != free_inodes)) {
+        fs->super->free_blocks += free_blocks - gd->free_blocks;
+        fs->super->free_inodes += free_inodes - gd->free_inodes;
+        gd->free_blocks = free_blocks;
+        gd->free_inodes = free_inodes;
+        fs_mark_super(fs);
+        fs_mark_group(fs, g);
+    }
+    int max_dirs = fs->group_inodes - free_inodes;
+    if ((gd->n_dirs < 0) || (gd->n_dirs > max_dirs)) {
+        gd->n_dirs = (gd->n_dirs < 0) ? 0 : max_dirs;
+        fs_mark_group(fs, g);
+    }
+    fs_bitmap_set(fs->group_checked, g);
+    return 0;
+}
+
+/**
+ * Write the zeroed inode blocks of a block group on
+ * first use, and record in the superblock that they
+ * are written. Does nothing if already written.
+ *
+ * Errors
+ *   -ENOMEM   - cannot allocate zeroed blocks
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param group the block group
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_init_itable(struct fs_ext2 *fs, int group)
+{
+    if (!fs_itable_uninit(fs->super, group)) {
+        return 0;
+    }
+
+    // blocks are written before the superblock records it
+    int group_iblks = fs->group_inodes / INODES_PER_BLK(fs->blk_size);
+    int first = fs->inode_base + group * group_iblks;
+    if (fs->inodes != NULL) {
+        if (fs->dev->ops->write(fs->dev, first, group_iblks, meta_at(fs, first)) != SUCCESS) {
+            return -EIO;
+        }
+    } else {
+        // paged blocks of the group are zero until written
+        void *zero = calloc(group_iblks, fs->blk_size);
+        if (zero == NULL) {
+            return -ENOMEM;
+        }
+        int status = fs->dev->ops->write(fs->dev, first, group_iblks, zero);
+        free(zero);
+        if (status != SUCCESS) {
+            return -EIO;
+        }
+    }
+    fs->super->itable_uninit[group / 64] &= ~((uint64_t)1 << (group % 64));
+    fs_mark_super(fs);
+    return 0;
+}
+
+/**
+ * Get the in-memory copy of a metadata block, reading it
+ * if it is a paged map or inode block that is not cached.
+ *
+ * @param fs the file system
+ * @param blkno the metadata block number
+ * @return the block or NULL if it cannot be read
+ */
+void *fs_meta_blk(struct fs_ext2 *fs, int blkno) {
+    if ((fs->mcache == NULL) || (blkno < fs->inode_map_base)) {
+        return meta_at(fs, blkno);
+    }
+    void *buf = fs_mcache_lookup(fs->mcache, blkno);
+    if (buf != NULL) {
+        return buf;
+    }
+
+    // read latest committed copy; inode blocks of groups
+    // not written since format are zero
+    buf = fs_mcache_insert(fs->mcache, blkno);
+    if (buf == NULL) {
+        return NULL;
+    }
+    if (   (blkno >= fs->inode_base)
+        && fs_itable_uninit(fs->super,
+                            (blkno - fs->inode_base) / (fs->group_inodes / INODES_PER_BLK(fs->blk_size)))) {
+        memset(buf, 0, fs->blk_size);
+    } else if (fs_journal_read_blk(fs, blkno, buf) != 0) {
+        fs_mcache_remove(fs->mcache, blkno);
+        return NULL;
+    }
+    return buf;
+}
+
+/**
+ * Get the in-memory copy of a metadata block without
+ * reading it.
+ *
+ * @param fs the file system
+ * @param blkno the metadata block number
+ * @return the block or NULL if it is not cached
+ */
+void *fs_meta_cached(struct fs_ext2 *fs, int blkno) {
+    if ((fs->mcache == NULL) || (blkno < fs->inode_map_base)) {
+        return meta_at(fs, blkno);
+    }
+    return fs_mcache_peek(fs->mcache, blkno);
+}
+
+/**
+ * Get a paged inode, reading its block if not cached.
+ *
+ * @param fs the file system
+ * @param ino the inode
+ * @return the inode or NULL if its block cannot be read
+ */
+struct fs_inode *fs_inode_paged(struct fs_ext2 *fs, int ino) {
+    int per_blk = INODES_PER_BLK(fs->blk_size);
+    struct fs_inode *inodes = fs_meta_blk(fs, fs->inode_base + ino/per_blk);
+    return (inodes != NULL) ? &inodes[ino % per_blk] : NULL;
+}
+
+/**
+ * Get an inode to change, marking it changed. A paged
+ * inode block stays cached while it is changed, so the
+ * pointer remains valid until metadata is synchronized.
+ *
+ * @param fs the file system
+ * @param ino the inode
+ * @return the inode or NULL if its block cannot be read
+ */
+struct fs_inode *fs_inode_mut(struct fs_ext2 *fs, int ino) {
+    struct fs_inode *in = (fs->inodes != NULL) ? &fs->inodes[ino] : fs_inode_paged(fs, ino);
+    if (in != NULL) {
+        fs_mark_inode(fs, ino);  // changed blocks are not evicted
+    }
+    return in;
+}
+
 /**
  * Mark inode metadata changed.
  *
@@ -110,13 +498,25 @@ struct fs_ext2 *fs_mount_volume(struct fs_dev_blkdev* dev)
  * @param ino the inode
  */
 void fs_mark_inode(struct fs_ext2 *fs, int ino) {
-    // mark inode map block changed
-    int inode_map_blk = fs->inode_map_base + ino/BITS_PER_BLK;
-    FD_SET(inode_map_blk, fs->meta_map);
+    // mark inode map and inode blocks changed; a paged
+    // block that is not cached has not been changed
+    int inode_map_blk = fs->inode_map_base + ino/BITS_PER_BLK(fs->blk_size);
+    if (fs_meta_cached(fs, inode_map_blk) != NULL) {
+        fs->n_dirty += fs_bitmap_set(fs->meta_map, inode_map_blk);
+    }
+    int inode_blk = fs->inode_base + ino/INODES_PER_BLK(fs->blk_size);
+    if (fs_meta_cached(fs, inode_blk) != NULL) {
+        fs->n_dirty += fs_bitmap_set(fs->meta_map, inode_blk);
+    }
+}
 
-    // mark inode block changed
-    int inode_blk = fs->inode_base + ino/INODES_PER_BLK;
-    FD_SET(inode_blk, fs->meta_map);
+/**
+ * Mark superblock metadata changed.
+ *
+ * @param fs the file system
+ */
+void fs_mark_super(struct fs_ext2 *fs) {
+    fs->n_dirty += fs_bitmap_set(fs->meta_map, 0);
 }
 
 /**
@@ -126,58 +526,406 @@ void fs_mark_inode(struct fs_ext2 *fs, int ino) {
  * @param ino the inode
  */
 void fs_mark_blk(struct fs_ext2 *fs, int blk) {
-    int blk_map_blk = fs->block_map_base + blk/BITS_PER_BLK;
-    FD_SET(blk_map_blk, fs->meta_map);
+    // a paged block that is not cached has not been changed
+    int blk_map_blk = fs->block_map_base + blk/BITS_PER_BLK(fs->blk_size);
+    if (fs_meta_cached(fs, blk_map_blk) != NULL) {
+        fs->n_dirty += fs_bitmap_set(fs->meta_map, blk_map_blk);
+    }
+}
+
+/**
+ * Mark block group descriptor changed.
+ *
+ * @param fs the file system
+ * @param g the block group
+ */
+void fs_mark_group(struct fs_ext2 *fs, int g) {
+    // counted groups of volumes without descriptors are not stored
+    if (fs->group_desc_base != 0) {
+        fs->n_dirty += fs_bitmap_set(fs->meta_map, fs->group_desc_base + g/GROUP_DESCS_PER_BLK(fs->blk_size));
+    }
+}
+
+/**
+ * Determine whether a block is held in memory.
+ *
+ * @param fs the file system
+ * @param blkno the block number
+ * @return 1 if held, 0 if not
+ */
+static inline int blk_is_held(const struct fs_ext2 *fs, int blkno) {
+    return (blkno >= 0) && (blkno < fs->n_blocks) && fs_bitmap_test(fs->blk_held, blkno);
+}
+
+/**
+ * Read a directory, index, indirect, or extent block
+ * of a file. A block changed or logged since the last
+ * checkpoint is read from memory.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param blkno the block number
+ * @param buf buffer for the block
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_blk_read(struct fs_ext2 *fs, int blkno, void *buf) {
+    if (blk_is_held(fs, blkno)) {
+        memcpy(buf, fs_mcache_peek(fs->blk_cache, blkno), fs->blk_size);
+        return 0;
+    }
+    return (fs->dev->ops->read(fs->dev, blkno, 1, buf) == SUCCESS) ? 0 : -EIO;
+}
+
+/**
+ * Write a directory, index, indirect, or extent block
+ * of a file. On a volume with a journal, or during a
+ * transaction, the block is held in memory and committed
+ * with the metadata; otherwise it is written in place.
+ *
+ * Errors
+ *   -ENOMEM   - cannot allocate held block
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param blkno the block number
+ * @param buf the block contents
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_blk_write(struct fs_ext2 *fs, int blkno, void *buf) {
+    if ((fs->journal_base == 0) && !fs->txn_active) {
+        return (fs->dev->ops->write(fs->dev, blkno, 1, buf) == SUCCESS) ? 0 : -EIO;
+    }
+    if ((blkno < 0) || (blkno >= fs->n_blocks)) {
+        return -EIO;
+    }
+
+    // held blocks are not evicted
+    void *held = fs_mcache_peek(fs->blk_cache, blkno);
+    if (held == NULL) {
+        held = fs_mcache_insert(fs->blk_cache, blkno);
+        if (held == NULL) {
+            return -ENOMEM;
+        }
+        fs_bitmap_set(fs->blk_held, blkno);
+    }
+    memcpy(held, buf, fs->blk_size);
+    fs->n_dirty += fs_bitmap_set(fs->blk_map, blkno);
+    return 0;
+}
+
+/**
+ * Stop holding a block in memory.
+ *
+ * @param fs the file system
+ * @param blkno the block number
+ */
+static void blk_unhold(struct fs_ext2 *fs, int blkno) {
+    fs_bitmap_clear(fs->blk_held, blkno);
+    fs_mcache_remove(fs->blk_cache, blkno);
+}
+
+/**
+ * Release a block that is being freed. Its changed copy
+ * is dropped, and if it was logged the journal is first
+ * checkpointed, so that replay cannot overwrite the block
+ * once it is reused.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param blkno the block number
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_blk_release(struct fs_ext2 *fs, int blkno) {
+    if (!blk_is_held(fs, blkno)) {
+        return 0;
+    }
+    if (fs_journal_logged(fs, blkno) && (fs_journal_checkpoint(fs) != 0)) {
+        return -EIO;
+    }
+    fs->n_dirty -= fs_bitmap_clear(fs->blk_map, blkno);
+    blk_unhold(fs, blkno);
+    return 0;
+}
+
+/**
+ * Drop the changes to held blocks since the last commit,
+ * restoring the latest committed copy of logged blocks.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_blk_discard(struct fs_ext2 *fs) {
+    // logged blocks that cannot be read remain changed
+    int status = 0;
+    for (int i = fs_bitmap_find_set(fs->blk_map, 0); i >= 0; i = fs_bitmap_find_set(fs->blk_map, i+1)) {
+        if (!fs_journal_logged(fs, i)) {
+            blk_unhold(fs, i);
+        } else if (fs_journal_read_blk(fs, i, fs_mcache_peek(fs->blk_cache, i)) != 0) {
+            status = -EIO;
+            continue;
+        }
+        fs_bitmap_clear(fs->blk_map, i);
+        fs->n_dirty--;
+    }
+    fs_mcache_trim(fs->blk_cache);
+    return status;
+}
+
+/**
+ * Write the changed held blocks in place, and stop
+ * holding them. Blocks must not have logged copies.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @return 0 if successful, -error if error occurred
+ */
+static int write_held(struct fs_ext2 *fs) {
+    struct blkdev_iovec iov[SYNC_BATCH];
+    int i = fs_bitmap_find_set(fs->blk_map, 0);
+    while (i >= 0) {
+        int n = 0;
+        for ( ; (n < SYNC_BATCH) && (i >= 0); i = fs_bitmap_find_set(fs->blk_map, i+1)) {
+            iov[n++] = (struct blkdev_iovec) {.blkno = i, .buf = fs_mcache_peek(fs->blk_cache, i)};
+        }
+        fs->sync_stats.last_calls++;
+        if (blkdev_writev(fs->dev, iov, n) != SUCCESS) {
+            return -EIO;  // blocks remain changed
+        }
+        fs->sync_stats.last_blocks += n;
+        fs->n_dirty -= n;
+        for (int k = 0; k < n; k++) {
+            fs_bitmap_clear(fs->blk_map, iov[k].blkno);
+            blk_unhold(fs, iov[k].blkno);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Write a run of metadata blocks to disk. Resident
+ * blocks are written directly; paged map and inode
+ * blocks are gathered from the cache.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param first the first block
+ * @param len the number of blocks
+ * @return 0 if successful, -error if error occurred
+ */
+static int write_meta(struct fs_ext2 *fs, int first, int len) {
+    if ((fs->mcache == NULL) || (first + len <= fs->inode_map_base)) {
+        return (fs->dev->ops->write(fs->dev, first, len, meta_at(fs, first)) == SUCCESS) ? 0 : -EIO;
+    }
+
+    struct blkdev_iovec iov[SYNC_BATCH];
+    for (int i = 0; i < len; ) {
+        int n = 0;
+        for ( ; (n < SYNC_BATCH) && (i < len); n++, i++) {
+            iov[n] = (struct blkdev_iovec) {.blkno = first+i, .buf = fs_meta_cached(fs, first+i)};
+        }
+        if (blkdev_writev(fs->dev, iov, n) != SUCCESS) {
+            return -EIO;
+        }
+    }
+    return 0;
 }
 
 /**
  * Synchronize changed file system volume metadata
- * blocks to disk.
+ * blocks and held blocks to disk. Each run of adjacent
+ * changed metadata blocks is written with one device call.
+ *
+ * Errors
+ *   -ENOMEM   - cannot allocate journal transaction
+ *   -EIO      - i/o error
  *
  * @param fs the file system
+ * @return 0 if successful, -error if error occurred
  */
-void fs_sync_metadata(struct fs_ext2 *fs) {
-    // write changed metadata blocks to disk
-    for (int i = 0; i < fs->n_meta; i++) {
-        if (FD_ISSET(i, fs->meta_map)) {
-            fs->dev->ops->write(fs->dev, i, 1, fs->meta[i]);
-            FD_CLR(i, fs->meta_map);
+int fs_sync_metadata(struct fs_ext2 *fs) {
+    int status = 0;
+    fs->sync_stats.last_blocks = 0;
+    fs->sync_stats.last_calls = 0;
+
+    // commit changed blocks to journal
+    if (fs->journal_base != 0) {
+        status = fs_journal_commit(fs);
+    }
+
+    // without a journal, write runs of changed metadata blocks to disk
+    for (int i = fs_bitmap_find_set(fs->meta_map, 0); (status == 0) && (i >= 0);
+         i = fs_bitmap_find_set(fs->meta_map, i)) {
+        int next = fs_bitmap_find_zero(fs->meta_map, i);
+        int len = ((next < 0) ? fs->n_meta : next) - i;
+
+        fs->sync_stats.last_calls++;
+        if (write_meta(fs, i, len) != 0) {
+            status = -EIO;  // blocks remain changed
+        } else {
+            fs->sync_stats.last_blocks += len;
+            fs->n_dirty -= len;
+            for (int j = i; j < i+len; j++) {
+                fs_bitmap_clear(fs->meta_map, j);
+            }
         }
+        i += len;
     }
+    if ((status == 0) && (write_held(fs) != 0)) {
+        status = -EIO;
+    }
+
+    // return paged and held blocks to the cache limit
+    if (fs->mcache != NULL) {
+        fs_mcache_trim(fs->mcache);
+    }
+    fs_mcache_trim(fs->blk_cache);
+
+    fs->sync_stats.blocks += fs->sync_stats.last_blocks;
+    fs->sync_stats.calls += fs->sync_stats.last_calls;
+    fs->last_sync = time(NULL);
+    return status;
 }
 
 /**
- * Synchronize file system volume to disk.
+ * Synchronize changed metadata at the end of an operation
+ * according to the volume sync policy. With FS_SYNC_ALWAYS
+ * metadata is always synchronized; with FS_SYNC_WRITEBACK
+ * it is synchronized once enough blocks have changed or
+ * enough time has passed since the last sync. Inside
+ * a transaction nothing is synchronized until commit.
+ *
+ * Errors
+ *   -EIO      - i/o error
  *
  * @param fs the file system
+ * @return 0 if successful, -error if error occurred
  */
-void fs_sync_volume(struct fs_ext2 *fs) {
-    // flush metadata blocks to disk
-    fs_sync_metadata(fs);
+int fs_commit_metadata(struct fs_ext2 *fs) {
+    if (fs->txn_active) {
+        return 0;  // synchronized by fs_txn_commit
+    }
+    // keep the changes of later operations within one
+    // journal transaction
+    if (   (fs->sync_mode == FS_SYNC_ALWAYS)
+        || (fs->n_dirty >= fs->sync_max_dirty)
+        || ((fs->journal_base != 0) && (fs->n_dirty >= fs_journal_capacity(fs) / 2))
+        || (time(NULL) - fs->last_sync >= fs->sync_interval)) {
+        return fs_sync_metadata(fs);
+    }
+    return 0;
+}
+
+/**
+ * Set the metadata sync policy of a volume. Changed
+ * metadata is synchronized before the policy changes;
+ * the policy is unchanged if that fails.
+ *
+ * Errors
+ *   -EBUSY    - transaction active
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param mode FS_SYNC_ALWAYS or FS_SYNC_WRITEBACK
+ * @param max_dirty changed blocks that trigger a write-back sync
+ * @param interval seconds between write-back syncs
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_set_sync_policy(struct fs_ext2 *fs, int mode, int max_dirty, int interval) {
+    if (fs->txn_active) {
+        return -EBUSY;
+    }
+    int status = fs_sync_metadata(fs);
+    if (status != 0) {
+        return status;
+    }
+    fs->sync_mode = mode;
+    fs->sync_max_dirty = max_dirty;
+    fs->sync_interval = interval;
+    return 0;
+}
+
+/**
+ * Synchronize file system volume to disk. Metadata
+ * changed by an active transaction is not synchronized.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_sync_volume(struct fs_ext2 *fs) {
+    int status = 0;
+
+    // flush metadata blocks to disk; those of an active
+    // transaction are synchronized by fs_txn_commit
+    if (!fs->txn_active && (fs_sync_metadata(fs) != 0)) {
+        status = -EIO;
+    }
+    if (fs_journal_checkpoint(fs) != 0) {
+        status = -EIO;
+    }
 
     // flush device volume blocks
-    fs->dev->ops->flush(fs->dev, 0, fs->n_blocks);
+    if (fs->dev->ops->flush(fs->dev, 0, fs->n_blocks) != SUCCESS) {
+        status = -EIO;
+    }
+    return status;
 }
 
 /**
  * Unmounts the file system volume. Does not close
- * disk device.
+ * disk device. Metadata changed by an active
+ * transaction is discarded. The volume is unmounted
+ * even if its changes cannot be synchronized.
  *
  * @param fs the file system
- * @return the underlying block device
+ * @return the underlying block device, or NULL if
+ *  changes could not be synchronized
  */
 struct fs_dev_blkdev *fs_unmount_volume(struct fs_ext2 *fs)
 {
-    struct fs_dev_blkdev *dev = fs->dev;
+    struct fs_dev_blkdev *disk = fs->disk;
 
+    // blocks changed by an active transaction are not
+    // synchronized; the journal checkpoint writes their
+    // committed copies
     // flush metadata to disk
-    fs_sync_volume(fs);
+    int status = fs_sync_volume(fs);
 
     // free metadata
     free(fs->meta);
-    free(fs->meta_map);
+    fs_mcache_destroy(fs->mcache);
+    fs_bitmap_destroy(fs->meta_map);
+    fs_bitmap_destroy(fs->inode_map);
+    fs_bitmap_destroy(fs->block_map);
+    fs_freetree_destroy(fs->free_tree);
+    fs_bitmap_destroy(fs->group_checked);
+    fs_mcache_destroy(fs->blk_cache);
+    fs_bitmap_destroy(fs->blk_held);
+    fs_bitmap_destroy(fs->blk_map);
+    free(fs->journal_map);
+    free(fs->journal_blks);
+    if (fs->group_desc_base == 0) {
+        free(fs->groups);
+    }
+    fs_dcache_destroy(fs->dcache);
+    if (fs->dev != disk) {
+        fs->dev->ops->close(fs->dev);  // volume blocks over disk blocks
+    }
     memset(fs, 0, sizeof(struct fs_ext2)); // kill fs struct
     free(fs);
 
-    return dev;
+    return (status == 0) ? disk : NULL;
 }
\ No newline at end of file
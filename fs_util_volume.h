@@ -12,56 +12,208 @@
 #ifndef FS_UTIL_VOLUME_H_
 #define FS_UTIL_VOLUME_H_
 
-#include <sys/select.h>
+#include <time.h>
 #include "fsx600.h"
 #include "fs_dev_blkdev.h"
+#include "fs_util_bitmap.h"
+#include "fs_util_freetree.h"
+#include "fs_util_dcache.h"
+#include "fs_util_mcache.h"
+
+/** statistics of metadata synchronization */
+struct fs_sync_stats {
+    /** blocks written by last sync */
+    int last_blocks;
+
+    /** device calls made by last sync */
+    int last_calls;
+
+    /** total blocks written */
+    long blocks;
+
+    /** total device calls */
+    long calls;
+};
+
+/** metadata sync policy */
+enum {
+    FS_SYNC_ALWAYS = 0,		/** sync metadata at the end of every operation */
+    FS_SYNC_WRITEBACK = 1	/** sync metadata on dirty threshold or interval */
+};
+
+/** default write-back policy limits */
+enum {
+    FS_SYNC_MAX_DIRTY = 64,	/** dirty metadata blocks that trigger a sync */
+    FS_SYNC_INTERVAL = 5	/** seconds between syncs */
+};
+
+/** options for mounting a volume */
+struct fs_mount_opts {
+    int mcache_blks;	/** map and inode blocks cached, 0 to read all metadata */
+};
+
+/** directory, index, indirect, or extent block logged since the last checkpoint */
+struct fs_journal_blk {
+    /** the block number */
+    int blkno;
+
+    /** log position + 1 of latest logged copy */
+    uint32_t pos;
+};
 
 /** information about ext2 fs volume */
 struct fs_ext2 {
-    /** disk device */
+    /** disk device, in blocks of the volume */
     struct fs_dev_blkdev* dev;
 
+    /** underlying disk device; dev itself if the
+     *  volume block size is the device block size */
+    struct fs_dev_blkdev* disk;
+
+    /** block size in bytes from superblock */
+    int blk_size;
+
     /** number of available blocks */
     int n_blocks;
 
     /** number of metadata blocks */
     int n_meta;
 
-    /** volume metadata */
-    block *meta;
+    /** volume metadata, blk_size bytes per block */
+    uint8_t *meta;
+
+    /** superblock in volume metadata */
+    struct fs_super *super;
+
+    /** blkno of first group descriptor block, 0 if none */
+    int group_desc_base;
 
     /** blkno of first inode map block */
     int inode_map_base;
 
-    /** pointer to inode bitmap */
-    fd_set *inode_map;
+    /** inode bitmap over inode map blocks, NULL if paged */
+    struct fs_bitmap *inode_map;
 
     /** number of inodes from superblock */
     int n_inodes;
 
+    /** number of block groups */
+    int n_groups;
+
+    /** blocks per block group */
+    int group_blks;
+
+    /** inodes per block group */
+    int group_inodes;
+
+    /** block group descriptors, in group descriptor
+     *  blocks or counted at mount if the volume has none */
+    struct fs_group_desc *groups;
+
+    /** groups whose descriptor was checked against the
+     *  maps, NULL if counted at mount */
+    struct fs_bitmap *group_checked;
+
     /** blkno of first inode block */
     int inode_base;
 
-    /** pointer to inode blocks */
+    /** pointer to inode blocks, NULL if paged */
     struct fs_inode *inodes;
 
+    /** map and inode blocks paged in on demand, NULL if not paged */
+    struct fs_mcache *mcache;
+
     /** number of root inode from superblock */
     int root_inode;
 
     /** blkno of first data block */
     int block_map_base;
 
-    /** pointer to block bitmap to determine free blocks */
-    fd_set *block_map;
+    /** block bitmap over block map blocks to determine free blocks, NULL if paged */
+    struct fs_bitmap *block_map;
+
+    /** free extents of block map, NULL if paged */
+    struct fs_freetree *free_tree;
+
+    /** bitmap of changed metadata blocks */
+    struct fs_bitmap *meta_map;
+
+    /** directory, index, indirect, and extent blocks
+     *  of files kept in memory until written home */
+    struct fs_mcache *blk_cache;
+
+    /** bitmap of blocks held in blk_cache because they are
+     *  changed or logged since the last checkpoint */
+    struct fs_bitmap *blk_held;
 
-    /** pointer to metadata bitmap */
-    fd_set *meta_map;
+    /** bitmap of held blocks changed since last commit */
+    struct fs_bitmap *blk_map;
 
     // fold case when storing names (1=fold, 0=preserve)
     int fold_case;
 
     // ignore case when comparing names (1=ci comparison, 1=exact comparison
     int ignore_case;
+
+    /** cache of directory entry lookups */
+    struct fs_dcache *dcache;
+
+    /** metadata synchronization statistics */
+    struct fs_sync_stats sync_stats;
+
+    /** metadata sync policy */
+    int sync_mode;
+
+    /** dirty metadata blocks that trigger a write-back sync */
+    int sync_max_dirty;
+
+    /** seconds between write-back syncs */
+    int sync_interval;
+
+    /** number of changed metadata and held blocks */
+    int n_dirty;
+
+    /** time of last metadata sync */
+    time_t last_sync;
+
+    /** blkno of journal header, 0 if no journal */
+    int journal_base;
+
+    /** number of journal log blocks */
+    int journal_n_log;
+
+    /** log position of next transaction */
+    uint32_t journal_head;
+
+    /** log position of oldest transaction not checkpointed */
+    uint32_t journal_tail;
+
+    /** sequence number of next transaction */
+    uint32_t journal_seq;
+
+    /** log position + 1 of latest logged copy of each
+     *  metadata block, 0 if home block is current */
+    uint32_t *journal_map;
+
+    /** directory, index, indirect, and extent blocks
+     *  logged since the last checkpoint */
+    struct fs_journal_blk *journal_blks;
+
+    /** number of logged directory, index, indirect,
+     *  and extent blocks */
+    int journal_n_blks;
+
+    /** 1 if an explicit transaction is active */
+    int txn_active;
+
+    /** volume features from superblock */
+    int features;
+
+    /** inode of last extent found, 0 if none */
+    int ext_hint_ino;
+
+    /** last extent found */
+    struct fs_extent ext_hint;
 };
 
 /**
@@ -73,21 +225,145 @@ struct fs_ext2 {
 struct fs_ext2 *fs_mount_volume(struct fs_dev_blkdev* dev);
 
 /**
- * Synchronize file system volume metadata to disk.
+ * Mount a file system volume on a block device with options.
+ * With a positive mcache_blks, only the superblock and the
+ * group descriptors are read at mount; map and inode blocks
+ * are paged in on first use and the least recently used
+ * clean blocks are evicted to keep at most mcache_blks cached.
  *
- * @param fs the file system
+ * @param disk the block device
+ * @param opts the mount options
+ * @return file system volume or NULL if cannot
  */
-void fs_sync_volume(struct fs_ext2 *fs);
+struct fs_ext2 *fs_mount_volume_opts(struct fs_dev_blkdev* dev, const struct fs_mount_opts *opts);
 
 /**
  * Unmounts the file system volume. Does not close
- * disk device.
+ * disk device. Metadata changed by an active
+ * transaction is discarded. The volume is unmounted
+ * even if its changes cannot be synchronized.
  *
  * @param fs the file system
- * @return the underlying block device
+ * @return the underlying block device, or NULL if
+ *  changes could not be synchronized
  */
 struct fs_dev_blkdev *fs_unmount_volume(struct fs_ext2 *fs);
 
+/**
+ * Recompute the free and directory counts of the
+ * block groups from the inode and block maps, for
+ * volumes without group descriptor blocks.
+ *
+ * @param fs the file system
+ */
+void fs_count_groups(struct fs_ext2 *fs);
+
+/**
+ * Check the free counts of a block group descriptor
+ * against the inode and block maps on first use of the
+ * group, repairing them and the superblock totals if they
+ * differ. The directory count is only a placement hint;
+ * it is kept within the number of inodes in use.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param g the block group
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_check_group(struct fs_ext2 *fs, int g);
+
+/**
+ * Mark block group descriptor changed.
+ *
+ * @param fs the file system
+ * @param g the block group
+ */
+void fs_mark_group(struct fs_ext2 *fs, int g);
+
+/**
+ * Determine whether the inode blocks of a block group
+ * have not been written since the volume was formatted.
+ * Such blocks are zero in memory but not on disk.
+ *
+ * @param sb the superblock
+ * @param group the block group
+ * @return 1 if not yet written, 0 if written
+ */
+static inline int fs_itable_uninit(const struct fs_super *sb, int group) {
+    return (group < FS_MAX_LAZY_GROUPS) && fs_bit_test(sb->itable_uninit, group);
+}
+
+/**
+ * Write the zeroed inode blocks of a block group on
+ * first use, and record in the superblock that they
+ * are written. Does nothing if already written.
+ *
+ * Errors
+ *   -ENOMEM   - cannot allocate zeroed blocks
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param group the block group
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_init_itable(struct fs_ext2 *fs, int group);
+
+/**
+ * Get the in-memory copy of a metadata block, reading it
+ * if it is a paged map or inode block that is not cached.
+ *
+ * @param fs the file system
+ * @param blkno the metadata block number
+ * @return the block or NULL if it cannot be read
+ */
+void *fs_meta_blk(struct fs_ext2 *fs, int blkno);
+
+/**
+ * Get the in-memory copy of a metadata block without
+ * reading it.
+ *
+ * @param fs the file system
+ * @param blkno the metadata block number
+ * @return the block or NULL if it is not cached
+ */
+void *fs_meta_cached(struct fs_ext2 *fs, int blkno);
+
+/**
+ * Get a paged inode, reading its block if not cached.
+ *
+ * @param fs the file system
+ * @param ino the inode
+ * @return the inode or NULL if its block cannot be read
+ */
+struct fs_inode *fs_inode_paged(struct fs_ext2 *fs, int ino);
+
+/**
+ * Get an inode to examine. A paged inode may be evicted
+ * once FS_MCACHE_MIN_BLKS other inode blocks are used,
+ * so the pointer must not be kept across operations;
+ * use fs_inode_mut() to change the inode.
+ *
+ * @param fs the file system
+ * @param ino the inode
+ * @return the inode or NULL if its block cannot be read
+ */
+static inline const struct fs_inode *fs_inode(struct fs_ext2 *fs, int ino) {
+    return (fs->inodes != NULL) ? &fs->inodes[ino] : fs_inode_paged(fs, ino);
+}
+
+/**
+ * Get an inode to change, marking it changed. A paged
+ * inode block stays cached while it is changed, so the
+ * pointer remains valid until metadata is synchronized.
+ *
+ * @param fs the file system
+ * @param ino the inode
+ * @return the inode or NULL if its block cannot be read
+ */
+struct fs_inode *fs_inode_mut(struct fs_ext2 *fs, int ino);
+
 /**
  * Mark inode metadata changed.
  *
@@ -96,6 +372,13 @@ struct fs_dev_blkdev *fs_unmount_volume(struct fs_ext2 *fs);
  */
 void fs_mark_inode(struct fs_ext2 *fs, int ino);
 
+/**
+ * Mark superblock metadata changed.
+ *
+ * @param fs the file system
+ */
+void fs_mark_super(struct fs_ext2 *fs);
+
 /**
  * Mark block metadata changed.
  *
@@ -104,19 +387,122 @@ void fs_mark_inode(struct fs_ext2 *fs, int ino);
  */
 void fs_mark_blk(struct fs_ext2 *fs, int blk);
 
+/**
+ * Read a directory, index, indirect, or extent block
+ * of a file. A block changed or logged since the last
+ * checkpoint is read from memory.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param blkno the block number
+ * @param buf buffer for the block
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_blk_read(struct fs_ext2 *fs, int blkno, void *buf);
+
+/**
+ * Write a directory, index, indirect, or extent block
+ * of a file. On a volume with a journal, or during a
+ * transaction, the block is held in memory and committed
+ * with the metadata; otherwise it is written in place.
+ *
+ * Errors
+ *   -ENOMEM   - cannot allocate held block
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param blkno the block number
+ * @param buf the block contents
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_blk_write(struct fs_ext2 *fs, int blkno, void *buf);
+
+/**
+ * Release a block that is being freed. Its changed copy
+ * is dropped, and if it was logged the journal is first
+ * checkpointed, so that replay cannot overwrite the block
+ * once it is reused.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param blkno the block number
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_blk_release(struct fs_ext2 *fs, int blkno);
+
+/**
+ * Drop the changes to held blocks since the last commit,
+ * restoring the latest committed copy of logged blocks.
+ *
+ * Errors
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_blk_discard(struct fs_ext2 *fs);
+
 /**
  * Synchronize changed file system volume metadata
- * blocks to disk.
+ * blocks and held blocks to disk. Each run of adjacent
+ * changed metadata blocks is written with one device call.
+ *
+ * Errors
+ *   -ENOMEM   - cannot allocate journal transaction
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_sync_metadata(struct fs_ext2 *fs);
+
+/**
+ * Synchronize changed metadata at the end of an operation
+ * according to the volume sync policy. With FS_SYNC_ALWAYS
+ * metadata is always synchronized; with FS_SYNC_WRITEBACK
+ * it is synchronized once enough blocks have changed or
+ * enough time has passed since the last sync. Inside
+ * a transaction nothing is synchronized until commit.
+ *
+ * Errors
+ *   -EIO      - i/o error
  *
  * @param fs the file system
+ * @return 0 if successful, -error if error occurred
  */
-void fs_sync_metadata(struct fs_ext2 *fs);
+int fs_commit_metadata(struct fs_ext2 *fs);
 
 /**
- * Synchronize file system volume to disk.
+ * Set the metadata sync policy of a volume. Changed
+ * metadata is synchronized before the policy changes;
+ * the policy is unchanged if that fails.
+ *
+ * Errors
+ *   -EBUSY    - transaction active
+ *   -EIO      - i/o error
+ *
+ * @param fs the file system
+ * @param mode FS_SYNC_ALWAYS or FS_SYNC_WRITEBACK
+ * @param max_dirty changed blocks that trigger a write-back sync
+ * @param interval seconds between write-back syncs
+ * @return 0 if successful, -error if error occurred
+ */
+int fs_set_sync_policy(struct fs_ext2 *fs, int mode, int max_dirty, int interval);
+
+/**
+ * Synchronize file system volume to disk. Metadata
+ * changed by an active transaction is not synchronized.
+ *
+ * Errors
+ *   -EIO      - i/o error
  *
  * @param fs the file system
+ * @return 0 if successful, -error if error occurred
  */
-void fs_sync_volume(struct fs_ext2 *fs);
+int fs_sync_volume(struct fs_ext2 *fs);
 
 #endif /* FS_UTIL_VOLUME_H_ */
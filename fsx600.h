@@ -12,11 +12,38 @@
 
 #include <stdint.h>
 
+/**
+ * Block sizes. A volume has the block size chosen when
+ * it is formatted: 1024, 2048, 4096, or 8192 bytes.
+ */
 enum {
-	FS_BLOCK_SIZE = 1024,		/** file system block size in bytes */
-	FS_MAGIC = 0x37363030		/** magic number for superblock */
+	FS_BLOCK_SIZE = 1024,		/** default file system block size in bytes */
+	FS_MIN_BLOCK_SIZE = 1024,	/** smallest block size */
+	FS_MAX_BLOCK_SIZE = 8192,	/** largest block size */
+	FS_MAGIC = 0x37363030,		/** magic number for superblock */
+	FS_JOURNAL_MAGIC = 0x4a4e4c30	/** magic number for journal blocks */
 };
 
+/**
+ * Expand X(suffix, size) once for each block size, to
+ * define a copy of a per-block loop specialized for
+ * that size.
+ */
+#define FS_FOR_EACH_BLK_SIZE(X) X(1k, 1024) X(2k, 2048) X(4k, 4096) X(8k, 8192)
+
+/**
+ * Call the copy of a function defined with
+ * FS_FOR_EACH_BLK_SIZE for a block size.
+ */
+#define FS_BLK_SIZE_CALL(blk_size, fn, ...) \
+    (  ((blk_size) == 1024) ? fn##_1k(__VA_ARGS__) \
+     : ((blk_size) == 2048) ? fn##_2k(__VA_ARGS__) \
+     : ((blk_size) == 4096) ? fn##_4k(__VA_ARGS__) \
+     : fn##_8k(__VA_ARGS__))
+
+/** Determine whether a block size is supported */
+#define FS_VALID_BLK_SIZE(bs) (((bs) == 1024) || ((bs) == 2048) || ((bs) == 4096) || ((bs) == 8192))
+
 
 /**
  *  Entry in a directory
@@ -29,8 +56,12 @@ struct fs_dirent {
     char name[FS_FILENAME_SIZE];/** with trailing NUL */
 };								/** total 32 bytes */
 
+/** block groups whose inode blocks can be left unwritten at format */
+enum { FS_MAX_LAZY_GROUPS = 4096 };
+
 /**
- * Superblock - holds file system parameters.
+ * Superblock - holds file system parameters. It is
+ * at the start of block 0 for every block size.
  */
 struct fs_super {
     uint32_t magic;				/** magic number */
@@ -41,10 +72,83 @@ struct fs_super {
     uint32_t fold_case: 1;      /** 1 if fold case, 0 if preserve case  */
     uint32_t ignore_case : 1;   /** 1 if case-independent, 0 if case-dependent */
     uint32_t root_inode: 30;	/** always inode 1 */
+    uint32_t journal_base;		/** blkno of journal header, 0 if none */
+    uint32_t journal_sz;		/** journal size in blocks, including header */
+    uint32_t free_blocks;		/** number of free blocks */
+    uint32_t free_inodes;		/** number of free inodes */
+    uint32_t group_blks;		/** blocks per block group, 0 for one group */
+    uint32_t group_inodes;		/** inodes per block group */
+    uint32_t features;			/** volume features: FS_FEATURE_EXTENTS, ... */
+    uint32_t blk_size;			/** block size in bytes, 0 for 1024 */
+    uint32_t num_inodes;		/** total inodes, 0 for whole inode region */
+    uint32_t group_desc_sz;		/** group descriptor size in blocks, 0 if none */
+
+    /** bit g set if the inode blocks of group g are not yet written */
+    uint64_t itable_uninit[FS_MAX_LAZY_GROUPS / 64];
+
+    /* pad out to the smallest block */
+    char pad[FS_MIN_BLOCK_SIZE - 16 * sizeof(uint32_t) - FS_MAX_LAZY_GROUPS / 8]; 
+};								/** total FS_MIN_BLOCK_SIZE bytes */
+
+/**
+ * Group descriptor - holds the counts of a block group.
+ * Group descriptor blocks follow the superblock.
+ */
+struct fs_group_desc {
+    int32_t free_blocks;		/** number of free blocks in group */
+    int32_t free_inodes;		/** number of free inodes in group */
+    int32_t n_dirs;				/** number of directories in group */
+    int32_t ino_cursor;			/** next-fit position in inode map */
+};								/** total 16 bytes */
+
+/**
+ * Volume features
+ *   FS_FEATURE_EXTENTS - new regular files are mapped by extents
+ */
+enum {
+    FS_FEATURE_EXTENTS = 0x1	/** new files use extents */
+};
+
+/**
+ * Extent - maps a run of logical file blocks
+ * to a run of device blocks
+ */
+struct fs_extent {
+    uint32_t lblk;				/** first logical block */
+    uint32_t pblk;				/** first device block */
+    uint32_t len;				/** number of blocks */
+};								/** total 12 bytes */
+
+/**
+ * Extent root - stored in the block pointers of an inode
+ * with the FS_INODE_EXTENTS flag. Extents are sorted by
+ * logical block; those that do not fit in the inode are
+ * in a chain of overflow extent blocks.
+ */
+enum {N_INODE_EXTENTS = 2 };	/** number of extents in inode */
+struct fs_extent_root {
+    uint32_t n_extents;			/** total number of extents */
+    uint32_t overflow;			/** first overflow extent block, 0 if none */
+    struct fs_extent extents[N_INODE_EXTENTS];	/** first extents */
+};								/** total 32 bytes */
+
+/**
+ * Constants for extents
+ *   EXTENTS_PER_BLK(bs) - number of extents per overflow block
+ */
+#define EXTENTS_PER_BLK(bs) ((int)(((bs) - 3*sizeof(uint32_t)) / sizeof(struct fs_extent)))
 
-    /* pad out to an entire block */
-    char pad[FS_BLOCK_SIZE - 6 * sizeof(uint32_t)]; 
-};								/** total FS_BLOCK_SIZE bytes */
+/**
+ * Overflow extent block. Sized for the largest block;
+ * only the first block size bytes are stored.
+ */
+struct fs_extent_blk {
+    uint32_t next;				/** next overflow extent block, 0 if none */
+    uint32_t n_extents;			/** number of extents in block */
+    struct fs_extent extents[EXTENTS_PER_BLK(FS_MAX_BLOCK_SIZE)];
+    char pad[FS_MAX_BLOCK_SIZE - 2*sizeof(uint32_t)
+             - EXTENTS_PER_BLK(FS_MAX_BLOCK_SIZE)*sizeof(struct fs_extent)];
+};								/** total FS_MAX_BLOCK_SIZE bytes */
 
 /**
  * Inode - holds file entry information
@@ -58,27 +162,148 @@ struct fs_inode {
     uint32_t mtime;				/** last data modification time */
     uint32_t size;				/** size in bytes */
     uint32_t nlink;				/** number of links */
-    uint32_t direct[N_DIRECT];	/** direct block pointers */
-    uint32_t indir_1;			/** single indirect block pointer */
-    uint32_t indir_2;			/** double indirect block pointer */
-    uint32_t pad[2];            /** 64 bytes per inode */
+    union {
+        struct {
+            uint32_t direct[N_DIRECT];	/** direct block pointers */
+            uint32_t indir_1;			/** single indirect block pointer */
+            uint32_t indir_2;			/** double indirect block pointer */
+        };
+        struct fs_extent_root ext;	/** extents if FS_INODE_EXTENTS */
+    };
+    uint32_t flags;				/** inode flags: FS_INODE_INDEX, ... */
+    uint32_t pad[1];            /** 64 bytes per inode */
 
 };								/** total 64 bytes */
 
 /**
- * Constants for blocks
- *   DIRENTS_PER_BLK   - number of directory entries per block
- *   INODES_PER_BLOCK  - number of inodes per block
- *   PTRS_PER_BLOCK    - number of inode pointers per block
- *   BITS_PER_BLOCK    - number of bits per block
+ * Inode flags
+ *   FS_INODE_INDEX    - directory has a hashed index
+ *   FS_INODE_EXTENTS  - file blocks are mapped by extents
  */
 enum {
-    DIRENTS_PER_BLK = FS_BLOCK_SIZE / sizeof(struct fs_dirent), /** directory entries per block */
-	INODES_PER_BLK = FS_BLOCK_SIZE / sizeof(struct fs_inode),	/** inodes per block */
-    PTRS_PER_BLK = FS_BLOCK_SIZE / sizeof(uint32_t),			/** inode pointers per block */
-	BITS_PER_BLK = FS_BLOCK_SIZE * 8							/** bits per block */
+    FS_INODE_INDEX = 0x1,		/** directory has hashed index */
+    FS_INODE_EXTENTS = 0x2		/** file mapped by extents */
 };
 
+/**
+ * Constants for blocks of size bs
+ *   DIRENTS_PER_BLK(bs)  - number of directory entries per block
+ *   INODES_PER_BLK(bs)   - number of inodes per block
+ *   PTRS_PER_BLK(bs)     - number of inode pointers per block
+ *   BITS_PER_BLK(bs)     - number of bits per block
+ *   GROUP_DESCS_PER_BLK(bs) - number of group descriptors per block
+ */
+#define DIRENTS_PER_BLK(bs) ((int)((bs) / sizeof(struct fs_dirent)))
+#define INODES_PER_BLK(bs) ((int)((bs) / sizeof(struct fs_inode)))
+#define PTRS_PER_BLK(bs) ((int)((bs) / sizeof(uint32_t)))
+#define BITS_PER_BLK(bs) ((int)(bs) * 8)
+#define GROUP_DESCS_PER_BLK(bs) ((int)((bs) / sizeof(struct fs_group_desc)))
+
+/**
+ * Constants for file size with blocks of size bs
+ *   MAX_MAPPED_BLKS(bs)  - number of blocks addressable through an inode
+ *   MAX_FILE_BLKS(bs)    - number of blocks in a file, limited so
+ *                          byte offsets fit in an int
+ *   FS_MAX_FILE_SIZE(bs) - maximum file size in bytes
+ */
+#define MAX_MAPPED_BLKS(bs) (N_DIRECT + PTRS_PER_BLK(bs) + PTRS_PER_BLK(bs) * PTRS_PER_BLK(bs))
+#define MAX_FILE_BLKS(bs) \
+    ((MAX_MAPPED_BLKS(bs) < 0x7fffffff / (int)(bs)) ? MAX_MAPPED_BLKS(bs) : 0x7fffffff / (int)(bs))
+#define FS_MAX_FILE_SIZE(bs) (MAX_FILE_BLKS(bs) * (int)(bs))
+
+/**
+ * Entry in a hashed directory index. Maps names whose
+ * hash is at least the entry hash (and less than the
+ * next entry hash) to a child logical block.
+ */
+struct fs_dx_entry {
+    uint32_t hash;				/** lowest name hash for child */
+    uint32_t lblk;				/** logical block of child */
+};								/** total 8 bytes */
+
+/**
+ * Constants for hashed directory index with blocks of size bs
+ *   DX_ROOT_LIMIT(bs) - number of entries in index root
+ *   DX_NODE_LIMIT(bs) - number of entries in index node
+ */
+#define DX_ROOT_LIMIT(bs) \
+    ((int)(((bs) - 2*sizeof(struct fs_dirent) - 4*sizeof(uint32_t)) / sizeof(struct fs_dx_entry)))
+#define DX_NODE_LIMIT(bs) ((int)(((bs) - 2*sizeof(uint32_t)) / sizeof(struct fs_dx_entry)))
+
+/**
+ * Root of a hashed directory index. Stored in logical
+ * block 0 of an indexed directory after the "." and ".."
+ * entries, which remain readable as a linear block.
+ * With one level, entries point to leaf directory blocks;
+ * with two levels, entries point to index node blocks.
+ */
+struct fs_dx_root {
+    uint32_t levels;			/** number of index levels (1 or 2) */
+    uint32_t count;				/** number of entries in use */
+    uint32_t next_lblk;			/** next unused logical block */
+    uint32_t pad;
+    struct fs_dx_entry entries[DX_ROOT_LIMIT(FS_MAX_BLOCK_SIZE)];
+};								/** largest block minus 2 entries */
+
+/**
+ * Index node of a two level hashed directory index.
+ */
+struct fs_dx_node {
+    uint32_t count;				/** number of entries in use */
+    uint32_t pad;
+    struct fs_dx_entry entries[DX_NODE_LIMIT(FS_MAX_BLOCK_SIZE)];
+};								/** total FS_MAX_BLOCK_SIZE bytes */
+
+/**
+ * Journal header - first block of the journal region. The
+ * rest of the region is a circular log of transactions,
+ * each a descriptor block, the logged metadata blocks and
+ * directory, index, indirect, and extent blocks of files,
+ * and a commit block. Log positions increase without
+ * wrapping; block (pos % log size) of the log holds pos.
+ * Sized for the largest block; only the first block size
+ * bytes are stored.
+ */
+struct fs_journal_super {
+    uint32_t magic;				/** FS_JOURNAL_MAGIC */
+    uint32_t tail;				/** log position of oldest live transaction */
+    uint32_t seq;				/** sequence number of transaction at tail */
+    uint32_t pad[FS_MAX_BLOCK_SIZE/sizeof(uint32_t) - 3];
+};								/** total FS_MAX_BLOCK_SIZE bytes */
+
+/**
+ * Journal block types
+ *   FS_JOURNAL_DESC   - descriptor block starting a transaction
+ *   FS_JOURNAL_COMMIT - commit block ending a transaction
+ */
+enum {
+    FS_JOURNAL_DESC = 1,		/** descriptor block */
+    FS_JOURNAL_COMMIT = 2		/** commit block */
+};
+
+/**
+ * Constants for journal with blocks of size bs
+ *   JOURNAL_DESC_LIMIT(bs) - number of blocks in one transaction
+ */
+#define JOURNAL_DESC_LIMIT(bs) ((int)((bs) / sizeof(uint32_t)) - 5)
+
+/**
+ * Journal descriptor or commit block. A descriptor lists
+ * the home block numbers of the logged blocks that follow
+ * it. A commit block repeats the sequence number and
+ * holds a checksum of the descriptor and logged blocks.
+ * Sized for the largest block; only the first block size
+ * bytes are stored.
+ */
+struct fs_journal_desc {
+    uint32_t magic;				/** FS_JOURNAL_MAGIC */
+    uint32_t type;				/** FS_JOURNAL_DESC or FS_JOURNAL_COMMIT */
+    uint32_t seq;				/** transaction sequence number */
+    uint32_t n_blocks;			/** number of logged blocks */
+    uint32_t checksum;			/** commit: checksum of transaction */
+    uint32_t blknos[JOURNAL_DESC_LIMIT(FS_MAX_BLOCK_SIZE)];	/** desc: home blocks */
+};								/** total FS_MAX_BLOCK_SIZE bytes */
+
 #endif  /* __FSX600_H__ */
 
 